@@ -33,6 +33,30 @@ typedef struct arp_buf
     net_protocol_t protocol; //上层协议
 } arp_buf_t;
 
+/**
+ * @brief arp表的查找与替换计数
+ * 
+ */
+typedef struct arp_stats
+{
+    uint64_t hits;      //查找命中次数
+    uint64_t misses;    //查找未命中次数
+    uint64_t evictions; //表满时替换有效表项的次数
+} arp_stats_t;
+
+/**
+ * @brief arp的状态，每个协议栈实例一份（见stack.h）
+ * 
+ */
+typedef struct arp_ctx
+{
+    arp_entry_t table[ARP_MAX_ENTRY]; //arp地址转换表
+    arp_buf_t buf;                    //长度为1的arp分组队列，当等待arp回复时暂存未发送的数据包
+    int silent;                       //为1时只学习不应答，也不在初始化时宣告本机地址
+    arp_stats_t stats;                //查找与替换计数
+    buf_t txbuf;                      //构造arp请求与应答
+} arp_ctx_t;
+
 #pragma pack(1)
 typedef struct arp_pkt
 {
@@ -47,12 +71,35 @@ typedef struct arp_pkt
 
 #pragma pack()
 
+/**
+ * @brief 以arp报文解释数据包，长度不足或不是以太网上的IPv4地址解析时为NULL
+ * 
+ * @param buf 数据包，data指向arp报文
+ * @return arp_pkt_t* arp报文
+ */
+static inline arp_pkt_t *arp_pkt_of(buf_t *buf)
+{
+    arp_pkt_t *pkt = (arp_pkt_t *)buf->data;
+    if (buf->len < sizeof(arp_pkt_t) || pkt->hw_type != swap16(ARP_HW_ETHER) || pkt->pro_type != swap16(NET_PROTOCOL_IP) ||
+        pkt->hw_len != NET_MAC_LEN || pkt->pro_len != NET_IP_LEN)
+        return NULL;
+    return pkt;
+}
+
 /**
  * @brief 初始化arp协议
  * 
  */
 void arp_init();
 
+/**
+ * @brief 设置当前协议栈实例是否应答arp请求、初始化时是否宣告本机地址，默认应答
+ *        分片模式下arp报文复制给每个工作线程以更新各自的arp表，只由0号工作线程应答
+ * 
+ * @param enable 为0时只学习不应答
+ */
+void arp_set_responder(int enable);
+
 /**
  * @brief 处理一个收到的数据包
  * 
@@ -69,6 +116,14 @@ void arp_in(buf_t *buf);
  */
 void arp_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol);
 
+/**
+ * @brief 从arp表中根据ip地址查找mac地址
+ * 
+ * @param ip 欲转换的ip地址
+ * @return uint8_t* mac地址，未找到时为NULL
+ */
+uint8_t *arp_lookup(uint8_t *ip);
+
 /**
  * @brief 更新arp表
  * 
@@ -77,4 +132,11 @@ void arp_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol);
  * @param state 表项的状态
  */
 void arp_update(uint8_t *ip, uint8_t *mac, arp_state_t state);
+
+/**
+ * @brief 获取当前协议栈实例arp表的查找与替换计数
+ * 
+ * @return const arp_stats_t* 计数
+ */
+const arp_stats_t *arp_get_stats();
 #endif
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+#include <stdint.h>
+#include "config.h"
+#include "net.h"
+
+/**
+ * @brief 协议栈内的抓包：在以太网层收发数据帧的位置（见ethernet_set_tap()）按过滤条件与采样率拷贝数据帧，
+ *        收到的数据帧在ethernet_in()处理之前，发出的在交给驱动之前，是协议栈实际看到与发出的内容。
+ *        每个收发线程一个单生产者单消费者的抓包环，收发线程只做拷贝、不等待，环满时丢弃并计数；
+ *        后台写盘线程取出数据帧写入pcapng文件，时间戳精确到纳秒，每个网卡一个接口，并记录收发方向。
+ *        同一时刻只有一次抓包。
+ *
+ */
+
+#define NET_CAPTURE_RX 1   //收到的数据帧
+#define NET_CAPTURE_TX 2   //发出的数据帧
+#define NET_CAPTURE_BOTH 3 //收发两个方向
+
+/**
+ * @brief 过滤条件，全为0时抓取所有数据帧（dir为0表示两个方向）
+ *        各项同时满足才抓取，之后每sample_every个满足条件的数据帧抓取1个（每个线程单独计数，第一个总被抓取）
+ *
+ */
+typedef struct net_capture_filter
+{
+    uint8_t dir;              //方向，NET_CAPTURE_RX、NET_CAPTURE_TX或NET_CAPTURE_BOTH，0同NET_CAPTURE_BOTH
+    uint32_t ifmask;          //网卡，第i位对应ifindex为i的网卡，0表示所有网卡
+    uint16_t ethertype;       //以太网协议类型，0表示所有
+    uint8_t ip_protocol;      //ip协议号，非0时只抓取该协议的ip数据帧
+    uint8_t host[NET_IP_LEN]; //源或目的ip地址，全0表示所有
+    uint16_t port;            //udp或tcp的源或目的端口，0表示所有；非首个分片不匹配
+    uint32_t sample_every;    //采样间隔，0与1表示抓取所有满足条件的数据帧
+} net_capture_filter_t;
+
+/**
+ * @brief 抓包计数，各线程之和
+ *
+ */
+typedef struct net_capture_stats
+{
+    uint64_t matched; //满足过滤条件的数据帧数
+    uint64_t queued;  //采样后放入抓包环的数据帧数
+    uint64_t dropped; //采样后因抓包环满而丢弃的数据帧数
+    uint64_t written; //写入文件的数据帧数
+} net_capture_stats_t;
+
+/**
+ * @brief 开始抓包：创建pcapng文件，写入头部与各网卡的接口描述，启动写盘线程并设置抓包钩子
+ *        须在net_init()之后调用，可以在任何线程中调用
+ *
+ * @param path 文件路径，已存在时被覆盖
+ * @param filter 过滤条件，为NULL时抓取所有数据帧
+ * @return int 成功为0，已在抓包、文件无法创建或线程无法启动为-1
+ */
+int net_capture_start(const char *path, const net_capture_filter_t *filter);
+
+/**
+ * @brief 停止抓包：清除抓包钩子，写盘线程写完各抓包环中已有的数据帧后关闭文件并退出
+ *        清除钩子时正在拷贝的数据帧可能来不及写入，会在下一次开始抓包时丢弃；没有在抓包时不做处理
+ *
+ */
+void net_capture_stop();
+
+/**
+ * @brief 获取抓包计数，从进程中第一次抓包开始累计，可以在任何线程中调用
+ *
+ * @param stats 保存计数
+ */
+void net_capture_get_stats(net_capture_stats_t *stats);
+#endif
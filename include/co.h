@@ -0,0 +1,225 @@
+#ifndef CO_H
+#define CO_H
+#include <stdint.h>
+#include <stddef.h>
+#include "net.h"
+#include "timer.h"
+
+/**
+ * @brief 无栈协程，用于在udp上编写请求/应答服务而不必手写状态机
+ *        协程体是一个函数，用下面的宏在等待点挂起与恢复：恢复点保存在协程帧的line中，
+ *        再次调用协程体时由switch跳回上次挂起的位置。普通局部变量在挂起后失效，
+ *        跨等待点的变量须放在协程帧的local中，用CO_LOCALS()取得。
+ *        协程帧从固定大小的池中分配，等待接收、睡眠与发送都不分配内存。
+ *
+ *        执行器是单线程的，只能在调用co_poll()的线程中使用：每次co_poll()先进行一次net_poll()，
+ *        收到的数据报与到期的定时器只把等待的协程放入就绪队列，随后依次运行所有就绪的协程。
+ *        一个协程体中的等待宏不能写在同一行。
+ *
+ *        例如一个回显服务：
+ *
+ *        static void echo(co_t *co)
+ *        {
+ *            CO_BEGIN(co);
+ *            while (1)
+ *            {
+ *                CO_RECV(co, 7, 0);
+ *                co_send(co->msg.data, co->msg.len, 7, co->msg.src_ip, co->msg.src_port);
+ *            }
+ *            CO_END(co);
+ *        }
+ *
+ *        net_init(); co_init(); co_open(7); co_spawn(echo, NULL, 0); while (1) co_poll();
+ */
+
+#define CO_MSG_MAX (ETHERNET_MTU - 28) //协程收到的udp数据报最大长度，更长的被截断
+
+typedef struct co co_t;
+typedef void (*co_fn_t)(co_t *co);
+
+/**
+ * @brief 协程收到的udp数据报
+ *
+ */
+typedef struct co_msg
+{
+    uint8_t src_ip[NET_IP_LEN]; //源ip地址
+    uint16_t src_port;          //源端口
+    uint16_t len;               //数据长度
+    uint8_t data[CO_MSG_MAX];   //数据
+} co_msg_t;
+
+/**
+ * @brief 协程帧
+ *
+ */
+struct co
+{
+    co_fn_t fn;                               //协程体
+    int line;                                 //恢复点，0为开始，-1为已结束
+    int result;                               //上一次等待的结果，接收到数据报为0，超时或端口关闭为-1
+    co_t *next;                               //就绪队列、等待队列或空闲链表
+    void *port;                               //正在等待接收的端口
+    net_timer_t timer;                        //睡眠与接收超时
+    co_msg_t msg;                             //CO_RECV收到的数据报
+    _Alignas(16) uint8_t local[CO_LOCAL_SIZE]; //跨等待点的变量
+};
+
+#define CO_BEGIN(co)    \
+    switch ((co)->line) \
+    {                   \
+    case 0:
+
+#define CO_END(co) \
+    }              \
+    (co)->line = -1
+
+/**
+ * @brief 提前结束协程
+ *
+ */
+#define CO_EXIT(co)          \
+    do                       \
+    {                        \
+        (co)->line = -1;     \
+        return;              \
+    } while (0)
+
+#define CO_SUSPEND_(co)        \
+    do                         \
+    {                          \
+        (co)->line = __LINE__; \
+        return;                \
+    case __LINE__:;            \
+    } while (0)
+
+/**
+ * @brief 等待端口收到一个数据报，结果在co->result中：收到为0，数据报在co->msg中；超时或端口关闭为-1
+ *        端口须已由co_open()打开；已有暂存的数据报时不挂起
+ *
+ * @param timeout_ms 超时毫秒数，0表示一直等待
+ */
+#define CO_RECV(co, port, timeout_ms)                    \
+    do                                                   \
+    {                                                    \
+        if (co_recv_begin((co), (port), (timeout_ms)))   \
+            CO_SUSPEND_(co);                             \
+    } while (0)
+
+/**
+ * @brief 睡眠ms毫秒，由协议栈的时间轮唤醒，精度为TIMER_TICK_MS，恢复后co->result为-1
+ *
+ */
+#define CO_SLEEP(co, ms)              \
+    do                                \
+    {                                 \
+        co_sleep_begin((co), (ms));   \
+        CO_SUSPEND_(co);              \
+    } while (0)
+
+/**
+ * @brief 让出执行，排到就绪队列末尾，在下一次co_run()中再次运行
+ *
+ */
+#define CO_YIELD(co)         \
+    do                       \
+    {                        \
+        co_ready(co);        \
+        CO_SUSPEND_(co);     \
+    } while (0)
+
+/**
+ * @brief 以type解释协程帧中跨等待点的变量，type超过CO_LOCAL_SIZE时编译失败
+ *
+ */
+#define CO_LOCALS(co, type) ((type *)((co)->local + 0 * sizeof(char[sizeof(type) <= CO_LOCAL_SIZE ? 1 : -1])))
+
+/**
+ * @brief 初始化执行器，须在net_init()之后调用，丢弃所有协程与端口；重新初始化前须先调用net_init()
+ *
+ */
+void co_init();
+
+/**
+ * @brief 打开一个udp端口供协程接收，没有协程等待时到达的数据报最多暂存CO_BACKLOG个
+ *
+ * @param port 端口号
+ * @return int 成功为0，已打开或端口数已达CO_MAX_PORTS为-1
+ */
+int co_open(uint16_t port);
+
+/**
+ * @brief 关闭端口，等待该端口的协程以-1恢复
+ *
+ * @param port 端口号
+ */
+void co_close(uint16_t port);
+
+/**
+ * @brief 创建一个协程，放入就绪队列，在下一次co_run()中开始运行
+ *
+ * @param fn 协程体
+ * @param arg 拷贝到协程帧local中的初始数据，可以为NULL
+ * @param len 初始数据长度，不超过CO_LOCAL_SIZE
+ * @return co_t* 协程帧，池已用完或len过长时为NULL
+ */
+co_t *co_spawn(co_fn_t fn, const void *arg, size_t len);
+
+/**
+ * @brief 发送一个udp数据报，协议栈的发送不会阻塞，因此不挂起
+ *
+ * @param data 要发送的数据
+ * @param len 数据长度
+ * @param src_port 源端口号
+ * @param dest_ip 目的ip地址
+ * @param dest_port 目的端口号
+ */
+void co_send(const uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port);
+
+/**
+ * @brief 运行就绪队列中的协程，运行中让出或新创建的协程留到下一次
+ *
+ * @return int 运行的次数
+ */
+int co_run();
+
+/**
+ * @brief 一次协议栈轮询，然后运行所有就绪的协程
+ *
+ */
+void co_poll();
+
+/**
+ * @brief 当前存在的协程数
+ *
+ * @return int 协程数
+ */
+int co_count();
+
+/**
+ * @brief 获取端口因暂存已满而丢弃的数据报数
+ *
+ * @param port 端口号
+ * @return uint64_t 丢弃数，端口未打开时为0
+ */
+uint64_t co_dropped(uint16_t port);
+
+/**
+ * @brief 供CO_RECV使用：有暂存的数据报时取出，否则加入端口的等待队列
+ *
+ * @return int 需要挂起为1，已得到结果为0
+ */
+int co_recv_begin(co_t *co, uint16_t port, uint32_t timeout_ms);
+
+/**
+ * @brief 供CO_SLEEP使用：启动协程的定时器，到期时放入就绪队列
+ *
+ */
+void co_sleep_begin(co_t *co, uint32_t ms);
+
+/**
+ * @brief 把协程放入就绪队列末尾
+ *
+ */
+void co_ready(co_t *co);
+#endif
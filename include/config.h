@@ -19,15 +19,99 @@
        0x11,0x22,0x33,0x44,0x55,0x66\
     }                     //自定义网卡mac地址
 
+#define DRIVER_IF_NETMASK \
+    {                     \
+        255,255,255,0     \
+    } //自定义网卡子网掩码
+
+#define DRIVER_IF_GATEWAY \
+    {                     \
+        192,168,231,2     \
+    } //默认网关，全0表示不设置默认路由
+
+
+#define NETIF_MAX_IF 4            //最多的网卡数
+#define NETIF_MAX_ADDR 16         //每个网卡最多的ip地址数
+#define NETIF_ADDR_HASH_SIZE 256  //本机地址哈希表大小，须为2的幂且大于网卡数*地址数
+#define NETIF_GROUP_HASH_SIZE 256 //组播组成员哈希表大小，须为2的幂，最多加入的组数比它少1
 
 #define ETHERNET_MTU 1500 //以太网最大传输单元
+#define ETHERNET_RX_BURST 32 //一次以太网轮询最多接收的帧数
+#define ETHERNET_TX_BURST 32 //批量发送队列长度
+#define ETHERNET_PROTO_TABLE_SIZE 16 //以太网协议分发表大小，须为2的幂
 
 #define ARP_MAX_ENTRY 16       //arp表最大长度
 #define ARP_TIMEOUT_SEC 60 * 5 //arp表过期时间
 #define ARP_MIN_INTERVAL 1     //向相同地址发送arp请求的最小间隔
 
 #define IP_DEFALUT_TTL 64 //IP默认TTL
+#define IP_FORWARD 0      //是否默认开启IP转发（路由器模式）
+#define IP_PMTU_CACHE_SIZE 64    //路径MTU缓存大小，须为2的幂
+#define IP_PMTU_TIMEOUT_SEC 600  //路径MTU估计值的老化时间，到期后恢复为网卡MTU
+#define IP_PMTU_AGE_INTERVAL 60  //检查路径MTU老化的间隔（秒）
+
+#define ICMP_RATE_GLOBAL 1000     //每秒最多发送的icmp差错报文数，0表示不限制
+#define ICMP_BURST_GLOBAL 50      //icmp差错报文全局令牌桶容量
+#define ICMP_RATE_PER_SRC 10      //每秒最多向同一地址发送的icmp差错报文数，0表示不限制
+#define ICMP_BURST_PER_SRC 10     //每个地址的令牌桶容量
+#define ICMP_RATE_TABLE_SIZE 256  //按地址限速的令牌桶表大小，须为2的幂
+
+#define ROUTE_MAX_ENTRY 4096   //路由表最大长度
+#define ROUTE_TBL8_GROUPS 1024 //前缀长于24位的路由可使用的tbl8组数
+
+#define UDP_GRO_MAX_SEGS 64  //一个接收批次内最多暂存待合并交付的udp数据报数，暂存满时提前交付
+#define UDP_GRO_MAX_FLOWS 16 //一个接收批次内最多合并的流数
+#define UDP_SOCKET_RING_SIZE 1024   //udp套接字接收队列默认长度，须为2的幂
+#define UDP_SOCKET_RCVBUF 212992    //udp套接字默认最多占用的接收内存（字节）
+#define UDP_PESO_CACHE_SIZE 256     //缓存伪头部累加和的（源ip、目的ip）地址对数，须为2的幂
+#define UDP_MAX_SUBSCRIBERS 64      //每个udp端口最多的订阅者数，不超过255
+
+#define TCP_MAX_CONN 1024       //每个线程最多的tcp连接数
+#define TCP_CONN_HASH_SIZE 1024 //tcp连接哈希表大小，须为2的幂
+#define TCP_MAX_LISTEN 16       //最多监听的tcp端口数
+#define TCP_SNDBUF (1 << 18)    //每个连接的发送缓冲区大小（字节），须为2的幂
+#define TCP_RCVBUF (1 << 18)    //每个连接的接收缓冲区大小（字节），须为2的幂
+#define TCP_INIT_CWND 10        //初始拥塞窗口（报文段数）
+#define TCP_RTO_INIT_MS 1000    //初始重传超时
+#define TCP_RTO_MIN_MS 200      //重传超时下限
+#define TCP_RTO_MAX_MS 60000    //重传超时上限
+#define TCP_MAX_RETRIES 8       //连续超时重传的次数上限，超过后放弃连接
+#define TCP_DELACK_MS 40        //延迟确认时间
+#define TCP_DELACK_SEGS 2       //收到多少个未确认的报文段后立即确认
+#define TCP_DUPACK_THRESH 3     //触发快速重传的重复确认数
+#define TCP_SACK_MAX_BLOCKS 8   //每个连接记录的乱序数据块数与对端SACK块数
+#define TCP_TIME_WAIT_MS 30000  //TIME_WAIT持续时间（2MSL）
+#define TCP_EPHEMERAL_MIN 49152 //自动选择的源端口下限
+
+#define NET_SHARD_MAX 16         //分片模式最多的工作线程数
+#define NET_SHARD_RING_SIZE 1024 //每个工作线程接收队列的长度，须为2的幂
+#define NET_STAGE_MAX 8          //流水线模式最多的协议线程数
+#define NET_STAGE_RING_SIZE 1024 //流水线每个协议线程接收、发送队列的长度，须为2的幂
+
+#define CO_POOL_SIZE 256  //协程帧池大小，即同时存在的最多协程数
+#define CO_LOCAL_SIZE 256 //每个协程帧中保存跨等待点变量的空间（字节）
+#define CO_MAX_PORTS 16   //协程可以接收的最多udp端口数
+#define CO_BACKLOG 64     //每个端口暂存的没有协程等待时到达的数据报数，须为2的幂
+
+#define NET_STATS_MAX_SLOTS 64    //共享内存中最多导出计数的协议栈实例数
+#define NET_STATS_UDP_PORTS 256   //每个实例导出计数的udp端口数，超出的已打开端口不导出
+#define NET_STATS_PUBLISH_MS 50   //实例把计数发布到共享内存的间隔（毫秒）
+
+#ifndef NET_TRACE
+#define NET_TRACE 0                //是否编译各层的跟踪点（见trace.h），可用-DNET_TRACE=1开启
+#endif
+#define NET_TRACE_RING_SIZE 16384  //每个线程跟踪环的记录数，须为2的幂
+
+#define NET_DROP_SAMPLE_EVERY 64  //每种丢弃原因每多少次丢弃写一次丢弃日志，须为2的幂
+#define NET_DROP_SAMPLE_BYTES 64  //丢弃日志中每个样本保存的数据包开头字节数
+#define NET_DROP_LOG_SIZE 16      //每个协议栈实例丢弃日志的样本数
+
+#define NET_CAPTURE_RING_SIZE 1024    //每个线程抓包环的数据帧数，须为2的幂，写盘线程跟不上时新的数据帧被丢弃
+#define NET_CAPTURE_SNAPLEN 1514      //每个数据帧最多保存的字节数
+#define NET_CAPTURE_MAX_THREADS 64    //最多抓包的线程数
+#define NET_CAPTURE_IDLE_US 1000      //写盘线程没有数据帧时的休眠时间（微秒）
 
-#define UDP_MAX_HANDLER 16 //最多的UDP处理程序数
+#define TIMER_TICK_MS 10      //时间轮精度（毫秒）
+#define TIMER_WHEEL_SIZE 512  //时间轮槽数，一圈为TIMER_TICK_MS * TIMER_WHEEL_SIZE毫秒
 
 #endif
\ No newline at end of file
@@ -2,6 +2,63 @@
 #define DRIVER_H
 #include "utils.h"
 
+typedef struct driver driver_t; //驱动句柄，每个网卡一个
+
+/**
+ * @brief 打开一个网卡
+ * 
+ * @param name 网卡名称
+ * @param mac 网卡mac地址，只接收发往该地址、广播与组播的数据帧
+ * @return driver_t* 驱动句柄，失败为NULL
+ */
+driver_t *driver_open_if(const char *name, const uint8_t *mac);
+
+/**
+ * @brief 以一个pcap文件代替网卡，按与driver_open_if()相同的过滤条件依次交出其中的数据帧，用于回放抓包文件
+ *        只能接收，发送总是失败
+ * 
+ * @param path pcap文件路径
+ * @param mac 网卡mac地址
+ * @return driver_t* 驱动句柄，失败为NULL
+ */
+driver_t *driver_open_file(const char *path, const uint8_t *mac);
+
+/**
+ * @brief 试图从指定网卡接收数据包
+ * 
+ * @param driver 驱动句柄
+ * @param buf 收到的数据包
+ * @return int 数据包的长度，未收到为0，错误为-1
+ */
+int driver_recv_if(driver_t *driver, buf_t *buf);
+
+/**
+ * @brief 使用指定网卡发送一个数据包
+ * 
+ * @param driver 驱动句柄
+ * @param buf 要发送的数据包
+ * @return int 成功为0，失败为-1
+ */
+int driver_send_if(driver_t *driver, buf_t *buf);
+
+/**
+ * @brief 使用指定网卡批量发送数据包
+ * 
+ * @param driver 驱动句柄
+ * @param frames 要发送的数据帧
+ * @param lens 每个数据帧的长度
+ * @param n 数据帧个数
+ * @return int 成功发送的个数
+ */
+int driver_send_burst_if(driver_t *driver, uint8_t *frames[], uint16_t lens[], int n);
+
+/**
+ * @brief 关闭指定网卡
+ * 
+ * @param driver 驱动句柄
+ */
+void driver_close_if(driver_t *driver);
+
 /**
  * @brief 打开网卡
  * 
@@ -25,9 +82,19 @@ int driver_recv(buf_t *buf);
  */
 int driver_send(buf_t *buf);
 
+/**
+ * @brief 使用网卡批量发送数据包
+ * 
+ * @param frames 要发送的数据帧
+ * @param lens 每个数据帧的长度
+ * @param n 数据帧个数
+ * @return int 成功发送的个数
+ */
+int driver_send_burst(uint8_t *frames[], uint16_t lens[], int n);
+
 /**
  * @brief 关闭网卡
  * 
  */
 void driver_close();
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,88 @@
+#ifndef DROP_H
+#define DROP_H
+#include <stdint.h>
+#include "config.h"
+#include "utils.h"
+
+/**
+ * @brief 丢弃原因，接收、转发与发送路径上每个丢弃数据包的位置对应一种
+ *
+ */
+typedef enum net_drop_reason
+{
+    NET_DROP_ETH_TRUNCATED,    //以太网帧短于以太网头部
+    NET_DROP_ETH_UNKNOWN_TYPE, //以太网协议类型没有注册处理程序
+    NET_DROP_ETH_TX_NO_IF,     //发送时出口网卡不存在，批量发送队列中的每个数据帧各计一次
+    NET_DROP_ETH_TX_OVERSIZE,  //加入批量发送队列的数据帧超过ETHERNET_MTU加以太网头部
+    NET_DROP_ARP_TRUNCATED,    //arp报文短于arp头部
+    NET_DROP_ARP_UNSUPPORTED,  //硬件类型、协议类型、地址长度或操作码不支持
+    NET_DROP_IP_TRUNCATED,     //短于ip头部，或总长度超过收到的数据
+    NET_DROP_IP_BAD_VERSION,   //版本号不是4
+    NET_DROP_IP_BAD_HDR_LEN,   //头部长度小于20字节或大于总长度
+    NET_DROP_IP_CHECKSUM,      //头部校验和错误
+    NET_DROP_IP_NOT_FOR_US,    //目的地址不是本机、不是本机接收的广播或组播，且不转发
+    NET_DROP_IP_UNKNOWN_PROTO, //上层协议没有处理程序
+    NET_DROP_IP_FWD_NO_IF,     //转发时路由的出口网卡不存在
+    NET_DROP_IP_TTL_EXCEEDED,  //转发时TTL耗尽，已回送ICMP超时报文
+    NET_DROP_ICMP_TRUNCATED,   //短于icmp头部
+    NET_DROP_ICMP_CHECKSUM,    //校验和错误
+    NET_DROP_ICMP_NOT_FOR_US,  //目的地址不是本机的回显请求，如广播ping
+    NET_DROP_ICMP_UNHANDLED,   //不处理的类型，或没有回显应答处理程序
+    NET_DROP_UDP_TRUNCATED,    //短于udp头部，或长度字段超过收到的数据
+    NET_DROP_UDP_BAD_LEN,      //长度字段小于udp头部
+    NET_DROP_UDP_CHECKSUM,     //校验和错误
+    NET_DROP_UDP_NO_PORT,      //目的端口没有打开
+    NET_DROP_REASON_COUNT,
+} net_drop_reason_t;
+
+/**
+ * @brief 丢弃日志中的一个样本
+ *
+ */
+typedef struct net_drop_sample
+{
+    uint64_t time_ms;                    //丢弃时间（单调时钟）
+    uint16_t reason;                     //丢弃原因，见net_drop_reason_t
+    int16_t ifindex;                     //收到或将要发送数据包的网卡
+    uint16_t len;                        //丢弃时数据包的长度，从丢弃它的那一层的头部算起
+    uint16_t cap_len;                    //data中保存的字节数
+    uint8_t data[NET_DROP_SAMPLE_BYTES]; //数据包开头的cap_len个字节
+} net_drop_sample_t;
+
+/**
+ * @brief 丢弃计数与丢弃日志，每个协议栈实例一份（见stack.h）
+ *        每种原因每NET_DROP_SAMPLE_EVERY次丢弃采样一次（包括第一次），写入环形的丢弃日志
+ *
+ */
+typedef struct net_drop_ctx
+{
+    uint64_t counts[NET_DROP_REASON_COUNT];   //以丢弃原因索引的丢弃数
+    uint64_t logged;                          //写入过日志的样本数，下一个样本写入log[logged % NET_DROP_LOG_SIZE]
+    net_drop_sample_t log[NET_DROP_LOG_SIZE]; //丢弃日志，写满后覆盖最早的样本
+} net_drop_ctx_t;
+
+/**
+ * @brief 把一个被丢弃的数据包写入当前协议栈实例的丢弃日志，由net_drop()在采样时调用
+ *
+ * @param reason 丢弃原因
+ * @param ifindex 收到或将要发送数据包的网卡
+ * @param data 数据包
+ * @param len 数据包长度
+ */
+void net_drop_log(net_drop_reason_t reason, int ifindex, const uint8_t *data, uint16_t len);
+
+/**
+ * @brief 获取当前协议栈实例的丢弃计数与丢弃日志
+ *
+ * @return const net_drop_ctx_t* 计数与日志
+ */
+const net_drop_ctx_t *net_drop_get_stats();
+
+/**
+ * @brief 获取丢弃原因的名称
+ *
+ * @param reason 丢弃原因
+ * @return const char* 名称，未知的原因为"unknown"
+ */
+const char *net_drop_name(uint16_t reason);
+#endif
@@ -14,6 +14,89 @@ typedef struct ether_hdr
 } ether_hdr_t;
 #pragma pack()
 
+/**
+ * @brief 以以太网头部解释数据包，长度不足时为NULL
+ *        头部为1字节对齐的结构体，多字节字段为网络字节序，读取时用swap16转换
+ * 
+ * @param buf 数据包，data指向以太网头部
+ * @return ether_hdr_t* 以太网头部
+ */
+static inline ether_hdr_t *ether_hdr_of(buf_t *buf)
+{
+    return buf->len < sizeof(ether_hdr_t) ? NULL : (ether_hdr_t *)buf->data;
+}
+
+typedef void (*ethernet_handler_t)(buf_t *buf);
+
+/**
+ * @brief 发送钩子，接收一个已填好以太网头部的数据帧，返回前须拷贝走数据帧
+ * 
+ * @param ifindex 出口网卡
+ * @param frame 数据帧
+ * @param len 数据帧长度
+ * @return int 成功为0，丢弃为-1
+ */
+typedef int (*ethernet_tx_hook_t)(int ifindex, const uint8_t *frame, uint16_t len);
+
+/**
+ * @brief 抓包钩子，在收到的数据帧交给ethernet_in()处理之前、发出的数据帧交给驱动或发送钩子之前调用，
+ *        返回前须拷贝走数据帧，不能修改数据帧
+ * 
+ * @param ifindex 收到或发出数据帧的网卡
+ * @param frame 数据帧
+ * @param len 数据帧长度
+ * @param tx 发出的数据帧为1，收到的为0
+ */
+typedef void (*ethernet_tap_t)(int ifindex, const uint8_t *frame, uint16_t len, int tx);
+
+/**
+ * @brief 每个网卡一个批量发送队列，转发的数据帧先在此攒批，再一次交给驱动
+ * 
+ */
+typedef struct tx_burst
+{
+    int count;                                                      //队列中的数据帧数
+    uint8_t *frames[ETHERNET_TX_BURST];                             //指向frame_buf中的各帧
+    uint16_t lens[ETHERNET_TX_BURST];                               //各帧长度
+    uint8_t frame_buf[ETHERNET_TX_BURST][ETHERNET_MTU + sizeof(ether_hdr_t)]; //数据帧
+} tx_burst_t;
+
+/**
+ * @brief 以太网协议分发表的表项，分发表开放定址、线性探测，protocol为0表示空位
+ *        以太网协议类型都不小于0x0600，不会与空位冲突
+ * 
+ */
+typedef struct ethernet_proto
+{
+    uint16_t protocol;          //以太网协议类型
+    ethernet_handler_t handler; //处理程序
+    net_proto_stats_t stats;    //收发计数
+} ethernet_proto_t;
+
+/**
+ * @brief 驱动收发出错的计数
+ * 
+ */
+typedef struct ethernet_driver_stats
+{
+    uint64_t rx_errors; //接收出错次数
+    uint64_t tx_errors; //没能交给驱动的数据帧数
+} ethernet_driver_stats_t;
+
+/**
+ * @brief 以太网层的状态，每个协议栈实例一份（见stack.h）
+ * 
+ */
+typedef struct ethernet_ctx
+{
+    tx_burst_t tx_burst[NETIF_MAX_IF];                  //各网卡的批量发送队列
+    ethernet_proto_t protos[ETHERNET_PROTO_TABLE_SIZE]; //协议分发表
+    net_proto_stats_t other_stats;                      //未注册协议的收发计数
+    ethernet_driver_stats_t driver_stats;               //驱动收发出错的计数
+    ethernet_tx_hook_t tx_hook;                         //发送钩子
+    buf_t rxbuf;                                        //轮询时接收数据帧
+} ethernet_ctx_t;
+
 /**
  * @brief 初始化以太网协议
  * 
@@ -22,14 +105,22 @@ typedef struct ether_hdr
 int ethernet_init();
 
 /**
- * @brief 处理一个收到的数据包
+ * @brief 在当前协议栈实例中处理一个收到的数据包
  * 
  * @param buf 要处理的数据包
  */
 void ethernet_in(buf_t *buf);
 
 /**
- * @brief 处理一个要发送的数据包
+ * @brief 在指定的协议栈实例中处理一个收到的数据包，处理期间实例绑定到本线程
+ * 
+ * @param stack 实例
+ * @param buf 要处理的数据包
+ */
+void ethernet_in_stack(net_stack_t *stack, buf_t *buf);
+
+/**
+ * @brief 处理一个要发送的数据包，从buf->ifindex指定的网卡发出
  * 
  * @param buf 要处理的数据包
  * @param mac 目标ip地址
@@ -38,10 +129,100 @@ void ethernet_in(buf_t *buf);
 void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol);
 
 /**
- * @brief 一次以太网轮询
+ * @brief 将一个已填好以太网头部的数据帧加入出口网卡的批量发送队列，队列满时立即发送
+ * 
+ * @param buf 要发送的数据帧，buf->ifindex为出口网卡
+ */
+void ethernet_out_burst(buf_t *buf);
+
+/**
+ * @brief 在出口网卡的批量发送队列中预留一个数据帧，调用者直接在其中构造数据帧，
+ *        避免先构造到buf再拷贝一次
+ * 
+ * @param ifindex 出口网卡
+ * @return uint8_t* 数据帧，可容纳ETHERNET_MTU加以太网头部
+ */
+uint8_t *ethernet_burst_reserve(int ifindex);
+
+/**
+ * @brief 将ethernet_burst_reserve()预留的数据帧加入批量发送队列，队列满时立即发送
+ * 
+ * @param ifindex 出口网卡
+ * @param len 数据帧长度
+ */
+void ethernet_burst_commit(int ifindex, uint16_t len);
+
+/**
+ * @brief 发送当前协议栈实例所有网卡批量发送队列中的数据帧
+ * 
+ */
+void ethernet_flush();
+
+/**
+ * @brief 发送指定协议栈实例所有网卡批量发送队列中的数据帧
+ * 
+ * @param stack 实例
+ */
+void ethernet_flush_stack(net_stack_t *stack);
+
+/**
+ * @brief 设置当前协议栈实例的发送钩子，设置后它的数据帧交给钩子而不再直接调用驱动
+ * 
+ * @param hook 发送钩子，为NULL时恢复直接调用驱动
+ */
+void ethernet_set_tx_hook(ethernet_tx_hook_t hook);
+
+/**
+ * @brief 设置抓包钩子，作用于所有线程的所有协议栈实例，可以在任何线程中调用
+ *        清除后正在别的线程中执行的钩子仍会执行完
+ * 
+ * @param tap 抓包钩子，为NULL时不抓包
+ */
+void ethernet_set_tap(ethernet_tap_t tap);
+
+/**
+ * @brief 一次以太网轮询，只接收当前协议栈实例负责的网卡
  * 
  */
 void ethernet_poll();
 
+/**
+ * @brief 一次以太网轮询，只接收指定协议栈实例负责的网卡，轮询期间实例绑定到本线程
+ * 
+ * @param stack 实例
+ */
+void ethernet_poll_stack(net_stack_t *stack);
+
+/**
+ * @brief 注册一个以太网协议的处理程序，已注册的协议会被替换
+ * 
+ * @param protocol 以太网协议类型
+ * @param handler 处理程序，收到时data指向以太网负载；为NULL时丢弃该协议的数据帧
+ * @return int 成功为0，分发表已满为-1
+ */
+int ethernet_register(uint16_t protocol, ethernet_handler_t handler);
+
+/**
+ * @brief 获取一个以太网协议的收发计数
+ * 
+ * @param protocol 以太网协议类型
+ * @return const net_proto_stats_t* 收发计数，协议未注册时为NULL
+ */
+const net_proto_stats_t *ethernet_get_stats(uint16_t protocol);
+
+/**
+ * @brief 获取所有未注册协议的收发计数之和
+ * 
+ * @return const net_proto_stats_t* 收发计数
+ */
+const net_proto_stats_t *ethernet_get_other_stats();
+
+/**
+ * @brief 获取当前协议栈实例驱动收发出错的计数
+ * 
+ * @return const ethernet_driver_stats_t* 计数
+ */
+const ethernet_driver_stats_t *ethernet_get_driver_stats();
+
 static const uint8_t ether_broadcast_mac[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}; //以太网广播mac地址
 #endif
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef ICMP_H
 #define ICMP_H
 #include <stdint.h>
+#include "net.h"
 #include "utils.h"
 #pragma pack(1)
 typedef struct icmp_hdr
@@ -13,26 +14,127 @@ typedef struct icmp_hdr
 } icmp_hdr_t;
 
 #pragma pack()
+
+/**
+ * @brief 以icmp头部解释数据包，长度不足时为NULL
+ * 
+ * @param buf 数据包，data指向icmp头部
+ * @return icmp_hdr_t* icmp头部
+ */
+static inline icmp_hdr_t *icmp_hdr_of(buf_t *buf)
+{
+    return buf->len < sizeof(icmp_hdr_t) ? NULL : (icmp_hdr_t *)buf->data;
+}
+
 typedef enum icmp_type
 {
     ICMP_TYPE_ECHO_REQUEST = 8, // 回显请求
     ICMP_TYPE_ECHO_REPLY = 0,   // 回显响应
     ICMP_TYPE_UNREACH = 3,      // 目的不可达
+    ICMP_TYPE_SOURCE_QUENCH = 4, // 源站抑制
+    ICMP_TYPE_REDIRECT = 5,     // 重定向
+    ICMP_TYPE_TIME_EXCEEDED = 11, // 超时
+    ICMP_TYPE_PARAM_PROBLEM = 12, // 参数问题
 } icmp_type_t;
 
 typedef enum icmp_code
 {
+    ICMP_CODE_TTL_EXCEEDED = 0,     // 传输中TTL耗尽
     ICMP_CODE_PROTOCOL_UNREACH = 2, // 协议不可达
-    ICMP_CODE_PORT_UNREACH = 3      // 端口不可达
+    ICMP_CODE_PORT_UNREACH = 3,     // 端口不可达
+    ICMP_CODE_FRAG_NEEDED = 4       // 需要分片但设置了DF位
 } icmp_code_t;
 
+/**
+ * @brief icmp差错报文的限速参数，速率为每秒报文数，0表示不限制，容量为令牌桶最多积攒的令牌数
+ * 
+ */
+typedef struct icmp_rate_limit
+{
+    uint32_t global_rate;  //全局速率
+    uint32_t global_burst; //全局令牌桶容量
+    uint32_t src_rate;     //向同一地址发送的速率
+    uint32_t src_burst;    //每个地址的令牌桶容量
+} icmp_rate_limit_t;
+
+typedef struct icmp_error_stats
+{
+    uint64_t sent;              //发送的差错报文数
+    uint64_t suppressed_global; //全局令牌桶为空而抑制的差错报文数
+    uint64_t suppressed_src;    //目的地址的令牌桶为空而抑制的差错报文数
+} icmp_error_stats_t;
+
+/**
+ * @brief 令牌桶，令牌以千分之一为单位，按距上次补充的毫秒数惰性补充
+ *        last_ms为0的令牌桶是新桶，从满桶开始
+ * 
+ */
+typedef struct icmp_bucket
+{
+    uint32_t tokens;  //剩余令牌数乘以1000
+    uint64_t last_ms; //上次补充的时间
+} icmp_bucket_t;
+
+/**
+ * @brief 按地址限速的令牌桶，以地址哈希直接映射，冲突时新地址占用该桶并从满桶开始
+ * 
+ */
+typedef struct icmp_src_bucket
+{
+    int valid;              //有效位
+    uint8_t ip[NET_IP_LEN]; //差错报文的目的地址
+    icmp_bucket_t bucket;   //令牌桶
+} icmp_src_bucket_t;
+
+typedef void (*icmp_echo_handler_t)(uint8_t *src_ip, uint16_t id, uint16_t seq, uint8_t *data, uint16_t len);
+
+/**
+ * @brief icmp的状态，每个协议栈实例一份（见stack.h）
+ *        限速参数、令牌桶与回显应答的处理程序每个实例一套，多个实例时的总速率是限速配置的实例数倍
+ * 
+ */
+typedef struct icmp_ctx
+{
+    icmp_rate_limit_t limit;                              //差错报文的限速参数
+    icmp_echo_handler_t echo_handler;                     //回显应答的处理程序
+    icmp_bucket_t global_bucket;                          //全局令牌桶
+    icmp_src_bucket_t src_buckets[ICMP_RATE_TABLE_SIZE]; //按地址的令牌桶
+    icmp_error_stats_t error_stats;                       //差错报文的发送与抑制计数
+    buf_t txbuf;                                          //构造回显与差错报文
+} icmp_ctx_t;
+
+/**
+ * @brief 初始化当前协议栈实例的icmp，限速参数恢复为config.h中的默认值，清空令牌桶与回显应答的处理程序
+ * 
+ */
+void icmp_init();
+
 /**
  * @brief 处理一个收到的数据包
  * 
  * @param buf 要处理的数据包
  * @param src_ip 源ip地址
+ * @param dest_ip 目的ip地址
+ */
+void icmp_in(buf_t *buf, uint8_t *src_ip, uint8_t *dest_ip);
+
+/**
+ * @brief 发送一个回显请求
+ * 
+ * @param dest_ip 目的ip地址
+ * @param id 标识符
+ * @param seq 序号
+ * @param data 数据
+ * @param len 数据长度
  */
-void icmp_in(buf_t *buf, uint8_t *src_ip);
+void icmp_send_echo(uint8_t *dest_ip, uint16_t id, uint16_t seq, const uint8_t *data, uint16_t len);
+
+/**
+ * @brief 注册当前协议栈实例的回显应答的处理程序
+ * 
+ * @param handler 处理程序，为NULL时丢弃回显应答
+ */
+void icmp_set_echo_handler(icmp_echo_handler_t handler);
 
 /**
  * @brief 发送icmp不可达
@@ -42,4 +144,34 @@ void icmp_in(buf_t *buf, uint8_t *src_ip);
  * @param code icmp code，协议不可达或端口不可达
  */
 void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code);
+
+/**
+ * @brief 发送icmp超时（TTL耗尽）
+ * 
+ * @param recv_buf 收到的ip数据包
+ * @param src_ip 源ip地址
+ */
+void icmp_time_exceeded(buf_t *recv_buf, uint8_t *src_ip);
+
+/**
+ * @brief 检查是否允许向一个地址发送icmp差错报文，不消耗令牌，不允许时计入抑制计数
+ * 
+ * @param ip 差错报文的目的地址，即出错数据报的源地址
+ * @return int 允许为1，不允许为0
+ */
+int icmp_error_allowed(uint8_t *ip);
+
+/**
+ * @brief 设置当前协议栈实例的icmp差错报文的限速参数
+ * 
+ * @param limit 限速参数，速率为0表示不限制
+ */
+void icmp_set_rate_limit(const icmp_rate_limit_t *limit);
+
+/**
+ * @brief 获取icmp差错报文的发送与抑制计数
+ * 
+ * @return const icmp_error_stats_t* 计数
+ */
+const icmp_error_stats_t *icmp_get_error_stats();
 #endif
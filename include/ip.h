@@ -3,6 +3,7 @@
 #include <stdint.h>
 #include "net.h"
 #include "utils.h"
+#include "timer.h"
 #pragma pack(1)
 typedef struct ip_hdr
 {
@@ -24,6 +25,76 @@ typedef struct ip_hdr
 #define IP_HDR_OFFSET_PER_BYTE (8) //ip分片偏移长度单位
 #define IP_VERSION_4 (4)           //ipv4
 #define IP_MORE_FRAGMENT 1 << 5    //ip分片mf位
+#define IP_DONT_FRAGMENT 1 << 6    //ip不分片df位
+#define IP_PMTU_MIN 68             //路径MTU下限，RFC 791要求所有主机都能处理
+
+/**
+ * @brief 以ip头部解释数据包，完成本层的全部长度检查
+ *        版本不是4、首部长度小于20字节、或首部与总长度超出数据包时为NULL，
+ *        之后读取头部字段不必再检查长度
+ * 
+ * @param buf 数据包，data指向ip头部
+ * @return ip_hdr_t* ip头部
+ */
+static inline ip_hdr_t *ip_hdr_of(buf_t *buf)
+{
+    ip_hdr_t *hdr = (ip_hdr_t *)buf->data;
+    if (buf->len < sizeof(ip_hdr_t) || hdr->version != IP_VERSION_4 || hdr->hdr_len < 5)
+        return NULL;
+    uint16_t total_len = swap16(hdr->total_len);
+    if (total_len < hdr->hdr_len * IP_HDR_LEN_PER_BYTE || total_len > buf->len)
+        return NULL;
+    return hdr;
+}
+
+typedef void (*ip_handler_t)(buf_t *buf, uint8_t *src_ip, uint8_t *dest_ip);
+
+typedef struct ip_forward_stats
+{
+    uint64_t forwarded;    //经批量发送队列转发的数据报数
+    uint64_t ttl_exceeded; //TTL耗尽而丢弃的数据报数
+    uint64_t no_if;        //路由的出口网卡不存在而丢弃的数据报数
+    uint64_t arp_miss;     //下一跳mac未知，交给arp层缓存的数据报数
+} ip_forward_stats_t;
+
+/**
+ * @brief 上层协议分发表的表项，以协议号直接索引，查找只需一次访存
+ *        ICMP与UDP是内置的，未调用过ip_register()的协议号使用内置的处理程序，
+ *        全0的表项因此就是初始状态
+ * 
+ */
+typedef struct ip_proto
+{
+    ip_handler_t handler;    //处理程序
+    int registered;          //是否调用过ip_register()
+    net_proto_stats_t stats; //收发计数
+} ip_proto_t;
+
+/**
+ * @brief 路径MTU缓存的表项，以目的地址哈希直接映射，冲突时新表项替换旧表项
+ *        没有表项的目的地址使用网卡MTU
+ * 
+ */
+typedef struct ip_pmtu_entry
+{
+    int valid;              //有效位
+    uint8_t ip[NET_IP_LEN]; //目的ip地址
+    uint16_t mtu;           //路径MTU
+    uint64_t expire_ms;     //老化时间
+} ip_pmtu_entry_t;
+
+/**
+ * @brief ip层的状态，每个协议栈实例一份（见stack.h）
+ * 
+ */
+typedef struct ip_ctx
+{
+    ip_proto_t protos[256];                         //上层协议分发表
+    ip_pmtu_entry_t pmtu_cache[IP_PMTU_CACHE_SIZE]; //路径MTU缓存
+    net_timer_t pmtu_timer;                         //路径MTU老化定时器
+    ip_forward_stats_t forward_stats;               //转发统计
+    uint16_t id;                                    //下一个发出的数据报的标识，分片重组按它区分数据报
+} ip_ctx_t;
 
 /**
  * @brief 处理一个收到的数据包
@@ -40,4 +111,88 @@ void ip_in(buf_t *buf);
  * @param protocol 上层协议
  */
 void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol);
+
+/**
+ * @brief 以指定的源地址发送一个ip数据包
+ * 
+ * @param buf 要处理的包
+ * @param src_ip 源ip地址，为NULL时按出口网卡选择
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ */
+void ip_out_from(buf_t *buf, uint8_t *src_ip, uint8_t *ip, net_protocol_t protocol);
+
+/**
+ * @brief 按路由选择发往目的地址时使用的源地址，与ip_out()的选择相同
+ * 
+ * @param ip 目标ip地址
+ * @return uint8_t* 源ip地址，没有可用的源地址时为NULL
+ */
+uint8_t *ip_select_src(uint8_t *ip);
+
+/**
+ * @brief 为发往目的地址的数据报构造以太网与ip头部模板
+ *        ip头部的总长度与校验和按当前buf->len填写，置DF位
+ * 
+ * @param buf 数据报，data指向ip负载；成功时data指向以太网头部，ifindex为出口网卡
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ * @return int 成功为0，没有可用的源地址或下一跳mac未知时为-1
+ */
+int ip_build_template(buf_t *buf, uint8_t *ip, net_protocol_t protocol);
+
+/**
+ * @brief 获取到目的地址的路径MTU
+ * 
+ * @param ip 目的ip地址
+ * @return int 路径MTU，未发现更小值时为网卡MTU
+ */
+int ip_get_pmtu(uint8_t *ip);
+
+/**
+ * @brief 根据ICMP“需要分片”差错更新到目的地址的路径MTU
+ * 
+ * @param ip 目的ip地址
+ * @param mtu 差错报文中的下一跳MTU，0表示路由器未提供
+ * @param orig_len 被丢弃的原数据报总长度
+ */
+void ip_pmtu_update(uint8_t *ip, uint16_t mtu, uint16_t orig_len);
+
+/**
+ * @brief 注册一个上层协议的处理程序，已注册的协议会被替换
+ * 
+ * @param protocol 上层协议号
+ * @param handler 处理程序，收到时data指向ip负载；为NULL时回送协议不可达
+ */
+void ip_register(uint8_t protocol, ip_handler_t handler);
+
+/**
+ * @brief 获取一个上层协议的收发计数，未注册的协议也会计数
+ * 
+ * @param protocol 上层协议号
+ * @return const net_proto_stats_t* 收发计数
+ */
+const net_proto_stats_t *ip_get_stats(uint8_t protocol);
+
+/**
+ * @brief 记录一个不经ip_out()、由上层按ip_build_template()的模板直接构造并发出的ip数据报
+ * 
+ * @param protocol 上层协议号
+ * @param len 数据报长度，含ip头部
+ */
+void ip_count_out(uint8_t protocol, uint16_t len);
+
+/**
+ * @brief 开启或关闭IP转发（路由器模式）
+ * 
+ * @param enable 非0为开启
+ */
+void ip_set_forward(int enable);
+
+/**
+ * @brief 获取IP转发统计
+ * 
+ * @return const ip_forward_stats_t* 转发统计
+ */
+const ip_forward_stats_t *ip_get_forward_stats();
 #endif
\ No newline at end of file
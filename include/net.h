@@ -11,21 +11,47 @@ typedef enum net_protocol
     NET_PROTOCOL_TCP = 6,
 } net_protocol_t;
 
-static uint8_t net_if_mac[] = DRIVER_IF_MAC;
-static uint8_t net_if_ip[] = DRIVER_IF_IP;
+/**
+ * @brief 分发表中每个协议（以及每个udp端口）的收发计数
+ * 
+ */
+typedef struct net_proto_stats
+{
+    uint64_t packets;     //收到的数据包数
+    uint64_t bytes;       //收到的字节数，含本层头部
+    uint64_t out_packets; //发送的数据包数
+    uint64_t out_bytes;   //发送的字节数，含本层头部
+} net_proto_stats_t;
 
 #define NET_MAC_LEN (6)                                     //mac地址长度
 #define NET_IP_LEN (4)                                      //ip地址长度
 #define swap16(x) ((((x)&0xFF) << 8) | (((x) >> 8) & 0xFF)) //为16位数据交换大小端
+#define swap32(x) ((uint32_t)swap16((x)&0xFFFF) << 16 | swap16((uint32_t)(x) >> 16)) //为32位数据交换大小端
+
+typedef struct net_stack net_stack_t; //协议栈实例，见stack.h
 
 /**
- * @brief 初始化协议栈
+ * @brief 初始化协议栈：共享的路由表与网卡表，以及本线程的默认协议栈实例（见stack.h）
  * 
  */
 void net_init();
 
 /**
- * @brief 一次协议栈轮询
+ * @brief 初始化本线程的默认协议栈实例，路由表与网卡表须已由net_init()初始化
+ *        即net_stack_init(net_stack_default())
+ * 
+ */
+void net_init_thread();
+
+/**
+ * @brief 释放本线程的默认协议栈实例，使用过默认实例的线程退出前调用
+ *        之后本线程再使用默认实例时会重新分配，须重新初始化
+ * 
+ */
+void net_exit_thread();
+
+/**
+ * @brief 一次本线程默认协议栈实例的轮询，即net_stack_poll(net_stack_default())
  * 
  */
 void net_poll();
@@ -0,0 +1,116 @@
+#ifndef NETIF_H
+#define NETIF_H
+#include <stdint.h>
+#include "config.h"
+#include "net.h"
+#include "driver.h"
+
+#define NETIF_NAME_LEN 16 //网卡名称最大长度
+
+typedef struct net_if
+{
+    int valid;                              //有效位
+    char name[NETIF_NAME_LEN];              //网卡名称
+    uint8_t mac[NET_MAC_LEN];               //mac地址
+    int ip_count;                           //ip地址个数
+    uint8_t ip[NETIF_MAX_ADDR][NET_IP_LEN]; //ip地址，ip[0]为主地址
+    uint8_t prefix_len[NETIF_MAX_ADDR];     //各地址所在子网的前缀长度
+    driver_t *driver;                       //驱动句柄
+} net_if_t;
+
+/**
+ * @brief 初始化网卡表，按config.h添加默认网卡及其地址
+ * 
+ */
+void netif_init();
+
+/**
+ * @brief 添加一个网卡
+ * 
+ * @param name 网卡名称
+ * @param mac mac地址
+ * @return int 网卡索引，失败为-1
+ */
+int netif_add(const char *name, const uint8_t *mac);
+
+/**
+ * @brief 为网卡添加一个ip地址，并添加该地址所在子网的直连路由
+ * 
+ * @param ifindex 网卡索引
+ * @param ip ip地址
+ * @param prefix_len 子网前缀长度
+ * @return int 成功为0，失败为-1
+ */
+int netif_add_addr(int ifindex, uint8_t *ip, int prefix_len);
+
+/**
+ * @brief 删除网卡的一个ip地址及其直连路由
+ * 
+ * @param ifindex 网卡索引
+ * @param ip ip地址
+ * @return int 成功为0，未找到为-1
+ */
+int netif_del_addr(int ifindex, uint8_t *ip);
+
+/**
+ * @brief 根据索引获取网卡
+ * 
+ * @param ifindex 网卡索引
+ * @return net_if_t* 网卡，不存在时为NULL
+ */
+net_if_t *netif_get(int ifindex);
+
+/**
+ * @brief 为发往目的地址的数据包选择源地址
+ *        优先选择与目的地址在同一子网的地址，否则使用主地址
+ * 
+ * @param ifindex 出口网卡索引
+ * @param dest_ip 目的ip地址
+ * @return uint8_t* 源ip地址，网卡不存在或没有地址时为NULL
+ */
+uint8_t *netif_select_src(int ifindex, uint8_t *dest_ip);
+
+/**
+ * @brief 判断ip地址是否为本机地址
+ * 
+ * @param ip ip地址
+ * @return int 地址所在网卡的索引，不是本机地址时为-1
+ */
+int netif_lookup(uint8_t *ip);
+
+/**
+ * @brief 网卡加入一个组播组，之后ip层接收在该网卡上收到的发往该组的数据报
+ * 
+ * @param ifindex 网卡索引
+ * @param group 组播地址（224.0.0.0/4）
+ * @return int 成功为0，网卡不存在、不是组播地址、已加入或成员表已满为-1
+ */
+int netif_join_group(int ifindex, uint8_t *group);
+
+/**
+ * @brief 网卡退出一个组播组
+ * 
+ * @param ifindex 网卡索引
+ * @param group 组播地址
+ * @return int 成功为0，未加入为-1
+ */
+int netif_leave_group(int ifindex, uint8_t *group);
+
+/**
+ * @brief 判断网卡是否已加入一个组播组
+ * 
+ * @param ifindex 网卡索引
+ * @param group 组播地址
+ * @return int 已加入为1，否则为0
+ */
+int netif_is_member(int ifindex, uint8_t *group);
+
+/**
+ * @brief 判断网卡是否接收发往一个非本机地址的数据报：受限广播、子网广播或已加入的组播组
+ * 
+ * @param ifindex 收到数据报的网卡
+ * @param ip 目的ip地址
+ * @return int 接收为1，否则为0
+ */
+int netif_accepts(int ifindex, uint8_t *ip);
+#endif
@@ -0,0 +1,137 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#include <stdint.h>
+#include <string.h>
+#include "net.h"
+#include "utils.h"
+#include "ethernet.h"
+#include "ip.h"
+#include "udp.h"
+
+/**
+ * @brief 编译期组合的接收流水线
+ *        应用用下面的宏自底向上声明自己需要的协议栈，每一层都是static inline函数，
+ *        下一层与协议号、端口、本机地址等都是宏参数，编译时即可确定，
+ *        分发全部在编译期完成并内联到应用的处理程序，没有用到的协议不会被编译进来。
+ *
+ *        例如只接收发往本机60000端口的udp数据报：
+ *
+ *        static inline void on_udp(uint8_t *src_ip, uint16_t src_port, buf_t *buf) { ... }
+ *        PIPELINE_UDP(rx_udp, 60000, on_udp)
+ *        PIPELINE_IPV4(rx_ip, DRIVER_IF_IP, NET_PROTOCOL_UDP, rx_udp)
+ *        PIPELINE_ETHERNET(rx, NET_PROTOCOL_IP, rx_ip)
+ *
+ *        然后对收到的每个数据帧调用 if (!rx(&rxbuf)) ethernet_in(&rxbuf);
+ *        各层在确认数据包属于自己之前不修改buf，不匹配的数据包（ARP、带选项或分片的ip数据报、
+ *        其他端口等）返回0，原样交给通用路径处理；匹配的数据包返回1。
+ *
+ */
+
+/**
+ * @brief 累加16位字，不做字节序转换
+ *        反码和与字节序无关，累加网络字节序的原始值，最后与同样是网络字节序的校验和比较即可
+ *
+ * @param p 数据
+ * @param len 字节数
+ * @param sum 已有的累加和
+ * @return uint32_t 未折叠的累加和
+ */
+static inline uint32_t pipeline_sum16(const uint8_t *p, int len, uint32_t sum)
+{
+    for (; len > 1; len -= 2, p += 2)
+    {
+        uint16_t word;
+        memcpy(&word, p, sizeof(word));
+        sum += word;
+    }
+    if (len)
+    {
+        uint8_t last[2] = {*p, 0};
+        uint16_t word;
+        memcpy(&word, last, sizeof(word));
+        sum += word;
+    }
+    return sum;
+}
+
+/**
+ * @brief 折叠累加和，结果为0xffff表示校验正确
+ *
+ */
+static inline uint16_t pipeline_fold(uint32_t sum)
+{
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum += sum >> 16;
+    return sum;
+}
+
+/**
+ * @brief 以太网层
+ *
+ * @param name 生成的函数名，int name(buf_t *buf)
+ * @param proto 接收的以太网协议类型
+ * @param next 下一层，int next(buf_t *buf, uint8_t *p, int len)
+ */
+#define PIPELINE_ETHERNET(name, proto, next)                                               \
+    static inline int name(buf_t *buf)                                                      \
+    {                                                                                       \
+        if (buf->len < sizeof(ether_hdr_t) ||                                               \
+            ((ether_hdr_t *)buf->data)->protocol != swap16(proto))                         \
+            return 0;                                                                       \
+        return next(buf, buf->data + sizeof(ether_hdr_t), buf->len - sizeof(ether_hdr_t)); \
+    }
+
+/**
+ * @brief IPv4层，只接收发往local_ip、没有选项也没有分片的数据报
+ *
+ * @param name 生成的函数名，int name(buf_t *buf, uint8_t *p, int len)
+ * @param local_ip 本机ip地址，形如DRIVER_IF_IP的初始化列表
+ * @param proto 接收的上层协议号
+ * @param next 下一层，int next(buf_t *buf, ip_hdr_t *ip, uint8_t *p, int len)
+ */
+#define PIPELINE_IPV4(name, local_ip, proto, next)                                                \
+    static inline int name(buf_t *buf, uint8_t *p, int len)                                        \
+    {                                                                                              \
+        static const uint8_t local[NET_IP_LEN] = local_ip;                                         \
+        ip_hdr_t *hdr = (ip_hdr_t *)p;                                                             \
+        if (len < (int)sizeof(ip_hdr_t) || p[0] != (IP_VERSION_4 << 4 | 5) ||                    \
+            hdr->protocol != (proto) || memcmp(hdr->dest_ip, local, NET_IP_LEN) != 0 ||         \
+            (hdr->flags_fragment & swap16(0x3fff)) != 0)                                           \
+            return 0;                                                                              \
+        int total_len = swap16(hdr->total_len);                                                    \
+        if (total_len < (int)sizeof(ip_hdr_t) || total_len > len ||                                \
+            pipeline_fold(pipeline_sum16(p, sizeof(ip_hdr_t), 0)) != 0xffff)                       \
+            return 0;                                                                              \
+        return next(buf, hdr, p + sizeof(ip_hdr_t), total_len - (int)sizeof(ip_hdr_t));           \
+    }
+
+/**
+ * @brief UDP层，校验和与伪头部一起在一次累加中完成，通过后直接调用处理程序
+ *
+ * @param name 生成的函数名，int name(buf_t *buf, ip_hdr_t *ip, uint8_t *p, int len)
+ * @param port 接收的目的端口
+ * @param handler 处理程序，void handler(uint8_t *src_ip, uint16_t src_port, buf_t *buf)，
+ *                buf->data指向udp数据
+ */
+#define PIPELINE_UDP(name, port, handler)                                                       \
+    static inline int name(buf_t *buf, ip_hdr_t *ip, uint8_t *p, int len)                        \
+    {                                                                                            \
+        udp_hdr_t *hdr = (udp_hdr_t *)p;                                                         \
+        if (len < (int)sizeof(udp_hdr_t) || hdr->dest_port != swap16(port))                      \
+            return 0;                                                                            \
+        int udp_len = swap16(hdr->total_len);                                                    \
+        if (udp_len < (int)sizeof(udp_hdr_t) || udp_len > len)                                   \
+            return 0;                                                                            \
+        if (hdr->checksum != 0)                                                                  \
+        {                                                                                        \
+            uint32_t sum = pipeline_sum16(ip->src_ip, 2 * NET_IP_LEN, 0) +                       \
+                           swap16(NET_PROTOCOL_UDP) + hdr->total_len;                            \
+            if (pipeline_fold(pipeline_sum16(p, udp_len, sum)) != 0xffff)                        \
+                return 0;                                                                        \
+        }                                                                                        \
+        buf->data = p + sizeof(udp_hdr_t);                                                       \
+        buf->len = udp_len - sizeof(udp_hdr_t);                                                  \
+        handler(ip->src_ip, swap16(hdr->src_port), buf);                                         \
+        return 1;                                                                                \
+    }
+#endif
@@ -0,0 +1,130 @@
+#ifndef RING_H
+#define RING_H
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+/**
+ * @brief 单生产者单消费者的无锁环形队列，保存指针
+ *        生产者只写tail，消费者只写head，两者放在不同的缓存行上，
+ *        生产者先写槽位再以release语义发布tail，消费者以acquire语义读取tail后再读槽位，
+ *        不需要锁，也不需要原子读改写指令。
+ *        同一时刻只能有一个线程入队、一个线程出队。
+ *
+ */
+typedef struct ring
+{
+    _Atomic uint32_t head __attribute__((aligned(64))); //下一个出队的位置，只由消费者修改
+    _Atomic uint32_t tail __attribute__((aligned(64))); //下一个入队的位置，只由生产者修改
+    uint32_t mask __attribute__((aligned(64)));         //容量减1
+    void **slots;                                       //槽位
+} ring_t;
+
+/**
+ * @brief 初始化环形队列
+ *
+ * @param r 环形队列
+ * @param size 容量，须为2的幂
+ * @return int 成功为0，容量不是2的幂或内存不足为-1
+ */
+static inline int ring_init(ring_t *r, uint32_t size)
+{
+    if (size == 0 || (size & (size - 1)) != 0)
+        return -1;
+    r->slots = calloc(size, sizeof(void *));
+    if (r->slots == NULL)
+        return -1;
+    r->mask = size - 1;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    return 0;
+}
+
+/**
+ * @brief 释放环形队列的槽位，队列中剩余的指针由调用者处理
+ *
+ * @param r 环形队列
+ */
+static inline void ring_free(ring_t *r)
+{
+    free(r->slots);
+    r->slots = NULL;
+}
+
+/**
+ * @brief 批量入队，只能由生产者调用
+ *
+ * @param r 环形队列
+ * @param objs 要入队的指针
+ * @param n 个数
+ * @return int 实际入队的个数，队列满时少于n
+ */
+static inline int ring_enqueue_burst(ring_t *r, void *const *objs, int n)
+{
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    uint32_t free_slots = r->mask + 1 - (tail - head);
+    if ((uint32_t)n > free_slots)
+        n = free_slots;
+    for (int i = 0; i < n; i++)
+        r->slots[(tail + i) & r->mask] = objs[i];
+    atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+    return n;
+}
+
+/**
+ * @brief 入队一个指针，只能由生产者调用
+ *
+ * @param r 环形队列
+ * @param obj 要入队的指针
+ * @return int 成功为0，队列满为-1
+ */
+static inline int ring_enqueue(ring_t *r, void *obj)
+{
+    return ring_enqueue_burst(r, &obj, 1) == 1 ? 0 : -1;
+}
+
+/**
+ * @brief 批量出队，只能由消费者调用
+ *
+ * @param r 环形队列
+ * @param objs 保存出队的指针
+ * @param n 最多出队的个数
+ * @return int 实际出队的个数，队列空时为0
+ */
+static inline int ring_dequeue_burst(ring_t *r, void **objs, int n)
+{
+    uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    uint32_t count = tail - head;
+    if ((uint32_t)n > count)
+        n = count;
+    for (int i = 0; i < n; i++)
+        objs[i] = r->slots[(head + i) & r->mask];
+    atomic_store_explicit(&r->head, head + n, memory_order_release);
+    return n;
+}
+
+/**
+ * @brief 出队一个指针，只能由消费者调用
+ *
+ * @param r 环形队列
+ * @return void* 出队的指针，队列空时为NULL
+ */
+static inline void *ring_dequeue(ring_t *r)
+{
+    void *obj;
+    return ring_dequeue_burst(r, &obj, 1) == 1 ? obj : NULL;
+}
+
+/**
+ * @brief 队列中的元素个数，其他线程同时入队或出队时只是一个近似值
+ *
+ * @param r 环形队列
+ * @return uint32_t 元素个数
+ */
+static inline uint32_t ring_count(ring_t *r)
+{
+    return atomic_load_explicit(&r->tail, memory_order_acquire) - atomic_load_explicit(&r->head, memory_order_acquire);
+}
+#endif
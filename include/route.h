@@ -0,0 +1,56 @@
+#ifndef ROUTE_H
+#define ROUTE_H
+#include <stdint.h>
+#include "config.h"
+#include "net.h"
+
+#define ROUTE_TBL24_SIZE (1 << 24)     //tbl24表项数，以目的ip的高24位为索引
+#define ROUTE_TBL8_GROUP_SIZE (1 << 8) //每个tbl8组的表项数，以目的ip的低8位为索引
+
+typedef struct route_entry
+{
+    int valid;                   //有效位
+    int direct;                  //是否为直连路由（网关为0.0.0.0）
+    uint8_t net[NET_IP_LEN];     //网络号
+    uint8_t prefix_len;          //前缀长度
+    uint8_t gateway[NET_IP_LEN]; //下一跳网关
+    int ifindex;                 //出口网卡
+} route_entry_t;
+
+/**
+ * @brief 初始化路由表，添加默认网关
+ *        各网卡子网的直连路由在为网卡添加地址时由netif添加
+ *
+ */
+void route_init();
+
+/**
+ * @brief 添加一条路由，已存在相同前缀时更新其网关
+ *
+ * @param net 网络号
+ * @param prefix_len 前缀长度，0表示默认路由
+ * @param gateway 下一跳网关，全0表示直连
+ * @param ifindex 出口网卡
+ * @return int 成功为0，失败为-1
+ */
+int route_add(uint8_t *net, int prefix_len, uint8_t *gateway, int ifindex);
+
+/**
+ * @brief 删除一条路由
+ *
+ * @param net 网络号
+ * @param prefix_len 前缀长度
+ * @return int 成功为0，未找到为-1
+ */
+int route_del(uint8_t *net, int prefix_len);
+
+/**
+ * @brief 最长前缀匹配查找下一跳
+ *        没有匹配的路由且没有默认路由时，认为目的地址直连于0号网卡
+ *
+ * @param ip 目的ip地址
+ * @param ifindex 输出出口网卡，可以为NULL
+ * @return uint8_t* 下一跳ip地址
+ */
+uint8_t *route_lookup(uint8_t *ip, int *ifindex);
+#endif
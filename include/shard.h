@@ -0,0 +1,80 @@
+#ifndef SHARD_H
+#define SHARD_H
+#include <stdint.h>
+#include "net.h"
+
+/**
+ * @brief 分片模式：把协议栈按流分到多个工作线程
+ *        每个工作线程使用net_shard_start()为它在堆上分配的协议栈实例（见stack.h），
+ *        调用net_shard_poll()的线程作为分发线程，从各网卡接收数据帧，
+ *        ip数据帧按（源ip、目的ip、协议、源端口、目的端口）哈希到工作线程，同一条流总在同一个线程中按序处理；
+ *        哈希与方向无关，工作线程主动发起的流（udp请求、tcp_connect()）的应答也回到该线程；
+ *        分片的ip数据报只按地址与协议哈希，使同一数据报的各分片到达同一线程；
+ *        arp数据帧复制给每个工作线程以更新各自的arp表，只有0号工作线程应答arp请求；其他数据帧交给0号工作线程。
+ *        工作线程直接调用驱动发送。
+ *
+ */
+
+/**
+ * @brief 工作线程的初始化函数，在该线程的协议栈初始化之后、开始处理数据帧之前调用
+ *        udp端口等协议栈状态是每个线程一份的，应用须在此为每个工作线程打开端口
+ *
+ * @param shard 工作线程序号
+ * @param arg net_shard_start()的参数
+ */
+typedef void (*net_shard_init_t)(int shard, void *arg);
+
+typedef struct net_shard_stats
+{
+    uint64_t dispatched; //分发给该线程的数据帧数
+    uint64_t dropped;    //接收队列满而丢弃的数据帧数
+    uint64_t processed;  //该线程处理完的数据帧数
+} net_shard_stats_t;
+
+/**
+ * @brief 启动工作线程，须在net_init()之后调用，返回前所有工作线程都已完成初始化
+ *
+ * @param count 工作线程数，不超过NET_SHARD_MAX
+ * @param init 工作线程的初始化函数，可以为NULL
+ * @param arg 初始化函数的参数
+ * @return int 成功为0，失败为-1
+ */
+int net_shard_start(int count, net_shard_init_t init, void *arg);
+
+/**
+ * @brief 一次分发：每个网卡最多接收ETHERNET_RX_BURST个数据帧并分给工作线程
+ *
+ * @return int 接收到的数据帧数
+ */
+int net_shard_poll();
+
+/**
+ * @brief 停止并等待所有工作线程退出，丢弃尚未处理的数据帧
+ *
+ */
+void net_shard_stop();
+
+/**
+ * @brief 当前线程的工作线程序号
+ *
+ * @return int 序号，不是工作线程时为-1
+ */
+int net_shard_self();
+
+/**
+ * @brief 计算数据帧的流哈希，非ip数据帧为0，交换两端的地址与端口后哈希值不变
+ *
+ * @param frame 以太网数据帧
+ * @param len 数据帧长度
+ * @return uint32_t 哈希值
+ */
+uint32_t net_shard_hash(const uint8_t *frame, int len);
+
+/**
+ * @brief 获取工作线程的计数，可以在任何线程中调用
+ *
+ * @param shard 工作线程序号
+ * @param stats 保存计数
+ */
+void net_shard_get_stats(int shard, net_shard_stats_t *stats);
+#endif
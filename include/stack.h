@@ -0,0 +1,151 @@
+#ifndef STACK_H
+#define STACK_H
+#include <stdint.h>
+#include "utils.h"
+#include "timer.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "icmp.h"
+#include "udp.h"
+#include "tcp.h"
+#include "stats.h"
+#include "drop.h"
+
+/**
+ * @brief 协议栈实例：arp表、udp表、tcp连接、定时器、批量发送队列、各类缓存、计数、丢弃日志与收发缓冲区
+ *        实例按缓存行对齐，不同线程的实例（包括各层的计数）不会共享缓存行；
+ *        一个进程中可以有多个互不共享的实例，例如每个核或每个网卡一个，各自轮询、互不加锁；
+ *        路由表、网卡表、驱动与各项配置在实例间共享。
+ *        各层的函数作用于本线程当前绑定的实例（见net_stack_bind()），没有绑定时是本线程的默认实例，
+ *        net_init()、net_poll()等原有接口使用的就是默认实例；
+ *        轮询与收包的入口另有显式传入实例的形式（如net_stack_poll()、ethernet_in_stack()），原有接口只是它们的包装。
+ *        实例有数MB，不放在线程局部存储中：默认实例在本线程第一次使用时才在堆上分配，线程中只保存指针，
+ *        不使用协议栈的线程不占用内存。默认实例开始时全为0，与原来的静态状态一样由net_init()或各层的初始化函数初始化。
+ *
+ */
+struct net_stack
+{
+    uint32_t ifmask; //本实例轮询的网卡，第i位对应ifindex为i的网卡，0表示全部
+    timer_ctx_t timer;
+    ethernet_ctx_t ethernet;
+    arp_ctx_t arp;
+    ip_ctx_t ip;
+    icmp_ctx_t icmp;
+    udp_ctx_t udp;
+    tcp_ctx_t tcp;
+    net_drop_ctx_t drop;
+    net_stats_ctx_t stats;
+} __attribute__((aligned(64)));
+
+extern NET_LOCAL net_stack_t *net_stack_local;  //本线程的默认实例，第一次使用时在堆上分配
+extern NET_LOCAL net_stack_t *net_stack_active; //本线程当前绑定的实例，NULL表示默认实例
+
+/**
+ * @brief 在堆上分配本线程的默认协议栈实例，内存不足时终止进程
+ *
+ * @return net_stack_t* 实例
+ */
+net_stack_t *net_stack_local_new();
+
+/**
+ * @brief 获取本线程的默认协议栈实例，第一次调用时分配
+ *
+ * @return net_stack_t* 实例
+ */
+static inline net_stack_t *net_stack_default()
+{
+    net_stack_t *stack = net_stack_local;
+    return stack != NULL ? stack : net_stack_local_new();
+}
+
+/**
+ * @brief 获取本线程当前绑定的协议栈实例
+ *
+ * @return net_stack_t* 实例
+ */
+static inline net_stack_t *net_stack_current()
+{
+    net_stack_t *stack = net_stack_active;
+    return stack != NULL ? stack : net_stack_default();
+}
+
+/**
+ * @brief 丢弃一个不在buf_t中的数据帧，如批量发送队列中的数据帧，计数与采样同net_drop()
+ *
+ * @param reason 丢弃原因
+ * @param ifindex 收到或将要发送数据帧的网卡
+ * @param data 数据帧
+ * @param len 数据帧长度
+ */
+static inline void net_drop_frame(net_drop_reason_t reason, int ifindex, const uint8_t *data, uint16_t len)
+{
+    net_drop_ctx_t *ctx = &net_stack_current()->drop;
+    if ((ctx->counts[reason]++ & (NET_DROP_SAMPLE_EVERY - 1)) == 0)
+        net_drop_log(reason, ifindex, data, len);
+}
+
+/**
+ * @brief 丢弃一个数据包：按原因计数，每种原因每NET_DROP_SAMPLE_EVERY次写一次丢弃日志
+ *        不采样时只有一次加法与一次判断
+ *
+ * @param reason 丢弃原因
+ * @param buf 数据包，data指向丢弃它的那一层的头部
+ */
+static inline void net_drop(net_drop_reason_t reason, const buf_t *buf)
+{
+    net_drop_frame(reason, buf->ifindex, buf->data, buf->len);
+}
+
+/**
+ * @brief 判断网卡是否由协议栈实例负责，实例只轮询、只宣告它负责的网卡
+ *
+ * @param stack 实例
+ * @param ifindex 网卡索引
+ * @return int 负责为1
+ */
+static inline int net_stack_owns(const net_stack_t *stack, int ifindex)
+{
+    return stack->ifmask == 0 || (stack->ifmask >> ifindex & 1);
+}
+
+/**
+ * @brief 把一个协议栈实例绑定到本线程，之后各层的函数都作用于它
+ *
+ * @param stack 实例，为NULL时恢复本线程的默认实例
+ * @return net_stack_t* 之前绑定的实例，为NULL表示默认实例，用于恢复
+ */
+net_stack_t *net_stack_bind(net_stack_t *stack);
+
+/**
+ * @brief 创建一个协议栈实例，之后须调用net_stack_init()
+ *
+ * @param ifmask 实例轮询的网卡，第i位对应ifindex为i的网卡，0表示全部
+ * @return net_stack_t* 实例，内存不足时为NULL
+ */
+net_stack_t *net_stack_new(uint32_t ifmask);
+
+/**
+ * @brief 释放一个协议栈实例，它的连接、端口与定时器一并丢弃，不向对端发送任何报文
+ *        不能释放本线程当前绑定的实例
+ *
+ * @param stack 实例
+ */
+void net_stack_free(net_stack_t *stack);
+
+/**
+ * @brief 初始化一个协议栈实例（定时器、以太网、arp、udp、tcp、计数导出），路由表与网卡表须已由net_init()初始化
+ *        是net_init_thread()的显式形式
+ *
+ * @param stack 实例
+ */
+void net_stack_init(net_stack_t *stack);
+
+/**
+ * @brief 一次协议栈实例的轮询，只接收它负责的网卡，是net_poll()的显式形式
+ *        轮询期间实例绑定到本线程，收发处理程序、定时器中调用的各层函数都作用于它
+ *
+ * @param stack 实例
+ */
+void net_stack_poll(net_stack_t *stack);
+#endif
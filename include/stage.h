@@ -0,0 +1,85 @@
+#ifndef STAGE_H
+#define STAGE_H
+#include <stdint.h>
+#include "net.h"
+
+/**
+ * @brief 流水线模式：把接收、协议处理与发送分到不同的线程，各阶段之间以无锁队列传递缓冲区指针
+ *        接收线程从各网卡批量接收数据帧，直接收进缓冲区池中的buf_t，再把指针交给协议线程；
+ *        协议线程（一个或多个）调用ethernet_in()处理，每个协议线程拥有一个在堆上分配的协议栈实例（见stack.h），
+ *        与分片模式一样按net_shard_hash()分流、复制arp数据帧、只由0号协议线程应答arp请求；
+ *        协议线程发出的数据帧经以太网发送钩子放入发送队列，由发送线程批量交给驱动。
+ *        接收线程与发送线程是唯一调用驱动的线程，协议线程不进入系统调用。
+ *
+ *        每个协议线程有四个单生产者单消费者队列：接收队列与其归还队列、发送队列与其归还队列，
+ *        发送线程轮询所有协议线程的发送队列，相当于一个多生产者单消费者队列。
+ *
+ */
+
+/**
+ * @brief 协议线程的初始化函数，在该线程的协议栈初始化之后、开始处理数据帧之前调用
+ *        udp端口等协议栈状态是每个线程一份的，应用须在此为每个协议线程打开端口
+ *
+ * @param index 协议线程序号
+ * @param arg net_stage_start()的参数
+ */
+typedef void (*net_stage_init_t)(int index, void *arg);
+
+typedef enum net_stage_kind
+{
+    NET_STAGE_RX,    //接收线程
+    NET_STAGE_PROTO, //协议线程
+    NET_STAGE_TX,    //发送线程
+} net_stage_kind_t;
+
+/**
+ * @brief 一个阶段的计数
+ *        占用为每次轮询时输入队列长度之和，除以轮询次数即平均占用，接收线程的输入是驱动，占用总为0；
+ *        受阻为输出队列满或没有空闲缓冲区的次数，接收线程没有空闲缓冲区时暂停接收，其他情况丢弃数据帧。
+ *        占用高的阶段是瓶颈，受阻多的阶段的下游是瓶颈。
+ *
+ */
+typedef struct net_stage_stats
+{
+    uint64_t packets;   //处理的数据帧数
+    uint64_t dropped;   //丢弃的数据帧数
+    uint64_t stalls;    //受阻次数
+    uint64_t polls;     //轮询次数
+    uint64_t idle;      //没有取到数据帧的轮询次数
+    uint64_t occupancy; //输入队列长度之和
+    uint32_t queued;    //当前输入队列长度
+} net_stage_stats_t;
+
+/**
+ * @brief 启动接收、协议与发送线程，须在net_init()之后调用，返回前所有协议线程都已完成初始化
+ *        之后调用者不应再调用net_poll()
+ *
+ * @param count 协议线程数，不超过NET_STAGE_MAX
+ * @param init 协议线程的初始化函数，可以为NULL
+ * @param arg 初始化函数的参数
+ * @return int 成功为0，失败为-1
+ */
+int net_stage_start(int count, net_stage_init_t init, void *arg);
+
+/**
+ * @brief 停止并等待所有线程退出，丢弃队列中的数据帧
+ *
+ */
+void net_stage_stop();
+
+/**
+ * @brief 当前线程的协议线程序号
+ *
+ * @return int 序号，不是协议线程时为-1
+ */
+int net_stage_self();
+
+/**
+ * @brief 获取一个阶段的计数，可以在任何线程中调用
+ *
+ * @param kind 阶段
+ * @param index 协议线程序号，接收与发送线程忽略
+ * @param stats 保存计数
+ */
+void net_stage_get_stats(net_stage_kind_t kind, int index, net_stage_stats_t *stats);
+#endif
@@ -0,0 +1,146 @@
+#ifndef STATS_H
+#define STATS_H
+#include <stdint.h>
+#include <stdatomic.h>
+#include "config.h"
+#include "net.h"
+#include "timer.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "drop.h"
+
+#define NET_STATS_MAGIC 0x4e455453     //"NETS"
+#define NET_STATS_VERSION 4            //共享内存布局的版本，布局改变时加1
+#define NET_STATS_SHM_NAME "/net_stats" //默认的共享内存名称
+
+/**
+ * @brief 一个以太网协议的收发计数
+ *
+ */
+typedef struct net_stats_ethertype
+{
+    uint16_t protocol;       //以太网协议类型，0表示所有未注册的协议
+    net_proto_stats_t stats; //收发计数
+} net_stats_ethertype_t;
+
+/**
+ * @brief 一个已打开udp端口的收发计数
+ *
+ */
+typedef struct net_stats_port
+{
+    uint16_t port;           //端口号
+    net_proto_stats_t stats; //收发计数
+} net_stats_port_t;
+
+/**
+ * @brief 共享内存中一个协议栈实例的计数，每个槽独占整数个缓存行
+ *        只由占用它的实例所在的线程写入：写入前后各把seq加1，读者读到相同的偶数seq时内容一致，
+ *        写者不等待读者，读者不加锁
+ *
+ */
+typedef struct net_stats_slot
+{
+    _Atomic uint64_t seq;                                        //发布序号，写入期间为奇数
+    _Atomic uint32_t active;                                     //是否被一个实例占用
+    int32_t tid;                                                 //最近一次发布的线程号
+    int32_t cpu;                                                 //最近一次发布时所在的cpu
+    uint32_t ifmask;                                             //实例负责的网卡，0表示全部
+    uint64_t publish_ms;                                         //最近一次发布的时间（单调时钟）
+    uint32_t ethertype_count;                                    //ethertypes中的协议数
+    uint32_t udp_port_count;                                     //udp_ports中的端口数
+    net_stats_ethertype_t ethertypes[ETHERNET_PROTO_TABLE_SIZE]; //各以太网协议的收发计数
+    net_proto_stats_t ip[256];                                   //以ip协议号索引的收发计数
+    net_stats_port_t udp_ports[NET_STATS_UDP_PORTS];             //已打开udp端口的收发计数
+    arp_stats_t arp;                                             //arp表的查找与替换计数
+    ethernet_driver_stats_t driver;                              //驱动收发出错的计数
+    uint64_t drops[NET_DROP_REASON_COUNT];                       //以丢弃原因索引的丢弃数
+    uint64_t drop_logged;                                        //写入过丢弃日志的样本数
+    net_drop_sample_t drop_log[NET_DROP_LOG_SIZE];               //丢弃日志，样本i在drop_log[i % NET_DROP_LOG_SIZE]
+} __attribute__((aligned(64))) net_stats_slot_t;
+
+/**
+ * @brief 导出计数的共享内存，布局由magic、version与slot_size标识，读者发现不一致时拒绝读取
+ *
+ */
+typedef struct net_stats_shm
+{
+    uint32_t magic;              //NET_STATS_MAGIC，初始化完成后才写入
+    uint32_t version;            //NET_STATS_VERSION
+    uint32_t slot_size;          //sizeof(net_stats_slot_t)
+    uint32_t slot_count;         //槽数
+    _Atomic uint32_t slots_used; //曾被占用过的槽数，读者只需检查前slots_used个槽
+    int32_t pid;                 //导出计数的进程
+    net_stats_slot_t slots[];    //各实例的计数
+} net_stats_shm_t;
+
+/**
+ * @brief 计数导出的状态，每个协议栈实例一份（见stack.h）
+ *        计数本身留在各层的状态中，由datapath直接累加；发布定时器定期把它们拷贝到共享内存中本实例的槽
+ *
+ */
+typedef struct net_stats_ctx
+{
+    net_timer_t timer;      //发布定时器
+    net_stats_slot_t *slot; //占用的槽，还没有发布过时为NULL
+} net_stats_ctx_t;
+
+/**
+ * @brief 创建共享内存并开始导出本进程所有协议栈实例的计数，同名的旧共享内存被清空
+ *        之后各实例在下一次发布时各自占用一个槽
+ *
+ * @param name 共享内存名称，以'/'开头，如NET_STATS_SHM_NAME
+ * @return int 成功为0，失败或已经导出为-1
+ */
+int net_stats_export(const char *name);
+
+/**
+ * @brief 初始化当前协议栈实例的计数导出，启动发布定时器，须在timer_init()之后调用
+ *
+ */
+void net_stats_init();
+
+/**
+ * @brief 停止当前协议栈实例的计数导出并释放它占用的槽
+ *
+ */
+void net_stats_release();
+
+/**
+ * @brief 立即把当前协议栈实例的计数发布到共享内存，没有导出时不做处理
+ *
+ */
+void net_stats_publish();
+
+/**
+ * @brief 把当前协议栈实例的计数拷贝到一个槽中，不修改槽的seq与active
+ *
+ * @param slot 槽
+ */
+void net_stats_collect(net_stats_slot_t *slot);
+
+/**
+ * @brief 以只读方式打开另一个进程导出的计数
+ *
+ * @param name 共享内存名称
+ * @return const net_stats_shm_t* 共享内存，不存在、还没有初始化完成或布局不一致时为NULL
+ */
+const net_stats_shm_t *net_stats_attach(const char *name);
+
+/**
+ * @brief 关闭net_stats_attach()打开的共享内存
+ *
+ * @param shm 共享内存
+ */
+void net_stats_detach(const net_stats_shm_t *shm);
+
+/**
+ * @brief 读取一个槽的一致快照
+ *
+ * @param shm 共享内存
+ * @param index 槽号，小于slots_used
+ * @param slot 保存快照
+ * @return int 槽被实例占用为0，空闲或写者长时间没有完成写入为-1
+ */
+int net_stats_read(const net_stats_shm_t *shm, int index, net_stats_slot_t *slot);
+#endif
@@ -0,0 +1,366 @@
+#ifndef TCP_H
+#define TCP_H
+#include <stdint.h>
+#include "net.h"
+#include "utils.h"
+#include "timer.h"
+#include "ethernet.h"
+#include "ip.h"
+#pragma pack(1)
+typedef struct tcp_hdr
+{
+    uint16_t src_port;  // 源端口
+    uint16_t dest_port; // 目标端口
+    uint32_t seq;       // 序号
+    uint32_t ack;       // 确认号
+    uint8_t reserved : 4;
+    uint8_t hdr_len : 4; // 首部长, 4字节为单位
+    uint8_t flags;       // 标志
+    uint16_t window;     // 窗口
+    uint16_t checksum;   // 校验和
+    uint16_t urgent;     // 紧急指针
+} tcp_hdr_t;
+#pragma pack()
+
+#define TCP_FIN 0x01
+#define TCP_SYN 0x02
+#define TCP_RST 0x04
+#define TCP_PSH 0x08
+#define TCP_ACK 0x10
+#define TCP_URG 0x20
+
+/**
+ * @brief 以tcp头部解释数据包，首部长度小于20字节或超出数据包时为NULL
+ *
+ * @param buf 数据包，data指向tcp头部
+ * @return tcp_hdr_t* tcp头部
+ */
+static inline tcp_hdr_t *tcp_hdr_of(buf_t *buf)
+{
+    tcp_hdr_t *hdr = (tcp_hdr_t *)buf->data;
+    if (buf->len < sizeof(tcp_hdr_t) || hdr->hdr_len < 5 || hdr->hdr_len * 4 > buf->len)
+        return NULL;
+    return hdr;
+}
+
+typedef enum tcp_state
+{
+    TCP_CLOSED,
+    TCP_SYN_SENT,
+    TCP_SYN_RCVD,
+    TCP_ESTABLISHED,
+    TCP_FIN_WAIT_1,
+    TCP_FIN_WAIT_2,
+    TCP_CLOSE_WAIT,
+    TCP_CLOSING,
+    TCP_LAST_ACK,
+    TCP_TIME_WAIT,
+} tcp_state_t;
+
+/**
+ * @brief 连接上发生的事件
+ *        TCP_EVENT_CLOSED之后连接被释放，处理程序返回后不能再使用
+ *
+ */
+typedef enum tcp_event
+{
+    TCP_EVENT_CONNECTED, //三次握手完成，主动与被动打开都会产生
+    TCP_EVENT_RECV,      //接收缓冲区中有新的数据
+    TCP_EVENT_SENT,      //对端确认了数据，发送缓冲区有了空间
+    TCP_EVENT_FIN,       //对端关闭了发送方向，之后不会再有数据
+    TCP_EVENT_CLOSED,    //连接结束：正常关闭完成、被复位或超时放弃
+} tcp_event_t;
+
+typedef struct tcp_conn tcp_conn_t;
+typedef void (*tcp_handler_t)(tcp_conn_t *conn, tcp_event_t event, void *arg);
+
+/**
+ * @brief 字节环形缓冲区，大小为2的幂，head与tail是不回绕的字节计数
+ *        发送缓冲区中[head, tail)是未被确认的数据，接收缓冲区中[head, tail)是按序到达、应用尚未读取的数据
+ *
+ */
+typedef struct tcp_ring
+{
+    uint8_t *data;
+    uint32_t size;
+    uint32_t head, tail;
+} tcp_ring_t;
+
+/**
+ * @brief 序号区间[start, end)，用于乱序数据块与对端的SACK块
+ *
+ */
+typedef struct tcp_block
+{
+    uint32_t start, end;
+} tcp_block_t;
+
+/**
+ * @brief tcp连接，序号都是绝对序号，比较时按32位回绕处理
+ *
+ */
+struct tcp_conn
+{
+    tcp_state_t state;
+    uint8_t local_ip[NET_IP_LEN];
+    uint8_t remote_ip[NET_IP_LEN];
+    uint16_t local_port;
+    uint16_t remote_port;
+    tcp_conn_t *hash_next; //连接哈希表中的下一个
+    tcp_conn_t *dirty_next; //待输出链表中的下一个
+    int dirty;              //是否在待输出链表中
+    tcp_handler_t handler;
+    void *arg;
+
+    //发送
+    uint32_t iss;         //初始发送序号，数据从iss + 1开始
+    uint32_t snd_una;     //最早的未确认序号
+    uint32_t snd_nxt;     //下一个要发送的序号，超时后退回snd_una
+    uint32_t snd_max;     //发送过的最大序号
+    uint32_t snd_wnd;     //对端通告的窗口（已按窗口扩大因子换算）
+    uint32_t snd_wl1, snd_wl2; //上次更新窗口的报文段的序号与确认号
+    uint8_t snd_wscale;   //对端的窗口扩大因子
+    uint16_t mss;         //发送的最大报文段长度
+    uint32_t cwnd;        //拥塞窗口（字节）
+    uint32_t ssthresh;    //慢启动阈值（字节）
+    uint32_t cwnd_acked;  //拥塞避免阶段累计确认的字节
+    int dupacks;          //连续重复确认数
+    int in_recovery;      //是否处于快速恢复
+    uint32_t recover;     //进入快速恢复时的snd_max，确认到它时退出
+    uint32_t rtx_next;    //快速恢复中下一个要重传的空洞的起点
+    tcp_block_t sacked[TCP_SACK_MAX_BLOCKS]; //对端SACK确认的块，按序号排列，不重叠
+    int sacked_count;
+    int fin_queued;       //应用已关闭发送方向，数据发完后发送FIN
+    int nodelay;          //是否关闭Nagle算法
+    int probe;            //零窗口探测到期，下一次输出发送一个字节
+    tcp_ring_t snd;
+
+    //接收
+    uint32_t irs;         //对端的初始序号
+    uint32_t rcv_nxt;     //期望收到的下一个序号
+    uint32_t rcv_adv;     //已通告的窗口右边沿
+    uint8_t rcv_wscale;   //本端的窗口扩大因子
+    int sack_ok;          //双方都支持SACK
+    int wscale_ok;        //双方都支持窗口扩大
+    tcp_block_t ooo[TCP_SACK_MAX_BLOCKS]; //已收到的乱序数据块，按序号排列，不重叠
+    int ooo_count;
+    int ooo_last;         //最近一次收到的乱序数据所在的块，SACK选项中第一个报告
+    int fin_received;     //FIN已按序收到
+    int fin_pending;      //FIN先于之前的数据到达
+    uint32_t fin_seq;     //先到的FIN的序号
+    int unacked_segs;     //收到后尚未确认的报文段数
+    int ack_now;          //需要立即发送的确认数，每个乱序报文段一个
+    tcp_ring_t rcv;
+
+    //计时
+    uint32_t rto;         //重传超时（毫秒）
+    uint32_t srtt, rttvar; //平滑的往返时间与方差（毫秒，乘以8与4）
+    uint32_t rtt_seq;     //正在计时的报文段的结束序号
+    uint64_t rtt_start;   //它的发送时间，0表示没有在计时
+    int retries;          //连续超时次数
+    net_timer_t rtx_timer;    //重传、零窗口探测、SYN重传与TIME_WAIT
+    net_timer_t delack_timer; //延迟确认
+};
+
+/**
+ * @brief 一个协议栈实例的tcp计数
+ *
+ */
+typedef struct tcp_stats
+{
+    uint64_t active_opens;    //主动打开的连接数
+    uint64_t passive_opens;   //被动打开的连接数
+    uint64_t segs_in;         //收到的报文段数
+    uint64_t segs_out;        //发送的报文段数
+    uint64_t retrans_segs;    //重传的报文段数
+    uint64_t fast_retrans;    //进入快速恢复的次数
+    uint64_t timeouts;        //重传超时次数
+    uint64_t predicted_acks;  //首部预测命中的纯确认
+    uint64_t predicted_data;  //首部预测命中的按序数据
+    uint64_t ooo_segs;        //收到的乱序报文段数
+    uint64_t acks_out;        //发送的纯确认数
+    uint64_t delayed_acks;    //延迟确认定时器到期发送的确认数
+    uint64_t resets_in;       //收到的复位数
+    uint64_t resets_out;      //发送的复位数
+    uint64_t bad_segs;        //校验和错误或格式错误的报文段数
+} tcp_stats_t;
+
+typedef struct tcp_listener
+{
+    int valid;             //有效位
+    uint16_t port;         //端口号
+    tcp_handler_t handler; //新连接的处理程序
+    void *arg;             //处理程序参数
+} tcp_listener_t;
+
+#define TCP_TMPL_LEN (sizeof(ether_hdr_t) + sizeof(ip_hdr_t))
+
+/**
+ * @brief tcp的状态，每个协议栈实例一份（见stack.h），连接属于创建它的实例
+ *
+ */
+typedef struct tcp_ctx
+{
+    tcp_conn_t *conn_hash[TCP_CONN_HASH_SIZE]; //连接哈希表
+    tcp_conn_t *dirty_head, *dirty_tail;       //待输出链表
+    int conns;                                 //连接数
+    tcp_listener_t listeners[TCP_MAX_LISTEN];  //监听的端口
+    tcp_stats_t stats;                         //计数
+    uint32_t next_port;                        //下一个尝试的临时端口
+    uint32_t iss_seed;                         //初始序号的种子
+    uint8_t tmpl[TCP_TMPL_LEN];                //本次输出的以太网与ip头部模板，ip总长度与校验和为0
+    uint32_t tmpl_sum;                         //模板ip头部的累加和
+    int tmpl_ifindex;                          //模板的出口网卡
+    tcp_conn_t *tmpl_conn;                     //模板所属的连接，为NULL时经ip_out_from()发送
+    buf_t txbuf;                               //没有模板时构造报文段
+} tcp_ctx_t;
+
+/**
+ * @brief 初始化当前协议栈实例的tcp协议，释放它的所有连接，并向ip层注册
+ *
+ */
+void tcp_init();
+
+/**
+ * @brief 处理一个收到的tcp报文段
+ *
+ * @param buf 要处理的包，data指向tcp头部
+ * @param src_ip 源ip地址
+ * @param dest_ip 目的ip地址
+ */
+void tcp_in(buf_t *buf, uint8_t *src_ip, uint8_t *dest_ip);
+
+/**
+ * @brief 输出当前协议栈实例所有有待发送数据或确认的连接，并释放已结束的连接
+ *        由net_poll()在每次轮询末尾调用
+ *
+ */
+void tcp_flush();
+
+/**
+ * @brief 输出指定协议栈实例所有有待发送数据或确认的连接，期间实例绑定到本线程
+ *
+ * @param stack 实例
+ */
+void tcp_flush_stack(net_stack_t *stack);
+
+/**
+ * @brief 监听一个端口，新连接的事件交给handler
+ *
+ * @param port 端口号
+ * @param handler 处理程序
+ * @param arg 处理程序参数
+ * @return int 成功为0，已监听或监听数已达TCP_MAX_LISTEN为-1
+ */
+int tcp_listen(uint16_t port, tcp_handler_t handler, void *arg);
+
+/**
+ * @brief 停止监听一个端口，已建立的连接不受影响
+ *
+ * @param port 端口号
+ */
+void tcp_unlisten(uint16_t port);
+
+/**
+ * @brief 主动打开一个连接，SYN在下一次tcp_flush()时发出
+ *
+ * @param dest_ip 目的ip地址
+ * @param dest_port 目的端口号
+ * @param src_port 源端口号，0表示自动选择
+ * @param handler 处理程序
+ * @param arg 处理程序参数
+ * @return tcp_conn_t* 连接，没有可用的源地址、端口或连接数已达TCP_MAX_CONN时为NULL
+ */
+tcp_conn_t *tcp_connect(uint8_t *dest_ip, uint16_t dest_port, uint16_t src_port, tcp_handler_t handler, void *arg);
+
+/**
+ * @brief 获取发送缓冲区中可直接写入的连续空间，写入后调用tcp_send_commit()
+ *
+ * @param conn 连接
+ * @param len 可写入的字节数
+ * @return uint8_t* 可写入的位置
+ */
+uint8_t *tcp_send_buf(tcp_conn_t *conn, int *len);
+
+/**
+ * @brief 提交tcp_send_buf()中写入的数据，在下一次tcp_flush()时发送
+ *
+ * @param conn 连接
+ * @param len 写入的字节数
+ */
+void tcp_send_commit(tcp_conn_t *conn, int len);
+
+/**
+ * @brief 把数据拷贝进发送缓冲区
+ *
+ * @param conn 连接
+ * @param data 数据
+ * @param len 数据长度
+ * @return int 放入的字节数，缓冲区满时可能少于len；连接不能再发送时为-1
+ */
+int tcp_send(tcp_conn_t *conn, const void *data, int len);
+
+/**
+ * @brief 获取接收缓冲区中可直接读取的连续数据，读完后调用tcp_recv_consume()
+ *
+ * @param conn 连接
+ * @param len 可读取的字节数
+ * @return uint8_t* 数据
+ */
+uint8_t *tcp_recv_buf(tcp_conn_t *conn, int *len);
+
+/**
+ * @brief 释放接收缓冲区中已读取的数据，窗口明显增大时通告对端
+ *
+ * @param conn 连接
+ * @param len 读取的字节数
+ */
+void tcp_recv_consume(tcp_conn_t *conn, int len);
+
+/**
+ * @brief 从接收缓冲区拷贝出数据
+ *
+ * @param conn 连接
+ * @param data 存放数据的位置
+ * @param len 最多读取的字节数
+ * @return int 读取的字节数
+ */
+int tcp_recv(tcp_conn_t *conn, void *data, int len);
+
+/**
+ * @brief 关闭发送方向，已放入发送缓冲区的数据发完后发送FIN
+ *        连接在四次挥手完成后以TCP_EVENT_CLOSED结束
+ *
+ * @param conn 连接
+ */
+void tcp_close(tcp_conn_t *conn);
+
+/**
+ * @brief 发送复位并立即结束连接，不再产生事件，返回后不能再使用连接
+ *
+ * @param conn 连接
+ */
+void tcp_abort(tcp_conn_t *conn);
+
+/**
+ * @brief 开启或关闭Nagle算法，关闭后不足一个报文段的数据也立即发送
+ *
+ * @param conn 连接
+ * @param nodelay 非0为关闭
+ */
+void tcp_set_nodelay(tcp_conn_t *conn, int nodelay);
+
+/**
+ * @brief 获取当前协议栈实例的连接数
+ *
+ * @return int 连接数
+ */
+int tcp_conn_count();
+
+/**
+ * @brief 获取当前协议栈实例的tcp计数
+ *
+ * @return const tcp_stats_t* 计数
+ */
+const tcp_stats_t *tcp_get_stats();
+#endif
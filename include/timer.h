@@ -0,0 +1,80 @@
+#ifndef TIMER_H
+#define TIMER_H
+#include <stdint.h>
+#include "config.h"
+#include "net.h"
+
+typedef struct net_timer net_timer_t;
+typedef void (*timer_handler_t)(net_timer_t *timer, void *arg);
+
+/**
+ * @brief 定时器，由使用者分配（通常嵌在协议的状态结构中），定时器模块只负责挂链
+ *
+ */
+struct net_timer
+{
+    net_timer_t *prev, *next; //时间轮槽内的双向链表
+    uint64_t expire;          //到期的tick
+    int pending;              //是否已加入时间轮
+    timer_handler_t handler;  //到期处理程序
+    void *arg;                //处理程序参数
+};
+
+/**
+ * @brief 定时器模块的状态，每个协议栈实例一份（见stack.h）
+ *        到期tick为t的定时器挂在wheel[t % TIMER_WHEEL_SIZE]上，
+ *        启动、停止都是O(1)，每个tick只需检查一个槽。
+ *        超过一圈的定时器留在槽中，轮到时比较到期tick即可。
+ *
+ */
+typedef struct timer_ctx
+{
+    net_timer_t wheel[TIMER_WHEEL_SIZE]; //时间轮，每个槽为一条带哨兵的双向链表
+    uint64_t tick;                       //已经处理到的tick
+    int ready;                           //时间轮是否已初始化，全0的实例在第一次使用时初始化
+} timer_ctx_t;
+
+/**
+ * @brief 初始化当前协议栈实例的定时器模块
+ *
+ */
+void timer_init();
+
+/**
+ * @brief 获取单调时钟的当前时间
+ *
+ * @return uint64_t 毫秒
+ */
+uint64_t timer_now_ms();
+
+/**
+ * @brief 启动一个定时器，已启动的定时器会被重新设置到期时间
+ *
+ * @param timer 定时器
+ * @param ms 多少毫秒后到期
+ * @param handler 到期处理程序
+ * @param arg 处理程序参数
+ */
+void timer_add(net_timer_t *timer, uint32_t ms, timer_handler_t handler, void *arg);
+
+/**
+ * @brief 停止一个定时器，未启动的定时器不做处理
+ *
+ * @param timer 定时器
+ */
+void timer_del(net_timer_t *timer);
+
+/**
+ * @brief 推进当前协议栈实例的时间轮，调用所有已到期定时器的处理程序
+ *        处理程序中可以重新启动或停止定时器
+ *
+ */
+void timer_poll();
+
+/**
+ * @brief 推进指定协议栈实例的时间轮，期间实例绑定到本线程
+ *
+ * @param stack 实例
+ */
+void timer_poll_stack(net_stack_t *stack);
+#endif
@@ -0,0 +1,142 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <stdint.h>
+#include "config.h"
+#include "utils.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+#define NET_TRACE_MAGIC 0x4e455452 //"NETR"
+#define NET_TRACE_VERSION 1        //快照文件格式的版本
+
+/**
+ * @brief 跟踪点，位于各层的边界
+ *
+ */
+typedef enum net_trace_event
+{
+    NET_TRACE_DRIVER_RECV,   //从驱动收到一个数据帧，开始一个新的数据包序号；arg为网卡
+    NET_TRACE_ETHERNET_IN,   //进入ethernet_in()；arg为以太网协议类型
+    NET_TRACE_IP_IN,         //进入ip_in()；arg为上层协议号
+    NET_TRACE_UDP_IN,        //进入udp_in()；arg为目的端口
+    NET_TRACE_HANDLER_ENTER, //调用udp处理程序；arg为端口，批量处理程序的len为一次交付的数据报数
+    NET_TRACE_HANDLER_EXIT,  //udp处理程序返回；arg为端口
+    NET_TRACE_IP_OUT,        //进入ip_out_from()；arg为上层协议号
+    NET_TRACE_ARP_OUT,       //进入arp_out()；arg为下一跳是否在arp表中
+    NET_TRACE_DRIVER_SEND,   //交给驱动；arg为一次交给驱动的数据帧数，len为其中第一个数据帧的长度
+    NET_TRACE_EVENT_COUNT,
+} net_trace_event_t;
+
+/**
+ * @brief 一条跟踪记录
+ *
+ */
+typedef struct net_trace_rec
+{
+    uint64_t tsc;   //时间戳计数器
+    uint32_t pkt;   //数据包序号，本线程每从驱动收到一个数据帧加1，处理它时发出的数据帧沿用同一序号
+    uint16_t event; //跟踪点，见net_trace_event_t
+    uint16_t len;   //数据包长度，含本层头部
+    uint64_t arg;   //跟踪点的参数
+} net_trace_rec_t;
+
+/**
+ * @brief 每个线程一个的跟踪环，写满后覆盖最早的记录
+ *
+ */
+typedef struct net_trace_ring
+{
+    uint64_t head;                             //已写入的记录数
+    uint32_t pkt;                              //当前的数据包序号
+    net_trace_rec_t recs[NET_TRACE_RING_SIZE]; //记录
+} net_trace_ring_t;
+
+/**
+ * @brief 快照文件的头部，之后是count条按时间先后排列的记录
+ *
+ */
+typedef struct net_trace_file
+{
+    uint32_t magic;    //NET_TRACE_MAGIC
+    uint32_t version;  //NET_TRACE_VERSION
+    uint32_t rec_size; //sizeof(net_trace_rec_t)
+    uint32_t count;    //记录数
+    uint64_t lost;     //已被覆盖的记录数
+    double tsc_hz;     //时间戳计数器的频率
+    int32_t pid;       //进程号
+    int32_t tid;       //线程号
+} net_trace_file_t;
+
+/**
+ * @brief 读取时间戳计数器，x86上是rdtsc，其他平台是单调时钟的纳秒数
+ *
+ * @return uint64_t 时间戳
+ */
+static inline uint64_t net_trace_tsc()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+#if NET_TRACE
+extern NET_LOCAL net_trace_ring_t net_trace_ring;
+
+/**
+ * @brief 向本线程的跟踪环写入一条记录，不加锁、不分支
+ *
+ */
+static inline void net_trace_record(net_trace_event_t event, uint16_t len, uint64_t arg)
+{
+    net_trace_ring_t *ring = &net_trace_ring;
+    ring->pkt += event == NET_TRACE_DRIVER_RECV;
+    net_trace_rec_t *rec = &ring->recs[ring->head++ & (NET_TRACE_RING_SIZE - 1)];
+    rec->tsc = net_trace_tsc();
+    rec->pkt = ring->pkt;
+    rec->event = event;
+    rec->len = len;
+    rec->arg = arg;
+}
+
+/**
+ * @brief 跟踪点，NET_TRACE为0时展开为空语句，参数不会被求值
+ *
+ */
+#define NET_TRACEPOINT(event, len, arg) net_trace_record((event), (len), (arg))
+#else
+#define NET_TRACEPOINT(event, len, arg) ((void)0)
+#endif
+
+/**
+ * @brief 把本线程跟踪环中的记录按时间先后写入快照文件，可用tools/tracedump转换为Chrome trace格式
+ *        只能在写跟踪环的线程中调用；NET_TRACE为0时写入没有记录的快照
+ *
+ * @param path 文件路径
+ * @return int 成功为0，失败为-1
+ */
+int net_trace_snapshot(const char *path);
+
+/**
+ * @brief 读取快照文件
+ *
+ * @param path 文件路径
+ * @param file 保存头部
+ * @return net_trace_rec_t* 记录，由调用者free()；文件不存在或格式不一致时为NULL
+ */
+net_trace_rec_t *net_trace_load(const char *path, net_trace_file_t *file);
+
+/**
+ * @brief 获取跟踪点的名称
+ *
+ * @param event 跟踪点
+ * @return const char* 名称，未知的跟踪点为"unknown"
+ */
+const char *net_trace_name(uint16_t event);
+#endif
@@ -1,6 +1,8 @@
 #ifndef UDP_H
 #define UDP_H
 #include <stdint.h>
+#include <stdatomic.h>
+#include "net.h"
 #include "utils.h"
 #pragma pack(1)
 typedef struct udp_hdr
@@ -21,17 +23,120 @@ typedef struct udp_peso_hdr
 } udp_peso_hdr_t;
 #pragma pack()
 
+/**
+ * @brief 以udp头部解释数据包，长度字段小于头部或超出数据包时为NULL
+ * 
+ * @param buf 数据包，data指向udp头部
+ * @return udp_hdr_t* udp头部
+ */
+static inline udp_hdr_t *udp_hdr_of(buf_t *buf)
+{
+    udp_hdr_t *hdr = (udp_hdr_t *)buf->data;
+    if (buf->len < sizeof(udp_hdr_t) || swap16(hdr->total_len) < sizeof(udp_hdr_t) || swap16(hdr->total_len) > buf->len)
+        return NULL;
+    return hdr;
+}
+
+/**
+ * @brief 扇出给订阅者的udp数据报，端口的所有订阅者收到同一个缓冲区的引用，不为每个订阅者拷贝
+ *        回调返回后引用即失效，要保留时在回调中调用udp_dgram_hold()，用完后调用udp_dgram_release()，
+ *        两者可以在任何线程中调用；数据是只读的
+ * 
+ */
+typedef struct udp_dgram
+{
+    _Atomic int refs;            //引用数
+    uint8_t src_ip[NET_IP_LEN];  //源ip地址
+    uint8_t dest_ip[NET_IP_LEN]; //目的ip地址，可以是广播或组播地址
+    uint16_t src_port;           //源端口
+    uint16_t dest_port;          //目的端口
+    uint16_t len;                //数据长度
+    uint8_t data[];              //数据
+} udp_dgram_t;
+typedef void (*udp_subscriber_t)(udp_dgram_t *dgram, void *arg);
+
+typedef struct udp_sub
+{
+    udp_subscriber_t fn; //回调
+    void *arg;           //回调参数
+} udp_sub_t;
+
 typedef struct udp_entry udp_entry_t;
 typedef void (*udp_handler_t)(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf);
+typedef void (*udp_batch_handler_t)(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port,
+                                    uint8_t **data, uint16_t *lens, int count);
+/**
+ * @brief 处理程序表的表项，正好占一个缓存行，每个收到的数据报只访问一个缓存行
+ *        订阅者不常访问，另存于udp_ctx_t的subs中
+ * 
+ */
 struct udp_entry
 {
-    int valid;             //有效位
-    int port;              //端口号
-    udp_handler_t handler; //处理程序
-};
+    uint8_t valid;                     //有效位
+    uint8_t sub_count;                 //订阅者数，不超过UDP_MAX_SUBSCRIBERS
+    uint16_t port;                     //端口号
+    uint16_t open_index;               //在open_ports中的位置
+    udp_handler_t handler;             //处理程序
+    udp_batch_handler_t batch_handler; //批量处理程序，非NULL时同一流的数据报在接收批次结束时合并交付
+    void *arg;                         //处理程序参数
+    net_proto_stats_t stats;           //本端口的收发计数，含udp头部，端口打开时清零
+} __attribute__((aligned(64)));
+
+#define UDP_PORT_COUNT 65536
+
+/**
+ * @brief 一个接收批次内暂存的一条udp流
+ *        rxbuf在每个数据帧之间复用，数据报的数据拷贝到gro_payload中，
+ *        udp_flush()时每条流调用一次批量处理程序
+ * 
+ */
+typedef struct udp_gro_flow
+{
+    udp_entry_t *entry;             //目的端口的表项
+    uint16_t port;                  //目的端口，交付前表项被关闭或改作其他端口时丢弃
+    uint8_t src_ip[NET_IP_LEN];     //源ip地址
+    uint16_t src_port;              //源端口
+    uint8_t dest_ip[NET_IP_LEN];    //目的ip地址
+    int count;                      //暂存的数据报数
+    uint8_t *data[UDP_GRO_MAX_SEGS]; //各数据报的数据
+    uint16_t lens[UDP_GRO_MAX_SEGS]; //各数据报的数据长度
+} udp_gro_flow_t;
+
+/**
+ * @brief 伪头部累加和缓存的一项，sum为0表示空闲（协议号使累加和不可能为0）
+ * 
+ */
+typedef struct udp_peso_sum
+{
+    uint32_t src;  //源ip地址
+    uint32_t dest; //目的ip地址
+    uint32_t sum;  //两个地址与协议号的累加和
+} udp_peso_sum_t;
+
+/**
+ * @brief udp的状态，每个协议栈实例一份（见stack.h）
+ *        处理程序表以端口号直接索引，查找、打开、关闭都只需一次访存，与已打开的端口数无关
+ * 
+ */
+typedef struct udp_ctx
+{
+    udp_entry_t table[UDP_PORT_COUNT];                   //处理程序表
+    udp_sub_t *subs[UDP_PORT_COUNT];                     //各端口的订阅者，以端口号索引
+    udp_gro_flow_t gro_flows[UDP_GRO_MAX_FLOWS];         //本接收批次暂存的流
+    int gro_flow_count;                                  //暂存的流数
+    int gro_last;                                        //上一个数据报所属的流，连续收到同一流时无需查找
+    uint8_t gro_payload[UDP_GRO_MAX_SEGS][ETHERNET_MTU]; //暂存的数据报的数据
+    int gro_seg_count;                                   //暂存的数据报数
+    udp_peso_sum_t peso_cache[UDP_PESO_CACHE_SIZE];      //伪头部累加和缓存
+    udp_dgram_t *dgram_spare;                            //上一次扇出后没有被订阅者保留的数据报，下一次扇出直接复用
+    uint16_t dgram_spare_len;                            //dgram_spare可容纳的数据长度
+    uint16_t open_ports[UDP_PORT_COUNT];                 //已打开的端口，导出计数时不必扫描整个处理程序表
+    int open_count;                                      //已打开的端口数
+    buf_t txbuf;                                         //构造要发送的数据报
+} udp_ctx_t;
 
 /**
- * @brief 初始化udp协议
+ * @brief 初始化当前协议栈实例的udp协议，关闭所有端口
  * 
  */
 void udp_init();
@@ -41,8 +146,9 @@ void udp_init();
  * 
  * @param buf 要处理的包
  * @param src_ip 源ip地址
+ * @param dest_ip 目的ip地址
  */
-void udp_in(buf_t *buf, uint8_t *src_ip);
+void udp_in(buf_t *buf, uint8_t *src_ip, uint8_t *dest_ip);
 
 /**
  * @brief 处理一个要发送的数据包
@@ -65,6 +171,28 @@ void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port
  */
 void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port);
 
+/**
+ * @brief 分段发送一大块数据，每seg_size字节构成一个udp数据报，
+ *        各数据报由同一个头部模板构造，一次批量交给驱动
+ * 
+ * @param data 要发送的数据
+ * @param len 数据长度
+ * @param seg_size 每个数据报的数据长度，超过路径MTU时按路径MTU
+ * @param src_port 源端口号
+ * @param dest_ip 目的ip地址
+ * @param dest_port 目的端口号
+ * @return int 发送的数据报数，参数错误时为-1；下一跳mac未知时只发出第一个数据报（在arp层等待应答），返回1
+ */
+int udp_send_gso(uint8_t *data, int len, uint16_t seg_size, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port);
+
+/**
+ * @brief 获取发往目的地址时不会被分片的最大数据长度
+ * 
+ * @param dest_ip 目的ip地址
+ * @return int 最大数据长度
+ */
+int udp_get_mtu(uint8_t *dest_ip);
+
 /**
  * @brief 打开一个udp端口并注册处理程序
  * 
@@ -75,9 +203,89 @@ void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip,
 int udp_open(uint16_t port, udp_handler_t handler);
 
 /**
- * @brief 关闭一个udp端口
+ * @brief 打开一个udp端口并注册带参数的处理程序，处理程序从entry->arg取得参数
+ * 
+ * @param port 端口号
+ * @param handler 处理程序
+ * @param arg 处理程序参数
+ * @return int 成功为0，失败为-1
+ */
+int udp_open_arg(uint16_t port, udp_handler_t handler, void *arg);
+
+/**
+ * @brief 打开一个udp端口并注册批量处理程序
+ *        一个接收批次内发往该端口的数据报按（源ip、源端口、目的ip）分组，
+ *        在udp_flush()时每组调用一次处理程序，组内保持到达顺序
+ * 
+ * @param port 端口号
+ * @param handler 批量处理程序
+ * @return int 成功为0，失败为-1
+ */
+int udp_open_batch(uint16_t port, udp_batch_handler_t handler);
+
+/**
+ * @brief 把当前协议栈实例暂存的数据报按流交付给批量处理程序，在一个接收批次结束时调用
+ * 
+ */
+void udp_flush();
+
+/**
+ * @brief 把指定协议栈实例暂存的数据报按流交付给批量处理程序，交付期间实例绑定到本线程
+ * 
+ * @param stack 实例
+ */
+void udp_flush_stack(net_stack_t *stack);
+
+/**
+ * @brief 订阅一个udp端口，可以与处理程序共存；同一端口的每个数据报按订阅顺序交给所有订阅者
+ *        接收广播与组播数据报时，组播组须先由netif_join_group()加入
+ * 
+ * @param port 端口号
+ * @param fn 回调
+ * @param arg 回调参数
+ * @return int 成功为0，已订阅或订阅者已达UDP_MAX_SUBSCRIBERS为-1
+ */
+int udp_subscribe(uint16_t port, udp_subscriber_t fn, void *arg);
+
+/**
+ * @brief 取消订阅，端口没有订阅者与处理程序时被关闭；可以在回调中调用
+ * 
+ * @param port 端口号
+ * @param fn 回调
+ * @param arg 回调参数
+ * @return int 成功为0，未订阅为-1
+ */
+int udp_unsubscribe(uint16_t port, udp_subscriber_t fn, void *arg);
+
+/**
+ * @brief 增加数据报的一个引用
+ * 
+ * @param dgram 数据报
+ */
+static inline void udp_dgram_hold(udp_dgram_t *dgram)
+{
+    atomic_fetch_add_explicit(&dgram->refs, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief 释放数据报的一个引用，最后一个引用释放时回收缓冲区
+ * 
+ * @param dgram 数据报
+ */
+void udp_dgram_release(udp_dgram_t *dgram);
+
+/**
+ * @brief 关闭一个udp端口，同时取消所有订阅
  * 
  * @param port 端口号
  */
 void udp_close(uint16_t port);
+
+/**
+ * @brief 获取一个已打开端口的收发计数，从端口打开时开始计
+ * 
+ * @param port 端口号
+ * @return const net_proto_stats_t* 收发计数，端口未打开时为NULL
+ */
+const net_proto_stats_t *udp_get_stats(uint16_t port);
 #endif
\ No newline at end of file
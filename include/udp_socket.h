@@ -0,0 +1,72 @@
+#ifndef UDP_SOCKET_H
+#define UDP_SOCKET_H
+#include <stdint.h>
+#include "net.h"
+
+/**
+ * @brief 套接字风格的udp接收接口
+ *        协议栈线程在net_poll()中把发往该端口的数据报拷贝后放入套接字的接收队列，
+ *        应用在自己的线程中用udp_socket_recv_batch()批量取出，处理程序的快慢不再影响收包路径。
+ *        接收队列是单生产者单消费者的无锁环形队列：打开、关闭套接字须在协议栈线程中进行，
+ *        同一个套接字只能由一个线程接收。
+ *
+ */
+typedef struct udp_socket udp_socket_t;
+
+/**
+ * @brief 一个接收到的数据报
+ *
+ */
+typedef struct udp_msg
+{
+    uint8_t *buf;                //接收数据的缓冲区，由调用者提供
+    uint16_t buf_len;            //缓冲区长度，数据报更长时被截断
+    uint16_t len;                //数据报的数据长度（截断前）
+    uint8_t src_ip[NET_IP_LEN];  //源ip地址
+    uint16_t src_port;           //源端口
+    uint64_t timestamp_ns;       //协议栈收到该数据报的时间（CLOCK_MONOTONIC）
+} udp_msg_t;
+
+typedef struct udp_socket_stats
+{
+    uint64_t received;     //放入接收队列的数据报数
+    uint64_t dropped_ring; //接收队列满而丢弃的数据报数
+    uint64_t dropped_mem;  //超过接收内存上限而丢弃的数据报数
+    uint64_t rmem;         //当前占用的接收内存（字节）
+} udp_socket_stats_t;
+
+/**
+ * @brief 打开一个udp套接字，绑定到端口，端口上原有的处理程序被替换
+ *
+ * @param port 端口号
+ * @param ring_size 接收队列长度，须为2的幂，0表示UDP_SOCKET_RING_SIZE
+ * @param rcvbuf 最多占用的接收内存（字节），0表示UDP_SOCKET_RCVBUF
+ * @return udp_socket_t* 套接字，参数错误或内存不足时为NULL
+ */
+udp_socket_t *udp_socket_open(uint16_t port, uint32_t ring_size, uint32_t rcvbuf);
+
+/**
+ * @brief 批量接收数据报，不阻塞
+ *
+ * @param sock 套接字
+ * @param msgs 接收的数据报
+ * @param n 最多接收的个数
+ * @return int 实际接收的个数，没有数据报时为0
+ */
+int udp_socket_recv_batch(udp_socket_t *sock, udp_msg_t *msgs, int n);
+
+/**
+ * @brief 获取套接字的计数，可以在任何线程中调用
+ *
+ * @param sock 套接字
+ * @param stats 保存计数
+ */
+void udp_socket_get_stats(udp_socket_t *sock, udp_socket_stats_t *stats);
+
+/**
+ * @brief 关闭套接字，释放队列中剩余的数据报，须在协议栈线程中调用，且没有线程正在接收
+ *
+ * @param sock 套接字
+ */
+void udp_socket_close(udp_socket_t *sock);
+#endif
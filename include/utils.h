@@ -1,16 +1,25 @@
 #ifndef UTILS_H
 #define UTILS_H
 #include <stdint.h>
+#include <stddef.h>
 #include "config.h"
 #define BUF_MAX_LEN (UINT16_MAX + 14) //最大udp包 + 以太网帧报头长度
 
 typedef struct buf
 {
     uint16_t len;                       // 包中有效数据大小
+    int ifindex;                        // 收到该包或将要发送该包的网卡
     uint8_t *data;                      // 包的数据起始地址
     uint8_t payload[BUF_MAX_LEN];       // 最大负载数据量
 } buf_t;
-static buf_t rxbuf, txbuf;          //一个buf足够单线程使用
+/**
+ * @brief 每个线程一份的存储类别
+ *        指向每个线程的默认协议栈实例与当前绑定的实例的指针（见stack.h）、分片与流水线模式中线程的角色以它声明；
+ *        协议栈实例本身都在堆上分配，不放在这里，以免每个线程都为它占用内存；
+ *        路由表、网卡表与各项配置在线程间共享，只在启动工作线程之前修改
+ * 
+ */
+#define NET_LOCAL _Thread_local
 
 /**
  * @brief 初始化buffer为给定的长度，用于装载数据包
@@ -53,6 +62,24 @@ void buf_copy(buf_t *dst, buf_t *src);
  */
 uint16_t checksum16(uint16_t *buf, int len);
 
+/**
+ * @brief 累加16位反码和，不折叠也不取反，用于分段计算校验和
+ * 
+ * @param sum 已有的累加和
+ * @param data 要累加的数据，按内存中的字节序累加
+ * @param len 字节数，奇数长度时末尾补0
+ * @return uint32_t 累加和
+ */
+uint32_t checksum_add(uint32_t sum, const void *data, int len);
+
+/**
+ * @brief 折叠累加和并取反，得到可直接写入报头的校验和
+ * 
+ * @param sum checksum_add()得到的累加和
+ * @return uint16_t 网络字节序的校验和
+ */
+uint16_t checksum_fold(uint32_t sum);
+
 /**
  * @brief ip转字符串
  * 
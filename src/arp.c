@@ -2,6 +2,9 @@
 #include "utils.h"
 #include "ethernet.h"
 #include "config.h"
+#include "netif.h"
+#include "stack.h"
+#include "trace.h"
 #include <string.h>
 #include <stdio.h>
 #include <sys/time.h>
@@ -19,18 +22,6 @@ static const arp_pkt_t arp_init_pkt = {
     .sender_mac = DRIVER_IF_MAC,
     .target_mac = {0}};
 
-/**
- * @brief arp地址转换表
- * 
- */
-arp_entry_t arp_table[ARP_MAX_ENTRY];
-
-/**
- * @brief 长度为1的arp分组队列，当等待arp回复时暂存未发送的数据包
- * 
- */
-arp_buf_t arp_buf;
-
 /**
  * @brief 更新arp表
  *        你首先需要依次轮询检测ARP表中所有的ARP表项是否有超时，如果有超时，则将该表项的状态改为无效。
@@ -46,41 +37,43 @@ arp_buf_t arp_buf;
 #define TTL 30
 void arp_update(uint8_t *ip, uint8_t *mac, arp_state_t state)
 {   
+    arp_ctx_t *ctx = &net_stack_current()->arp;
     // TODO
     struct timeval time;
     gettimeofday(&time, NULL);
     long sec = time.tv_sec;
   
     for(int i=0; i<ARP_MAX_ENTRY; i++){
-        if(sec - arp_table[i].timeout > TTL){
+        if(sec - ctx->table[i].timeout > TTL){
             //timeout > TTL = 30
-            arp_table[i].state = ARP_INVALID;
+            ctx->table[i].state = ARP_INVALID;
         } 
     }
 
     int flag = 0;
     for(int i=0; i<ARP_MAX_ENTRY; i++){
-        if(arp_table[i].state == ARP_INVALID){
-            arp_table[i].state = ARP_VALID;
-            arp_table[i].timeout = sec;
-            memcpy(arp_table[i].ip,ip,NET_IP_LEN);
-            memcpy(arp_table[i].mac,mac,NET_MAC_LEN);
+        if(ctx->table[i].state == ARP_INVALID){
+            ctx->table[i].state = ARP_VALID;
+            ctx->table[i].timeout = sec;
+            memcpy(ctx->table[i].ip,ip,NET_IP_LEN);
+            memcpy(ctx->table[i].mac,mac,NET_MAC_LEN);
             flag = 1;
             break;
         }
     }
 
     if(flag==0){
+        ctx->stats.evictions++;
         int max_timeout = 0, index = 0;
         for(int i=0; i<ARP_MAX_ENTRY; i++){
-            if(sec - arp_table[i].timeout > max_timeout){
-                max_timeout = sec - arp_table[i].timeout;
+            if(sec - ctx->table[i].timeout > max_timeout){
+                max_timeout = sec - ctx->table[i].timeout;
                 index = i;
         }
-        arp_table[index].state = ARP_VALID;
-        arp_table[index].timeout = sec;
-        memcpy(arp_table[index].ip,ip,NET_IP_LEN);
-        memcpy(arp_table[index].mac,mac,NET_MAC_LEN);
+        ctx->table[index].state = ARP_VALID;
+        ctx->table[index].timeout = sec;
+        memcpy(ctx->table[index].ip,ip,NET_IP_LEN);
+        memcpy(ctx->table[index].mac,mac,NET_MAC_LEN);
         }
     }
 }
@@ -91,122 +84,96 @@ void arp_update(uint8_t *ip, uint8_t *mac, arp_state_t state)
  * @param ip 欲转换的ip地址
  * @return uint8_t* mac地址，未找到时为NULL
  */
-static uint8_t *arp_lookup(uint8_t *ip)
+uint8_t *arp_lookup(uint8_t *ip)
 {
+    arp_ctx_t *ctx = &net_stack_current()->arp;
     for (int i = 0; i < ARP_MAX_ENTRY; i++)
-        if (arp_table[i].state == ARP_VALID && memcmp(arp_table[i].ip, ip, NET_IP_LEN) == 0)
-            return arp_table[i].mac;
+        if (ctx->table[i].state == ARP_VALID && memcmp(ctx->table[i].ip, ip, NET_IP_LEN) == 0)
+        {
+            ctx->stats.hits++;
+            return ctx->table[i].mac;
+        }
+    ctx->stats.misses++;
     return NULL;
 }
 
 /**
  * @brief 发送一个arp请求
  *        你需要调用buf_init对txbuf进行初始化
- *        填写ARP报头，将ARP的opcode设置为ARP_REQUEST，注意大小端转换
- *        将ARP数据报发送到ethernet层
+ *        以arp_init_pkt为模板，填写操作类型ARP_REQUEST、本机地址与目标ip地址，目标mac为0
+ *        将ARP数据报广播到ethernet层
  * 
+ * @param ifindex 发出请求的网卡
  * @param target_ip 想要知道的目标的ip地址
  */
-static void arp_req(uint8_t *target_ip)
+static void arp_req(int ifindex, uint8_t *target_ip)
 {
-    // TODO
-    buf_init(&txbuf,28);
-    uint8_t *p = &txbuf.data[0];
-    //硬件类型
-    p[0] = 0x00; p[1] = ARP_HW_ETHER;
-    //上层协议类型:IP
-    p[2] = 0x08; p[3] = 0x00;
-    //MAC 地址长度
-    p[4] = 0x06;
-    //IP 协议地址长度
-    p[5] = 0x04;
-    //操作类型:request
-    p[6] = 0x00; p[7] = ARP_REQUEST;
-
-    uint8_t if_mac[] = DRIVER_IF_MAC;
-    uint8_t if_ip[] = DRIVER_IF_IP;
-    //源MAC
-    p += 8;
-    memcpy(p,if_mac,NET_MAC_LEN);
-    //源IP
-    p += 6;
-    memcpy(p,if_ip,NET_IP_LEN);
-    //目的 MAC
-    p += 6;
-    memset(p,0x00,NET_MAC_LEN * sizeof(uint8_t));
-    //目的 IP
-    p += 4;
-    memcpy(p,target_ip,NET_IP_LEN);
-    //调用 ethernet_out 函数将 ARP 报文发送出去
-    const uint8_t mac_broadcast[] = {0xff,0xff,0xff,0xff,0xff,0xff};
-    ethernet_out(&txbuf, mac_broadcast, NET_PROTOCOL_ARP);
+    arp_ctx_t *ctx = &net_stack_current()->arp;
+    net_if_t *netif = netif_get(ifindex);
+    uint8_t *if_ip = netif_select_src(ifindex, target_ip);
+    if (if_ip == NULL)
+        return;
+    buf_init(&ctx->txbuf, sizeof(arp_pkt_t));
+    ctx->txbuf.ifindex = ifindex;
+    arp_pkt_t *req = (arp_pkt_t *)ctx->txbuf.data;
+    *req = arp_init_pkt;
+    req->opcode = swap16(ARP_REQUEST);
+    memcpy(req->sender_mac, netif->mac, NET_MAC_LEN);
+    memcpy(req->sender_ip, if_ip, NET_IP_LEN);
+    memcpy(req->target_ip, target_ip, NET_IP_LEN);
+    static const uint8_t mac_broadcast[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    ethernet_out(&ctx->txbuf, mac_broadcast, NET_PROTOCOL_ARP);
 }
 
 /**
  * @brief 处理一个收到的数据包
  *        你首先需要做报头检查，查看报文是否完整，
  *        检查项包括：硬件类型，协议类型，硬件地址长度，协议地址长度，操作类型
+ *        除操作类型外都在arp_pkt_of()中完成
  *        
  *        接着，调用arp_update更新ARP表项
  *        查看arp_buf是否有效，如果有效，则说明ARP分组队列里面有待发送的数据包。
  *        即上一次调用arp_out()发送来自IP层的数据包时，由于没有找到对应的MAC地址进而先发送的ARP request报文
- *        此时，收到了该request的应答报文。然后，根据IP地址来查找ARM表项，如果能找到该IP地址对应的MAC地址，
- *        则将缓存的数据包arp_buf再发送到ethernet层。
+ *        此时，收到了该request的应答报文。只有发送方正是缓存的数据包等待的地址时，
+ *        才将缓存的数据包arp_buf再发送到ethernet层，发往其他地址的arp报文不会把它发给错误的主机。
  * 
- *        如果arp_buf无效，还需要判断接收到的报文是否为request请求报文，并且，该请求报文的目的IP正好是本机的IP地址，
- *        则认为是请求本机MAC地址的ARP请求报文，则回应一个响应报文（应答报文）。
- *        响应报文：需要调用buf_init初始化一个buf，填写ARP报头，目的IP和目的MAC需要填写为收到的ARP报的源IP和源MAC。
+ *        无论是否有缓存的数据包，还需要判断接收到的报文是否为request请求报文，并且，该请求报文的目的IP正好是本机的某个IP地址，
+ *        则认为是请求本机MAC地址的ARP请求报文，则从收到请求的网卡回应一个响应报文（应答报文）。
+ *        响应报文：以arp_init_pkt为模板，填写操作类型与双方地址，目的IP和目的MAC需要填写为收到的ARP报的源IP和源MAC。
  * 
  * @param buf 要处理的数据包
  */
 void arp_in(buf_t *buf)
 {
-    uint8_t *pr = &buf->data[0];
-    uint8_t *sor_mac = pr+8;
-    uint8_t *sor_ip = pr+14;
-    uint8_t *dst_mac = pr+18;
-    uint8_t *dst_ip = pr+24;
-    arp_update(sor_ip,sor_mac,ARP_VALID);
-    if(arp_buf.valid){
-        arp_lookup(sor_ip);
-        ethernet_out(&arp_buf.buf,sor_mac,arp_buf.protocol);
-        arp_buf.valid = 0;
+    arp_ctx_t *ctx = &net_stack_current()->arp;
+    arp_pkt_t *pkt = arp_pkt_of(buf);
+    if(pkt == NULL || (pkt->opcode != swap16(ARP_REQUEST) && pkt->opcode != swap16(ARP_REPLY))){
+        net_drop(buf->len < sizeof(arp_pkt_t) ? NET_DROP_ARP_TRUNCATED : NET_DROP_ARP_UNSUPPORTED, buf);
+        return;
     }
-    else{
-        uint8_t if_mac[] = DRIVER_IF_MAC;
-        uint8_t if_ip[] = DRIVER_IF_IP;
-        if(pr[7]==ARP_REQUEST && memcmp(dst_ip, if_ip, NET_IP_LEN) == 0){
-            buf_init(&txbuf,28);
-            uint8_t *p = &txbuf.data[0];
-            //硬件类型
-            p[0] = 0x00; p[1] = ARP_HW_ETHER;
-            //上层协议类型:IP
-            p[2] = 0x08; p[3] = 0x00;
-            //MAC 地址长度
-            p[4] = 0x06;
-            //IP 协议地址长度
-            p[5] = 0x04;
-            //操作类型:reply
-            p[6] = 0x00; p[7] = ARP_REPLY;
-            //源MAC
-            p += 8;
-            memcpy(p,if_mac,NET_MAC_LEN);
-            //源IP
-            p += 6;
-            memcpy(p,if_ip,NET_IP_LEN);
-            //目的 MAC
-            p += 4;
-            memcpy(p,sor_mac,NET_MAC_LEN);
-            //目的 IP
-            p += 6;
-            memcpy(p,sor_ip,NET_IP_LEN);
-            //调用 ethernet_out 函数将 ARP 报文发送出去
-            ethernet_out(&txbuf, sor_mac, NET_PROTOCOL_ARP);
-        }
+    arp_update(pkt->sender_ip,pkt->sender_mac,ARP_VALID);
+    if(ctx->buf.valid && memcmp(pkt->sender_ip,ctx->buf.ip,NET_IP_LEN) == 0){
+        ethernet_out(&ctx->buf.buf,pkt->sender_mac,ctx->buf.protocol);
+        ctx->buf.valid = 0;
     }
-    
 
-    
+    net_if_t *netif = netif_get(buf->ifindex);
+    //只应答本实例负责的网卡上的地址，网卡表在实例间共享
+    int owner = netif_lookup(pkt->target_ip);
+    if(pkt->opcode==swap16(ARP_REQUEST) && !ctx->silent && netif != NULL && owner != -1 && net_stack_owns(net_stack_current(), owner)){
+        buf_init(&ctx->txbuf,sizeof(arp_pkt_t));
+        ctx->txbuf.ifindex = buf->ifindex;
+        arp_pkt_t *reply = (arp_pkt_t *)ctx->txbuf.data;
+        *reply = arp_init_pkt;
+        reply->opcode = swap16(ARP_REPLY);
+        memcpy(reply->sender_mac,netif->mac,NET_MAC_LEN);
+        //源IP，即被请求的本机地址
+        memcpy(reply->sender_ip,pkt->target_ip,NET_IP_LEN);
+        memcpy(reply->target_mac,pkt->sender_mac,NET_MAC_LEN);
+        memcpy(reply->target_ip,pkt->sender_ip,NET_IP_LEN);
+        //调用 ethernet_out 函数将 ARP 报文发送出去
+        ethernet_out(&ctx->txbuf, reply->target_mac, NET_PROTOCOL_ARP);
+    }
 }
 
 /**
@@ -222,29 +189,59 @@ void arp_in(buf_t *buf)
  */
 void arp_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
 {   
+    arp_ctx_t *ctx = &net_stack_current()->arp;
     uint8_t *mac = arp_lookup(ip);
+    NET_TRACEPOINT(NET_TRACE_ARP_OUT, buf->len, mac != NULL);
     if(mac != NULL){
         ethernet_out(buf,mac,protocol);
     }
     else{
-        arp_req(ip);
+        arp_req(buf->ifindex, ip);
         //将来自IP层的数据包缓存到arp_buf的buf中
-        arp_buf.valid = ARP_VALID;
-        // arp_buf.buf = buf;
-        buf_copy(&arp_buf.buf,buf);
-        memcpy(arp_buf.ip,ip,NET_IP_LEN);
-        arp_buf.protocol = protocol;
+        ctx->buf.valid = ARP_VALID;
+        // ctx->buf.buf = buf;
+        buf_copy(&ctx->buf.buf,buf);
+        memcpy(ctx->buf.ip,ip,NET_IP_LEN);
+        ctx->buf.protocol = protocol;
     }
 }
 
 /**
- * @brief 初始化arp协议
+ * @brief 初始化arp协议，在当前协议栈实例负责的网卡上宣告本机地址
  * 
  */
 void arp_init()
 {
+    arp_ctx_t *ctx = &net_stack_current()->arp;
     for (int i = 0; i < ARP_MAX_ENTRY; i++)
-        arp_table[i].state = ARP_INVALID;
-    arp_buf.valid = 0;
-    arp_req(net_if_ip);
-}
\ No newline at end of file
+        ctx->table[i].state = ARP_INVALID;
+    ctx->buf.valid = 0;
+    for (int i = 0; !ctx->silent && i < NETIF_MAX_IF; i++)
+    {
+        net_if_t *netif = netif_get(i);
+        if (netif != NULL && netif->ip_count > 0 && net_stack_owns(net_stack_current(), i))
+            arp_req(i, netif->ip[0]);
+    }
+}
+
+/**
+ * @brief 设置当前协议栈实例是否应答arp请求、初始化时是否宣告本机地址，默认应答
+ * 
+ * @param enable 为0时只学习不应答
+ */
+void arp_set_responder(int enable)
+{
+    arp_ctx_t *ctx = &net_stack_current()->arp;
+    ctx->silent = !enable;
+}
+
+/**
+ * @brief 获取当前协议栈实例arp表的查找与替换计数
+ * 
+ * @return const arp_stats_t* 计数
+ */
+const arp_stats_t *arp_get_stats()
+{
+    arp_ctx_t *ctx = &net_stack_current()->arp;
+    return &ctx->stats;
+}
@@ -0,0 +1,416 @@
+#include "capture.h"
+#include "ethernet.h"
+#include "netif.h"
+#include "ring.h"
+#include "utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define PCAPNG_SHB 0x0a0d0d0a      //Section Header Block
+#define PCAPNG_IDB 1               //Interface Description Block
+#define PCAPNG_EPB 6               //Enhanced Packet Block
+#define PCAPNG_BYTE_ORDER 0x1a2b3c4d //按写入者的字节序写入，读者据此判断字节序
+#define PCAPNG_LINKTYPE_ETHERNET 1
+#define PCAPNG_OPT_END 0
+#define PCAPNG_OPT_IF_NAME 2
+#define PCAPNG_OPT_IF_TSRESOL 9
+#define PCAPNG_OPT_EPB_FLAGS 2
+#define PCAPNG_TSRESOL_NS 9        //时间戳单位为10^-9秒
+#define NET_CAPTURE_WRITE_BURST 64 //写盘线程每次从一个抓包环取出的最多数据帧数
+
+/**
+ * @brief 抓包环中的一个数据帧
+ *
+ */
+typedef struct net_capture_rec
+{
+    uint64_t ts_ns;                    //抓取时间，自1970年起的纳秒数
+    uint16_t len;                      //数据帧长度
+    uint16_t cap_len;                  //保存的字节数
+    uint8_t ifindex;                   //收发数据帧的网卡
+    uint8_t dir;                       //NET_CAPTURE_RX或NET_CAPTURE_TX
+    uint8_t data[NET_CAPTURE_SNAPLEN]; //数据帧开头的cap_len个字节
+} net_capture_rec_t;
+
+/**
+ * @brief 一个收发线程的抓包环：收发线程从free取出空闲数据帧、拷贝后放入ready，
+ *        写盘线程从ready取出、写入文件后放回free，两个环都是单生产者单消费者的
+ *        线程退出后抓包环可以被其他线程接手，进程退出前不释放
+ *
+ */
+typedef struct net_capture_channel
+{
+    ring_t ready;              //待写入的数据帧
+    ring_t free;               //空闲的数据帧
+    net_capture_rec_t *recs;   //数据帧
+    _Atomic uint32_t owned;    //是否属于一个线程
+    uint32_t session;          //seen所属的抓包序号
+    uint64_t seen;             //本次抓包中满足条件的数据帧数，用于采样
+    _Atomic uint64_t matched;  //以下三项只由所属线程修改
+    _Atomic uint64_t queued;
+    _Atomic uint64_t dropped;
+    _Atomic uint64_t written;  //只由写盘线程修改
+} net_capture_channel_t;
+
+static _Atomic(net_capture_channel_t *) net_capture_channels[NET_CAPTURE_MAX_THREADS];
+static NET_LOCAL net_capture_channel_t *net_capture_self; //本线程的抓包环
+static pthread_key_t net_capture_key;                     //线程退出时交还抓包环
+static pthread_once_t net_capture_key_once = PTHREAD_ONCE_INIT;
+
+static _Atomic int net_capture_state;      //0为空闲，1为正在抓包，2为正在停止
+static _Atomic int net_capture_stopping;   //通知写盘线程写完后退出
+static _Atomic uint32_t net_capture_session; //抓包序号，每次开始时加1
+static net_capture_filter_t net_capture_filter;
+static int net_capture_any_host;           //过滤条件中是否没有指定ip地址
+static FILE *net_capture_file;
+static pthread_t net_capture_writer;
+
+static inline void net_capture_inc(_Atomic uint64_t *counter)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+static void net_capture_release(void *channel)
+{
+    atomic_store_explicit(&((net_capture_channel_t *)channel)->owned, 0, memory_order_release);
+}
+
+static void net_capture_make_key()
+{
+    pthread_key_create(&net_capture_key, net_capture_release);
+}
+
+static net_capture_channel_t *net_capture_channel_new()
+{
+    net_capture_channel_t *channel = calloc(1, sizeof(net_capture_channel_t));
+    if (channel == NULL)
+        return NULL;
+    channel->recs = malloc(NET_CAPTURE_RING_SIZE * sizeof(net_capture_rec_t));
+    if (channel->recs == NULL || ring_init(&channel->ready, NET_CAPTURE_RING_SIZE) != 0 ||
+        ring_init(&channel->free, NET_CAPTURE_RING_SIZE) != 0)
+    {
+        ring_free(&channel->ready);
+        free(channel->recs);
+        free(channel);
+        return NULL;
+    }
+    for (int i = 0; i < NET_CAPTURE_RING_SIZE; i++)
+        ring_enqueue(&channel->free, &channel->recs[i]);
+    atomic_init(&channel->owned, 1);
+    return channel;
+}
+
+/**
+ * @brief 为本线程取得一个抓包环：优先接手已退出线程的，没有时新建一个
+ *
+ * @return net_capture_channel_t* 抓包环，已有NET_CAPTURE_MAX_THREADS个线程在抓包或内存不足时为NULL
+ */
+static net_capture_channel_t *net_capture_claim()
+{
+    pthread_once(&net_capture_key_once, net_capture_make_key);
+    net_capture_channel_t *fresh = NULL;
+    for (int i = 0; i < NET_CAPTURE_MAX_THREADS; i++)
+    {
+        net_capture_channel_t *channel = atomic_load_explicit(&net_capture_channels[i], memory_order_acquire);
+        uint32_t idle = 0;
+        if (channel == NULL)
+        {
+            if (fresh == NULL && (fresh = net_capture_channel_new()) == NULL)
+                return NULL;
+            if (!atomic_compare_exchange_strong(&net_capture_channels[i], &channel, fresh))
+                continue; //被其他线程抢先，继续找
+            channel = fresh;
+            fresh = NULL;
+        }
+        else if (!atomic_compare_exchange_strong(&channel->owned, &idle, 1))
+            continue;
+        if (fresh != NULL) //新建后又接手了已有的
+        {
+            ring_free(&fresh->ready);
+            ring_free(&fresh->free);
+            free(fresh->recs);
+            free(fresh);
+        }
+        pthread_setspecific(net_capture_key, channel);
+        return channel;
+    }
+    return NULL;
+}
+
+/**
+ * @brief 判断数据帧是否满足过滤条件中的协议、地址与端口
+ *
+ */
+static int net_capture_match(const net_capture_filter_t *filter, const uint8_t *frame, uint16_t len)
+{
+    int need_ip = filter->ip_protocol != 0 || !net_capture_any_host || filter->port != 0;
+    if (len < sizeof(ether_hdr_t))
+        return filter->ethertype == 0 && !need_ip;
+    uint16_t protocol = frame[12] << 8 | frame[13];
+    if (filter->ethertype != 0 && protocol != filter->ethertype)
+        return 0;
+    if (!need_ip)
+        return 1;
+    const uint8_t *ip = frame + sizeof(ether_hdr_t);
+    if (protocol != NET_PROTOCOL_IP || len < sizeof(ether_hdr_t) + 20)
+        return 0;
+    if (filter->ip_protocol != 0 && ip[9] != filter->ip_protocol)
+        return 0;
+    if (!net_capture_any_host && memcmp(ip + 12, filter->host, NET_IP_LEN) != 0 && memcmp(ip + 16, filter->host, NET_IP_LEN) != 0)
+        return 0;
+    if (filter->port == 0)
+        return 1;
+    int hdr_len = (ip[0] & 0xf) * 4;
+    if ((ip[9] != NET_PROTOCOL_UDP && ip[9] != NET_PROTOCOL_TCP) || ((ip[6] & 0x1f) | ip[7]) != 0 ||
+        len < sizeof(ether_hdr_t) + hdr_len + 4)
+        return 0;
+    const uint8_t *ports = ip + hdr_len;
+    return (ports[0] << 8 | ports[1]) == filter->port || (ports[2] << 8 | ports[3]) == filter->port;
+}
+
+/**
+ * @brief 抓包钩子：过滤、采样后把数据帧拷贝进本线程的抓包环，环满时丢弃，不等待写盘线程
+ *
+ */
+static void net_capture_tap(int ifindex, const uint8_t *frame, uint16_t len, int tx)
+{
+    const net_capture_filter_t *filter = &net_capture_filter;
+    uint8_t dir = tx ? NET_CAPTURE_TX : NET_CAPTURE_RX;
+    if (!(filter->dir & dir) || ifindex < 0 || ifindex >= NETIF_MAX_IF ||
+        (filter->ifmask != 0 && !(filter->ifmask >> ifindex & 1)) || !net_capture_match(filter, frame, len))
+        return;
+    net_capture_channel_t *channel = net_capture_self;
+    if (channel == NULL && (channel = net_capture_self = net_capture_claim()) == NULL)
+        return;
+    uint32_t session = atomic_load_explicit(&net_capture_session, memory_order_relaxed);
+    if (channel->session != session)
+    {
+        channel->session = session;
+        channel->seen = 0;
+    }
+    net_capture_inc(&channel->matched);
+    if (channel->seen++ % filter->sample_every != 0)
+        return;
+    net_capture_rec_t *rec = ring_dequeue(&channel->free);
+    if (rec == NULL)
+    {
+        net_capture_inc(&channel->dropped);
+        return;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    rec->ts_ns = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    rec->len = len;
+    rec->cap_len = len < NET_CAPTURE_SNAPLEN ? len : NET_CAPTURE_SNAPLEN;
+    rec->ifindex = ifindex;
+    rec->dir = dir;
+    memcpy(rec->data, frame, rec->cap_len);
+    ring_enqueue(&channel->ready, rec); //ready与free容量相同，不会满
+    net_capture_inc(&channel->queued);
+}
+
+static void net_capture_put32(uint32_t value)
+{
+    fwrite(&value, sizeof(value), 1, net_capture_file);
+}
+
+/**
+ * @brief 写入一个选项，值补齐到4字节
+ *
+ */
+static void net_capture_put_opt(uint16_t code, const void *value, uint16_t len)
+{
+    static const uint8_t pad[4] = {0};
+    uint16_t hdr[2] = {code, len};
+    fwrite(hdr, sizeof(hdr), 1, net_capture_file);
+    fwrite(value, 1, len, net_capture_file);
+    fwrite(pad, 1, (4 - len % 4) % 4, net_capture_file);
+}
+
+static uint32_t net_capture_opt_size(uint16_t len)
+{
+    return 4 + (len + 3) / 4 * 4;
+}
+
+/**
+ * @brief 写入Section Header Block与每个网卡一个的Interface Description Block，接口号即网卡索引
+ *
+ */
+static int net_capture_write_header()
+{
+    uint32_t shb[] = {PCAPNG_SHB, 28, PCAPNG_BYTE_ORDER, 1, 0xffffffff, 0xffffffff, 28}; //版本1.0，节长度未知
+    fwrite(shb, sizeof(shb), 1, net_capture_file);
+    for (int i = 0; i < NETIF_MAX_IF; i++)
+    {
+        net_if_t *netif = netif_get(i);
+        char name[NETIF_NAME_LEN + 8];
+        snprintf(name, sizeof(name), "%s", netif != NULL ? netif->name : "");
+        if (name[0] == 0)
+            snprintf(name, sizeof(name), "if%d", i);
+        uint8_t tsresol = PCAPNG_TSRESOL_NS;
+        uint32_t total = 20 + net_capture_opt_size(strlen(name)) + net_capture_opt_size(1) + 4;
+        net_capture_put32(PCAPNG_IDB);
+        net_capture_put32(total);
+        net_capture_put32(PCAPNG_LINKTYPE_ETHERNET); //链路类型与保留的16位
+        net_capture_put32(NET_CAPTURE_SNAPLEN);
+        net_capture_put_opt(PCAPNG_OPT_IF_NAME, name, strlen(name));
+        net_capture_put_opt(PCAPNG_OPT_IF_TSRESOL, &tsresol, 1);
+        net_capture_put_opt(PCAPNG_OPT_END, NULL, 0);
+        net_capture_put32(total);
+    }
+    return ferror(net_capture_file) ? -1 : 0;
+}
+
+/**
+ * @brief 写入一个Enhanced Packet Block，方向记录在epb_flags的最低两位（1为收，2为发）
+ *
+ */
+static void net_capture_write_rec(const net_capture_rec_t *rec)
+{
+    static const uint8_t pad[4] = {0};
+    uint32_t padded = (rec->cap_len + 3) / 4 * 4, flags = rec->dir == NET_CAPTURE_RX ? 1 : 2;
+    uint32_t total = 28 + padded + net_capture_opt_size(4) + 4 + 4;
+    uint32_t hdr[] = {PCAPNG_EPB, total, rec->ifindex, rec->ts_ns >> 32, (uint32_t)rec->ts_ns, rec->cap_len, rec->len};
+    fwrite(hdr, sizeof(hdr), 1, net_capture_file);
+    fwrite(rec->data, 1, rec->cap_len, net_capture_file);
+    fwrite(pad, 1, padded - rec->cap_len, net_capture_file);
+    net_capture_put_opt(PCAPNG_OPT_EPB_FLAGS, &flags, 4);
+    net_capture_put_opt(PCAPNG_OPT_END, NULL, 0);
+    net_capture_put32(total);
+}
+
+/**
+ * @brief 取出所有抓包环中的数据帧，写入文件（write为0时直接丢弃）后放回空闲环
+ *
+ * @return int 取出的数据帧数
+ */
+static int net_capture_drain(int write)
+{
+    int total = 0;
+    for (int i = 0; i < NET_CAPTURE_MAX_THREADS; i++)
+    {
+        net_capture_channel_t *channel = atomic_load_explicit(&net_capture_channels[i], memory_order_acquire);
+        net_capture_rec_t *recs[NET_CAPTURE_WRITE_BURST];
+        int n;
+        while (channel != NULL && (n = ring_dequeue_burst(&channel->ready, (void **)recs, NET_CAPTURE_WRITE_BURST)) > 0)
+        {
+            for (int j = 0; write && j < n; j++)
+                net_capture_write_rec(recs[j]);
+            ring_enqueue_burst(&channel->free, (void **)recs, n);
+            if (write)
+                atomic_fetch_add_explicit(&channel->written, n, memory_order_relaxed);
+            total += n;
+        }
+    }
+    return total;
+}
+
+/**
+ * @brief 写盘线程：没有数据帧时休眠NET_CAPTURE_IDLE_US微秒，收到停止通知后写完已有的数据帧再退出
+ *
+ */
+static void *net_capture_main(void *arg)
+{
+    while (1)
+    {
+        int stopping = atomic_load_explicit(&net_capture_stopping, memory_order_acquire);
+        if (net_capture_drain(1) == 0)
+        {
+            if (stopping)
+                break;
+            usleep(NET_CAPTURE_IDLE_US);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 开始抓包：创建pcapng文件，写入头部与各网卡的接口描述，启动写盘线程并设置抓包钩子
+ *        上一次抓包停止后才放入抓包环的数据帧先被丢弃
+ *
+ * @param path 文件路径，已存在时被覆盖
+ * @param filter 过滤条件，为NULL时抓取所有数据帧
+ * @return int 成功为0，已在抓包、文件无法创建或线程无法启动为-1
+ */
+int net_capture_start(const char *path, const net_capture_filter_t *filter)
+{
+    int idle = 0;
+    if (!atomic_compare_exchange_strong(&net_capture_state, &idle, 1))
+        return -1;
+    net_capture_file = fopen(path, "wb");
+    if (net_capture_file == NULL)
+    {
+        atomic_store(&net_capture_state, 0);
+        return -1;
+    }
+    setvbuf(net_capture_file, NULL, _IOFBF, 1 << 20);
+    if (net_capture_write_header() != 0)
+    {
+        fclose(net_capture_file);
+        atomic_store(&net_capture_state, 0);
+        return -1;
+    }
+    net_capture_drain(0);
+
+    static const net_capture_filter_t all = {0};
+    static const uint8_t any_host[NET_IP_LEN] = {0};
+    net_capture_filter = filter != NULL ? *filter : all;
+    if (net_capture_filter.dir == 0)
+        net_capture_filter.dir = NET_CAPTURE_BOTH;
+    if (net_capture_filter.sample_every == 0)
+        net_capture_filter.sample_every = 1;
+    net_capture_any_host = memcmp(net_capture_filter.host, any_host, NET_IP_LEN) == 0;
+    atomic_fetch_add(&net_capture_session, 1);
+    atomic_store(&net_capture_stopping, 0);
+    if (pthread_create(&net_capture_writer, NULL, net_capture_main, NULL) != 0)
+    {
+        fclose(net_capture_file);
+        atomic_store(&net_capture_state, 0);
+        return -1;
+    }
+    ethernet_set_tap(net_capture_tap);
+    return 0;
+}
+
+/**
+ * @brief 停止抓包：清除抓包钩子，写盘线程写完各抓包环中已有的数据帧后关闭文件并退出
+ *        清除钩子时正在拷贝的数据帧可能来不及写入，会在下一次开始抓包时丢弃；没有在抓包时不做处理
+ *
+ */
+void net_capture_stop()
+{
+    int running = 1;
+    if (!atomic_compare_exchange_strong(&net_capture_state, &running, 2))
+        return;
+    ethernet_set_tap(NULL);
+    atomic_store_explicit(&net_capture_stopping, 1, memory_order_release);
+    pthread_join(net_capture_writer, NULL);
+    fclose(net_capture_file);
+    net_capture_file = NULL;
+    atomic_store(&net_capture_state, 0);
+}
+
+/**
+ * @brief 获取抓包计数，从进程中第一次抓包开始累计，可以在任何线程中调用
+ *
+ * @param stats 保存计数
+ */
+void net_capture_get_stats(net_capture_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < NET_CAPTURE_MAX_THREADS; i++)
+    {
+        net_capture_channel_t *channel = atomic_load_explicit(&net_capture_channels[i], memory_order_acquire);
+        if (channel == NULL)
+            continue;
+        stats->matched += atomic_load_explicit(&channel->matched, memory_order_relaxed);
+        stats->queued += atomic_load_explicit(&channel->queued, memory_order_relaxed);
+        stats->dropped += atomic_load_explicit(&channel->dropped, memory_order_relaxed);
+        stats->written += atomic_load_explicit(&channel->written, memory_order_relaxed);
+    }
+}
@@ -0,0 +1,331 @@
+#include "co.h"
+#include "udp.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief 协程接收的udp端口
+ *        到达的数据报先交给等待队列中最早的协程，没有协程等待时暂存在backlog中
+ *
+ */
+typedef struct co_port
+{
+    int valid;            //有效位
+    uint16_t port;        //端口号
+    co_t *wait_head;      //等待接收的协程，按开始等待的顺序
+    co_t *wait_tail;
+    co_msg_t *backlog;    //暂存的数据报，CO_BACKLOG个，co_open()时分配
+    uint32_t head, count; //backlog中最早的数据报与暂存数
+    uint64_t dropped;     //暂存已满时丢弃的数据报数
+} co_port_t;
+
+static co_t co_pool[CO_POOL_SIZE];
+static co_t *co_free_list;
+static co_t *co_ready_head, *co_ready_tail;
+static int co_active;
+static co_port_t co_ports[CO_MAX_PORTS];
+
+static co_port_t *co_port_find(uint16_t port)
+{
+    for (int i = 0; i < CO_MAX_PORTS; i++)
+        if (co_ports[i].valid && co_ports[i].port == port)
+            return &co_ports[i];
+    return NULL;
+}
+
+/**
+ * @brief 把协程放入就绪队列末尾
+ *
+ */
+void co_ready(co_t *co)
+{
+    co->next = NULL;
+    if (co_ready_tail != NULL)
+        co_ready_tail->next = co;
+    else
+        co_ready_head = co;
+    co_ready_tail = co;
+}
+
+/**
+ * @brief 把协程从端口的等待队列中取下
+ *
+ */
+static void co_port_unwait(co_port_t *port, co_t *co)
+{
+    co_t **p = &port->wait_head, *prev = NULL;
+    while (*p != co)
+    {
+        prev = *p;
+        p = &(*p)->next;
+    }
+    *p = co->next;
+    if (port->wait_tail == co)
+        port->wait_tail = prev;
+    co->port = NULL;
+}
+
+/**
+ * @brief 接收超时或睡眠到期：取消等待并放入就绪队列
+ *
+ */
+static void co_timer_handler(net_timer_t *timer, void *arg)
+{
+    co_t *co = arg;
+    if (co->port != NULL)
+        co_port_unwait(co->port, co);
+    co->result = -1;
+    co_ready(co);
+}
+
+static void co_msg_fill(co_msg_t *msg, uint8_t *src_ip, uint16_t src_port, const uint8_t *data, uint16_t len)
+{
+    memcpy(msg->src_ip, src_ip, NET_IP_LEN);
+    msg->src_port = src_port;
+    msg->len = len < CO_MSG_MAX ? len : CO_MSG_MAX;
+    memcpy(msg->data, data, msg->len);
+}
+
+/**
+ * @brief 端口的udp处理程序：交给最早等待的协程并唤醒它，没有协程等待时暂存
+ *
+ */
+static void co_udp_handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+    co_port_t *port = entry->arg;
+    co_t *co = port->wait_head;
+    if (co != NULL)
+    {
+        co_port_unwait(port, co);
+        timer_del(&co->timer);
+        co_msg_fill(&co->msg, src_ip, src_port, buf->data, buf->len);
+        co->result = 0;
+        co_ready(co);
+    }
+    else if (port->count < CO_BACKLOG)
+    {
+        co_msg_fill(&port->backlog[(port->head + port->count) & (CO_BACKLOG - 1)], src_ip, src_port, buf->data, buf->len);
+        port->count++;
+    }
+    else
+        port->dropped++;
+}
+
+/**
+ * @brief 初始化执行器，须在net_init()之后调用，丢弃所有协程与端口
+ *        net_init()已重置时间轮与udp端口表，这里不再逐个停止定时器、关闭端口
+ *
+ */
+void co_init()
+{
+    for (int i = 0; i < CO_MAX_PORTS; i++)
+        free(co_ports[i].backlog);
+    memset(co_ports, 0, sizeof(co_ports));
+    memset(co_pool, 0, sizeof(co_pool));
+    co_free_list = NULL;
+    for (int i = CO_POOL_SIZE - 1; i >= 0; i--)
+    {
+        co_pool[i].next = co_free_list;
+        co_free_list = &co_pool[i];
+    }
+    co_ready_head = co_ready_tail = NULL;
+    co_active = 0;
+}
+
+/**
+ * @brief 打开一个udp端口供协程接收，没有协程等待时到达的数据报最多暂存CO_BACKLOG个
+ *
+ * @param port 端口号
+ * @return int 成功为0，已打开或端口数已达CO_MAX_PORTS为-1
+ */
+int co_open(uint16_t port)
+{
+    if (co_port_find(port) != NULL)
+        return -1;
+    for (int i = 0; i < CO_MAX_PORTS; i++)
+    {
+        co_port_t *p = &co_ports[i];
+        if (p->valid)
+            continue;
+        memset(p, 0, sizeof(*p));
+        p->backlog = malloc(CO_BACKLOG * sizeof(co_msg_t));
+        if (p->backlog == NULL || udp_open_arg(port, co_udp_handler, p) != 0)
+        {
+            free(p->backlog);
+            p->backlog = NULL;
+            return -1;
+        }
+        p->port = port;
+        p->valid = 1;
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * @brief 关闭端口，等待该端口的协程以-1恢复
+ *
+ * @param port 端口号
+ */
+void co_close(uint16_t port)
+{
+    co_port_t *p = co_port_find(port);
+    if (p == NULL)
+        return;
+    while (p->wait_head != NULL)
+    {
+        co_t *co = p->wait_head;
+        co_port_unwait(p, co);
+        timer_del(&co->timer);
+        co->result = -1;
+        co_ready(co);
+    }
+    udp_close(port);
+    free(p->backlog);
+    p->backlog = NULL;
+    p->valid = 0;
+}
+
+/**
+ * @brief 创建一个协程，放入就绪队列，在下一次co_run()中开始运行
+ *
+ * @param fn 协程体
+ * @param arg 拷贝到协程帧local中的初始数据，可以为NULL
+ * @param len 初始数据长度，不超过CO_LOCAL_SIZE
+ * @return co_t* 协程帧，池已用完或len过长时为NULL
+ */
+co_t *co_spawn(co_fn_t fn, const void *arg, size_t len)
+{
+    co_t *co = co_free_list;
+    if (co == NULL || len > CO_LOCAL_SIZE)
+        return NULL;
+    co_free_list = co->next;
+    co->fn = fn;
+    co->line = 0;
+    co->result = 0;
+    co->port = NULL;
+    if (arg != NULL)
+        memcpy(co->local, arg, len);
+    co_active++;
+    co_ready(co);
+    return co;
+}
+
+/**
+ * @brief 供CO_RECV使用：有暂存的数据报时取出，否则加入端口的等待队列
+ *
+ * @return int 需要挂起为1，已得到结果为0
+ */
+int co_recv_begin(co_t *co, uint16_t port, uint32_t timeout_ms)
+{
+    co_port_t *p = co_port_find(port);
+    if (p == NULL)
+    {
+        co->result = -1;
+        return 0;
+    }
+    if (p->count > 0)
+    {
+        co_msg_t *msg = &p->backlog[p->head];
+        co_msg_fill(&co->msg, msg->src_ip, msg->src_port, msg->data, msg->len);
+        p->head = (p->head + 1) & (CO_BACKLOG - 1);
+        p->count--;
+        co->result = 0;
+        return 0;
+    }
+    co->next = NULL;
+    if (p->wait_tail != NULL)
+        p->wait_tail->next = co;
+    else
+        p->wait_head = co;
+    p->wait_tail = co;
+    co->port = p;
+    if (timeout_ms > 0)
+        timer_add(&co->timer, timeout_ms, co_timer_handler, co);
+    return 1;
+}
+
+/**
+ * @brief 供CO_SLEEP使用：启动协程的定时器，到期时放入就绪队列
+ *
+ */
+void co_sleep_begin(co_t *co, uint32_t ms)
+{
+    timer_add(&co->timer, ms, co_timer_handler, co);
+}
+
+/**
+ * @brief 发送一个udp数据报，协议栈的发送不会阻塞，因此不挂起
+ *
+ * @param data 要发送的数据
+ * @param len 数据长度
+ * @param src_port 源端口号
+ * @param dest_ip 目的ip地址
+ * @param dest_port 目的端口号
+ */
+void co_send(const uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
+{
+    udp_send((uint8_t *)data, len, src_port, dest_ip, dest_port);
+}
+
+/**
+ * @brief 运行开始时就绪队列中的所有协程，运行中让出或新创建的协程留到下一次；结束的协程帧回到池中
+ *
+ * @return int 运行的次数
+ */
+int co_run()
+{
+    int runs = 0;
+    co_t *last = co_ready_tail;
+    while (last != NULL)
+    {
+        co_t *co = co_ready_head;
+        co_ready_head = co->next;
+        if (co_ready_head == NULL)
+            co_ready_tail = NULL;
+        co->fn(co);
+        runs++;
+        if (co->line == -1)
+        {
+            timer_del(&co->timer);
+            co->next = co_free_list;
+            co_free_list = co;
+            co_active--;
+        }
+        if (co == last)
+            break;
+    }
+    return runs;
+}
+
+/**
+ * @brief 一次协议栈轮询，然后运行所有就绪的协程
+ *
+ */
+void co_poll()
+{
+    net_poll();
+    co_run();
+}
+
+/**
+ * @brief 当前存在的协程数
+ *
+ * @return int 协程数
+ */
+int co_count()
+{
+    return co_active;
+}
+
+/**
+ * @brief 获取端口因暂存已满而丢弃的数据报数
+ *
+ * @param port 端口号
+ * @return uint64_t 丢弃数，端口未打开时为0
+ */
+uint64_t co_dropped(uint16_t port)
+{
+    co_port_t *p = co_port_find(port);
+    return p != NULL ? p->dropped : 0;
+}
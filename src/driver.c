@@ -1,113 +1,255 @@
 #include <pcap.h>
+#include <stdlib.h>
 #include <string.h>
 #include "utils.h"
 #include "config.h"
 #include "driver.h"
 
-static pcap_t *pcap;
+struct driver
+{
+    pcap_t *pcap;
+};
+
 static char pcap_errbuf[PCAP_ERRBUF_SIZE];
 
 /**
- * @brief 打开网卡
+ * @brief 按config.h打开的默认网卡，供不区分网卡的旧接口使用
  * 
- * @return int 成功为0，失败为-1
  */
-int driver_open()
+static driver_t *default_driver;
+
+/**
+ * @brief 在已打开的pcap句柄上设置过滤条件，得到驱动句柄
+ *        只接收发往本网卡、广播与组播地址的数据帧，不接收本网卡自己发出的数据帧；
+ *        组播帧是否属于已加入的组由ip层判断（见netif_accepts()）
+ * 
+ * @param pcap pcap句柄，失败时被关闭
+ * @param mac 网卡mac地址
+ * @param net 网卡的网络号
+ * @return driver_t* 驱动句柄，失败为NULL
+ */
+static driver_t *driver_attach(pcap_t *pcap, const uint8_t *mac, uint32_t net)
+{
+    char filter_exp[PCAP_BUF_SIZE];
+    struct bpf_program fp;
+    sprintf(filter_exp, //过滤数据包，ether multicast包括广播
+            "(ether dst %02x:%02x:%02x:%02x:%02x:%02x or ether multicast) and (not ether src %02x:%02x:%02x:%02x:%02x:%02x)",
+            mac[0], mac[1], mac[2], mac[3], mac[4], mac[5],
+            mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    
+    // 只捕获发往本网卡接口、广播与组播的数据帧，也就是只处理发往这张网卡的数据包
+    if (pcap_compile(pcap, &fp, filter_exp, 0, net) == -1)
+    {
+        fprintf(stderr, "Error in pcap_compile: %s\n", pcap_geterr(pcap));
+        pcap_close(pcap);
+        return NULL;
+    }
+    if (pcap_setfilter(pcap, &fp) == -1)
+    {
+        fprintf(stderr, "Error in pcap_setfilter: %s\n", pcap_geterr(pcap));
+        pcap_freecode(&fp);
+        pcap_close(pcap);
+        return NULL;
+    }
+    pcap_freecode(&fp);
+
+    driver_t *driver = malloc(sizeof(driver_t));
+    driver->pcap = pcap;
+    return driver;
+}
+
+/**
+ * @brief 打开一个网卡
+ * 
+ * @param name 网卡名称
+ * @param mac 网卡mac地址，只接收发往该地址、广播与组播的数据帧
+ * @return driver_t* 驱动句柄，失败为NULL
+ */
+driver_t *driver_open_if(const char *name, const uint8_t *mac)
 {
     uint32_t net, mask;
+    pcap_t *pcap;
 
-    // 根据DRIVER_IF_NAME网卡名，获取网卡的网络号net和子网掩码mask
-    if (pcap_lookupnet(DRIVER_IF_NAME, &net, &mask, pcap_errbuf) == -1) //查找网卡
+    // 根据网卡名，获取网卡的网络号net和子网掩码mask
+    if (pcap_lookupnet(name, &net, &mask, pcap_errbuf) == -1) //查找网卡
     {
-        fprintf(stderr, "Error in pcap_lookupnet: %s\n", pcap_geterr(pcap));
-        return -1;
+        fprintf(stderr, "Error in pcap_lookupnet: %s\n", pcap_errbuf);
+        return NULL;
     }
 
     // 获取一个数据包捕获的描述符，以便用来查看网络上的数据包。
     // 第二个参数表示捕获的最大字节数，通常来说数据包的大小不会超过65535
     // 第三个参数表示开启混杂模式，0表示非混杂模式，任何其他值表示混合模式
     // 第四个参数指定需要等待的毫秒数，0表示一直等待直到有数据包到来
-    if ((pcap = pcap_open_live(DRIVER_IF_NAME, 65536, 1, 0, pcap_errbuf)) == NULL) //混杂模式打开网卡
+    if ((pcap = pcap_open_live(name, 65536, 1, 0, pcap_errbuf)) == NULL) //混杂模式打开网卡
     {
-        fprintf(stderr, "Error in pcap_open_live: %s.\n", pcap_geterr(pcap));
-        return -1;
+        fprintf(stderr, "Error in pcap_open_live: %s.\n", pcap_errbuf);
+        return NULL;
     }
     if (pcap_setnonblock(pcap, 1, pcap_errbuf) != 0) //设置非阻塞模式
     {
         fprintf(stderr, "Error in pcap_setnonblock: %s\n", pcap_geterr(pcap));
-        return -1;
-    }
-    char filter_exp[PCAP_BUF_SIZE];
-    struct bpf_program fp;
-    uint8_t mac_addr[6] = DRIVER_IF_MAC;
-    sprintf(filter_exp, //过滤数据包
-            "(ether dst %02x:%02x:%02x:%02x:%02x:%02x or ether broadcast) and (not ether src %02x:%02x:%02x:%02x:%02x:%02x)",
-            mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5],
-            mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
-    
-    // 只捕获发往本网卡接口与广播的数据帧，也就是只处理发往这张网卡的数据包
-    if (pcap_compile(pcap, &fp, filter_exp, 0, net) == -1)
-    {
-        fprintf(stderr, "Error in pcap_compile: %s\n", pcap_geterr(pcap));
-        return -1;
+        pcap_close(pcap);
+        return NULL;
     }
-    if (pcap_setfilter(pcap, &fp) == -1)
+    return driver_attach(pcap, mac, net);
+}
+
+/**
+ * @brief 以一个pcap文件代替网卡，按与driver_open_if()相同的过滤条件依次交出其中的数据帧，用于回放抓包文件
+ *        只能接收，发送总是失败
+ * 
+ * @param path pcap文件路径
+ * @param mac 网卡mac地址
+ * @return driver_t* 驱动句柄，失败为NULL
+ */
+driver_t *driver_open_file(const char *path, const uint8_t *mac)
+{
+    pcap_t *pcap = pcap_open_offline(path, pcap_errbuf);
+    if (pcap == NULL)
     {
-        fprintf(stderr, "Error in pcap_setfilter: %s\n", pcap_geterr(pcap));
-        return -1;
+        fprintf(stderr, "Error in pcap_open_offline: %s\n", pcap_errbuf);
+        return NULL;
     }
-    return 0;
+    return driver_attach(pcap, mac, 0);
 }
 
 /**
- * @brief 试图从网卡接收数据包
+ * @brief 试图从指定网卡接收数据包
  * 
+ * @param driver 驱动句柄
  * @param buf 收到的数据包
  * @return int 数据包的长度，未收到为0，错误为-1
  */
-int driver_recv(buf_t *buf)
+int driver_recv_if(driver_t *driver, buf_t *buf)
 {
     struct pcap_pkthdr *pkt_hdr;
     const uint8_t *pkt_data;
 
     // 从本网卡接口获取一个数据报文
-    int ret = pcap_next_ex(pcap, &pkt_hdr, &pkt_data);
-    if (ret == 0)
+    int ret = pcap_next_ex(driver->pcap, &pkt_hdr, &pkt_data);
+    if (ret == 0 || ret == PCAP_ERROR_BREAK) //PCAP_ERROR_BREAK表示pcap文件已读完
         return 0;
     else if (ret == 1)
     {
+        buf_init(buf, pkt_hdr->len);
         memcpy(buf->data, pkt_data, pkt_hdr->len);
-        buf->len = pkt_hdr->len;
         return pkt_hdr->len;
     }
-    fprintf(stderr, "Error in driver_recv: %s\n", pcap_geterr(pcap));
+    fprintf(stderr, "Error in driver_recv: %s\n", pcap_geterr(driver->pcap));
     return -1;
 }
 
 /**
- * @brief 使用网卡发送一个数据包
+ * @brief 使用指定网卡发送一个数据包
  * 
+ * @param driver 驱动句柄
  * @param buf 要发送的数据包
  * @return int 成功为0，失败为-1
  */
-int driver_send(buf_t *buf)
+int driver_send_if(driver_t *driver, buf_t *buf)
 {   
 
     // 将数据包发往指定的网卡接口
-    if (pcap_sendpacket(pcap, buf->data, buf->len) == -1)
+    if (pcap_sendpacket(driver->pcap, buf->data, buf->len) == -1)
     {
-        fprintf(stderr, "Error in driver_send: %s\n", pcap_geterr(pcap));
+        fprintf(stderr, "Error in driver_send: %s\n", pcap_geterr(driver->pcap));
         return -1;
     }
 
     return 0;
 }
 
+/**
+ * @brief 使用指定网卡批量发送数据包
+ *        libpcap在Linux上没有批量发送接口，这里逐个发送，
+ *        但上层只需一次调用即可交出整批数据帧
+ * 
+ * @param driver 驱动句柄
+ * @param frames 要发送的数据帧
+ * @param lens 每个数据帧的长度
+ * @param n 数据帧个数
+ * @return int 成功发送的个数
+ */
+int driver_send_burst_if(driver_t *driver, uint8_t *frames[], uint16_t lens[], int n)
+{
+    int sent = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (pcap_sendpacket(driver->pcap, frames[i], lens[i]) == -1)
+        {
+            fprintf(stderr, "Error in driver_send_burst: %s\n", pcap_geterr(driver->pcap));
+            continue;
+        }
+        sent++;
+    }
+    return sent;
+}
+
+/**
+ * @brief 关闭指定网卡
+ * 
+ * @param driver 驱动句柄
+ */
+void driver_close_if(driver_t *driver)
+{
+    pcap_close(driver->pcap);
+    free(driver);
+}
+
+/**
+ * @brief 打开网卡
+ * 
+ * @return int 成功为0，失败为-1
+ */
+int driver_open()
+{
+    uint8_t mac_addr[6] = DRIVER_IF_MAC;
+    default_driver = driver_open_if(DRIVER_IF_NAME, mac_addr);
+    return default_driver == NULL ? -1 : 0;
+}
+
+/**
+ * @brief 试图从网卡接收数据包
+ * 
+ * @param buf 收到的数据包
+ * @return int 数据包的长度，未收到为0，错误为-1
+ */
+int driver_recv(buf_t *buf)
+{
+    return driver_recv_if(default_driver, buf);
+}
+
+/**
+ * @brief 使用网卡发送一个数据包
+ * 
+ * @param buf 要发送的数据包
+ * @return int 成功为0，失败为-1
+ */
+int driver_send(buf_t *buf)
+{
+    return driver_send_if(default_driver, buf);
+}
+
+/**
+ * @brief 使用网卡批量发送数据包
+ * 
+ * @param frames 要发送的数据帧
+ * @param lens 每个数据帧的长度
+ * @param n 数据帧个数
+ * @return int 成功发送的个数
+ */
+int driver_send_burst(uint8_t *frames[], uint16_t lens[], int n)
+{
+    return driver_send_burst_if(default_driver, frames, lens, n);
+}
+
 /**
  * @brief 关闭网卡
  * 
  */
 void driver_close()
 {
-    pcap_close(pcap);
+    driver_close_if(default_driver);
+    default_driver = NULL;
 }
@@ -0,0 +1,73 @@
+#include "drop.h"
+#include "stack.h"
+#include <string.h>
+#include <time.h>
+
+static const char *net_drop_names[NET_DROP_REASON_COUNT] = {
+    [NET_DROP_ETH_TRUNCATED] = "eth_truncated",
+    [NET_DROP_ETH_UNKNOWN_TYPE] = "eth_unknown_type",
+    [NET_DROP_ETH_TX_NO_IF] = "eth_tx_no_if",
+    [NET_DROP_ETH_TX_OVERSIZE] = "eth_tx_oversize",
+    [NET_DROP_ARP_TRUNCATED] = "arp_truncated",
+    [NET_DROP_ARP_UNSUPPORTED] = "arp_unsupported",
+    [NET_DROP_IP_TRUNCATED] = "ip_truncated",
+    [NET_DROP_IP_BAD_VERSION] = "ip_bad_version",
+    [NET_DROP_IP_BAD_HDR_LEN] = "ip_bad_hdr_len",
+    [NET_DROP_IP_CHECKSUM] = "ip_checksum",
+    [NET_DROP_IP_NOT_FOR_US] = "ip_not_for_us",
+    [NET_DROP_IP_UNKNOWN_PROTO] = "ip_unknown_proto",
+    [NET_DROP_IP_FWD_NO_IF] = "ip_fwd_no_if",
+    [NET_DROP_IP_TTL_EXCEEDED] = "ip_ttl_exceeded",
+    [NET_DROP_ICMP_TRUNCATED] = "icmp_truncated",
+    [NET_DROP_ICMP_CHECKSUM] = "icmp_checksum",
+    [NET_DROP_ICMP_NOT_FOR_US] = "icmp_not_for_us",
+    [NET_DROP_ICMP_UNHANDLED] = "icmp_unhandled",
+    [NET_DROP_UDP_TRUNCATED] = "udp_truncated",
+    [NET_DROP_UDP_BAD_LEN] = "udp_bad_len",
+    [NET_DROP_UDP_CHECKSUM] = "udp_checksum",
+    [NET_DROP_UDP_NO_PORT] = "udp_no_port",
+};
+
+/**
+ * @brief 获取丢弃原因的名称
+ *
+ * @param reason 丢弃原因
+ * @return const char* 名称，未知的原因为"unknown"
+ */
+const char *net_drop_name(uint16_t reason)
+{
+    return reason < NET_DROP_REASON_COUNT ? net_drop_names[reason] : "unknown";
+}
+
+/**
+ * @brief 把一个被丢弃的数据包写入当前协议栈实例的丢弃日志，由net_drop()在采样时调用
+ *        时间与timer_now_ms()取自同一个单调时钟
+ *
+ * @param reason 丢弃原因
+ * @param ifindex 收到或将要发送数据包的网卡
+ * @param data 数据包
+ * @param len 数据包长度
+ */
+void net_drop_log(net_drop_reason_t reason, int ifindex, const uint8_t *data, uint16_t len)
+{
+    net_drop_ctx_t *ctx = &net_stack_current()->drop;
+    net_drop_sample_t *sample = &ctx->log[ctx->logged++ % NET_DROP_LOG_SIZE];
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    sample->time_ms = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    sample->reason = reason;
+    sample->ifindex = ifindex;
+    sample->len = len;
+    sample->cap_len = len < NET_DROP_SAMPLE_BYTES ? len : NET_DROP_SAMPLE_BYTES;
+    memcpy(sample->data, data, sample->cap_len);
+}
+
+/**
+ * @brief 获取当前协议栈实例的丢弃计数与丢弃日志
+ *
+ * @return const net_drop_ctx_t* 计数与日志
+ */
+const net_drop_ctx_t *net_drop_get_stats()
+{
+    return &net_stack_current()->drop;
+}
@@ -3,42 +3,184 @@
 #include "driver.h"
 #include "arp.h"
 #include "ip.h"
+#include "netif.h"
+#include "stack.h"
+#include "trace.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdatomic.h>
+
+static _Atomic(ethernet_tap_t) ethernet_tap; //抓包钩子，进程内共享
+
+/**
+ * @brief 有抓包钩子时把数据帧交给它，没有时只是一次读取与一次判断
+ * 
+ */
+static inline void ethernet_tap_frame(int ifindex, const uint8_t *frame, uint16_t len, int tx)
+{
+    ethernet_tap_t tap = atomic_load_explicit(&ethernet_tap, memory_order_acquire);
+    if (tap != NULL)
+        tap(ifindex, frame, len, tx);
+}
+
+static uint32_t ethernet_proto_hash(uint16_t protocol)
+{
+    return (protocol ^ protocol >> 8) & (ETHERNET_PROTO_TABLE_SIZE - 1);
+}
+
+/**
+ * @brief 在分发表中查找协议，常用协议的哈希值互不冲突，一次探测即可命中
+ * 
+ * @return ethernet_proto_t* 表项，未注册时为NULL
+ */
+static ethernet_proto_t *ethernet_proto_find(ethernet_ctx_t *ctx, uint16_t protocol)
+{
+    uint32_t i = ethernet_proto_hash(protocol);
+    while (ctx->protos[i].protocol != protocol)
+    {
+        if (ctx->protos[i].protocol == 0)
+            return NULL;
+        i = (i + 1) & (ETHERNET_PROTO_TABLE_SIZE - 1);
+    }
+    return &ctx->protos[i];
+}
+
+/**
+ * @brief 注册一个以太网协议的处理程序，已注册的协议会被替换
+ *        分发表始终保留一个空位，保证查找能够结束
+ * 
+ * @param protocol 以太网协议类型
+ * @param handler 处理程序，收到时data指向以太网负载；为NULL时丢弃该协议的数据帧
+ * @return int 成功为0，分发表已满为-1
+ */
+int ethernet_register(uint16_t protocol, ethernet_handler_t handler)
+{
+    ethernet_ctx_t *ctx = &net_stack_current()->ethernet;
+    ethernet_proto_t *proto = ethernet_proto_find(ctx, protocol);
+    if (proto == NULL)
+    {
+        int used = 0;
+        for (int i = 0; i < ETHERNET_PROTO_TABLE_SIZE; i++)
+            used += ctx->protos[i].protocol != 0;
+        if (protocol == 0 || used == ETHERNET_PROTO_TABLE_SIZE - 1)
+            return -1;
+        uint32_t i = ethernet_proto_hash(protocol);
+        while (ctx->protos[i].protocol != 0)
+            i = (i + 1) & (ETHERNET_PROTO_TABLE_SIZE - 1);
+        proto = &ctx->protos[i];
+        proto->protocol = protocol;
+    }
+    proto->handler = handler;
+    return 0;
+}
+
+/**
+ * @brief 获取一个以太网协议的收发计数
+ * 
+ * @param protocol 以太网协议类型
+ * @return const net_proto_stats_t* 收发计数，协议未注册时为NULL
+ */
+const net_proto_stats_t *ethernet_get_stats(uint16_t protocol)
+{
+    ethernet_proto_t *proto = ethernet_proto_find(&net_stack_current()->ethernet, protocol);
+    return proto ? &proto->stats : NULL;
+}
+
+/**
+ * @brief 获取所有未注册协议的收发计数之和
+ * 
+ * @return const net_proto_stats_t* 收发计数
+ */
+const net_proto_stats_t *ethernet_get_other_stats()
+{
+    ethernet_ctx_t *ctx = &net_stack_current()->ethernet;
+    return &ctx->other_stats;
+}
+
+/**
+ * @brief 获取当前协议栈实例驱动收发出错的计数
+ * 
+ * @return const ethernet_driver_stats_t* 计数
+ */
+const ethernet_driver_stats_t *ethernet_get_driver_stats()
+{
+    ethernet_ctx_t *ctx = &net_stack_current()->ethernet;
+    return &ctx->driver_stats;
+}
+
+/**
+ * @brief 记录一个发出的数据帧，按以太网协议类型计数，未注册的协议计入other_stats
+ * 
+ * @param protocol 以太网协议类型
+ * @param len 数据帧长度，含以太网头部
+ */
+static void ethernet_count_out(ethernet_ctx_t *ctx, uint16_t protocol, uint16_t len)
+{
+    ethernet_proto_t *proto = ethernet_proto_find(ctx, protocol);
+    net_proto_stats_t *stats = proto != NULL ? &proto->stats : &ctx->other_stats;
+    stats->out_packets++;
+    stats->out_bytes += len;
+}
 
 /**
  * @brief 处理一个收到的数据包
  *        你需要判断以太网数据帧的协议类型，注意大小端转换
- *        如果是ARP协议数据包，则去掉以太网包头，发送到arp层处理arp_in()
- *        如果是IP协议数据包，则去掉以太网包头，发送到IP层处理ip_in()
+ *        按协议类型查分发表，去掉以太网包头后交给注册的处理程序，
+ *        如IP协议交给ip_in()，ARP协议交给arp_in()
+ *        ctx所在的实例须已绑定到本线程，处理程序作用于绑定的实例
  * 
+ * @param ctx 以太网状态
  * @param buf 要处理的数据包
  */
-void ethernet_in(buf_t *buf)
+static void ethernet_in_ctx(ethernet_ctx_t *ctx, buf_t *buf)
 {   
-    if(buf->data[12]==0x08){
-        switch (buf->data[13])
-        {
-        case 0x00://IP
-            buf_remove_header(buf,14);
-            ip_in(buf);
-            break;
-
-        case 0x06://ARP
-            buf_remove_header(buf,14);
-            arp_in(buf);
-            break;
-        
-        default:
-            break;
-        }
-    }   
+    ethernet_tap_frame(buf->ifindex, buf->data, buf->len, 0);
+    ether_hdr_t *hdr = ether_hdr_of(buf);
+    if(hdr == NULL){
+        net_drop(NET_DROP_ETH_TRUNCATED, buf);
+        return;
+    }
+    NET_TRACEPOINT(NET_TRACE_ETHERNET_IN, buf->len, swap16(hdr->protocol));
+    ethernet_proto_t *proto = ethernet_proto_find(ctx, swap16(hdr->protocol));
+    if(proto == NULL || proto->handler == NULL){
+        ctx->other_stats.packets++;
+        ctx->other_stats.bytes += buf->len;
+        net_drop(NET_DROP_ETH_UNKNOWN_TYPE, buf);
+        return;
+    }
+    proto->stats.packets++;
+    proto->stats.bytes += buf->len;
+    buf_remove_header(buf,sizeof(ether_hdr_t));
+    proto->handler(buf);
+}
+
+/**
+ * @brief 在指定的协议栈实例中处理一个收到的数据包，处理期间实例绑定到本线程
+ * 
+ * @param stack 实例
+ * @param buf 要处理的数据包
+ */
+void ethernet_in_stack(net_stack_t *stack, buf_t *buf)
+{
+    net_stack_t *prev = net_stack_bind(stack);
+    ethernet_in_ctx(&stack->ethernet, buf);
+    net_stack_bind(prev);
+}
+
+/**
+ * @brief 在当前协议栈实例中处理一个收到的数据包
+ * 
+ * @param buf 要处理的数据包
+ */
+void ethernet_in(buf_t *buf)
+{
+    ethernet_in_ctx(&net_stack_current()->ethernet, buf);
 }
 
 /**
  * @brief 处理一个要发送的数据包
  *        你需添加以太网包头，填写目的MAC地址、源MAC地址、协议类型
- *        添加完成后将以太网数据帧发送到驱动层
+ *        添加完成后将以太网数据帧发送到buf->ifindex指定网卡的驱动
  * 
  * @param buf 要处理的数据包
  * @param mac 目标ip地址
@@ -46,42 +188,219 @@ void ethernet_in(buf_t *buf)
  */
 void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
 {   
-    buf_add_header(buf,14);
-    uint8_t if_mac[] = DRIVER_IF_MAC;
-    for(int i = 0;i<=5;i++)
+    ethernet_ctx_t *ctx = &net_stack_current()->ethernet;
+    net_if_t *netif = netif_get(buf->ifindex);
+    if (netif == NULL)
     {
-        //填写目的MAC地址
-        buf->data[i] = mac[i];
-        //填写本机MAC地址
-        buf->data[i+6] = if_mac[i];
+        ctx->driver_stats.tx_errors++;
+        net_drop(NET_DROP_ETH_TX_NO_IF, buf);
+        return;
     }
+    buf_add_header(buf,14);
+    //填写目的MAC地址
+    memcpy(buf->data, mac, NET_MAC_LEN);
+    //填写出口网卡的MAC地址
+    memcpy(buf->data + NET_MAC_LEN, netif->mac, NET_MAC_LEN);
 
     //填写协议
     buf->data[12]=protocol/256;
     buf->data[13]=protocol%256;
 
-    driver_send(buf);
+    ethernet_count_out(ctx, protocol, buf->len);
+    NET_TRACEPOINT(NET_TRACE_DRIVER_SEND, buf->len, 1);
+    ethernet_tap_frame(buf->ifindex, buf->data, buf->len, 1);
+    if (ctx->tx_hook != NULL)
+        ctx->tx_hook(buf->ifindex, buf->data, buf->len);
+    else if (driver_send_if(netif->driver, buf) != 0)
+        ctx->driver_stats.tx_errors++;
+}
+
+/**
+ * @brief 发送一个网卡批量发送队列中的所有数据帧
+ * 
+ */
+static void ethernet_flush_if(ethernet_ctx_t *ctx, int ifindex)
+{
+    tx_burst_t *burst = &ctx->tx_burst[ifindex];
+    net_if_t *netif = netif_get(ifindex);
+    if (burst->count == 0)
+        return;
+    if (netif == NULL) //网卡在数据帧入队后被删除
+    {
+        for (int i = 0; i < burst->count; i++)
+            net_drop_frame(NET_DROP_ETH_TX_NO_IF, ifindex, burst->frames[i], burst->lens[i]);
+        ctx->driver_stats.tx_errors += burst->count;
+        burst->count = 0;
+        return;
+    }
+    NET_TRACEPOINT(NET_TRACE_DRIVER_SEND, burst->lens[0], burst->count);
+    for (int i = 0; i < burst->count; i++)
+        ethernet_tap_frame(ifindex, burst->frames[i], burst->lens[i], 1);
+    if (ctx->tx_hook != NULL)
+    {
+        for (int i = 0; i < burst->count; i++)
+            ctx->tx_hook(ifindex, burst->frames[i], burst->lens[i]);
+    }
+    else
+        ctx->driver_stats.tx_errors += burst->count - driver_send_burst_if(netif->driver, burst->frames, burst->lens, burst->count);
+    burst->count = 0;
 }
 
 /**
- * @brief 初始化以太网协议
+ * @brief 将一个已填好以太网头部的数据帧加入出口网卡的批量发送队列，队列满时立即发送
+ * 
+ * @param buf 要发送的数据帧，buf->ifindex为出口网卡
+ */
+void ethernet_out_burst(buf_t *buf)
+{
+    if (buf->len > ETHERNET_MTU + sizeof(ether_hdr_t))
+    {
+        net_drop(NET_DROP_ETH_TX_OVERSIZE, buf);
+        return;
+    }
+    memcpy(ethernet_burst_reserve(buf->ifindex), buf->data, buf->len);
+    ethernet_burst_commit(buf->ifindex, buf->len);
+}
+
+/**
+ * @brief 在出口网卡的批量发送队列中预留一个数据帧，调用者直接在其中构造数据帧
+ *        队列未满时预留的总是下一个空位，提交前再次预留得到同一个数据帧
+ * 
+ * @param ifindex 出口网卡
+ * @return uint8_t* 数据帧，可容纳ETHERNET_MTU加以太网头部
+ */
+uint8_t *ethernet_burst_reserve(int ifindex)
+{
+    ethernet_ctx_t *ctx = &net_stack_current()->ethernet;
+    tx_burst_t *burst = &ctx->tx_burst[ifindex];
+    return burst->frame_buf[burst->count];
+}
+
+/**
+ * @brief 将ethernet_burst_reserve()预留的数据帧加入批量发送队列，队列满时立即发送
+ * 
+ * @param ifindex 出口网卡
+ * @param len 数据帧长度
+ */
+void ethernet_burst_commit(int ifindex, uint16_t len)
+{
+    ethernet_ctx_t *ctx = &net_stack_current()->ethernet;
+    tx_burst_t *burst = &ctx->tx_burst[ifindex];
+    burst->frames[burst->count] = burst->frame_buf[burst->count];
+    burst->lens[burst->count] = len;
+    ethernet_count_out(ctx, swap16(((ether_hdr_t *)burst->frames[burst->count])->protocol), len);
+    if (++burst->count == ETHERNET_TX_BURST)
+        ethernet_flush_if(ctx, ifindex);
+}
+
+/**
+ * @brief 发送指定协议栈实例所有网卡批量发送队列中的数据帧，发送期间实例绑定到本线程
+ * 
+ * @param stack 实例
+ */
+void ethernet_flush_stack(net_stack_t *stack)
+{
+    net_stack_t *prev = net_stack_bind(stack);
+    for (int i = 0; i < NETIF_MAX_IF; i++)
+        ethernet_flush_if(&stack->ethernet, i);
+    net_stack_bind(prev);
+}
+
+/**
+ * @brief 发送当前协议栈实例所有网卡批量发送队列中的数据帧
+ * 
+ */
+void ethernet_flush()
+{
+    ethernet_ctx_t *ctx = &net_stack_current()->ethernet;
+    for (int i = 0; i < NETIF_MAX_IF; i++)
+        ethernet_flush_if(ctx, i);
+}
+
+/**
+ * @brief 设置当前协议栈实例的发送钩子，设置后它的数据帧交给钩子而不再直接调用驱动
+ * 
+ * @param hook 发送钩子，为NULL时恢复直接调用驱动
+ */
+void ethernet_set_tx_hook(ethernet_tx_hook_t hook)
+{
+    ethernet_ctx_t *ctx = &net_stack_current()->ethernet;
+    ctx->tx_hook = hook;
+}
+
+/**
+ * @brief 设置抓包钩子，作用于所有线程的所有协议栈实例，可以在任何线程中调用
+ *        清除后正在别的线程中执行的钩子仍会执行完
+ * 
+ * @param tap 抓包钩子，为NULL时不抓包
+ */
+void ethernet_set_tap(ethernet_tap_t tap)
+{
+    atomic_store_explicit(&ethernet_tap, tap, memory_order_release);
+}
+
+/**
+ * @brief 初始化以太网协议，注册IP与ARP，并为每个网卡打开驱动
  * 
  * @return int 成功为0，失败为-1
  */
 int ethernet_init()
 {
-    buf_init(&rxbuf, ETHERNET_MTU + sizeof(ether_hdr_t));
-    return driver_open();
+    ethernet_ctx_t *ctx = &net_stack_current()->ethernet;
+    ethernet_register(NET_PROTOCOL_IP, ip_in);
+    ethernet_register(NET_PROTOCOL_ARP, arp_in);
+    buf_init(&ctx->rxbuf, ETHERNET_MTU + sizeof(ether_hdr_t));
+    for (int i = 0; i < NETIF_MAX_IF; i++)
+    {
+        net_if_t *netif = netif_get(i);
+        if (netif == NULL || netif->driver != NULL)
+            continue;
+        netif->driver = driver_open_if(netif->name, netif->mac);
+        if (netif->driver == NULL)
+            return -1;
+    }
+    return 0;
 }
 
 /**
- * @brief 一次以太网轮询
+ * @brief 一次以太网轮询，只接收指定协议栈实例负责的网卡，轮询期间实例绑定到本线程
+ *        每个网卡一次最多接收ETHERNET_RX_BURST个数据帧，
+ *        处理完这一批后再统一发送批量发送队列中的数据帧
  * 
+ * @param stack 实例
  */
-void ethernet_poll()
+void ethernet_poll_stack(net_stack_t *stack)
 {
-    if (driver_recv(&rxbuf) > 0){
-        ethernet_in(&rxbuf);
+    net_stack_t *prev = net_stack_bind(stack);
+    ethernet_ctx_t *ctx = &stack->ethernet;
+    for (int i = 0; i < NETIF_MAX_IF; i++)
+    {
+        net_if_t *netif = netif_get(i);
+        if (netif == NULL || netif->driver == NULL || !net_stack_owns(stack, i))
+            continue;
+        for (int j = 0; j < ETHERNET_RX_BURST; j++)
+        {
+            int len = driver_recv_if(netif->driver, &ctx->rxbuf);
+            if (len <= 0)
+            {
+                ctx->driver_stats.rx_errors += len < 0;
+                break;
+            }
+            NET_TRACEPOINT(NET_TRACE_DRIVER_RECV, len, i);
+            ctx->rxbuf.ifindex = i;
+            ethernet_in_ctx(ctx, &ctx->rxbuf);
+        }
     }
-        
+    for (int i = 0; i < NETIF_MAX_IF; i++)
+        ethernet_flush_if(ctx, i);
+    net_stack_bind(prev);
+}
+
+/**
+ * @brief 一次当前协议栈实例的以太网轮询
+ * 
+ */
+void ethernet_poll()
+{
+    ethernet_poll_stack(net_stack_current());
 }
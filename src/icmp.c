@@ -1,80 +1,311 @@
 #include "icmp.h"
 #include "ip.h"
+#include "netif.h"
+#include "timer.h"
+#include "stack.h"
 #include <string.h>
 #include <stdio.h>
 
+/**
+ * @brief 补充令牌，返回是否至少有一个令牌；rate为0时总是有令牌，新桶先补满
+ * 
+ */
+static int icmp_bucket_refill(icmp_bucket_t *bucket, uint32_t rate, uint32_t burst, uint64_t now)
+{
+    if (rate == 0)
+        return 1;
+    if (bucket->last_ms == 0)
+        bucket->tokens = burst * 1000;
+    uint64_t tokens = bucket->tokens + (now - bucket->last_ms) * rate;
+    bucket->tokens = tokens > burst * 1000 ? burst * 1000 : tokens;
+    bucket->last_ms = now;
+    return bucket->tokens >= 1000;
+}
+
+static icmp_src_bucket_t *icmp_src_bucket(uint8_t *ip, uint64_t now)
+{
+    icmp_ctx_t *ctx = &net_stack_current()->icmp;
+    uint32_t key = ((uint32_t)ip[0] << 24) | ((uint32_t)ip[1] << 16) | ((uint32_t)ip[2] << 8) | ip[3];
+    icmp_src_bucket_t *src = &ctx->src_buckets[(key * 2654435761u) >> 24 & (ICMP_RATE_TABLE_SIZE - 1)];
+    if (!src->valid || memcmp(src->ip, ip, NET_IP_LEN) != 0)
+    {
+        src->valid = 1;
+        memcpy(src->ip, ip, NET_IP_LEN);
+        src->bucket.tokens = ctx->limit.src_burst * 1000;
+        src->bucket.last_ms = now;
+    }
+    return src;
+}
+
+/**
+ * @brief 检查全局与按地址的令牌桶，两者都有令牌时才允许发送
+ * 
+ * @param ip 差错报文的目的地址
+ * @param consume 允许时是否消耗令牌
+ * @return int 允许为1，不允许为0并计入抑制计数
+ */
+static int icmp_error_allow(uint8_t *ip, int consume)
+{
+    icmp_ctx_t *ctx = &net_stack_current()->icmp;
+    uint64_t now = timer_now_ms();
+    icmp_src_bucket_t *src = icmp_src_bucket(ip, now);
+    if (!icmp_bucket_refill(&src->bucket, ctx->limit.src_rate, ctx->limit.src_burst, now))
+    {
+        ctx->error_stats.suppressed_src++;
+        return 0;
+    }
+    if (!icmp_bucket_refill(&ctx->global_bucket, ctx->limit.global_rate, ctx->limit.global_burst, now))
+    {
+        ctx->error_stats.suppressed_global++;
+        return 0;
+    }
+    if (consume)
+    {
+        if (ctx->limit.src_rate)
+            src->bucket.tokens -= 1000;
+        if (ctx->limit.global_rate)
+            ctx->global_bucket.tokens -= 1000;
+    }
+    return 1;
+}
+
 /**
  * @brief 处理一个收到的数据包
  *        你首先要检查ICMP报头长度是否小于icmp头部长度
  *        接着，查看该报文的ICMP类型是否为回显请求，
- *        如果是，则回送一个回显应答（ping应答），需要自行封装应答包。
+ *        如果是，则回送一个回显应答（ping应答），需要自行封装应答包；
+ *        发往广播或组播地址的回显请求不应答。
  * 
  *        应答包封装如下：
  *        首先调用buf_init()函数初始化txbuf，然后封装报头和数据，
- *        数据部分可以拷贝来自接收到的回显请求报文中的数据。
+ *        应答的标识符、序号与数据部分都与回显请求相同，只需改写类型并增量修正校验和，不必重新累加数据部分。
  *        最后将封装好的ICMP报文发送到IP层。  
  * 
+ *        如果是回显应答，则交给icmp_set_echo_handler()注册的处理程序。
+ * 
+ *        如果是“需要分片”差错，则其数据部分是被丢弃数据报的IP头部，
+ *        原数据报由本机发出时，按其中的下一跳MTU更新到原目的地址的路径MTU。
+ * 
  * @param buf 要处理的数据包
  * @param src_ip 源ip地址
+ * @param dest_ip 目的ip地址，回显应答以它作为源地址
  */
-void icmp_in(buf_t *buf, uint8_t *src_ip)
+void icmp_in(buf_t *buf, uint8_t *src_ip, uint8_t *dest_ip)
 {
-    icmp_hdr_t icmp_hdr;
-    icmp_hdr.type = buf->data[0];
-    icmp_hdr.code = buf->data[1];
-    icmp_hdr.checksum = (buf->data[2]<<8)+buf->data[3];
-    icmp_hdr.id = (buf->data[4]<<8)+buf->data[5];
-    icmp_hdr.seq = (buf->data[6]<<8)+buf->data[7];
+    icmp_ctx_t *ctx = &net_stack_current()->icmp;
+    icmp_hdr_t *hdr = icmp_hdr_of(buf);
+    if(hdr == NULL){
+        net_drop(NET_DROP_ICMP_TRUNCATED, buf);
+        return;
+    }
 
     //对包括 ICMP 报文数据部分在内的整个 ICMP 数据报的校验和
-    if(checksum16((uint16_t*) buf->data, buf->len/2)!=0) return;
+    if(checksum16((uint16_t*) buf->data, buf->len/2)!=0){
+        net_drop(NET_DROP_ICMP_CHECKSUM, buf);
+        return;
+    }
     
-    uint16_t static this_seq = 1;
     //查看该报文的ICMP类型是否为回显请求
-    if(icmp_hdr.type==ICMP_TYPE_ECHO_REQUEST){
-        buf_init(&txbuf,buf->len);
-        memset(&txbuf.data[0],0,sizeof(uint8_t)*4);
-        txbuf.data[4] = (icmp_hdr.seq) >> 8;
-        txbuf.data[5] = icmp_hdr.seq & 0xff;
-        txbuf.data[6] = (this_seq) >> 8;
-        txbuf.data[7] = this_seq & 0xff;
-        memcpy(&txbuf.data[8],&buf->data[8],buf->len-8);
-        
-        uint16_t cksum = checksum16((uint16_t*) txbuf.data, buf->len/2);
-        txbuf.data[2] = (cksum&0xff00) >> 8;
-        txbuf.data[3] = cksum & 0xff;
-
-        this_seq++;
-        ip_out(&txbuf,src_ip,NET_PROTOCOL_ICMP);
+    if(hdr->type==ICMP_TYPE_ECHO_REQUEST){
+        if(netif_lookup(dest_ip) == -1){
+            net_drop(NET_DROP_ICMP_NOT_FOR_US, buf);
+            return;
+        }
+        buf_init(&ctx->txbuf,buf->len);
+        memcpy(ctx->txbuf.data,buf->data,buf->len);
+        icmp_hdr_t *reply = (icmp_hdr_t *)ctx->txbuf.data;
+        //只有类型与代码所在的16位字改变，按RFC 1624增量修正校验和：HC' = ~(~HC + ~m + m')
+        uint16_t old_word, new_word;
+        memcpy(&old_word, reply, sizeof(old_word));
+        reply->type = ICMP_TYPE_ECHO_REPLY;
+        reply->code = 0;
+        memcpy(&new_word, reply, sizeof(new_word));
+        reply->checksum = checksum_fold((uint16_t)~reply->checksum + (uint16_t)~old_word + new_word);
+
+        ip_out_from(&ctx->txbuf,dest_ip,src_ip,NET_PROTOCOL_ICMP);
     }
-    
+    else if(hdr->type==ICMP_TYPE_ECHO_REPLY && ctx->echo_handler != NULL){
+        ctx->echo_handler(src_ip, swap16(hdr->id), swap16(hdr->seq), (uint8_t *)(hdr + 1), buf->len - sizeof(icmp_hdr_t));
+    }
+    else if(hdr->type==ICMP_TYPE_UNREACH && hdr->code==ICMP_CODE_FRAG_NEEDED && buf->len >= sizeof(icmp_hdr_t) + sizeof(ip_hdr_t)){
+        ip_hdr_t *orig = (ip_hdr_t *)(hdr + 1);
+        if(netif_lookup(orig->src_ip) != -1) //“需要分片”差错的序号字段为下一跳MTU
+            ip_pmtu_update(orig->dest_ip, swap16(hdr->seq), swap16(orig->total_len));
+    }
+    else
+        net_drop(NET_DROP_ICMP_UNHANDLED, buf);
+}
 
-    
+/**
+ * @brief 发送一个回显请求
+ * 
+ * @param dest_ip 目的ip地址
+ * @param id 标识符
+ * @param seq 序号
+ * @param data 数据
+ * @param len 数据长度
+ */
+void icmp_send_echo(uint8_t *dest_ip, uint16_t id, uint16_t seq, const uint8_t *data, uint16_t len)
+{
+    icmp_ctx_t *ctx = &net_stack_current()->icmp;
+    buf_init(&ctx->txbuf, sizeof(icmp_hdr_t) + len);
+    icmp_hdr_t *req = (icmp_hdr_t *)ctx->txbuf.data;
+    req->type = ICMP_TYPE_ECHO_REQUEST;
+    req->code = 0;
+    req->checksum = 0;
+    req->id = swap16(id);
+    req->seq = swap16(seq);
+    memcpy(req + 1, data, len);
+    req->checksum = checksum_fold(checksum_add(0, ctx->txbuf.data, ctx->txbuf.len));
+    ip_out(&ctx->txbuf, dest_ip, NET_PROTOCOL_ICMP);
 }
 
 /**
- * @brief 发送icmp不可达
- *        你需要首先调用buf_init初始化buf，长度为ICMP头部 + IP头部 + 原始IP数据报中的前8字节 
- *        填写ICMP报头首部，类型值为目的不可达
- *        填写校验和
+ * @brief 注册回显应答的处理程序
+ * 
+ * @param handler 处理程序，为NULL时丢弃回显应答
+ */
+void icmp_set_echo_handler(icmp_echo_handler_t handler)
+{
+    icmp_ctx_t *ctx = &net_stack_current()->icmp;
+    ctx->echo_handler = handler;
+}
+
+/**
+ * @brief 判断是否按RFC 1812第4.3.2.7节不为一个数据报发送差错报文：
+ *        原数据报是icmp差错报文、不是第一个分片，或源地址为0.0.0.0、组播或广播地址
+ * 
+ * @param recv_buf 收到的ip数据包，data指向ip头部
+ * @param src_ip 原数据报的源地址
+ * @return int 不发送为1
+ */
+static int icmp_error_forbidden(buf_t *recv_buf, uint8_t *src_ip)
+{
+    ip_hdr_t *ip = (ip_hdr_t *)recv_buf->data;
+    if (swap16(ip->flags_fragment) & 0x1fff)
+        return 1;
+    int hdr_len = ip->hdr_len * IP_HDR_LEN_PER_BYTE;
+    if (ip->protocol == NET_PROTOCOL_ICMP && recv_buf->len > hdr_len)
+    {
+        uint8_t type = recv_buf->data[hdr_len];
+        if (type == ICMP_TYPE_UNREACH || type == ICMP_TYPE_SOURCE_QUENCH || type == ICMP_TYPE_REDIRECT ||
+            type == ICMP_TYPE_TIME_EXCEEDED || type == ICMP_TYPE_PARAM_PROBLEM)
+            return 1;
+    }
+    uint8_t any[NET_IP_LEN] = {0};
+    return src_ip[0] >= 224 || memcmp(src_ip, any, NET_IP_LEN) == 0 || netif_accepts(recv_buf->ifindex, src_ip);
+}
+
+/**
+ * @brief 发送icmp差错报文
+ *        你需要首先调用buf_init初始化buf，长度为ICMP头部 + IP头部 + 原始IP数据报中的前8字节，
+ *        原数据报更短时只带原数据报
+ *        填写ICMP报头首部与校验和
  *        将封装好的ICMP数据报发送到IP层。
+ *        原数据报发往本机地址时以该地址作为源地址，否则按出口网卡选择。
+ *        icmp_error_forbidden()禁止的数据报不发送差错报文，也不消耗令牌。
+ *        发送前先经过全局与按地址的令牌桶，没有令牌时只增加抑制计数。
+ * 
+ * @param recv_buf 收到的ip数据包
+ * @param src_ip 源ip地址
+ * @param type icmp type
+ * @param code icmp code
+ */
+static void icmp_error(buf_t *recv_buf, uint8_t *src_ip, icmp_type_t type, icmp_code_t code)
+{   
+    icmp_ctx_t *ctx = &net_stack_current()->icmp;
+    if(icmp_error_forbidden(recv_buf, src_ip)) return;
+    if(!icmp_error_allow(src_ip, 1)) return;
+    ctx->error_stats.sent++;
+
+    //ICMP 差错报文：头部只有类型与代码不为0，累加和加上带回的原数据报即得校验和
+    int hdr_len = ((ip_hdr_t *)recv_buf->data)->hdr_len * IP_HDR_LEN_PER_BYTE;
+    int len = recv_buf->len < hdr_len + 8 ? recv_buf->len : hdr_len + 8;
+    buf_init(&ctx->txbuf,sizeof(icmp_hdr_t) + len);
+    icmp_hdr_t *hdr = (icmp_hdr_t *)ctx->txbuf.data;
+    memset(hdr, 0, sizeof(icmp_hdr_t));
+    hdr->type = type;
+    hdr->code = code;
+    memcpy(hdr + 1,recv_buf->data,len);
+    hdr->checksum = checksum_fold(checksum_add(checksum_add(0, hdr, 2), hdr + 1, len));
+
+    uint8_t *orig_dest = recv_buf->data + 16;
+    ip_out_from(&ctx->txbuf,netif_lookup(orig_dest) != -1 ? orig_dest : NULL,src_ip,NET_PROTOCOL_ICMP);
+}
+
+/**
+ * @brief 发送icmp不可达
  * 
  * @param recv_buf 收到的ip数据包
  * @param src_ip 源ip地址
  * @param code icmp code，协议不可达或端口不可达
  */
 void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
-{   
-    //ICMP 差错报文
-    int icmp_len = 36;
-    buf_init(&txbuf,icmp_len);
-    txbuf.data[0] = 3; txbuf.data[1] = code;
-    memset(&txbuf.data[2],0,sizeof(uint8_t)*6);
-    memcpy(&txbuf.data[8],recv_buf->data,28);
-
-    uint16_t cksum = checksum16((uint16_t*) txbuf.data, icmp_len/2);
-    txbuf.data[2] = (cksum&0xff00) >> 8;
-    txbuf.data[3] = cksum & 0xff;
-
-    ip_out(&txbuf,src_ip,NET_PROTOCOL_ICMP);
-}
\ No newline at end of file
+{
+    icmp_error(recv_buf, src_ip, ICMP_TYPE_UNREACH, code);
+}
+
+/**
+ * @brief 发送icmp超时（TTL耗尽），转发时TTL减到0的数据报使用
+ * 
+ * @param recv_buf 收到的ip数据包
+ * @param src_ip 源ip地址
+ */
+void icmp_time_exceeded(buf_t *recv_buf, uint8_t *src_ip)
+{
+    icmp_error(recv_buf, src_ip, ICMP_TYPE_TIME_EXCEEDED, ICMP_CODE_TTL_EXCEEDED);
+}
+
+/**
+ * @brief 检查是否允许向一个地址发送icmp差错报文，不消耗令牌
+ *        不允许时计入抑制计数，调用者可以跳过构造原数据报的开销，直接丢弃
+ * 
+ * @param ip 差错报文的目的地址，即出错数据报的源地址
+ * @return int 允许为1，不允许为0
+ */
+int icmp_error_allowed(uint8_t *ip)
+{
+    return icmp_error_allow(ip, 0);
+}
+
+/**
+ * @brief 初始化当前协议栈实例的icmp，限速参数恢复为config.h中的默认值，清空令牌桶与回显应答的处理程序
+ * 
+ */
+void icmp_init()
+{
+    icmp_ctx_t *ctx = &net_stack_current()->icmp;
+    ctx->limit = (icmp_rate_limit_t){ICMP_RATE_GLOBAL, ICMP_BURST_GLOBAL, ICMP_RATE_PER_SRC, ICMP_BURST_PER_SRC};
+    ctx->echo_handler = NULL;
+    ctx->global_bucket.tokens = 0;
+    ctx->global_bucket.last_ms = 0;
+    for (int i = 0; i < ICMP_RATE_TABLE_SIZE; i++)
+        ctx->src_buckets[i].valid = 0;
+}
+
+/**
+ * @brief 设置当前协议栈实例的icmp差错报文的限速参数，速率为0表示不限制
+ *        已有令牌桶中的令牌数不超过新的容量
+ * 
+ * @param limit 限速参数
+ */
+void icmp_set_rate_limit(const icmp_rate_limit_t *limit)
+{
+    icmp_ctx_t *ctx = &net_stack_current()->icmp;
+    ctx->limit = *limit;
+    if (ctx->global_bucket.tokens > limit->global_burst * 1000)
+        ctx->global_bucket.tokens = limit->global_burst * 1000;
+    for (int i = 0; i < ICMP_RATE_TABLE_SIZE; i++)
+        ctx->src_buckets[i].valid = 0;
+}
+
+/**
+ * @brief 获取icmp差错报文的发送与抑制计数
+ * 
+ * @return const icmp_error_stats_t* 计数
+ */
+const icmp_error_stats_t *icmp_get_error_stats()
+{
+    icmp_ctx_t *ctx = &net_stack_current()->icmp;
+    return &ctx->error_stats;
+}
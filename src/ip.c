@@ -2,113 +2,368 @@
 #include "arp.h"
 #include "icmp.h"
 #include "udp.h"
+#include "route.h"
+#include "ethernet.h"
+#include "netif.h"
+#include "timer.h"
+#include "stack.h"
+#include "trace.h"
 #include <string.h>
 
+static int ip_forwarding = IP_FORWARD;
+
+/**
+ * @brief 内置的上层协议处理程序，其他协议由各自模块在初始化时调用ip_register()注册
+ * 
+ */
+static const ip_handler_t ip_builtin_handlers[256] = {
+    [NET_PROTOCOL_ICMP] = icmp_in,
+    [NET_PROTOCOL_UDP] = udp_in,
+};
+
+/**
+ * @brief RFC 1191中的MTU平台值，路由器未提供下一跳MTU时按原数据报长度取下一个较小值
+ * 
+ */
+static const uint16_t ip_mtu_plateaus[] = {32000, 17914, 8166, 4352, 2002, 1492, 1006, 508, 296, IP_PMTU_MIN};
+
+static ip_pmtu_entry_t *ip_pmtu_slot(uint8_t *ip)
+{
+    ip_ctx_t *ctx = &net_stack_current()->ip;
+    uint32_t key = ((uint32_t)ip[0] << 24) | ((uint32_t)ip[1] << 16) | ((uint32_t)ip[2] << 8) | ip[3];
+    return &ctx->pmtu_cache[(key * 2654435761u) >> 24 & (IP_PMTU_CACHE_SIZE - 1)];
+}
+
+/**
+ * @brief 路径MTU老化定时器，超时的表项恢复为网卡MTU
+ *        RFC 1191建议定期尝试更大的MTU，以便路径变化后能重新用上更大的报文
+ * 
+ */
+static void ip_pmtu_age(net_timer_t *timer, void *arg)
+{
+    ip_ctx_t *ctx = &net_stack_current()->ip;
+    uint64_t now = timer_now_ms();
+    int remain = 0;
+    for (int i = 0; i < IP_PMTU_CACHE_SIZE; i++)
+    {
+        if (ctx->pmtu_cache[i].valid && ctx->pmtu_cache[i].expire_ms <= now)
+            ctx->pmtu_cache[i].valid = 0;
+        remain |= ctx->pmtu_cache[i].valid;
+    }
+    if (remain)
+        timer_add(timer, IP_PMTU_AGE_INTERVAL * 1000, ip_pmtu_age, NULL);
+}
+
+/**
+ * @brief 获取到目的地址的路径MTU
+ * 
+ * @param ip 目的ip地址
+ * @return int 路径MTU，未发现更小值时为网卡MTU
+ */
+int ip_get_pmtu(uint8_t *ip)
+{
+    ip_pmtu_entry_t *entry = ip_pmtu_slot(ip);
+    if (entry->valid && memcmp(entry->ip, ip, NET_IP_LEN) == 0)
+        return entry->mtu;
+    return ETHERNET_MTU;
+}
+
+/**
+ * @brief 根据ICMP“需要分片”差错更新到目的地址的路径MTU
+ *        只会减小路径MTU，增大只能等待老化，以免伪造的差错报文把MTU抬高。
+ * 
+ * @param ip 目的ip地址
+ * @param mtu 差错报文中的下一跳MTU，0表示路由器未提供
+ * @param orig_len 被丢弃的原数据报总长度
+ */
+void ip_pmtu_update(uint8_t *ip, uint16_t mtu, uint16_t orig_len)
+{
+    ip_ctx_t *ctx = &net_stack_current()->ip;
+    if (mtu == 0 || mtu >= orig_len)
+    {
+        int i = 0;
+        while (ip_mtu_plateaus[i] >= orig_len && ip_mtu_plateaus[i] > IP_PMTU_MIN)
+            i++;
+        mtu = ip_mtu_plateaus[i];
+    }
+    if (mtu < IP_PMTU_MIN)
+        mtu = IP_PMTU_MIN;
+    if (mtu >= ip_get_pmtu(ip))
+        return;
+
+    ip_pmtu_entry_t *entry = ip_pmtu_slot(ip);
+    entry->valid = 1;
+    memcpy(entry->ip, ip, NET_IP_LEN);
+    entry->mtu = mtu;
+    entry->expire_ms = timer_now_ms() + IP_PMTU_TIMEOUT_SEC * 1000ull;
+    if (!ctx->pmtu_timer.pending)
+        timer_add(&ctx->pmtu_timer, IP_PMTU_AGE_INTERVAL * 1000, ip_pmtu_age, NULL);
+}
+
+/**
+ * @brief 转发一个目的地址不是本机的数据报
+ *        TTL耗尽时回送ICMP超时报文；否则TTL减1，并按RFC 1624增量更新首部校验和，
+ *        不必重新计算整个首部。查路由表得到下一跳后，若下一跳mac已知，
+ *        直接在接收缓冲区中改写以太网头部并加入批量发送队列；
+ *        未知时交给arp层缓存并发送arp请求。
+ * 
+ * @param buf 要转发的包，data指向ip头部，其前面仍是收到时的以太网头部
+ * @param hdr 已检查过的ip头部
+ */
+static void ip_forward(buf_t *buf, ip_hdr_t *hdr)
+{
+    ip_ctx_t *ctx = &net_stack_current()->ip;
+    if (hdr->ttl <= 1)
+    {
+        ctx->forward_stats.ttl_exceeded++;
+        net_drop(NET_DROP_IP_TTL_EXCEEDED, buf);
+        icmp_time_exceeded(buf, hdr->src_ip);
+        return;
+    }
+
+    uint16_t old_word = (hdr->ttl << 8) | hdr->protocol;
+    hdr->ttl--;
+    uint16_t new_word = (hdr->ttl << 8) | hdr->protocol;
+    uint32_t sum = (uint16_t)~swap16(hdr->hdr_checksum) + (uint16_t)~old_word + new_word;
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum += sum >> 16;
+    uint16_t cksum = ~sum;
+    hdr->hdr_checksum = swap16(cksum);
+
+    uint8_t *next_hop = route_lookup(hdr->dest_ip, &buf->ifindex);
+    net_if_t *netif = netif_get(buf->ifindex);
+    uint8_t *mac = arp_lookup(next_hop);
+    if (netif == NULL)
+    {
+        ctx->forward_stats.no_if++;
+        net_drop(NET_DROP_IP_FWD_NO_IF, buf);
+        return;
+    }
+    if (mac == NULL)
+    {
+        ctx->forward_stats.arp_miss++;
+        arp_out(buf, next_hop, NET_PROTOCOL_IP);
+        return;
+    }
+    buf_add_header(buf, sizeof(ether_hdr_t));
+    memcpy(buf->data, mac, NET_MAC_LEN);
+    memcpy(buf->data + NET_MAC_LEN, netif->mac, NET_MAC_LEN);
+    ethernet_out_burst(buf);
+    ctx->forward_stats.forwarded++;
+}
+
+/**
+ * @brief 找出ip_hdr_of()拒绝一个数据包的原因，只在丢弃时调用
+ * 
+ * @param buf 被拒绝的数据包
+ * @return net_drop_reason_t 丢弃原因
+ */
+static net_drop_reason_t ip_hdr_drop_reason(buf_t *buf)
+{
+    ip_hdr_t *hdr = (ip_hdr_t *)buf->data;
+    if (buf->len < sizeof(ip_hdr_t))
+        return NET_DROP_IP_TRUNCATED;
+    if (hdr->version != IP_VERSION_4)
+        return NET_DROP_IP_BAD_VERSION;
+    if (hdr->hdr_len < 5 || swap16(hdr->total_len) < hdr->hdr_len * IP_HDR_LEN_PER_BYTE)
+        return NET_DROP_IP_BAD_HDR_LEN;
+    return NET_DROP_IP_TRUNCATED;
+}
 
 /**
  * @brief 处理一个收到的数据包
  *        你首先需要做报头检查，检查项包括：版本号、总长度、首部长度等。
+ *        这些检查都在ip_hdr_of()中一次完成，之后直接读取头部字段，不再复制到临时变量。
  * 
  *        接着，计算头部校验和，注意：需要先把头部校验和字段缓存起来，再将校验和字段清零，
  *        调用checksum16()函数计算头部检验和，比较计算的结果与之前缓存的校验和是否一致，
  *        如果不一致，则不处理该数据报。
  * 
- *        检查收到的数据包的目的IP地址是否为本机的IP地址，只处理目的IP为本机的数据报。
+ *        检查收到的数据包的目的IP地址是否为本机的某个IP地址，只处理目的IP为本机的数据报。
+ *        本机地址保存在netif的哈希表中，一次查找即可完成判断。
+ *        发往广播地址或收到该帧的网卡已加入的组播组的数据报同样接收，组成员也保存在哈希表中；
+ *        这些数据报不转发，也不回送ICMP差错报文。
+ *        开启转发时，目的IP不是本机的单播数据报交给ip_forward()转发。
+ * 
+ *        检查IP报头的协议字段，按协议号查分发表：
+ *        如果注册了处理程序（如ICMP、UDP），则去掉IP头部，交给该协议层处理
+ *        如果是没有注册的协议，则需要调用icmp_unreachable()函数回送一个ICMP协议不可达的报文。
  * 
- *        检查IP报头的协议字段：
- *        如果是ICMP协议，则去掉IP头部，发送给ICMP协议层处理
- *        如果是UDP协议，则去掉IP头部，发送给UDP协议层处理
- *        如果是本实验中不支持的其他协议，则需要调用icmp_unreachable()函数回送一个ICMP协议不可达的报文。
+ *        每个不处理数据报的位置都调用net_drop()按原因计数。
  *          
  * @param buf 要处理的包
  */
 void ip_in(buf_t *buf)
 {   
-    //set ip_hdr
-    ip_hdr_t ip_hdr;
-    ip_hdr.version = (buf->data[0]&0xf0)>>4;
-    ip_hdr.hdr_len = (buf->data[0]&0x0f);
-    //check ip_hdr
-    if( (ip_hdr.version != IP_VERSION_4) && (ip_hdr.hdr_len < 5 )) return;
-    
-    ip_hdr.tos = buf->data[1];
-    ip_hdr.total_len = (buf->data[2]<<8) + buf->data[3];
-    ip_hdr.id = (buf->data[4]<<8) + buf->data[5];
-    ip_hdr.flags_fragment = (buf->data[6]<<8) + buf->data[7];
-    ip_hdr.ttl = buf->data[8];
-    ip_hdr.protocol = buf->data[9];
-    ip_hdr.hdr_checksum = (buf->data[10]<<8) +buf->data[11];
-    memcpy(ip_hdr.src_ip ,&buf->data[12],NET_IP_LEN);
-    memcpy(ip_hdr.dest_ip ,&buf->data[16],NET_IP_LEN);
+    ip_ctx_t *ctx = &net_stack_current()->ip;
+    ip_hdr_t *hdr = ip_hdr_of(buf);
+    if(hdr == NULL){
+        net_drop(ip_hdr_drop_reason(buf), buf);
+        return;
+    }
+    NET_TRACEPOINT(NET_TRACE_IP_IN, buf->len, hdr->protocol);
+    int hdr_len = hdr->hdr_len * IP_HDR_LEN_PER_BYTE;
 
     //运算单位是双字节
-    if(checksum16((uint16_t*) buf->data, ip_hdr.hdr_len*IP_HDR_LEN_PER_BYTE/2)!=0) return;
+    if(checksum16((uint16_t*) buf->data, hdr_len/2)!=0){
+        net_drop(NET_DROP_IP_CHECKSUM, buf);
+        return;
+    }
+    buf->len = swap16(hdr->total_len); //去掉以太网帧的填充
     //check DEST IP
-    uint8_t if_ip[] = DRIVER_IF_IP;
-    if(memcmp(ip_hdr.dest_ip,if_ip,NET_IP_LEN)!=0) return;
+    int local = netif_lookup(hdr->dest_ip) != -1;
+    if(!local && !netif_accepts(buf->ifindex, hdr->dest_ip)){
+        if(ip_forwarding && hdr->dest_ip[0] < 224) ip_forward(buf,hdr); //组播、广播与保留地址不转发
+        else net_drop(NET_DROP_IP_NOT_FOR_US, buf);
+        return;
+    }
 
-    switch (ip_hdr.protocol)
-    {
-    case NET_PROTOCOL_ICMP:
-        buf_remove_header(buf, ip_hdr.hdr_len*IP_HDR_LEN_PER_BYTE);
-        icmp_in(buf,ip_hdr.src_ip);
-        break;
-
-    case NET_PROTOCOL_UDP:
-        buf_remove_header(buf, ip_hdr.hdr_len*IP_HDR_LEN_PER_BYTE);
-        udp_in(buf,ip_hdr.src_ip);
-        break;
-    
-    default:
-        icmp_unreachable(buf,ip_hdr.src_ip,ICMP_CODE_PROTOCOL_UNREACH);
-        break;
+    ip_proto_t *proto = &ctx->protos[hdr->protocol];
+    proto->stats.packets++;
+    proto->stats.bytes += buf->len;
+    ip_handler_t handler = proto->registered ? proto->handler : ip_builtin_handlers[hdr->protocol];
+    if(handler == NULL){
+        net_drop(NET_DROP_IP_UNKNOWN_PROTO, buf);
+        if(local) icmp_unreachable(buf,hdr->src_ip,ICMP_CODE_PROTOCOL_UNREACH);
+        return;
     }
+    buf_remove_header(buf, hdr_len);
+    handler(buf,hdr->src_ip,hdr->dest_ip);
+}
+
+/**
+ * @brief ip头部模板，同一数据报的各分片只有总长度、标志与分片偏移不同
+ *        其余字段构造一次，并保存它们的累加和；每个分片只需拷贝模板、填写不同的字段，
+ *        校验和由累加和加上这两个字段得到，不必对整个头部重新计算
+ * 
+ */
+typedef struct ip_template
+{
+    ip_hdr_t hdr; //总长度、标志与分片偏移、校验和为0的头部
+    uint32_t sum; //hdr的累加和
+} ip_template_t;
+
+/**
+ * @brief 初始的ip头部
+ * 
+ */
+static const ip_hdr_t ip_init_hdr = {
+    .hdr_len = sizeof(ip_hdr_t) / IP_HDR_LEN_PER_BYTE,
+    .version = IP_VERSION_4,
+    .ttl = 64};
+
+/**
+ * @brief 构造ip头部模板
+ * 
+ * @param t 模板
+ * @param src_ip 源ip地址
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ * @param id 数据包id
+ */
+static void ip_template_init(ip_template_t *t, uint8_t *src_ip, uint8_t *ip, net_protocol_t protocol, int id)
+{
+    t->hdr = ip_init_hdr;
+    t->hdr.id = swap16(id);
+    t->hdr.protocol = protocol;
+    memcpy(t->hdr.src_ip, src_ip, NET_IP_LEN);
+    memcpy(t->hdr.dest_ip, ip, NET_IP_LEN);
+    t->sum = checksum_add(0, &t->hdr, sizeof(ip_hdr_t));
+}
 
+/**
+ * @brief 按模板增加ip头部，总长度按buf->len填写
+ * 
+ * @param buf 数据报，data指向ip负载
+ * @param t 模板
+ * @param offset 分片offset，以8字节为单位
+ * @param mf 分片标志
+ */
+static void ip_template_fill(buf_t *buf, const ip_template_t *t, uint16_t offset, int mf)
+{
+    buf_add_header(buf, sizeof(ip_hdr_t));
+    ip_hdr_t *hdr = (ip_hdr_t *)buf->data;
+    *hdr = t->hdr;
+    hdr->total_len = swap16(buf->len);
+    hdr->flags_fragment = swap16(mf << 8 | (offset & 0x1fff));
+    hdr->hdr_checksum = checksum_fold(t->sum + hdr->total_len + hdr->flags_fragment);
+}
+
+/**
+ * @brief 按模板增加ip头部，计数后将分片发送到arp层
+ * 
+ */
+static void ip_template_out(buf_t *buf, const ip_template_t *t, uint8_t *next_hop, uint16_t offset, int mf)
+{
+    ip_template_fill(buf, t, offset, mf);
+    ip_count_out(t->hdr.protocol, buf->len);
+    arp_out(buf, next_hop, NET_PROTOCOL_IP);
 }
 
 /**
  * @brief 处理一个要发送的ip分片
- *        你需要调用buf_add_header增加IP数据报头部缓存空间。
- *        填写IP数据报头部字段。
- *        将checksum字段填0，再调用checksum16()函数计算校验和，并将计算后的结果填写到checksum字段中。
- *        将封装后的IP数据报发送到arp层。
+ *        单独发送一个分片时使用，先构造ip头部模板，再按模板增加头部并填写校验和。
+ *        将封装后的IP数据报发送到arp层，arp层解析的是下一跳地址而不是目标地址。
  * 
- * @param buf 要发送的分片
+ * @param buf 要发送的分片，buf->ifindex为出口网卡
+ * @param src_ip 源ip地址
  * @param ip 目标ip地址
+ * @param next_hop 下一跳ip地址
  * @param protocol 上层协议
  * @param id 数据包id
  * @param offset 分片offset，必须被8整除
- * @param mf 分片mf标志，是否有下一个分片
+ * @param mf 分片标志，IP_MORE_FRAGMENT表示有下一个分片，IP_DONT_FRAGMENT表示禁止路由器分片
  */
-void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf)
+void ip_fragment_out(buf_t *buf, uint8_t *src_ip, uint8_t *ip, uint8_t *next_hop, net_protocol_t protocol, int id, uint16_t offset, int mf)
 {   
-    buf_add_header(buf,20);
-
-    buf->data[0] = IP_VERSION_4*16 + 5;
-    buf->data[1] = 0;
-    buf->data[2] = (buf->len & 0xff00)>>8; 
-    buf->data[3] = buf->len & 0x00ff;
-
-    buf->data[4] = (id & 0xff00)>>8;
-    buf->data[5] = id & 0x00ff;
-    buf->data[6] = mf + ((offset & 0x1f00)>>8);
-    buf->data[7] = (offset & 0x00ff);
-
-    buf->data[8] = 64;
-    buf->data[9] = protocol;
-    buf->data[10] = 0;
-    buf->data[11] = 0;
-
-    uint8_t if_ip[] = DRIVER_IF_IP;
-    memcpy(&buf->data[12] ,if_ip,NET_IP_LEN);
-    memcpy(&buf->data[16] ,ip,NET_IP_LEN);
-
-    uint16_t cksum = checksum16((uint16_t*)buf->data,10);
-    buf->data[10] = (cksum & 0xff00)>>8;
-    buf->data[11] = cksum & 0x00ff;
+    ip_template_t t;
+    ip_template_init(&t, src_ip, ip, protocol, id);
+    ip_template_out(buf, &t, next_hop, offset, mf);
+}
 
-    arp_out(buf,ip,NET_PROTOCOL_IP);
+/**
+ * @brief 按路由选择发往目的地址时使用的源地址，与ip_out()的选择相同
+ *        上层需要在交给ip层之前知道源地址时使用，如计算udp伪头部校验和
+ * 
+ * @param ip 目标ip地址
+ * @return uint8_t* 源ip地址，没有可用的源地址时为NULL
+ */
+uint8_t *ip_select_src(uint8_t *ip)
+{
+    int ifindex;
+    route_lookup(ip, &ifindex);
+    return netif_select_src(ifindex, ip);
+}
 
+/**
+ * @brief 为发往目的地址的数据报构造以太网与ip头部模板，用于批量构造同一目的地址的数据报
+ *        与ip_out_from()一样查路由、选源地址，下一跳的mac地址必须已在arp表中；
+ *        ip头部的总长度与校验和按当前buf->len填写，置DF位，调用者按各数据报的长度增量修正
+ * 
+ * @param buf 数据报，data指向ip负载；成功时data指向以太网头部，ifindex为出口网卡
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ * @return int 成功为0，没有可用的源地址或下一跳mac未知时为-1，此时buf不变
+ */
+int ip_build_template(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
+{
+    int ifindex;
+    uint8_t *next_hop = route_lookup(ip, &ifindex);
+    uint8_t *src_ip = netif_select_src(ifindex, ip);
+    net_if_t *netif = netif_get(ifindex);
+    uint8_t *mac = arp_lookup(next_hop);
+    if (src_ip == NULL || netif == NULL || mac == NULL)
+        return -1;
+    buf->ifindex = ifindex;
+    ip_template_t t;
+    ip_template_init(&t, src_ip, ip, protocol, 0);
+    ip_template_fill(buf, &t, 0, IP_DONT_FRAGMENT);
+    buf_add_header(buf, sizeof(ether_hdr_t));
+    ether_hdr_t *eth = (ether_hdr_t *)buf->data;
+    memcpy(eth->dest, mac, NET_MAC_LEN);
+    memcpy(eth->src, netif->mac, NET_MAC_LEN);
+    eth->protocol = swap16(NET_PROTOCOL_IP);
+    return 0;
 }
 
 /**
@@ -121,38 +376,124 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, u
  *        （2）将数据报截断，每个截断后的包长度 = 以太网帧的最大包长，调用ip_fragment_out()函数发送出去
  *        （3）如果截断后最后的一个分片小于或等于以太网帧的最大包长，
  *             调用buf_init()函数初始化buf，长度为该分片大小，再调用ip_fragment_out()函数发送出去
- *             注意：id为IP数据报的分片标识，从0开始编号，每增加一个分片，自加1。最后一个分片的MF = 0
+ *             注意：id为IP数据报的分片标识，每个数据报取协议栈实例中的下一个标识，所有分片共用。最后一个分片的MF = 0
  *    
  *        如果没有超过以太网帧的最大包长，则直接调用调用ip_fragment_out()函数发送出去。
  * 
+ *        发送前先查路由表得到下一跳与出口网卡，所有分片共用同一个下一跳与ip头部模板。
+ *        分片长度由到目的地址的路径MTU决定。不需要分片的数据报置DF位（ICMP报文除外），
+ *        路径上MTU更小的路由器会回送“需要分片”差错，由icmp_in()更新路径MTU。
+ * 
  * @param buf 要处理的包
+ * @param src_ip 源ip地址，为NULL时按出口网卡选择
  * @param ip 目标ip地址
  * @param protocol 上层协议
  */
-void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
+void ip_out_from(buf_t *buf, uint8_t *src_ip, uint8_t *ip, net_protocol_t protocol)
 {   
     // TODO 
-    int id = 0;
-    int max_len = ETHERNET_MTU - IP_HDR_LEN_PER_BYTE*5;
+    NET_TRACEPOINT(NET_TRACE_IP_OUT, buf->len, protocol);
+    int ifindex;
+    uint8_t *next_hop = route_lookup(ip, &ifindex);
+    if (src_ip == NULL)
+        src_ip = netif_select_src(ifindex, ip);
+    if (src_ip == NULL)
+        return;
+    buf->ifindex = ifindex;
+    ip_template_t t;
+    ip_template_init(&t, src_ip, ip, protocol, net_stack_current()->ip.id++);
+    int max_len = (ip_get_pmtu(ip) - IP_HDR_LEN_PER_BYTE*5) & ~(IP_HDR_OFFSET_PER_BYTE - 1);
     // amount of slices
-    int slices = buf->len/max_len + 1;
+    int slices = (buf->len + max_len - 1)/max_len;
     if(slices > 1){
         for(int i=0; i < slices-1;i++){
             int offset = i*max_len;
             buf_t slice_buf;
             buf_init(&slice_buf,max_len);
+            slice_buf.ifindex = ifindex;
             memcpy(slice_buf.data, &buf->data[offset], max_len);
-            ip_fragment_out(&slice_buf, ip, protocol, id, offset/IP_HDR_OFFSET_PER_BYTE, IP_MORE_FRAGMENT);
+            ip_template_out(&slice_buf, &t, next_hop, offset/IP_HDR_OFFSET_PER_BYTE, IP_MORE_FRAGMENT);
         }
         int offset = (slices-1)*max_len,
             remain_len = buf->len - offset;
         buf_t slice_buf;
         buf_init(&slice_buf, remain_len);
+        slice_buf.ifindex = ifindex;
         memcpy(slice_buf.data, &buf->data[offset], remain_len);
-        ip_fragment_out(&slice_buf, ip, protocol, id, offset/IP_HDR_OFFSET_PER_BYTE, 0);
+        ip_template_out(&slice_buf, &t, next_hop, offset/IP_HDR_OFFSET_PER_BYTE, 0);
     }
     else{
-        ip_fragment_out(buf, ip, protocol, id, 0, 0);
+        ip_template_out(buf, &t, next_hop, 0, protocol == NET_PROTOCOL_ICMP ? 0 : IP_DONT_FRAGMENT);
     }
-    id += 1;
+}
+
+/**
+ * @brief 处理一个要发送的ip数据包，源地址按出口网卡选择
+ * 
+ * @param buf 要处理的包
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ */
+void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
+{
+    ip_out_from(buf, NULL, ip, protocol);
+}
+
+/**
+ * @brief 注册一个上层协议的处理程序，已注册的协议会被替换
+ * 
+ * @param protocol 上层协议号
+ * @param handler 处理程序，收到时data指向ip负载；为NULL时回送协议不可达
+ */
+void ip_register(uint8_t protocol, ip_handler_t handler)
+{
+    ip_ctx_t *ctx = &net_stack_current()->ip;
+    ctx->protos[protocol].handler = handler;
+    ctx->protos[protocol].registered = 1;
+}
+
+/**
+ * @brief 获取一个上层协议的收发计数，未注册的协议也会计数
+ * 
+ * @param protocol 上层协议号
+ * @return const net_proto_stats_t* 收发计数
+ */
+const net_proto_stats_t *ip_get_stats(uint8_t protocol)
+{
+    ip_ctx_t *ctx = &net_stack_current()->ip;
+    return &ctx->protos[protocol].stats;
+}
+
+/**
+ * @brief 记录一个不经ip_out()、由上层按ip_build_template()的模板直接构造并发出的ip数据报
+ * 
+ * @param protocol 上层协议号
+ * @param len 数据报长度，含ip头部
+ */
+void ip_count_out(uint8_t protocol, uint16_t len)
+{
+    ip_ctx_t *ctx = &net_stack_current()->ip;
+    ctx->protos[protocol].stats.out_packets++;
+    ctx->protos[protocol].stats.out_bytes += len;
+}
+
+/**
+ * @brief 开启或关闭IP转发（路由器模式）
+ * 
+ * @param enable 非0为开启
+ */
+void ip_set_forward(int enable)
+{
+    ip_forwarding = enable;
+}
+
+/**
+ * @brief 获取IP转发统计
+ * 
+ * @return const ip_forward_stats_t* 转发统计
+ */
+const ip_forward_stats_t *ip_get_forward_stats()
+{
+    ip_ctx_t *ctx = &net_stack_current()->ip;
+    return &ctx->forward_stats;
 }
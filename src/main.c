@@ -1,8 +1,36 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <signal.h>
 #include <time.h>
+#include <unistd.h>
 #include "net.h"
 #include "udp.h"
+#include "ip.h"
+#include "shard.h"
+#include "stage.h"
+#include "co.h"
+#include "tcp.h"
+#include "stats.h"
+#include "trace.h"
+#include "capture.h"
+
+#define SERVICE_WORKERS 4                      //默认模式下处理请求的协程数
+#define TRACE_SNAPSHOT_PATH "/tmp/net_trace"   //默认模式下收到SIGUSR1时写入跟踪快照的文件
+#define CAPTURE_PATH "/tmp/net_capture.pcapng" //默认模式下收到SIGUSR2时开始或停止抓包的文件
+
+static volatile sig_atomic_t trace_requested;
+static volatile sig_atomic_t capture_toggled;
+
+static void on_sigusr1(int sig)
+{
+    trace_requested = 1;
+}
+
+static void on_sigusr2(int sig)
+{
+    capture_toggled = 1;
+}
 
 void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
 {
@@ -12,6 +40,8 @@ void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
     putchar('\n');
     // uint16_t len = 1800;
     uint16_t len = 1000;
+    if (len > udp_get_mtu(src_ip)) //按路径MTU限制应答长度，避免分片
+        len = udp_get_mtu(src_ip);
     uint8_t data[len];
 
     uint16_t dest_port = 60001;
@@ -19,15 +49,237 @@ void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
         data[i] = i;
     udp_send(data, len, 60000, src_ip, dest_port); //发送udp包
 }
+
+void open_ports(int shard, void *arg)
+{
+    udp_open(60000, handler); //每个工作线程各自注册端口
+}
+
+/**
+ * @brief 默认模式的服务协程：等待60000端口的请求，打印后向请求方的60001端口发送应答
+ *        几个协程在同一端口上轮流接收，一个请求只交给一个协程
+ *
+ */
+void service(co_t *co)
+{
+    static uint8_t data[1000]; //应答内容，不跨等待点使用
+    CO_BEGIN(co);
+    for (int i = 0; i < sizeof(data); i++)
+        data[i] = i;
+    while (1)
+    {
+        CO_RECV(co, 60000, 0);
+        if (co->result != 0)
+            break;
+        printf("recv udp packet from %s:%d len=%d\n", iptos(co->msg.src_ip), co->msg.src_port, co->msg.len);
+        fwrite(co->msg.data, 1, co->msg.len, stdout);
+        putchar('\n');
+        uint16_t len = sizeof(data);
+        if (len > udp_get_mtu(co->msg.src_ip)) //按路径MTU限制应答长度，避免分片
+            len = udp_get_mtu(co->msg.src_ip);
+        co_send(data, len, 60000, co->msg.src_ip, 60001); //发送udp包
+    }
+    CO_END(co);
+}
+
+static uint64_t tcp_bytes; //tcp模式下收到或被确认的字节数
+
+/**
+ * @brief tcp-sink模式的连接：读取并丢弃收到的数据，对端关闭后关闭
+ *
+ */
+void sink(tcp_conn_t *conn, tcp_event_t event, void *arg)
+{
+    int len;
+    if (event == TCP_EVENT_CONNECTED)
+        printf("tcp connection from %s:%d\n", iptos(conn->remote_ip), conn->remote_port);
+    else if (event == TCP_EVENT_RECV)
+    {
+        while (tcp_recv_buf(conn, &len), len > 0)
+        {
+            tcp_bytes += len;
+            tcp_recv_consume(conn, len);
+        }
+    }
+    else if (event == TCP_EVENT_FIN)
+        tcp_close(conn);
+}
+
+/**
+ * @brief tcp-source模式的连接：发送缓冲区有空间就填满，按发送缓冲区释放的字节统计吞吐量
+ *
+ */
+void source(tcp_conn_t *conn, tcp_event_t event, void *arg)
+{
+    static uint32_t acked; //上次统计时发送缓冲区的head
+    int len;
+    uint8_t *p;
+    if (event == TCP_EVENT_CLOSED)
+    {
+        printf("tcp connection closed\n");
+        exit(1);
+    }
+    if (event == TCP_EVENT_SENT || event == TCP_EVENT_CONNECTED)
+    {
+        tcp_bytes += conn->snd.head - acked;
+        acked = conn->snd.head;
+        while ((p = tcp_send_buf(conn, &len)), len > 0)
+        {
+            memset(p, 'x', len);
+            tcp_send_commit(conn, len);
+        }
+    }
+}
+
+/**
+ * @brief tcp模式的主循环：每秒打印吞吐量与重传计数，用于与内核tcp在veth对上对比大块传输
+ *
+ */
+void tcp_loop()
+{
+    time_t last = time(NULL);
+    uint64_t last_bytes = 0;
+    while (1)
+    {
+        net_poll();
+        if (time(NULL) != last)
+        {
+            const tcp_stats_t *stats = tcp_get_stats();
+            printf("%.3f Gbit/s, retrans %lu, fast retrans %lu, timeouts %lu\n", (tcp_bytes - last_bytes) * 8 / 1e9,
+                   (unsigned long)stats->retrans_segs, (unsigned long)stats->fast_retrans, (unsigned long)stats->timeouts);
+            last_bytes = tcp_bytes;
+            last = time(NULL);
+        }
+    }
+}
+
+/**
+ * @brief 打印流水线一个阶段上一秒的数据帧数、平均队列长度与受阻次数
+ *
+ */
+void print_stage(const char *name, net_stage_stats_t *now, net_stage_stats_t *last)
+{
+    uint64_t polls = now->polls - last->polls;
+    printf("%s %lu pps, avg queue %.1f, stalls %lu, dropped %lu\n", name, (unsigned long)(now->packets - last->packets),
+           polls ? (double)(now->occupancy - last->occupancy) / polls : 0,
+           (unsigned long)(now->stalls - last->stalls), (unsigned long)(now->dropped - last->dropped));
+    *last = *now;
+}
+
 int main(int argc, char const *argv[])
 {
 
-    net_init();               //初始化协议栈
-    udp_open(60000, handler); //注册端口的udp监听回调
+    net_init(); //初始化协议栈
+    if (net_stats_export(NET_STATS_SHM_NAME) != 0) //各实例的计数发布到共享内存，可用tools/nettop查看
+        printf("failed to export stats to %s\n", NET_STATS_SHM_NAME);
+
+    if (argc > 2 && strcmp(argv[1], "shard") == 0) //分片模式：按流分给argv[2]个工作线程处理
+    {
+        if (net_shard_start(atoi(argv[2]), open_ports, NULL) != 0)
+        {
+            printf("failed to start %s workers\n", argv[2]);
+            return 1;
+        }
+        while (1)
+            net_shard_poll();
+    }
+
+    if (argc > 2 && strcmp(argv[1], "pipeline") == 0) //流水线模式：接收、argv[2]个协议线程与发送线程，每秒打印各阶段计数
+    {
+        int count = atoi(argv[2]);
+        if (net_stage_start(count, open_ports, NULL) != 0)
+        {
+            printf("failed to start %s protocol threads\n", argv[2]);
+            return 1;
+        }
+        net_stage_stats_t now, last[NET_STAGE_MAX + 2] = {0};
+        while (1)
+        {
+            sleep(1);
+            net_stage_get_stats(NET_STAGE_RX, 0, &now);
+            print_stage("rx:     ", &now, &last[0]);
+            for (int i = 0; i < count; i++)
+            {
+                char name[24];
+                snprintf(name, sizeof(name), "proto %d:", i);
+                net_stage_get_stats(NET_STAGE_PROTO, i, &now);
+                print_stage(name, &now, &last[1 + i]);
+            }
+            net_stage_get_stats(NET_STAGE_TX, 0, &now);
+            print_stage("tx:     ", &now, &last[count + 1]);
+        }
+    }
+
+    if (argc > 1 && strcmp(argv[1], "tcp-sink") == 0) //tcp接收端：监听argv[2]端口（默认5001）
+    {
+        tcp_listen(argc > 2 ? atoi(argv[2]) : 5001, sink, NULL);
+        tcp_loop();
+    }
+
+    if (argc > 3 && strcmp(argv[1], "tcp-source") == 0) //tcp发送端：向argv[2]:argv[3]持续发送
+    {
+        unsigned a, b, c, d;
+        if (sscanf(argv[2], "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+        {
+            printf("bad address %s\n", argv[2]);
+            return 1;
+        }
+        uint8_t ip[NET_IP_LEN] = {a, b, c, d};
+        if (tcp_connect(ip, atoi(argv[3]), 0, source, NULL) == NULL)
+        {
+            printf("failed to connect to %s\n", argv[2]);
+            return 1;
+        }
+        tcp_loop();
+    }
+
+    co_init(); //默认模式：由协程处理60000端口的请求
+    co_open(60000);
+    for (int i = 0; i < SERVICE_WORKERS; i++)
+        co_spawn(service, NULL, 0);
+
+    int forward = argc > 1 && strcmp(argv[1], "forward") == 0;
+    if (forward)
+        ip_set_forward(1); //路由器模式，每秒打印一次转发速率
+    time_t last = time(NULL);
+    uint64_t last_forwarded = 0;
+    signal(SIGUSR1, on_sigusr1); //以-DNET_TRACE=1编译时可用kill -USR1取得跟踪快照，再用tools/tracedump转换
+    signal(SIGUSR2, on_sigusr2); //kill -USR2开始抓取所有数据帧，再次发送时停止
+    int capturing = 0;
 
     while (1)
     {
-        net_poll(); //一次主循环
+        co_poll(); //一次主循环：协议栈轮询，然后运行就绪的协程
+        if (trace_requested)
+        {
+            trace_requested = 0;
+            if (net_trace_snapshot(TRACE_SNAPSHOT_PATH) == 0)
+                printf("trace snapshot written to %s\n", TRACE_SNAPSHOT_PATH);
+        }
+        if (capture_toggled)
+        {
+            capture_toggled = 0;
+            if (capturing)
+            {
+                net_capture_stop();
+                capturing = 0;
+                printf("capture written to %s\n", CAPTURE_PATH);
+            }
+            else if (net_capture_start(CAPTURE_PATH, NULL) == 0)
+            {
+                capturing = 1;
+                printf("capturing to %s\n", CAPTURE_PATH);
+            }
+        }
+        if (forward && time(NULL) != last)
+        {
+            const ip_forward_stats_t *stats = ip_get_forward_stats();
+            printf("forwarded %lu pps, ttl exceeded %lu, arp miss %lu\n",
+                   (unsigned long)(stats->forwarded - last_forwarded),
+                   (unsigned long)stats->ttl_exceeded, (unsigned long)stats->arp_miss);
+            last_forwarded = stats->forwarded;
+            last = time(NULL);
+        }
     }
 
     return 0;
@@ -1,24 +1,100 @@
 #include "net.h"
+#include "stack.h"
 #include "arp.h"
+#include "icmp.h"
 #include "udp.h"
+#include "tcp.h"
 #include "ethernet.h"
+#include "route.h"
+#include "netif.h"
+#include "timer.h"
+#include "stats.h"
+#include <stdlib.h>
 
 /**
- * @brief 初始化协议栈
+ * @brief 初始化协议栈：共享的路由表与网卡表，以及本线程的默认协议栈实例
  * 
  */
 void net_init()
 {
+    route_init();
+    netif_init();
+    net_init_thread();
+}
+
+/**
+ * @brief 初始化本线程的默认协议栈实例，路由表与网卡表须已初始化
+ *        使用默认实例的每个线程各调用一次；分片与流水线模式的工作线程使用各自在堆上分配的实例，不调用它
+ * 
+ */
+void net_init_thread()
+{
+    net_stack_init(net_stack_default());
+}
+
+/**
+ * @brief 释放本线程的默认协议栈实例，没有分配过时不做处理
+ * 
+ */
+void net_exit_thread()
+{
+    if (net_stack_local == NULL)
+        return;
+    net_stack_free(net_stack_local);
+    net_stack_local = NULL;
+}
+
+/**
+ * @brief 一次本线程默认协议栈实例的轮询
+ * 
+ */
+void net_poll()
+{
+    net_stack_poll(net_stack_default());
+}
+
+/**
+ * @brief 释放一个协议栈实例，先释放它导出计数的槽，在实例中关闭所有udp端口、释放所有tcp连接
+ * 
+ * @param stack 实例
+ */
+void net_stack_free(net_stack_t *stack)
+{
+    net_stack_t *prev = net_stack_bind(stack);
+    net_stats_release();
+    udp_init();
+    tcp_init();
+    net_stack_bind(prev);
+    free(stack);
+}
+
+/**
+ * @brief 初始化一个协议栈实例（定时器、以太网、arp、icmp、udp、tcp、计数导出），路由表与网卡表须已初始化
+ * 
+ * @param stack 实例
+ */
+void net_stack_init(net_stack_t *stack)
+{
+    net_stack_t *prev = net_stack_bind(stack);
+    timer_init();
     ethernet_init();
     arp_init();
+    icmp_init();
     udp_init();
+    tcp_init();
+    net_stats_init();
+    net_stack_bind(prev);
 }
 
 /**
- * @brief 一次协议栈轮询
+ * @brief 一次协议栈实例的轮询
  * 
+ * @param stack 实例
  */
-void net_poll()
+void net_stack_poll(net_stack_t *stack)
 {
-    ethernet_poll();
-}
\ No newline at end of file
+    ethernet_poll_stack(stack);
+    udp_flush_stack(stack);
+    timer_poll_stack(stack);
+    tcp_flush_stack(stack);
+}
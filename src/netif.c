@@ -0,0 +1,320 @@
+#include "netif.h"
+#include "route.h"
+#include <string.h>
+
+/**
+ * @brief 网卡表
+ *
+ */
+static net_if_t netif_table[NETIF_MAX_IF];
+
+/**
+ * @brief 本机地址哈希表，开放定址、线性探测，key为0表示空位
+ *        每个收到的数据包都要判断目的地址是否为本机地址，一次哈希即可完成
+ *
+ */
+typedef struct netif_addr_slot
+{
+    uint32_t key; //ip地址
+    int ifindex;  //所在网卡
+} netif_addr_slot_t;
+static netif_addr_slot_t netif_addr_hash[NETIF_ADDR_HASH_SIZE];
+
+/**
+ * @brief 组播组成员哈希表，与本机地址哈希表结构相同，key为组地址
+ *        不同网卡可以加入同一个组，以（组地址、网卡）区分表项
+ *
+ */
+static netif_addr_slot_t netif_group_hash[NETIF_GROUP_HASH_SIZE];
+static int netif_group_count;
+
+static int netif_ready;
+
+static uint32_t netif_ip_to_u32(uint8_t *ip)
+{
+    return ((uint32_t)ip[0] << 24) | ((uint32_t)ip[1] << 16) | ((uint32_t)ip[2] << 8) | ip[3];
+}
+
+/**
+ * @brief 乘法哈希，取乘积的高位：低位只取决于地址的最后几位，共用最后一个字节的地址会落在同一个槽
+ *
+ * @param size 哈希表大小，须为2的幂且不小于2
+ */
+static uint32_t netif_hash(uint32_t key, uint32_t size)
+{
+    return (key * 2654435761u) >> (32 - __builtin_ctz(size));
+}
+
+/**
+ * @brief 从哈希表中删除一个表项，并把其后同一探测链上的表项前移
+ *
+ */
+static void netif_hash_del(netif_addr_slot_t *table, uint32_t size, uint32_t key, int ifindex)
+{
+    uint32_t i = netif_hash(key, size);
+    while (table[i].key != key || table[i].ifindex != ifindex)
+    {
+        if (table[i].key == 0)
+            return;
+        i = (i + 1) & (size - 1);
+    }
+    table[i].key = 0;
+    for (uint32_t j = (i + 1) & (size - 1); table[j].key != 0; j = (j + 1) & (size - 1))
+    {
+        uint32_t home = netif_hash(table[j].key, size);
+        //home不在(i, j]之间时，该表项可以移到空位i
+        if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j))
+        {
+            table[i] = table[j];
+            table[j].key = 0;
+            i = j;
+        }
+    }
+}
+
+/**
+ * @brief 初始化网卡表，按config.h添加默认网卡及其地址
+ *
+ */
+void netif_init()
+{
+    memset(netif_table, 0, sizeof(netif_table));
+    memset(netif_addr_hash, 0, sizeof(netif_addr_hash));
+    memset(netif_group_hash, 0, sizeof(netif_group_hash));
+    netif_group_count = 0;
+    netif_ready = 1;
+
+    uint8_t if_mac[] = DRIVER_IF_MAC;
+    uint8_t if_ip[] = DRIVER_IF_IP;
+    uint8_t if_mask[] = DRIVER_IF_NETMASK;
+    int prefix_len = 0;
+    for (int i = 0; i < NET_IP_LEN; i++)
+        for (int bit = 7; bit >= 0 && (if_mask[i] >> bit & 1); bit--)
+            prefix_len++;
+    int ifindex = netif_add(DRIVER_IF_NAME, if_mac);
+    netif_add_addr(ifindex, if_ip, prefix_len);
+}
+
+/**
+ * @brief 添加一个网卡
+ *
+ * @param name 网卡名称
+ * @param mac mac地址
+ * @return int 网卡索引，失败为-1
+ */
+int netif_add(const char *name, const uint8_t *mac)
+{
+    if (!netif_ready)
+        netif_init();
+    for (int i = 0; i < NETIF_MAX_IF; i++)
+        if (!netif_table[i].valid)
+        {
+            memset(&netif_table[i], 0, sizeof(net_if_t));
+            strncpy(netif_table[i].name, name, NETIF_NAME_LEN - 1);
+            memcpy(netif_table[i].mac, mac, NET_MAC_LEN);
+            netif_table[i].valid = 1;
+            return i;
+        }
+    return -1;
+}
+
+/**
+ * @brief 为网卡添加一个ip地址，并添加该地址所在子网的直连路由
+ *
+ * @param ifindex 网卡索引
+ * @param ip ip地址
+ * @param prefix_len 子网前缀长度
+ * @return int 成功为0，失败为-1
+ */
+int netif_add_addr(int ifindex, uint8_t *ip, int prefix_len)
+{
+    net_if_t *netif = netif_get(ifindex);
+    uint32_t key = netif_ip_to_u32(ip);
+    if (netif == NULL || netif->ip_count == NETIF_MAX_ADDR || key == 0 || netif_lookup(ip) != -1)
+        return -1;
+
+    uint32_t i = netif_hash(key, NETIF_ADDR_HASH_SIZE);
+    while (netif_addr_hash[i].key != 0)
+        i = (i + 1) & (NETIF_ADDR_HASH_SIZE - 1);
+    netif_addr_hash[i].key = key;
+    netif_addr_hash[i].ifindex = ifindex;
+
+    memcpy(netif->ip[netif->ip_count], ip, NET_IP_LEN);
+    netif->prefix_len[netif->ip_count] = prefix_len;
+    netif->ip_count++;
+
+    uint8_t direct[NET_IP_LEN] = {0};
+    route_add(ip, prefix_len, direct, ifindex);
+    return 0;
+}
+
+/**
+ * @brief 删除网卡的一个ip地址及其直连路由
+ *        同一子网内仍有其他本机地址时保留直连路由
+ *
+ * @param ifindex 网卡索引
+ * @param ip ip地址
+ * @return int 成功为0，未找到为-1
+ */
+int netif_del_addr(int ifindex, uint8_t *ip)
+{
+    net_if_t *netif = netif_get(ifindex);
+    if (netif == NULL || netif_lookup(ip) != ifindex)
+        return -1;
+    netif_hash_del(netif_addr_hash, NETIF_ADDR_HASH_SIZE, netif_ip_to_u32(ip), ifindex);
+
+    int i = 0;
+    while (memcmp(netif->ip[i], ip, NET_IP_LEN) != 0)
+        i++;
+    int prefix_len = netif->prefix_len[i];
+    netif->ip_count--;
+    memmove(netif->ip[i], netif->ip[i + 1], (netif->ip_count - i) * NET_IP_LEN);
+    memmove(&netif->prefix_len[i], &netif->prefix_len[i + 1], netif->ip_count - i);
+
+    uint32_t mask = prefix_len == 0 ? 0 : 0xffffffffu << (32 - prefix_len);
+    for (int j = 0; j < netif->ip_count; j++)
+        if (netif->prefix_len[j] == prefix_len &&
+            (netif_ip_to_u32(netif->ip[j]) & mask) == (netif_ip_to_u32(ip) & mask))
+            return 0;
+    route_del(ip, prefix_len);
+    return 0;
+}
+
+/**
+ * @brief 根据索引获取网卡
+ *
+ * @param ifindex 网卡索引
+ * @return net_if_t* 网卡，不存在时为NULL
+ */
+net_if_t *netif_get(int ifindex)
+{
+    if (!netif_ready)
+        netif_init();
+    if (ifindex < 0 || ifindex >= NETIF_MAX_IF || !netif_table[ifindex].valid)
+        return NULL;
+    return &netif_table[ifindex];
+}
+
+/**
+ * @brief 为发往目的地址的数据包选择源地址
+ *        优先选择与目的地址在同一子网的地址，否则使用主地址
+ *
+ * @param ifindex 出口网卡索引
+ * @param dest_ip 目的ip地址
+ * @return uint8_t* 源ip地址，网卡不存在或没有地址时为NULL
+ */
+uint8_t *netif_select_src(int ifindex, uint8_t *dest_ip)
+{
+    net_if_t *netif = netif_get(ifindex);
+    if (netif == NULL || netif->ip_count == 0)
+        return NULL;
+    uint32_t dest = netif_ip_to_u32(dest_ip);
+    for (int i = 0; i < netif->ip_count; i++)
+    {
+        uint32_t mask = netif->prefix_len[i] == 0 ? 0 : 0xffffffffu << (32 - netif->prefix_len[i]);
+        if ((netif_ip_to_u32(netif->ip[i]) & mask) == (dest & mask))
+            return netif->ip[i];
+    }
+    return netif->ip[0];
+}
+
+/**
+ * @brief 判断ip地址是否为本机地址
+ *
+ * @param ip ip地址
+ * @return int 地址所在网卡的索引，不是本机地址时为-1
+ */
+int netif_lookup(uint8_t *ip)
+{
+    if (!netif_ready)
+        netif_init();
+    uint32_t key = netif_ip_to_u32(ip);
+    for (uint32_t i = netif_hash(key, NETIF_ADDR_HASH_SIZE); netif_addr_hash[i].key != 0; i = (i + 1) & (NETIF_ADDR_HASH_SIZE - 1))
+        if (netif_addr_hash[i].key == key)
+            return netif_addr_hash[i].ifindex;
+    return -1;
+}
+
+/**
+ * @brief 网卡加入一个组播组，之后ip层接收在该网卡上收到的发往该组的数据报
+ *
+ * @param ifindex 网卡索引
+ * @param group 组播地址（224.0.0.0/4）
+ * @return int 成功为0，网卡不存在、不是组播地址、已加入或成员表已满为-1
+ */
+int netif_join_group(int ifindex, uint8_t *group)
+{
+    uint32_t key = netif_ip_to_u32(group);
+    if (netif_get(ifindex) == NULL || (group[0] & 0xf0) != 0xe0 || netif_is_member(ifindex, group) ||
+        netif_group_count == NETIF_GROUP_HASH_SIZE - 1)
+        return -1;
+    uint32_t i = netif_hash(key, NETIF_GROUP_HASH_SIZE);
+    while (netif_group_hash[i].key != 0)
+        i = (i + 1) & (NETIF_GROUP_HASH_SIZE - 1);
+    netif_group_hash[i].key = key;
+    netif_group_hash[i].ifindex = ifindex;
+    netif_group_count++;
+    return 0;
+}
+
+/**
+ * @brief 网卡退出一个组播组
+ *
+ * @param ifindex 网卡索引
+ * @param group 组播地址
+ * @return int 成功为0，未加入为-1
+ */
+int netif_leave_group(int ifindex, uint8_t *group)
+{
+    if (!netif_is_member(ifindex, group))
+        return -1;
+    netif_hash_del(netif_group_hash, NETIF_GROUP_HASH_SIZE, netif_ip_to_u32(group), ifindex);
+    netif_group_count--;
+    return 0;
+}
+
+/**
+ * @brief 判断网卡是否已加入一个组播组
+ *
+ * @param ifindex 网卡索引
+ * @param group 组播地址
+ * @return int 已加入为1，否则为0
+ */
+int netif_is_member(int ifindex, uint8_t *group)
+{
+    if (!netif_ready)
+        netif_init();
+    uint32_t key = netif_ip_to_u32(group);
+    for (uint32_t i = netif_hash(key, NETIF_GROUP_HASH_SIZE); netif_group_hash[i].key != 0; i = (i + 1) & (NETIF_GROUP_HASH_SIZE - 1))
+        if (netif_group_hash[i].key == key && netif_group_hash[i].ifindex == ifindex)
+            return 1;
+    return 0;
+}
+
+/**
+ * @brief 判断网卡是否接收发往一个非本机地址的数据报：
+ *        受限广播地址、网卡某个地址所在子网的广播地址，或网卡已加入的组播组
+ *
+ * @param ifindex 收到数据报的网卡
+ * @param ip 目的ip地址
+ * @return int 接收为1，否则为0
+ */
+int netif_accepts(int ifindex, uint8_t *ip)
+{
+    uint32_t dest = netif_ip_to_u32(ip);
+    if (dest == 0xffffffffu)
+        return 1;
+    if ((ip[0] & 0xf0) == 0xe0)
+        return netif_is_member(ifindex, ip);
+    net_if_t *netif = netif_get(ifindex);
+    if (netif == NULL)
+        return 0;
+    for (int i = 0; i < netif->ip_count; i++)
+    {
+        //前缀长于30位的子网没有广播地址
+        uint32_t host = netif->prefix_len[i] >= 31 ? 0 : 0xffffffffu >> netif->prefix_len[i];
+        if (host != 0 && dest == (netif_ip_to_u32(netif->ip[i]) | host))
+            return 1;
+    }
+    return 0;
+}
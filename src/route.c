@@ -0,0 +1,289 @@
+#include "route.h"
+#include <string.h>
+
+/**
+ * @brief DIR-24-8 表项
+ *        bit31: 有效位
+ *        bit30: 扩展位，置位时低24位为tbl8组号，否则为路由表索引
+ *        bit24-29: 该表项所对应路由的前缀长度
+ *
+ */
+#define ROUTE_VALID (1u << 31)
+#define ROUTE_EXT (1u << 30)
+#define ROUTE_DEPTH_SHIFT 24
+#define ROUTE_DEPTH_MASK 0x3f
+#define ROUTE_VALUE_MASK 0xffffff
+#define ROUTE_DEPTH(e) (((e) >> ROUTE_DEPTH_SHIFT) & ROUTE_DEPTH_MASK)
+#define ROUTE_MAKE(index, depth) (ROUTE_VALID | ((uint32_t)(depth) << ROUTE_DEPTH_SHIFT) | (index))
+
+/**
+ * @brief 路由表，保存所有添加的路由
+ *
+ */
+static route_entry_t route_table[ROUTE_MAX_ENTRY];
+
+/**
+ * @brief 默认路由在路由表中的索引，-1表示没有默认路由
+ *
+ */
+static int route_default = -1;
+
+/**
+ * @brief 以目的ip高24位为索引的一级表，一次访存即可完成绝大多数查找
+ *
+ */
+static uint32_t tbl24[ROUTE_TBL24_SIZE];
+
+/**
+ * @brief 前缀长度大于24时使用的二级表
+ *
+ */
+static uint32_t tbl8[ROUTE_TBL8_GROUPS][ROUTE_TBL8_GROUP_SIZE];
+static int tbl8_used[ROUTE_TBL8_GROUPS];
+
+static uint32_t route_ip_to_u32(uint8_t *ip)
+{
+    return ((uint32_t)ip[0] << 24) | ((uint32_t)ip[1] << 16) | ((uint32_t)ip[2] << 8) | ip[3];
+}
+
+static uint32_t route_mask(int prefix_len)
+{
+    return prefix_len == 0 ? 0 : 0xffffffffu << (32 - prefix_len);
+}
+
+/**
+ * @brief 在路由表中查找与给定前缀完全相同的路由
+ *
+ * @return int 找到时为索引,未找到时为-1
+ */
+static int route_find(uint32_t net, int prefix_len)
+{
+    for (int i = 0; i < ROUTE_MAX_ENTRY; i++)
+        if (route_table[i].valid && route_table[i].prefix_len == prefix_len &&
+            route_ip_to_u32(route_table[i].net) == net)
+            return i;
+    return -1;
+}
+
+/**
+ * @brief 分配一个tbl8组，并用原tbl24表项填满
+ *
+ * @return int 组号，无可用组时为-1
+ */
+static int tbl8_alloc(uint32_t fill)
+{
+    for (int g = 0; g < ROUTE_TBL8_GROUPS; g++)
+        if (!tbl8_used[g])
+        {
+            tbl8_used[g] = 1;
+            for (int i = 0; i < ROUTE_TBL8_GROUP_SIZE; i++)
+                tbl8[g][i] = fill;
+            return g;
+        }
+    return -1;
+}
+
+/**
+ * @brief 若tbl8组内所有表项都相同且不比24位更长，则回收该组并写回tbl24
+ *
+ */
+static void tbl8_try_free(uint32_t idx24)
+{
+    uint32_t g = tbl24[idx24] & ROUTE_VALUE_MASK;
+    uint32_t first = tbl8[g][0];
+    if ((first & ROUTE_VALID) && ROUTE_DEPTH(first) > 24)
+        return;
+    for (int i = 1; i < ROUTE_TBL8_GROUP_SIZE; i++)
+        if (tbl8[g][i] != first)
+            return;
+    tbl24[idx24] = first;
+    tbl8_used[g] = 0;
+}
+
+/**
+ * @brief 用新表项覆盖前缀范围内不比它更长的表项
+ *
+ * @param net 网络号
+ * @param prefix_len 前缀长度，必须大于0
+ * @param entry 新表项
+ * @param old 为0时覆盖前缀长度不大于新表项的表项，否则只替换值等于old的表项（用于删除）
+ */
+static void route_fill(uint32_t net, int prefix_len, uint32_t entry, uint32_t old)
+{
+    uint32_t depth = ROUTE_DEPTH(entry);
+    if (prefix_len <= 24)
+    {
+        uint32_t start = net >> 8, count = 1u << (24 - prefix_len);
+        for (uint32_t i = start; i < start + count; i++)
+        {
+            uint32_t e = tbl24[i];
+            if (e & ROUTE_EXT)
+            {
+                uint32_t *group = tbl8[e & ROUTE_VALUE_MASK];
+                for (int j = 0; j < ROUTE_TBL8_GROUP_SIZE; j++)
+                    if (old ? group[j] == old : (!(group[j] & ROUTE_VALID) || ROUTE_DEPTH(group[j]) <= depth))
+                        group[j] = entry;
+                if (old)
+                    tbl8_try_free(i);
+            }
+            else if (old ? e == old : (!(e & ROUTE_VALID) || ROUTE_DEPTH(e) <= depth))
+                tbl24[i] = entry;
+        }
+        return;
+    }
+
+    uint32_t idx24 = net >> 8;
+    if (!(tbl24[idx24] & ROUTE_EXT))
+        return;
+    uint32_t *group = tbl8[tbl24[idx24] & ROUTE_VALUE_MASK];
+    uint32_t start = net & 0xff, count = 1u << (32 - prefix_len);
+    for (uint32_t i = start; i < start + count; i++)
+        if (old ? group[i] == old : (!(group[i] & ROUTE_VALID) || ROUTE_DEPTH(group[i]) <= depth))
+            group[i] = entry;
+    if (old)
+        tbl8_try_free(idx24);
+}
+
+/**
+ * @brief 添加一条路由，已存在相同前缀时更新其网关
+ *        前缀长度不大于24时直接填写tbl24中对应的一段表项，
+ *        大于24时为该/24分配一个tbl8组，再填写组内对应的一段表项。
+ *        填写时只覆盖前缀不比新路由更长的表项，从而保证最长前缀匹配。
+ *
+ * @param net 网络号
+ * @param prefix_len 前缀长度，0表示默认路由
+ * @param gateway 下一跳网关，全0表示直连
+ * @param ifindex 出口网卡
+ * @return int 成功为0，失败为-1
+ */
+int route_add(uint8_t *net, int prefix_len, uint8_t *gateway, int ifindex)
+{
+    static const uint8_t zero_ip[NET_IP_LEN] = {0};
+    if (prefix_len < 0 || prefix_len > 32)
+        return -1;
+    uint32_t net32 = route_ip_to_u32(net) & route_mask(prefix_len);
+
+    int index = route_find(net32, prefix_len);
+    if (index == -1)
+    {
+        for (int i = 0; i < ROUTE_MAX_ENTRY; i++)
+            if (!route_table[i].valid)
+            {
+                index = i;
+                break;
+            }
+        if (index == -1)
+            return -1;
+        if (prefix_len > 24 && !(tbl24[net32 >> 8] & ROUTE_EXT))
+        {
+            int g = tbl8_alloc(tbl24[net32 >> 8]);
+            if (g == -1)
+                return -1;
+            tbl24[net32 >> 8] = ROUTE_EXT | g;
+        }
+    }
+
+    route_entry_t *route = &route_table[index];
+    route->net[0] = net32 >> 24;
+    route->net[1] = net32 >> 16;
+    route->net[2] = net32 >> 8;
+    route->net[3] = net32;
+    route->prefix_len = prefix_len;
+    memcpy(route->gateway, gateway, NET_IP_LEN);
+    route->direct = memcmp(gateway, zero_ip, NET_IP_LEN) == 0;
+    route->ifindex = ifindex;
+    route->valid = 1;
+
+    if (prefix_len == 0)
+        route_default = index;
+    else
+        route_fill(net32, prefix_len, ROUTE_MAKE(index, prefix_len), 0);
+    return 0;
+}
+
+/**
+ * @brief 删除一条路由
+ *        找到覆盖该前缀的次长路由，用它替换该路由在表中写下的表项
+ *
+ * @param net 网络号
+ * @param prefix_len 前缀长度
+ * @return int 成功为0，未找到为-1
+ */
+int route_del(uint8_t *net, int prefix_len)
+{
+    if (prefix_len < 0 || prefix_len > 32)
+        return -1;
+    uint32_t net32 = route_ip_to_u32(net) & route_mask(prefix_len);
+    int index = route_find(net32, prefix_len);
+    if (index == -1)
+        return -1;
+    route_table[index].valid = 0;
+
+    if (prefix_len == 0)
+    {
+        route_default = -1;
+        return 0;
+    }
+
+    int parent = -1;
+    for (int i = 0; i < ROUTE_MAX_ENTRY; i++)
+    {
+        route_entry_t *r = &route_table[i];
+        if (r->valid && r->prefix_len > 0 && r->prefix_len < prefix_len &&
+            (net32 & route_mask(r->prefix_len)) == route_ip_to_u32(r->net) &&
+            (parent == -1 || r->prefix_len > route_table[parent].prefix_len))
+            parent = i;
+    }
+    uint32_t replace = parent == -1 ? 0 : ROUTE_MAKE(parent, route_table[parent].prefix_len);
+    route_fill(net32, prefix_len, replace, ROUTE_MAKE(index, prefix_len));
+    return 0;
+}
+
+/**
+ * @brief 最长前缀匹配查找下一跳
+ *        先以目的ip高24位查tbl24，表项为扩展项时再以低8位查tbl8，
+ *        至多两次访存。没有匹配的路由时使用默认路由，
+ *        没有默认路由时认为目的地址直连于0号网卡。
+ *
+ * @param ip 目的ip地址
+ * @param ifindex 输出出口网卡，可以为NULL
+ * @return uint8_t* 下一跳ip地址
+ */
+uint8_t *route_lookup(uint8_t *ip, int *ifindex)
+{
+    uint32_t e = tbl24[((uint32_t)ip[0] << 16) | ((uint32_t)ip[1] << 8) | ip[2]];
+    if (e & ROUTE_EXT)
+        e = tbl8[e & ROUTE_VALUE_MASK][ip[3]];
+
+    route_entry_t *route;
+    if (e & ROUTE_VALID)
+        route = &route_table[e & ROUTE_VALUE_MASK];
+    else if (route_default != -1)
+        route = &route_table[route_default];
+    else
+    {
+        if (ifindex)
+            *ifindex = 0;
+        return ip;
+    }
+    if (ifindex)
+        *ifindex = route->ifindex;
+    return route->direct ? ip : route->gateway;
+}
+
+/**
+ * @brief 初始化路由表，添加默认网关
+ *        各网卡子网的直连路由在为网卡添加地址时由netif添加
+ *
+ */
+void route_init()
+{
+    for (int i = 0; i < ROUTE_MAX_ENTRY; i++) //逐条删除而不是清空tbl24，避免触碰整张64MB的表
+        if (route_table[i].valid)
+            route_del(route_table[i].net, route_table[i].prefix_len);
+
+    uint8_t gateway[] = DRIVER_IF_GATEWAY;
+    uint8_t any[NET_IP_LEN] = {0};
+    if (memcmp(gateway, any, NET_IP_LEN) != 0)
+        route_add(any, 0, gateway, 0);
+}
@@ -0,0 +1,283 @@
+#include "shard.h"
+#include "ethernet.h"
+#include "ip.h"
+#include "arp.h"
+#include "udp.h"
+#include "tcp.h"
+#include "timer.h"
+#include "netif.h"
+#include "driver.h"
+#include "stack.h"
+#include "ring.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief 分发线程交给工作线程的数据帧
+ *
+ */
+typedef struct shard_frame
+{
+    uint16_t len;                                        //数据帧长度
+    int ifindex;                                         //收到该帧的网卡
+    uint8_t data[ETHERNET_MTU + sizeof(ether_hdr_t)];    //数据帧
+} shard_frame_t;
+
+/**
+ * @brief 一个工作线程
+ *        rx由分发线程入队、工作线程出队，free相反，两者都是单生产者单消费者；
+ *        frames中的每个数据帧总在free、rx或工作线程手中，free队列永远放得下全部数据帧
+ *
+ */
+typedef struct net_shard
+{
+    pthread_t thread;
+    int index;                    //序号
+    net_stack_t *stack;           //工作线程的协议栈实例，在堆上分配，线程中只保存指向它的指针
+    ring_t rx;                    //待处理的数据帧
+    ring_t free;                  //空闲的数据帧
+    shard_frame_t *frames;        //数据帧池
+    _Atomic uint64_t dispatched;  //只由分发线程修改
+    _Atomic uint64_t dropped;     //只由分发线程修改
+    _Atomic uint64_t processed;   //只由工作线程修改
+} net_shard_t;
+
+static net_shard_t net_shards[NET_SHARD_MAX];
+static int net_shard_count;
+static net_shard_init_t net_shard_init;
+static void *net_shard_arg;
+static _Atomic int net_shard_running;
+static _Atomic int net_shard_ready;
+static NET_LOCAL int net_shard_index = -1;
+
+/**
+ * @brief 计算数据帧的流哈希，非ip数据帧为0
+ *        udp与tcp按（源ip、目的ip、协议、源端口、目的端口）计算，
+ *        分片与其他协议只按（源ip、目的ip、协议）计算。
+ *        两端的（地址、端口）先排序再混合，哈希与方向无关，一条流两个方向的数据帧落在同一个工作线程
+ *
+ * @param frame 以太网数据帧
+ * @param len 数据帧长度
+ * @return uint32_t 哈希值
+ */
+uint32_t net_shard_hash(const uint8_t *frame, int len)
+{
+    const ether_hdr_t *eth = (const ether_hdr_t *)frame;
+    if (len < sizeof(ether_hdr_t) + sizeof(ip_hdr_t) || eth->protocol != swap16(NET_PROTOCOL_IP))
+        return 0;
+    const ip_hdr_t *ip = (const ip_hdr_t *)(eth + 1);
+    uint32_t src, dest;
+    uint16_t ports[2] = {0, 0}; //源端口、目的端口
+    memcpy(&src, ip->src_ip, NET_IP_LEN);
+    memcpy(&dest, ip->dest_ip, NET_IP_LEN);
+    int hdr_len = ip->hdr_len * IP_HDR_LEN_PER_BYTE;
+    int has_ports = (ip->protocol == NET_PROTOCOL_UDP || ip->protocol == NET_PROTOCOL_TCP) &&
+                    !(ip->flags_fragment & swap16(0x3fff)) && len >= sizeof(ether_hdr_t) + hdr_len + sizeof(ports);
+    if (has_ports)
+        memcpy(ports, frame + sizeof(ether_hdr_t) + hdr_len, sizeof(ports));
+    uint32_t lo = src, hi = dest, lo_port = ports[0], hi_port = ports[1];
+    if (src > dest || (src == dest && ports[0] > ports[1]))
+    {
+        lo = dest, hi = src;
+        lo_port = ports[1], hi_port = ports[0];
+    }
+    uint32_t h = (lo ^ hi * 0x9e3779b1u) + ip->protocol;
+    if (has_ports)
+        h ^= (lo_port | hi_port << 16) * 0x85ebca6bu;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    return h;
+}
+
+/**
+ * @brief 把数据帧拷贝给一个工作线程，没有空闲的数据帧时丢弃
+ *
+ */
+static void net_shard_push(net_shard_t *shard, buf_t *buf)
+{
+    shard_frame_t *frame = buf->len <= sizeof(frame->data) ? ring_dequeue(&shard->free) : NULL;
+    if (frame == NULL)
+    {
+        atomic_fetch_add_explicit(&shard->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    frame->len = buf->len;
+    frame->ifindex = buf->ifindex;
+    memcpy(frame->data, buf->data, buf->len);
+    ring_enqueue(&shard->rx, frame);
+    atomic_fetch_add_explicit(&shard->dispatched, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief 工作线程：把分配给它的协议栈实例绑定到本线程并初始化，循环处理分发来的数据帧，
+ *        每批处理完后与net_poll()一样发送批量发送队列、交付合并的udp数据报并推进定时器
+ *
+ */
+static void *net_shard_main(void *arg)
+{
+    net_shard_t *shard = arg;
+    net_shard_index = shard->index;
+    net_stack_bind(shard->stack);
+    arp_set_responder(shard->index == 0);
+    net_stack_init(shard->stack);
+    if (net_shard_init != NULL)
+        net_shard_init(shard->index, net_shard_arg);
+    atomic_fetch_add(&net_shard_ready, 1);
+
+    buf_t *rxbuf = &shard->stack->ethernet.rxbuf;
+    shard_frame_t *batch[ETHERNET_RX_BURST];
+    while (atomic_load_explicit(&net_shard_running, memory_order_relaxed))
+    {
+        int n = ring_dequeue_burst(&shard->rx, (void **)batch, ETHERNET_RX_BURST);
+        for (int i = 0; i < n; i++)
+        {
+            buf_init(rxbuf, batch[i]->len);
+            memcpy(rxbuf->data, batch[i]->data, batch[i]->len);
+            rxbuf->ifindex = batch[i]->ifindex;
+            ethernet_in_stack(shard->stack, rxbuf);
+        }
+        ring_enqueue_burst(&shard->free, (void **)batch, n);
+        atomic_fetch_add_explicit(&shard->processed, n, memory_order_relaxed);
+        ethernet_flush_stack(shard->stack);
+        udp_flush_stack(shard->stack);
+        timer_poll_stack(shard->stack);
+        tcp_flush_stack(shard->stack);
+        if (n == 0)
+            sched_yield();
+    }
+    net_stack_bind(NULL);
+    return NULL;
+}
+
+/**
+ * @brief 启动工作线程，须在net_init()之后调用，返回前所有工作线程都已完成初始化
+ *
+ * @param count 工作线程数，不超过NET_SHARD_MAX
+ * @param init 工作线程的初始化函数，可以为NULL
+ * @param arg 初始化函数的参数
+ * @return int 成功为0，失败为-1
+ */
+int net_shard_start(int count, net_shard_init_t init, void *arg)
+{
+    if (count < 1 || count > NET_SHARD_MAX || net_shard_count != 0)
+        return -1;
+    net_shard_init = init;
+    net_shard_arg = arg;
+    atomic_store(&net_shard_running, 1);
+    atomic_store(&net_shard_ready, 0);
+    for (int i = 0; i < count; i++)
+    {
+        net_shard_t *shard = &net_shards[i];
+        memset(shard, 0, sizeof(*shard));
+        shard->index = i;
+        shard->frames = malloc(NET_SHARD_RING_SIZE * sizeof(shard_frame_t));
+        shard->stack = net_stack_new(0);
+        if (shard->frames == NULL || shard->stack == NULL || ring_init(&shard->rx, NET_SHARD_RING_SIZE) != 0 ||
+            ring_init(&shard->free, NET_SHARD_RING_SIZE) != 0)
+        {
+            free(shard->frames);
+            free(shard->stack);
+            ring_free(&shard->rx);
+            ring_free(&shard->free);
+            net_shard_count = i;
+            net_shard_stop();
+            return -1;
+        }
+        for (int j = 0; j < NET_SHARD_RING_SIZE; j++)
+            ring_enqueue(&shard->free, &shard->frames[j]);
+        if (pthread_create(&shard->thread, NULL, net_shard_main, shard) != 0)
+        {
+            free(shard->frames);
+            free(shard->stack);
+            ring_free(&shard->rx);
+            ring_free(&shard->free);
+            net_shard_count = i;
+            net_shard_stop();
+            return -1;
+        }
+    }
+    net_shard_count = count;
+    while (atomic_load(&net_shard_ready) < count)
+        sched_yield();
+    return 0;
+}
+
+/**
+ * @brief 一次分发：每个网卡最多接收ETHERNET_RX_BURST个数据帧并分给工作线程
+ *
+ * @return int 接收到的数据帧数
+ */
+int net_shard_poll()
+{
+    buf_t *rxbuf = &net_stack_current()->ethernet.rxbuf;
+    int received = 0;
+    for (int i = 0; i < NETIF_MAX_IF; i++)
+    {
+        net_if_t *netif = netif_get(i);
+        if (netif == NULL || netif->driver == NULL)
+            continue;
+        for (int j = 0; j < ETHERNET_RX_BURST; j++)
+        {
+            if (driver_recv_if(netif->driver, rxbuf) <= 0)
+                break;
+            rxbuf->ifindex = i;
+            received++;
+            if (rxbuf->len >= sizeof(ether_hdr_t) && ((ether_hdr_t *)rxbuf->data)->protocol == swap16(NET_PROTOCOL_ARP))
+            {
+                for (int k = 0; k < net_shard_count; k++)
+                    net_shard_push(&net_shards[k], rxbuf);
+            }
+            else
+                net_shard_push(&net_shards[net_shard_hash(rxbuf->data, rxbuf->len) % net_shard_count], rxbuf);
+        }
+    }
+    return received;
+}
+
+/**
+ * @brief 停止并等待所有工作线程退出，丢弃尚未处理的数据帧，释放各工作线程的协议栈实例
+ *
+ */
+void net_shard_stop()
+{
+    atomic_store(&net_shard_running, 0);
+    for (int i = 0; i < net_shard_count; i++)
+    {
+        net_shard_t *shard = &net_shards[i];
+        pthread_join(shard->thread, NULL);
+        ring_free(&shard->rx);
+        ring_free(&shard->free);
+        free(shard->frames);
+        shard->frames = NULL;
+        net_stack_free(shard->stack);
+        shard->stack = NULL;
+    }
+    net_shard_count = 0;
+}
+
+/**
+ * @brief 当前线程的工作线程序号
+ *
+ * @return int 序号，不是工作线程时为-1
+ */
+int net_shard_self()
+{
+    return net_shard_index;
+}
+
+/**
+ * @brief 获取工作线程的计数，可以在任何线程中调用
+ *
+ * @param shard 工作线程序号
+ * @param stats 保存计数
+ */
+void net_shard_get_stats(int shard, net_shard_stats_t *stats)
+{
+    net_shard_t *s = &net_shards[shard];
+    stats->dispatched = atomic_load_explicit(&s->dispatched, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&s->dropped, memory_order_relaxed);
+    stats->processed = atomic_load_explicit(&s->processed, memory_order_relaxed);
+}
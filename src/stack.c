@@ -0,0 +1,53 @@
+#include "stack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+NET_LOCAL net_stack_t *net_stack_local;
+NET_LOCAL net_stack_t *net_stack_active;
+
+/**
+ * @brief 把一个协议栈实例绑定到本线程，之后各层的函数都作用于它
+ *
+ * @param stack 实例，为NULL时恢复本线程的默认实例
+ * @return net_stack_t* 之前绑定的实例，为NULL表示默认实例，用于恢复
+ */
+net_stack_t *net_stack_bind(net_stack_t *stack)
+{
+    net_stack_t *prev = net_stack_active;
+    net_stack_active = stack;
+    return prev;
+}
+
+/**
+ * @brief 创建一个协议栈实例，之后须调用net_stack_init()
+ *
+ * @param ifmask 实例轮询的网卡，第i位对应ifindex为i的网卡，0表示全部
+ * @return net_stack_t* 实例，内存不足时为NULL
+ */
+net_stack_t *net_stack_new(uint32_t ifmask)
+{
+    net_stack_t *stack = aligned_alloc(_Alignof(net_stack_t), sizeof(net_stack_t));
+    if (stack == NULL)
+        return NULL;
+    memset(stack, 0, sizeof(net_stack_t));
+    stack->ifmask = ifmask;
+    return stack;
+}
+
+/**
+ * @brief 在堆上分配本线程的默认协议栈实例，内存不足时终止进程
+ *        各层的函数没有出错的返回值，取不到实例时无法继续
+ *
+ * @return net_stack_t* 实例
+ */
+net_stack_t *net_stack_local_new()
+{
+    net_stack_local = net_stack_new(0);
+    if (net_stack_local == NULL)
+    {
+        fprintf(stderr, "Error in net_stack_local_new: out of memory\n");
+        abort();
+    }
+    return net_stack_local;
+}
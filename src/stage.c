@@ -0,0 +1,419 @@
+#include "stage.h"
+#include "shard.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "udp.h"
+#include "tcp.h"
+#include "timer.h"
+#include "netif.h"
+#include "driver.h"
+#include "stack.h"
+#include "ring.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief 一个阶段的计数，只由该阶段的线程修改，独占缓存行
+ *
+ */
+typedef struct stage_counters
+{
+    _Alignas(64) _Atomic uint64_t packets;
+    _Atomic uint64_t dropped;
+    _Atomic uint64_t stalls;
+    _Atomic uint64_t polls;
+    _Atomic uint64_t idle;
+    _Atomic uint64_t occupancy;
+} stage_counters_t;
+
+/**
+ * @brief 一个协议线程
+ *        rx由接收线程入队、协议线程出队，rx_done相反；tx由协议线程入队、发送线程出队，tx_done相反。
+ *        接收缓冲区池共NET_STAGE_RING_SIZE个，由所有协议线程共用，每个队列都放得下全部接收缓冲区；
+ *        发送缓冲区池每个协议线程NET_STAGE_RING_SIZE个，tx与tx_done都放得下全部发送缓冲区，入队不会失败
+ *
+ */
+typedef struct net_stage
+{
+    pthread_t thread;
+    int started;                          //线程是否已启动
+    int index;                            //序号
+    net_stack_t *stack;                   //协议线程的协议栈实例，在堆上分配，线程中只保存指向它的指针
+    ring_t rx;                            //待处理的数据帧
+    ring_t rx_done;                       //处理完的接收缓冲区
+    ring_t tx;                            //待发送的数据帧
+    ring_t tx_done;                       //发送完的发送缓冲区
+    buf_t *tx_bufs;                       //发送缓冲区池
+    buf_t *tx_free[NET_STAGE_RING_SIZE];  //空闲的发送缓冲区，只由协议线程使用
+    int tx_free_count;
+    stage_counters_t counters;
+} net_stage_t;
+
+static net_stage_t net_stages[NET_STAGE_MAX];
+static int net_stage_count;
+static buf_t *stage_rx_bufs;                      //接收缓冲区池
+static buf_t *stage_rx_free[NET_STAGE_RING_SIZE]; //空闲的接收缓冲区，只由接收线程使用
+static int stage_rx_free_count;
+static stage_counters_t stage_rx_counters, stage_tx_counters;
+static pthread_t stage_rx_thread, stage_tx_thread;
+static int stage_rx_started, stage_tx_started;
+static net_stage_init_t net_stage_init;
+static void *net_stage_arg;
+static _Atomic int net_stage_running;
+static _Atomic int net_stage_ready;
+static NET_LOCAL net_stage_t *net_stage_current;
+
+/**
+ * @brief 增加一个计数，计数只有一个写者，不需要原子的读-改-写
+ *
+ */
+static void stage_count(_Atomic uint64_t *counter, uint64_t n)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+/**
+ * @brief 取一个空闲的接收缓冲区，本地没有时收回各协议线程处理完的缓冲区
+ *
+ */
+static buf_t *stage_rx_alloc()
+{
+    for (int i = 0; i < net_stage_count && stage_rx_free_count == 0; i++)
+        stage_rx_free_count = ring_dequeue_burst(&net_stages[i].rx_done, (void **)stage_rx_free, NET_STAGE_RING_SIZE);
+    return stage_rx_free_count ? stage_rx_free[--stage_rx_free_count] : NULL;
+}
+
+/**
+ * @brief 接收线程：从各网卡批量接收数据帧，直接收进接收缓冲区，按流把指针交给协议线程
+ *        arp数据帧拷贝给其他协议线程，原缓冲区交给0号协议线程
+ *
+ */
+static void *net_stage_rx_main(void *arg)
+{
+    while (atomic_load_explicit(&net_stage_running, memory_order_relaxed))
+    {
+        int received = 0, stalled = 0;
+        for (int i = 0; i < NETIF_MAX_IF && !stalled; i++)
+        {
+            net_if_t *netif = netif_get(i);
+            if (netif == NULL || netif->driver == NULL)
+                continue;
+            for (int j = 0; j < ETHERNET_RX_BURST; j++)
+            {
+                buf_t *buf = stage_rx_alloc();
+                if (buf == NULL)
+                {
+                    stalled = 1;
+                    break;
+                }
+                if (driver_recv_if(netif->driver, buf) <= 0)
+                {
+                    stage_rx_free[stage_rx_free_count++] = buf;
+                    break;
+                }
+                buf->ifindex = i;
+                received++;
+                if (buf->len >= sizeof(ether_hdr_t) && ((ether_hdr_t *)buf->data)->protocol == swap16(NET_PROTOCOL_ARP))
+                {
+                    for (int k = 1; k < net_stage_count; k++)
+                    {
+                        buf_t *copy = stage_rx_alloc();
+                        if (copy == NULL)
+                        {
+                            stage_count(&stage_rx_counters.dropped, 1);
+                            continue;
+                        }
+                        buf_init(copy, buf->len);
+                        memcpy(copy->data, buf->data, buf->len);
+                        copy->ifindex = i;
+                        ring_enqueue(&net_stages[k].rx, copy);
+                    }
+                    ring_enqueue(&net_stages[0].rx, buf);
+                }
+                else
+                    ring_enqueue(&net_stages[net_shard_hash(buf->data, buf->len) % net_stage_count].rx, buf);
+            }
+        }
+        stage_count(&stage_rx_counters.polls, 1);
+        stage_count(&stage_rx_counters.packets, received);
+        if (stalled)
+            stage_count(&stage_rx_counters.stalls, 1);
+        if (received == 0)
+        {
+            stage_count(&stage_rx_counters.idle, 1);
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 协议线程的发送钩子：把数据帧拷贝进一个发送缓冲区，放入发送队列
+ *        没有空闲的发送缓冲区时丢弃
+ *
+ */
+static int net_stage_tx_hook(int ifindex, const uint8_t *frame, uint16_t len)
+{
+    net_stage_t *stage = net_stage_current;
+    if (stage->tx_free_count == 0)
+        stage->tx_free_count = ring_dequeue_burst(&stage->tx_done, (void **)stage->tx_free, NET_STAGE_RING_SIZE);
+    if (stage->tx_free_count == 0)
+    {
+        stage_count(&stage->counters.stalls, 1);
+        stage_count(&stage->counters.dropped, 1);
+        return -1;
+    }
+    buf_t *buf = stage->tx_free[--stage->tx_free_count];
+    buf_init(buf, len);
+    memcpy(buf->data, frame, len);
+    buf->ifindex = ifindex;
+    ring_enqueue(&stage->tx, buf);
+    return 0;
+}
+
+/**
+ * @brief 协议线程：把分配给它的协议栈实例绑定到本线程并初始化，循环处理接收队列中的数据帧并归还缓冲区，
+ *        每批处理完后与net_poll()一样发送批量发送队列、交付合并的udp数据报并推进定时器
+ *
+ */
+static void *net_stage_proto_main(void *arg)
+{
+    net_stage_t *stage = arg;
+    net_stage_current = stage;
+    net_stack_bind(stage->stack);
+    ethernet_set_tx_hook(net_stage_tx_hook);
+    arp_set_responder(stage->index == 0);
+    net_stack_init(stage->stack);
+    if (net_stage_init != NULL)
+        net_stage_init(stage->index, net_stage_arg);
+    atomic_fetch_add(&net_stage_ready, 1);
+
+    buf_t *batch[ETHERNET_RX_BURST];
+    while (atomic_load_explicit(&net_stage_running, memory_order_relaxed))
+    {
+        stage_count(&stage->counters.occupancy, ring_count(&stage->rx));
+        int n = ring_dequeue_burst(&stage->rx, (void **)batch, ETHERNET_RX_BURST);
+        for (int i = 0; i < n; i++)
+            ethernet_in_stack(stage->stack, batch[i]);
+        ring_enqueue_burst(&stage->rx_done, (void **)batch, n);
+        ethernet_flush_stack(stage->stack);
+        udp_flush_stack(stage->stack);
+        timer_poll_stack(stage->stack);
+        tcp_flush_stack(stage->stack);
+        stage_count(&stage->counters.polls, 1);
+        stage_count(&stage->counters.packets, n);
+        if (n == 0)
+        {
+            stage_count(&stage->counters.idle, 1);
+            sched_yield();
+        }
+    }
+    net_stack_bind(NULL);
+    return NULL;
+}
+
+/**
+ * @brief 把一批发送缓冲区中连续发往同一网卡的数据帧一次交给驱动
+ *
+ */
+static void stage_tx_send(buf_t **batch, int n)
+{
+    uint8_t *frames[ETHERNET_TX_BURST];
+    uint16_t lens[ETHERNET_TX_BURST];
+    for (int i = 0; i < n;)
+    {
+        int ifindex = batch[i]->ifindex, count = 0;
+        for (; i < n && batch[i]->ifindex == ifindex; i++, count++)
+        {
+            frames[count] = batch[i]->data;
+            lens[count] = batch[i]->len;
+        }
+        net_if_t *netif = netif_get(ifindex);
+        int sent = netif != NULL ? driver_send_burst_if(netif->driver, frames, lens, count) : 0;
+        if (sent < count)
+            stage_count(&stage_tx_counters.dropped, count - (sent > 0 ? sent : 0));
+    }
+}
+
+/**
+ * @brief 发送线程：轮流取出各协议线程发送队列中的数据帧交给驱动，再归还发送缓冲区
+ *
+ */
+static void *net_stage_tx_main(void *arg)
+{
+    buf_t *batch[ETHERNET_TX_BURST];
+    while (atomic_load_explicit(&net_stage_running, memory_order_relaxed))
+    {
+        int sent = 0;
+        for (int i = 0; i < net_stage_count; i++)
+        {
+            net_stage_t *stage = &net_stages[i];
+            stage_count(&stage_tx_counters.occupancy, ring_count(&stage->tx));
+            int n = ring_dequeue_burst(&stage->tx, (void **)batch, ETHERNET_TX_BURST);
+            if (n == 0)
+                continue;
+            stage_tx_send(batch, n);
+            ring_enqueue_burst(&stage->tx_done, (void **)batch, n);
+            sent += n;
+        }
+        stage_count(&stage_tx_counters.polls, 1);
+        stage_count(&stage_tx_counters.packets, sent);
+        if (sent == 0)
+        {
+            stage_count(&stage_tx_counters.idle, 1);
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static int net_stage_setup(net_stage_t *stage, int index)
+{
+    memset(stage, 0, sizeof(*stage));
+    stage->index = index;
+    stage->tx_bufs = calloc(NET_STAGE_RING_SIZE, sizeof(buf_t));
+    stage->stack = net_stack_new(0);
+    if (stage->tx_bufs == NULL || stage->stack == NULL || ring_init(&stage->rx, NET_STAGE_RING_SIZE) != 0 ||
+        ring_init(&stage->rx_done, NET_STAGE_RING_SIZE) != 0 || ring_init(&stage->tx, NET_STAGE_RING_SIZE) != 0 ||
+        ring_init(&stage->tx_done, NET_STAGE_RING_SIZE) != 0)
+        return -1;
+    for (int i = 0; i < NET_STAGE_RING_SIZE; i++)
+        stage->tx_free[i] = &stage->tx_bufs[i];
+    stage->tx_free_count = NET_STAGE_RING_SIZE;
+    return 0;
+}
+
+static void net_stage_release(net_stage_t *stage)
+{
+    ring_free(&stage->rx);
+    ring_free(&stage->rx_done);
+    ring_free(&stage->tx);
+    ring_free(&stage->tx_done);
+    free(stage->tx_bufs);
+    stage->tx_bufs = NULL;
+    if (stage->stack != NULL)
+        net_stack_free(stage->stack);
+    stage->stack = NULL;
+}
+
+/**
+ * @brief 启动接收、协议与发送线程，须在net_init()之后调用，返回前所有协议线程都已完成初始化
+ *        发送线程最先启动，以便发出协议线程初始化时的arp宣告；接收线程最后启动
+ *
+ * @param count 协议线程数，不超过NET_STAGE_MAX
+ * @param init 协议线程的初始化函数，可以为NULL
+ * @param arg 初始化函数的参数
+ * @return int 成功为0，失败为-1
+ */
+int net_stage_start(int count, net_stage_init_t init, void *arg)
+{
+    if (count < 1 || count > NET_STAGE_MAX || net_stage_count != 0 || stage_rx_bufs != NULL)
+        return -1;
+    net_stage_init = init;
+    net_stage_arg = arg;
+    memset(&stage_rx_counters, 0, sizeof(stage_rx_counters));
+    memset(&stage_tx_counters, 0, sizeof(stage_tx_counters));
+    atomic_store(&net_stage_running, 1);
+    atomic_store(&net_stage_ready, 0);
+
+    stage_rx_bufs = calloc(NET_STAGE_RING_SIZE, sizeof(buf_t));
+    if (stage_rx_bufs == NULL)
+        return -1;
+    for (int i = 0; i < NET_STAGE_RING_SIZE; i++)
+        stage_rx_free[i] = &stage_rx_bufs[i];
+    stage_rx_free_count = NET_STAGE_RING_SIZE;
+    for (int i = 0; i < count; i++)
+    {
+        if (net_stage_setup(&net_stages[i], i) != 0)
+        {
+            net_stage_release(&net_stages[i]);
+            net_stage_count = i;
+            net_stage_stop();
+            return -1;
+        }
+        net_stage_count = i + 1;
+    }
+
+    stage_tx_started = pthread_create(&stage_tx_thread, NULL, net_stage_tx_main, NULL) == 0;
+    if (!stage_tx_started)
+    {
+        net_stage_stop();
+        return -1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        net_stages[i].started = pthread_create(&net_stages[i].thread, NULL, net_stage_proto_main, &net_stages[i]) == 0;
+        if (!net_stages[i].started)
+        {
+            net_stage_stop();
+            return -1;
+        }
+    }
+    while (atomic_load(&net_stage_ready) < count)
+        sched_yield();
+    stage_rx_started = pthread_create(&stage_rx_thread, NULL, net_stage_rx_main, NULL) == 0;
+    if (!stage_rx_started)
+    {
+        net_stage_stop();
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 停止并等待所有线程退出，丢弃队列中的数据帧
+ *
+ */
+void net_stage_stop()
+{
+    atomic_store(&net_stage_running, 0);
+    if (stage_rx_started)
+        pthread_join(stage_rx_thread, NULL);
+    for (int i = 0; i < net_stage_count; i++)
+        if (net_stages[i].started)
+            pthread_join(net_stages[i].thread, NULL);
+    if (stage_tx_started)
+        pthread_join(stage_tx_thread, NULL);
+    stage_rx_started = stage_tx_started = 0;
+    for (int i = 0; i < net_stage_count; i++)
+        net_stage_release(&net_stages[i]);
+    net_stage_count = 0;
+    free(stage_rx_bufs);
+    stage_rx_bufs = NULL;
+}
+
+/**
+ * @brief 当前线程的协议线程序号
+ *
+ * @return int 序号，不是协议线程时为-1
+ */
+int net_stage_self()
+{
+    return net_stage_current != NULL ? net_stage_current->index : -1;
+}
+
+/**
+ * @brief 获取一个阶段的计数，可以在任何线程中调用
+ *
+ * @param kind 阶段
+ * @param index 协议线程序号，接收与发送线程忽略
+ * @param stats 保存计数
+ */
+void net_stage_get_stats(net_stage_kind_t kind, int index, net_stage_stats_t *stats)
+{
+    stage_counters_t *c = kind == NET_STAGE_RX ? &stage_rx_counters : kind == NET_STAGE_TX ? &stage_tx_counters : &net_stages[index].counters;
+    stats->packets = atomic_load_explicit(&c->packets, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&c->dropped, memory_order_relaxed);
+    stats->stalls = atomic_load_explicit(&c->stalls, memory_order_relaxed);
+    stats->polls = atomic_load_explicit(&c->polls, memory_order_relaxed);
+    stats->idle = atomic_load_explicit(&c->idle, memory_order_relaxed);
+    stats->occupancy = atomic_load_explicit(&c->occupancy, memory_order_relaxed);
+    stats->queued = 0;
+    if (kind == NET_STAGE_PROTO)
+        stats->queued = ring_count(&net_stages[index].rx);
+    else if (kind == NET_STAGE_TX)
+        for (int i = 0; i < net_stage_count; i++)
+            stats->queued += ring_count(&net_stages[i].tx);
+}
@@ -0,0 +1,247 @@
+#define _GNU_SOURCE
+#include "stats.h"
+#include "stack.h"
+#include <string.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define NET_STATS_READ_TRIES 1000 //读者等待写者完成写入的最多次数
+
+static _Atomic(net_stats_shm_t *) net_stats_segment; //本进程导出计数的共享内存，进程内共享
+
+static size_t net_stats_size(uint32_t slot_count)
+{
+    return sizeof(net_stats_shm_t) + (size_t)slot_count * sizeof(net_stats_slot_t);
+}
+
+/**
+ * @brief 创建共享内存并开始导出本进程所有协议栈实例的计数，同名的旧共享内存被清空
+ *        头部的其余字段写完后才写入magic，读者不会看到初始化到一半的共享内存
+ *
+ * @param name 共享内存名称，以'/'开头，如NET_STATS_SHM_NAME
+ * @return int 成功为0，失败或已经导出为-1
+ */
+int net_stats_export(const char *name)
+{
+    if (atomic_load(&net_stats_segment) != NULL)
+        return -1;
+    int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+    size_t size = net_stats_size(NET_STATS_MAX_SLOTS);
+    net_stats_shm_t *shm = MAP_FAILED;
+    if (ftruncate(fd, size) == 0)
+        shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED)
+        return -1;
+    shm->version = NET_STATS_VERSION;
+    shm->slot_size = sizeof(net_stats_slot_t);
+    shm->slot_count = NET_STATS_MAX_SLOTS;
+    shm->pid = getpid();
+    atomic_thread_fence(memory_order_release);
+    shm->magic = NET_STATS_MAGIC;
+
+    net_stats_shm_t *expected = NULL;
+    if (!atomic_compare_exchange_strong(&net_stats_segment, &expected, shm))
+    {
+        munmap(shm, size);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 占用一个空闲的槽，槽在实例释放后可以被其他实例再次占用
+ *
+ * @return net_stats_slot_t* 槽，全部被占用时为NULL
+ */
+static net_stats_slot_t *net_stats_claim(net_stats_shm_t *shm)
+{
+    for (uint32_t i = 0; i < shm->slot_count; i++)
+    {
+        uint32_t idle = 0;
+        if (!atomic_compare_exchange_strong(&shm->slots[i].active, &idle, 1))
+            continue;
+        uint32_t used = atomic_load(&shm->slots_used);
+        while (used < i + 1 && !atomic_compare_exchange_weak(&shm->slots_used, &used, i + 1))
+            ;
+        return &shm->slots[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief 发布定时器，每NET_STATS_PUBLISH_MS毫秒发布一次
+ *
+ */
+static void net_stats_tick(net_timer_t *timer, void *arg)
+{
+    net_stats_publish();
+    timer_add(timer, NET_STATS_PUBLISH_MS, net_stats_tick, NULL);
+}
+
+/**
+ * @brief 初始化当前协议栈实例的计数导出，启动发布定时器，须在timer_init()之后调用
+ *        已占用的槽继续使用
+ *
+ */
+void net_stats_init()
+{
+    net_stats_ctx_t *ctx = &net_stack_current()->stats;
+    ctx->timer.pending = 0; //timer_init()已丢弃时间轮上的定时器
+    timer_add(&ctx->timer, NET_STATS_PUBLISH_MS, net_stats_tick, NULL);
+}
+
+/**
+ * @brief 停止当前协议栈实例的计数导出并释放它占用的槽
+ *
+ */
+void net_stats_release()
+{
+    net_stats_ctx_t *ctx = &net_stack_current()->stats;
+    timer_del(&ctx->timer);
+    if (ctx->slot != NULL)
+        atomic_store_explicit(&ctx->slot->active, 0, memory_order_release);
+    ctx->slot = NULL;
+}
+
+/**
+ * @brief 把当前协议栈实例的计数拷贝到一个槽中，不修改槽的seq与active
+ *        只导出已打开的udp端口，超过NET_STATS_UDP_PORTS个时其余端口不导出
+ *
+ * @param slot 槽
+ */
+void net_stats_collect(net_stats_slot_t *slot)
+{
+    net_stack_t *stack = net_stack_current();
+    slot->tid = syscall(SYS_gettid);
+    slot->cpu = sched_getcpu();
+    slot->ifmask = stack->ifmask;
+    slot->publish_ms = timer_now_ms();
+
+    int n = 0;
+    slot->ethertypes[n].protocol = 0;
+    slot->ethertypes[n++].stats = stack->ethernet.other_stats;
+    for (int i = 0; i < ETHERNET_PROTO_TABLE_SIZE && n < ETHERNET_PROTO_TABLE_SIZE; i++)
+    {
+        const ethernet_proto_t *proto = &stack->ethernet.protos[i];
+        if (proto->protocol == 0)
+            continue;
+        slot->ethertypes[n].protocol = proto->protocol;
+        slot->ethertypes[n++].stats = proto->stats;
+    }
+    slot->ethertype_count = n;
+
+    for (int i = 0; i < 256; i++)
+        slot->ip[i] = stack->ip.protos[i].stats;
+
+    n = 0;
+    for (int i = 0; i < stack->udp.open_count && n < NET_STATS_UDP_PORTS; i++)
+    {
+        const udp_entry_t *entry = &stack->udp.table[stack->udp.open_ports[i]];
+        if (!entry->valid)
+            continue;
+        slot->udp_ports[n].port = entry->port;
+        slot->udp_ports[n++].stats = entry->stats;
+    }
+    slot->udp_port_count = n;
+
+    slot->arp = stack->arp.stats;
+    slot->driver = stack->ethernet.driver_stats;
+    memcpy(slot->drops, stack->drop.counts, sizeof(slot->drops));
+    slot->drop_logged = stack->drop.logged;
+    memcpy(slot->drop_log, stack->drop.log, sizeof(slot->drop_log));
+}
+
+/**
+ * @brief 立即把当前协议栈实例的计数发布到共享内存，没有导出时不做处理
+ *        第一次发布时占用一个槽，槽已全部被占用时不发布
+ *
+ */
+void net_stats_publish()
+{
+    net_stats_ctx_t *ctx = &net_stack_current()->stats;
+    net_stats_shm_t *shm = atomic_load_explicit(&net_stats_segment, memory_order_acquire);
+    if (shm == NULL)
+        return;
+    if (ctx->slot == NULL)
+        ctx->slot = net_stats_claim(shm);
+    net_stats_slot_t *slot = ctx->slot;
+    if (slot == NULL)
+        return;
+    uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    net_stats_collect(slot);
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+}
+
+/**
+ * @brief 以只读方式打开另一个进程导出的计数
+ *
+ * @param name 共享内存名称
+ * @return const net_stats_shm_t* 共享内存，不存在、还没有初始化完成或布局不一致时为NULL
+ */
+const net_stats_shm_t *net_stats_attach(const char *name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    net_stats_shm_t *shm = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(net_stats_shm_t))
+        shm = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED)
+        return NULL;
+    if (shm->magic != NET_STATS_MAGIC || shm->version != NET_STATS_VERSION || shm->slot_size != sizeof(net_stats_slot_t) ||
+        net_stats_size(shm->slot_count) > (size_t)st.st_size)
+    {
+        munmap(shm, st.st_size);
+        return NULL;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    return shm;
+}
+
+/**
+ * @brief 关闭net_stats_attach()打开的共享内存
+ *
+ * @param shm 共享内存
+ */
+void net_stats_detach(const net_stats_shm_t *shm)
+{
+    munmap((void *)shm, net_stats_size(shm->slot_count));
+}
+
+/**
+ * @brief 读取一个槽的一致快照：拷贝前后seq相同且为偶数时拷贝的内容一致，否则重读
+ *
+ * @param shm 共享内存
+ * @param index 槽号，小于slots_used
+ * @param slot 保存快照
+ * @return int 槽被实例占用为0，空闲或写者长时间没有完成写入为-1
+ */
+int net_stats_read(const net_stats_shm_t *shm, int index, net_stats_slot_t *slot)
+{
+    const net_stats_slot_t *src = &shm->slots[index];
+    for (int i = 0; i < NET_STATS_READ_TRIES; i++)
+    {
+        uint64_t seq = atomic_load_explicit(&src->seq, memory_order_acquire);
+        if (seq & 1)
+        {
+            sched_yield();
+            continue;
+        }
+        memcpy(slot, (const void *)src, sizeof(*slot));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&src->seq, memory_order_relaxed) == seq)
+            return atomic_load_explicit(&slot->active, memory_order_relaxed) ? 0 : -1;
+    }
+    return -1;
+}
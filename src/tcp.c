@@ -0,0 +1,1557 @@
+#include "tcp.h"
+#include "ip.h"
+#include "ethernet.h"
+#include "netif.h"
+#include "stack.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief tcp协议
+ *        连接按（远端ip、本端端口、远端端口）哈希到链表，本端ip在链表中比较。
+ *        收到的报文段先做首部预测：已建立连接上没有选项、按序到达、窗口不变的纯确认或纯数据
+ *        直接更新状态，不解析选项也不走完整的状态机。
+ *        报文段的处理只更新状态，把连接挂到待输出链表上，由net_poll()末尾的tcp_flush()统一输出，
+ *        同一批收到的多个数据报文段合并为一个确认；不足TCP_DELACK_SEGS个时等待TCP_DELACK_MS再确认。
+ *        发送与接收缓冲区是环形缓冲区，应用直接在其中读写；输出时数据从发送缓冲区直接拷贝进批量发送队列的
+ *        数据帧中，以太网与ip头部每次输出只构造一次模板。
+ *        重传、零窗口探测、延迟确认与TIME_WAIT都由时间轮驱动；丢包恢复按SACK重传空洞，
+ *        对端不支持SACK时退回NewReno。
+ *
+ */
+
+/**
+ * @brief 报文段中的选项
+ *
+ */
+typedef struct tcp_opts
+{
+    int mss;               //最大报文段长度，0表示没有
+    int wscale;            //窗口扩大因子，-1表示没有
+    int sack_ok;           //允许SACK
+    int sack_count;        //SACK块数
+    tcp_block_t sack[4];   //SACK块
+} tcp_opts_t;
+
+static inline int seq_lt(uint32_t a, uint32_t b) { return (int32_t)(a - b) < 0; }
+static inline int seq_leq(uint32_t a, uint32_t b) { return (int32_t)(a - b) <= 0; }
+static inline uint32_t seq_max(uint32_t a, uint32_t b) { return seq_lt(a, b) ? b : a; }
+static inline uint32_t seq_min(uint32_t a, uint32_t b) { return seq_lt(a, b) ? a : b; }
+static inline uint32_t min_u32(uint32_t a, uint32_t b) { return a < b ? a : b; }
+
+static uint32_t tcp_get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void tcp_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void tcp_ring_read(tcp_ring_t *ring, uint32_t off, uint8_t *dst, uint32_t len)
+{
+    uint32_t idx = off & (ring->size - 1), first = min_u32(len, ring->size - idx);
+    memcpy(dst, ring->data + idx, first);
+    memcpy(dst + first, ring->data, len - first);
+}
+
+static void tcp_ring_write(tcp_ring_t *ring, uint32_t off, const uint8_t *src, uint32_t len)
+{
+    uint32_t idx = off & (ring->size - 1), first = min_u32(len, ring->size - idx);
+    memcpy(ring->data + idx, src, first);
+    memcpy(ring->data, src + first, len - first);
+}
+
+static uint32_t tcp_hash(const uint8_t *remote_ip, uint16_t local_port, uint16_t remote_port)
+{
+    uint32_t ip;
+    memcpy(&ip, remote_ip, NET_IP_LEN);
+    return ((ip ^ ((uint32_t)local_port << 16 | remote_port)) * 0x9e3779b1u >> 16) & (TCP_CONN_HASH_SIZE - 1);
+}
+
+static tcp_conn_t *tcp_lookup(const uint8_t *local_ip, uint16_t local_port, const uint8_t *remote_ip, uint16_t remote_port)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    tcp_conn_t *conn = ctx->conn_hash[tcp_hash(remote_ip, local_port, remote_port)];
+    for (; conn != NULL; conn = conn->hash_next)
+        if (conn->local_port == local_port && conn->remote_port == remote_port &&
+            memcmp(conn->remote_ip, remote_ip, NET_IP_LEN) == 0 && memcmp(conn->local_ip, local_ip, NET_IP_LEN) == 0)
+            return conn;
+    return NULL;
+}
+
+static tcp_listener_t *tcp_listener_find(uint16_t port)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    for (int i = 0; i < TCP_MAX_LISTEN; i++)
+        if (ctx->listeners[i].valid && ctx->listeners[i].port == port)
+            return &ctx->listeners[i];
+    return NULL;
+}
+
+/**
+ * @brief 把连接挂到待输出链表上，在tcp_flush()时输出或释放
+ *
+ */
+static void tcp_dirty(tcp_conn_t *conn)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    if (conn->dirty)
+        return;
+    conn->dirty = 1;
+    conn->dirty_next = NULL;
+    if (ctx->dirty_tail != NULL)
+        ctx->dirty_tail->dirty_next = conn;
+    else
+        ctx->dirty_head = conn;
+    ctx->dirty_tail = conn;
+}
+
+/**
+ * @brief 本端的窗口扩大因子：使接收缓冲区大小右移后不超过16位
+ *
+ */
+static uint8_t tcp_local_wscale()
+{
+    uint8_t shift = 0;
+    while ((TCP_RCVBUF >> shift) > 0xffff && shift < 14)
+        shift++;
+    return shift;
+}
+
+/**
+ * @brief 初始序号：按毫秒增长的时钟加上连接四元组的哈希，避免与旧连接的报文段混淆（RFC 6528）
+ *
+ */
+static uint32_t tcp_new_iss(tcp_conn_t *conn)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    uint32_t h = tcp_hash(conn->remote_ip, conn->local_port, conn->remote_port);
+    return (uint32_t)timer_now_ms() * 250 + (h ^ ctx->iss_seed) * 2654435761u;
+}
+
+static void tcp_rtx_expire(net_timer_t *timer, void *arg);
+static void tcp_delack_expire(net_timer_t *timer, void *arg);
+
+/**
+ * @brief 分配一个连接并加入哈希表
+ *
+ * @return tcp_conn_t* 连接，连接数已达上限或内存不足时为NULL
+ */
+static tcp_conn_t *tcp_conn_new(const uint8_t *local_ip, uint16_t local_port, const uint8_t *remote_ip, uint16_t remote_port,
+                                tcp_handler_t handler, void *arg)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    if (ctx->conns >= TCP_MAX_CONN)
+        return NULL;
+    tcp_conn_t *conn = calloc(1, sizeof(tcp_conn_t));
+    if (conn == NULL)
+        return NULL;
+    conn->snd.data = malloc(TCP_SNDBUF);
+    conn->rcv.data = malloc(TCP_RCVBUF);
+    if (conn->snd.data == NULL || conn->rcv.data == NULL)
+    {
+        free(conn->snd.data);
+        free(conn->rcv.data);
+        free(conn);
+        return NULL;
+    }
+    conn->snd.size = TCP_SNDBUF;
+    conn->rcv.size = TCP_RCVBUF;
+    memcpy(conn->local_ip, local_ip, NET_IP_LEN);
+    memcpy(conn->remote_ip, remote_ip, NET_IP_LEN);
+    conn->local_port = local_port;
+    conn->remote_port = remote_port;
+    conn->handler = handler;
+    conn->arg = arg;
+    conn->iss = tcp_new_iss(conn);
+    conn->snd_una = conn->snd_nxt = conn->snd_max = conn->recover = conn->iss;
+    conn->mss = ip_get_pmtu(conn->remote_ip) - sizeof(ip_hdr_t) - sizeof(tcp_hdr_t);
+    conn->ssthresh = UINT32_MAX;
+    conn->rto = TCP_RTO_INIT_MS;
+    conn->rcv_wscale = tcp_local_wscale();
+
+    uint32_t h = tcp_hash(remote_ip, local_port, remote_port);
+    conn->hash_next = ctx->conn_hash[h];
+    ctx->conn_hash[h] = conn;
+    ctx->conns++;
+    return conn;
+}
+
+static void tcp_conn_free(tcp_conn_t *conn)
+{
+    free(conn->snd.data);
+    free(conn->rcv.data);
+    free(conn);
+}
+
+/**
+ * @brief 结束连接：移出哈希表、停止定时器，内存在下一次tcp_flush()时释放
+ *
+ * @param conn 连接
+ * @param notify 是否产生TCP_EVENT_CLOSED
+ */
+static void tcp_destroy(tcp_conn_t *conn, int notify)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    tcp_conn_t **p = &ctx->conn_hash[tcp_hash(conn->remote_ip, conn->local_port, conn->remote_port)];
+    while (*p != conn)
+        p = &(*p)->hash_next;
+    *p = conn->hash_next;
+    ctx->conns--;
+    timer_del(&conn->rtx_timer);
+    timer_del(&conn->delack_timer);
+    conn->state = TCP_CLOSED;
+    tcp_dirty(conn);
+    if (notify && conn->handler != NULL)
+        conn->handler(conn, TCP_EVENT_CLOSED, conn->arg);
+}
+
+static void tcp_event(tcp_conn_t *conn, tcp_event_t event)
+{
+    if (conn->handler != NULL)
+        conn->handler(conn, event, conn->arg);
+}
+
+/**
+ * @brief 计算tcp校验和，包括伪头部；对收到的报文段结果为0表示正确
+ *
+ */
+static uint16_t tcp_checksum(const uint8_t *seg, int len, const uint8_t *src_ip, const uint8_t *dest_ip)
+{
+    uint32_t sum = checksum_add(checksum_add(0, src_ip, NET_IP_LEN), dest_ip, NET_IP_LEN);
+    return checksum_fold(checksum_add(sum + swap16(NET_PROTOCOL_TCP) + swap16(len), seg, len));
+}
+
+static void tcp_parse_options(tcp_hdr_t *hdr, tcp_opts_t *opts)
+{
+    uint8_t *p = (uint8_t *)(hdr + 1), *end = (uint8_t *)hdr + hdr->hdr_len * 4;
+    opts->mss = 0;
+    opts->wscale = -1;
+    opts->sack_ok = 0;
+    opts->sack_count = 0;
+    while (p < end && *p != 0)
+    {
+        if (*p == 1)
+        {
+            p++;
+            continue;
+        }
+        if (end - p < 2 || p[1] < 2 || p[1] > end - p)
+            break;
+        if (p[0] == 2 && p[1] == 4)
+            opts->mss = p[2] << 8 | p[3];
+        else if (p[0] == 3 && p[1] == 3)
+            opts->wscale = p[2] < 14 ? p[2] : 14;
+        else if (p[0] == 4 && p[1] == 2)
+            opts->sack_ok = 1;
+        else if (p[0] == 5)
+        {
+            for (int i = 0; i < (p[1] - 2) / 8 && i < 4; i++)
+            {
+                opts->sack[i].start = tcp_get32(p + 2 + 8 * i);
+                opts->sack[i].end = tcp_get32(p + 6 + 8 * i);
+                opts->sack_count = i + 1;
+            }
+        }
+        p += p[1];
+    }
+}
+
+/**
+ * @brief 构造选项：SYN中带MSS、窗口扩大与SACK允许，有乱序数据时确认中带SACK块
+ *
+ * @return int 选项长度，为4的倍数
+ */
+static int tcp_build_options(tcp_conn_t *conn, uint8_t flags, uint8_t *opt)
+{
+    int len = 0;
+    if (flags & TCP_SYN)
+    {
+        uint16_t mss = ip_get_pmtu(conn->remote_ip) - sizeof(ip_hdr_t) - sizeof(tcp_hdr_t);
+        opt[len++] = 2;
+        opt[len++] = 4;
+        opt[len++] = mss >> 8;
+        opt[len++] = mss & 0xff;
+        if (conn->state == TCP_SYN_SENT || conn->wscale_ok)
+        {
+            opt[len++] = 1;
+            opt[len++] = 3;
+            opt[len++] = 3;
+            opt[len++] = conn->rcv_wscale;
+        }
+        if (conn->state == TCP_SYN_SENT || conn->sack_ok)
+        {
+            opt[len++] = 1;
+            opt[len++] = 1;
+            opt[len++] = 4;
+            opt[len++] = 2;
+        }
+    }
+    else if (conn->sack_ok && conn->ooo_count > 0)
+    {
+        //最近收到的块排在最前（RFC 2018），其余按序号
+        int n = conn->ooo_count < 3 ? conn->ooo_count : 3;
+        opt[len++] = 1;
+        opt[len++] = 1;
+        opt[len++] = 5;
+        opt[len++] = 2 + 8 * n;
+        tcp_block_t *first = &conn->ooo[conn->ooo_last];
+        tcp_put32(opt + len, first->start);
+        tcp_put32(opt + len + 4, first->end);
+        len += 8;
+        for (int i = 0; i < conn->ooo_count && len < 4 + 8 * n; i++)
+        {
+            if (i == conn->ooo_last)
+                continue;
+            tcp_put32(opt + len, conn->ooo[i].start);
+            tcp_put32(opt + len + 4, conn->ooo[i].end);
+            len += 8;
+        }
+    }
+    return len;
+}
+
+/**
+ * @brief 一个报文段最多携带的数据，SACK选项占用的空间从MSS中扣除
+ *
+ */
+static uint32_t tcp_seg_size(tcp_conn_t *conn)
+{
+    if (conn->sack_ok && conn->ooo_count > 0)
+        return conn->mss - 4 - 8 * (conn->ooo_count < 3 ? conn->ooo_count : 3);
+    return conn->mss;
+}
+
+/**
+ * @brief 构造本次输出的以太网与ip头部模板，下一跳mac未知时为-1，由ip_out_from()发送并触发arp请求
+ *
+ */
+static int tcp_tmpl_build(tcp_conn_t *conn)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    buf_init(&ctx->txbuf, 0);
+    if (ip_build_template(&ctx->txbuf, conn->remote_ip, NET_PROTOCOL_TCP) != 0)
+        return -1;
+    memcpy(ctx->tmpl, ctx->txbuf.data, TCP_TMPL_LEN);
+    ip_hdr_t *ip = (ip_hdr_t *)(ctx->tmpl + sizeof(ether_hdr_t));
+    memcpy(ip->src_ip, conn->local_ip, NET_IP_LEN);
+    ip->total_len = 0;
+    ip->hdr_checksum = 0;
+    ctx->tmpl_sum = checksum_add(0, ip, sizeof(ip_hdr_t));
+    ctx->tmpl_ifindex = ctx->txbuf.ifindex;
+    ctx->tmpl_conn = conn;
+    return 0;
+}
+
+/**
+ * @brief 发送一个报文段，数据从发送缓冲区中序号seq处取len字节
+ *        有模板时直接在批量发送队列的数据帧中构造，否则在txbuf中构造后经ip层发送。
+ *        带ACK的报文段同时确认了所有已收到的数据，取消延迟确认
+ *
+ */
+static void tcp_xmit(tcp_conn_t *conn, uint32_t seq, uint8_t flags, uint32_t len)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    uint8_t opt[40];
+    int opt_len = tcp_build_options(conn, flags, opt);
+    int hdr_len = sizeof(tcp_hdr_t) + opt_len;
+    uint8_t *frame = NULL, *seg;
+    if (ctx->tmpl_conn == conn)
+    {
+        frame = ethernet_burst_reserve(ctx->tmpl_ifindex);
+        memcpy(frame, ctx->tmpl, TCP_TMPL_LEN);
+        ip_hdr_t *ip = (ip_hdr_t *)(frame + sizeof(ether_hdr_t));
+        ip->total_len = swap16(sizeof(ip_hdr_t) + hdr_len + len);
+        ip->hdr_checksum = checksum_fold(ctx->tmpl_sum + ip->total_len);
+        seg = (uint8_t *)(ip + 1);
+    }
+    else
+    {
+        buf_init(&ctx->txbuf, hdr_len + len);
+        seg = ctx->txbuf.data;
+    }
+
+    uint32_t wnd = conn->rcv.size - (conn->rcv.tail - conn->rcv.head);
+    uint32_t wnd_field = (flags & TCP_SYN) ? min_u32(wnd, 0xffff) : min_u32(wnd >> conn->rcv_wscale, 0xffff);
+    tcp_hdr_t *hdr = (tcp_hdr_t *)seg;
+    hdr->src_port = swap16(conn->local_port);
+    hdr->dest_port = swap16(conn->remote_port);
+    hdr->seq = swap32(seq);
+    hdr->ack = (flags & TCP_ACK) ? swap32(conn->rcv_nxt) : 0;
+    hdr->reserved = 0;
+    hdr->hdr_len = hdr_len / 4;
+    hdr->flags = flags;
+    hdr->window = swap16(wnd_field);
+    hdr->checksum = 0;
+    hdr->urgent = 0;
+    memcpy(hdr + 1, opt, opt_len);
+    if (len > 0)
+        tcp_ring_read(&conn->snd, seq - (conn->iss + 1), seg + hdr_len, len);
+    hdr->checksum = tcp_checksum(seg, hdr_len + len, conn->local_ip, conn->remote_ip);
+
+    if (frame != NULL)
+    {
+        ip_count_out(NET_PROTOCOL_TCP, sizeof(ip_hdr_t) + hdr_len + len);
+        ethernet_burst_commit(ctx->tmpl_ifindex, TCP_TMPL_LEN + hdr_len + len);
+    }
+    else
+        ip_out_from(&ctx->txbuf, conn->local_ip, conn->remote_ip, NET_PROTOCOL_TCP);
+    ctx->stats.segs_out++;
+    if (flags & TCP_ACK)
+    {
+        conn->unacked_segs = 0;
+        conn->ack_now = 0;
+        timer_del(&conn->delack_timer);
+        conn->rcv_adv = conn->rcv_nxt + (wnd_field << ((flags & TCP_SYN) ? 0 : conn->rcv_wscale));
+    }
+}
+
+/**
+ * @brief 回送复位，用于没有对应连接的报文段
+ *
+ */
+static void tcp_send_rst(uint8_t *src_ip, uint8_t *dest_ip, uint16_t src_port, uint16_t dest_port, uint32_t seq, uint32_t ack, uint8_t flags)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    buf_init(&ctx->txbuf, sizeof(tcp_hdr_t));
+    tcp_hdr_t *hdr = (tcp_hdr_t *)ctx->txbuf.data;
+    memset(hdr, 0, sizeof(tcp_hdr_t));
+    hdr->src_port = swap16(src_port);
+    hdr->dest_port = swap16(dest_port);
+    hdr->seq = swap32(seq);
+    hdr->ack = swap32(ack);
+    hdr->hdr_len = sizeof(tcp_hdr_t) / 4;
+    hdr->flags = flags;
+    hdr->checksum = tcp_checksum(ctx->txbuf.data, sizeof(tcp_hdr_t), src_ip, dest_ip);
+    ip_out_from(&ctx->txbuf, src_ip, dest_ip, NET_PROTOCOL_TCP);
+    ctx->stats.segs_out++;
+    ctx->stats.resets_out++;
+}
+
+/**
+ * @brief 加入一个序号区间，与重叠或相邻的块合并，保持按序号排列
+ *
+ * @return int 区间所在块的下标，块数已满且不能合并时为-1
+ */
+static int tcp_block_add(tcp_block_t *blocks, int *count, uint32_t start, uint32_t end)
+{
+    int i = 0;
+    while (i < *count && seq_lt(blocks[i].end, start))
+        i++;
+    int j = i;
+    while (j < *count && seq_leq(blocks[j].start, end))
+    {
+        start = seq_min(start, blocks[j].start);
+        end = seq_max(end, blocks[j].end);
+        j++;
+    }
+    if (i == j)
+    {
+        if (*count == TCP_SACK_MAX_BLOCKS)
+            return -1;
+        memmove(&blocks[i + 1], &blocks[i], (*count - i) * sizeof(tcp_block_t));
+        (*count)++;
+    }
+    else
+    {
+        memmove(&blocks[i + 1], &blocks[j], (*count - j) * sizeof(tcp_block_t));
+        *count -= j - i - 1;
+    }
+    blocks[i].start = start;
+    blocks[i].end = end;
+    return i;
+}
+
+/**
+ * @brief 区间[start, end)中被对端SACK确认的字节数
+ *
+ */
+static uint32_t tcp_sacked_in(tcp_conn_t *conn, uint32_t start, uint32_t end)
+{
+    uint32_t n = 0;
+    for (int i = 0; i < conn->sacked_count; i++)
+    {
+        uint32_t s = seq_max(conn->sacked[i].start, start), e = seq_min(conn->sacked[i].end, end);
+        if (seq_lt(s, e))
+            n += e - s;
+    }
+    return n;
+}
+
+/**
+ * @brief 估计在途的字节数（RFC 6675的pipe）：已发送未确认的减去被SACK的，
+ *        快速恢复中还要减去最高SACK块以下尚未重传的空洞，它们被认为已经丢失
+ *
+ */
+static uint32_t tcp_pipe(tcp_conn_t *conn)
+{
+    uint32_t pipe = conn->snd_nxt - conn->snd_una - tcp_sacked_in(conn, conn->snd_una, conn->snd_nxt);
+    if (conn->in_recovery && conn->sacked_count > 0)
+    {
+        uint32_t high = conn->sacked[conn->sacked_count - 1].end, from = seq_max(conn->rtx_next, conn->snd_una);
+        if (seq_lt(from, high))
+            pipe -= (high - from) - tcp_sacked_in(conn, from, high);
+    }
+    return pipe;
+}
+
+/**
+ * @brief 快速恢复中从rtx_next起找下一个空洞，只找最高SACK块以下的
+ *
+ * @return int 找到为1
+ */
+static int tcp_next_hole(tcp_conn_t *conn, uint32_t *start, uint32_t *len)
+{
+    uint32_t s = seq_max(conn->rtx_next, conn->snd_una);
+    for (int i = 0; i < conn->sacked_count; i++)
+    {
+        if (seq_leq(conn->sacked[i].end, s))
+            continue;
+        if (seq_lt(s, conn->sacked[i].start))
+        {
+            *start = s;
+            *len = conn->sacked[i].start - s;
+            return 1;
+        }
+        s = conn->sacked[i].end;
+    }
+    return 0;
+}
+
+static uint32_t tcp_data_end(tcp_conn_t *conn)
+{
+    return conn->iss + 1 + conn->snd.tail;
+}
+
+/**
+ * @brief 本端的FIN是否已在发送序列中
+ *
+ */
+static int tcp_fin_state(tcp_conn_t *conn)
+{
+    return conn->state == TCP_FIN_WAIT_1 || conn->state == TCP_CLOSING || conn->state == TCP_LAST_ACK;
+}
+
+static void tcp_rtx_arm(tcp_conn_t *conn)
+{
+    timer_add(&conn->rtx_timer, conn->rto, tcp_rtx_expire, conn);
+}
+
+/**
+ * @brief 输出一个连接：SYN，快速恢复中要重传的空洞，窗口允许的新数据与FIN，最后是需要的确认
+ *
+ */
+static void tcp_output(tcp_conn_t *conn)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    if (conn->state == TCP_SYN_SENT || conn->state == TCP_SYN_RCVD)
+    {
+        if (conn->snd_nxt == conn->iss)
+        {
+            if (conn->snd_max != conn->iss)
+                ctx->stats.retrans_segs++;
+            tcp_xmit(conn, conn->iss, conn->state == TCP_SYN_SENT ? TCP_SYN : TCP_SYN | TCP_ACK, 0);
+            conn->snd_nxt = conn->snd_max = conn->iss + 1;
+            tcp_rtx_arm(conn);
+        }
+        return;
+    }
+    if (conn->state == TCP_TIME_WAIT)
+    {
+        if (conn->ack_now)
+            tcp_xmit(conn, conn->snd_nxt, TCP_ACK, 0);
+        return;
+    }
+
+    //握手后路径MTU减小时按新值缩小报文段：报文段都带DF位，不缩小会一直重传到不了对端的报文段
+    int pmtu_mss = ip_get_pmtu(conn->remote_ip) - sizeof(ip_hdr_t) - sizeof(tcp_hdr_t);
+    if (pmtu_mss < conn->mss)
+        conn->mss = pmtu_mss;
+    if (tcp_tmpl_build(conn) != 0)
+        ctx->tmpl_conn = NULL;
+    int sent = 0, dupacks = conn->ack_now > 1 ? conn->ack_now : 0;
+    uint32_t data_end = tcp_data_end(conn);
+
+    //进入快速恢复或部分确认后重传snd_una处的报文段
+    if (conn->in_recovery && conn->rtx_next == conn->snd_una && seq_lt(conn->snd_una, conn->snd_max))
+    {
+        uint32_t n = seq_lt(conn->snd_una, data_end) ? min_u32(data_end - conn->snd_una, tcp_seg_size(conn)) : 0;
+        if (conn->sacked_count > 0 && seq_lt(conn->sacked[0].start, conn->snd_una + n))
+            n = conn->sacked[0].start - conn->snd_una;
+        int fin = tcp_fin_state(conn) && conn->snd_una + n == data_end && seq_lt(data_end, conn->snd_max);
+        tcp_xmit(conn, conn->snd_una, TCP_ACK | (fin ? TCP_FIN : 0), n);
+        conn->rtx_next = conn->snd_una + n + fin;
+        ctx->stats.retrans_segs++;
+        sent++;
+    }
+    //SACK：按pipe重传最高SACK块以下的其余空洞
+    while (conn->in_recovery && conn->sack_ok)
+    {
+        uint32_t start, len;
+        if (!tcp_next_hole(conn, &start, &len))
+            break;
+        len = min_u32(len, tcp_seg_size(conn));
+        if (tcp_pipe(conn) + len > conn->cwnd)
+            break;
+        tcp_xmit(conn, start, TCP_ACK, len);
+        conn->rtx_next = start + len;
+        ctx->stats.retrans_segs++;
+        sent++;
+    }
+
+    while (1)
+    {
+        uint32_t seg = tcp_seg_size(conn);
+        uint32_t avail = seq_lt(conn->snd_nxt, data_end) ? data_end - conn->snd_nxt : 0;
+        uint32_t wnd_end = conn->snd_una + conn->snd_wnd;
+        uint32_t room = seq_lt(conn->snd_nxt, wnd_end) ? wnd_end - conn->snd_nxt : 0;
+        uint32_t pipe = tcp_pipe(conn);
+        uint32_t n = min_u32(min_u32(avail, room), min_u32(seg, pipe < conn->cwnd ? conn->cwnd - pipe : 0));
+        if (conn->probe && avail > 0 && room == 0 && conn->snd_nxt == conn->snd_una)
+            n = 1; //零窗口探测
+        conn->probe = 0;
+        int fin = tcp_fin_state(conn) && conn->snd_nxt + n == data_end;
+        if (n == 0 && !fin)
+            break;
+        //避免糊涂窗口：窗口不足一个报文段且不到对端窗口的一半时等待；Nagle：有未确认数据时不发送新的小报文段
+        if (n < seg && n < avail && n < conn->snd_wnd / 2 && n > 1)
+            break;
+        if (n < seg && n == avail && !fin && !conn->nodelay && conn->snd_una != conn->snd_nxt && !seq_lt(conn->snd_nxt, conn->snd_max))
+            break;
+        if (seq_lt(conn->snd_nxt, conn->snd_max))
+            ctx->stats.retrans_segs++;
+        else if (conn->rtt_start == 0 && n > 0)
+        {
+            conn->rtt_seq = conn->snd_nxt + n;
+            conn->rtt_start = timer_now_ms();
+        }
+        tcp_xmit(conn, conn->snd_nxt, TCP_ACK | (n == avail && n > 0 ? TCP_PSH : 0) | (fin ? TCP_FIN : 0), n);
+        conn->snd_nxt += n + fin;
+        if (seq_lt(conn->snd_max, conn->snd_nxt))
+            conn->snd_max = conn->snd_nxt;
+        sent++;
+        if (fin)
+            break;
+    }
+    ctx->tmpl_conn = NULL;
+
+    //收到多个乱序报文段时逐个回送重复确认，否则一个确认累计确认所有收到的数据
+    if (dupacks > 0 || (!sent && (conn->ack_now || conn->unacked_segs >= TCP_DELACK_SEGS)))
+    {
+        for (int i = 0; i < (dupacks > 0 ? dupacks : 1); i++)
+            tcp_xmit(conn, conn->snd_nxt, TCP_ACK, 0);
+        ctx->stats.acks_out += dupacks > 0 ? dupacks : 1;
+    }
+    else if (conn->unacked_segs > 0 && !conn->delack_timer.pending)
+        timer_add(&conn->delack_timer, TCP_DELACK_MS, tcp_delack_expire, conn);
+
+    //有数据在途时保证重传定时器在运行；对端窗口为0时由它进行零窗口探测
+    if (!conn->rtx_timer.pending && (conn->snd_max != conn->snd_una || (conn->snd_wnd == 0 && seq_lt(conn->snd_nxt, data_end))))
+        tcp_rtx_arm(conn);
+}
+
+/**
+ * @brief 重传定时器到期：SYN与数据按go-back-N重传，拥塞窗口降为一个报文段；
+ *        没有在途数据时是零窗口探测；TIME_WAIT到期时释放连接
+ *
+ */
+static void tcp_rtx_expire(net_timer_t *timer, void *arg)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    tcp_conn_t *conn = arg;
+    if (conn->state == TCP_TIME_WAIT)
+    {
+        tcp_destroy(conn, 1);
+        return;
+    }
+    conn->rto = conn->rto * 2 < TCP_RTO_MAX_MS ? conn->rto * 2 : TCP_RTO_MAX_MS;
+    if (conn->snd_max == conn->snd_una)
+    {
+        conn->probe = 1;
+        tcp_dirty(conn);
+        return;
+    }
+    if (++conn->retries > TCP_MAX_RETRIES)
+    {
+        tcp_destroy(conn, 1);
+        return;
+    }
+    ctx->stats.timeouts++;
+    if (conn->state >= TCP_ESTABLISHED)
+    {
+        uint32_t flight = conn->snd_max - conn->snd_una;
+        conn->ssthresh = flight / 2 > 2u * conn->mss ? flight / 2 : 2u * conn->mss;
+        conn->cwnd = conn->mss;
+        conn->cwnd_acked = 0;
+    }
+    conn->in_recovery = 0;
+    conn->dupacks = 0;
+    conn->recover = conn->snd_max;
+    conn->sacked_count = 0;
+    conn->snd_nxt = conn->snd_una;
+    conn->rtt_start = 0;
+    tcp_dirty(conn);
+}
+
+static void tcp_delack_expire(net_timer_t *timer, void *arg)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    tcp_conn_t *conn = arg;
+    conn->ack_now = 1;
+    ctx->stats.delayed_acks++;
+    tcp_dirty(conn);
+}
+
+/**
+ * @brief 用一个往返时间样本更新重传超时（RFC 6298）
+ *
+ */
+static void tcp_rtt_sample(tcp_conn_t *conn, uint32_t rtt)
+{
+    if (conn->srtt == 0)
+    {
+        conn->srtt = rtt << 3;
+        conn->rttvar = rtt << 1;
+    }
+    else
+    {
+        int32_t delta = (int32_t)rtt - (int32_t)(conn->srtt >> 3);
+        conn->srtt += delta;
+        if (delta < 0)
+            delta = -delta;
+        conn->rttvar += delta - (conn->rttvar >> 2);
+    }
+    uint32_t rto = (conn->srtt >> 3) + (conn->rttvar > TIMER_TICK_MS ? conn->rttvar : TIMER_TICK_MS);
+    conn->rto = rto < TCP_RTO_MIN_MS ? TCP_RTO_MIN_MS : rto > TCP_RTO_MAX_MS ? TCP_RTO_MAX_MS : rto;
+}
+
+/**
+ * @brief 处理确认了新数据的确认号：释放发送缓冲区、取样往返时间、增大拥塞窗口、重设重传定时器
+ *
+ */
+static void tcp_acked(tcp_conn_t *conn, uint32_t ack)
+{
+    uint32_t acked = ack - conn->snd_una;
+    if (conn->rtt_start != 0 && seq_leq(conn->rtt_seq, ack))
+    {
+        tcp_rtt_sample(conn, timer_now_ms() - conn->rtt_start);
+        conn->rtt_start = 0;
+    }
+    conn->retries = 0;
+    uint32_t data_start = seq_max(conn->snd_una, conn->iss + 1), data_ack = seq_min(ack, tcp_data_end(conn));
+    uint32_t freed = seq_lt(data_start, data_ack) ? data_ack - data_start : 0;
+    conn->snd.head += freed;
+    conn->snd_una = ack;
+    if (seq_lt(conn->snd_nxt, ack))
+        conn->snd_nxt = ack;
+
+    //丢弃已被累计确认的SACK块
+    int k = 0;
+    for (int i = 0; i < conn->sacked_count; i++)
+    {
+        if (seq_leq(conn->sacked[i].end, ack))
+            continue;
+        conn->sacked[k] = conn->sacked[i];
+        if (seq_lt(conn->sacked[k].start, ack))
+            conn->sacked[k].start = ack;
+        k++;
+    }
+    conn->sacked_count = k;
+
+    if (conn->in_recovery)
+    {
+        if (seq_leq(conn->recover, ack))
+        {
+            conn->in_recovery = 0;
+            conn->cwnd = conn->ssthresh;
+        }
+        else if (!conn->sack_ok)
+        {
+            //NewReno部分确认：重传下一个报文段，窗口收缩已确认的数据量
+            conn->cwnd = conn->cwnd > acked ? conn->cwnd - acked + conn->mss : conn->mss;
+            conn->rtx_next = conn->snd_una;
+        }
+        else if (seq_lt(conn->rtx_next, ack))
+            conn->rtx_next = ack;
+    }
+    else if (conn->cwnd < conn->ssthresh)
+        conn->cwnd += acked; //慢启动按确认的字节数增长，不限于每个确认两个报文段：本协议栈的确认按批合并
+    else
+    {
+        conn->cwnd_acked += acked;
+        if (conn->cwnd_acked >= conn->cwnd)
+        {
+            conn->cwnd_acked -= conn->cwnd;
+            conn->cwnd += conn->mss;
+        }
+    }
+    if (conn->cwnd > (1u << 30))
+        conn->cwnd = 1u << 30;
+    conn->dupacks = 0;
+
+    if (conn->snd_una == conn->snd_max)
+        timer_del(&conn->rtx_timer);
+    else
+        tcp_rtx_arm(conn);
+    tcp_dirty(conn);
+    if (freed > 0)
+        tcp_event(conn, TCP_EVENT_SENT);
+}
+
+/**
+ * @brief 对端的SACK块加入记分板，只接受[snd_una, snd_max)内的部分
+ *
+ * @return int 是否有新被SACK的数据
+ */
+static int tcp_sack_update(tcp_conn_t *conn, tcp_opts_t *opts)
+{
+    uint32_t before = tcp_sacked_in(conn, conn->snd_una, conn->snd_max);
+    for (int i = 0; i < opts->sack_count; i++)
+    {
+        uint32_t start = seq_max(opts->sack[i].start, conn->snd_una), end = seq_min(opts->sack[i].end, conn->snd_max);
+        if (seq_lt(start, end))
+            tcp_block_add(conn->sacked, &conn->sacked_count, start, end);
+    }
+    return tcp_sacked_in(conn, conn->snd_una, conn->snd_max) != before;
+}
+
+static void tcp_enter_time_wait(tcp_conn_t *conn)
+{
+    conn->state = TCP_TIME_WAIT;
+    timer_add(&conn->rtx_timer, TCP_TIME_WAIT_MS, tcp_rtx_expire, conn);
+}
+
+/**
+ * @brief 处理确认号与窗口，本端的FIN被确认时推进关闭状态
+ *
+ */
+static void tcp_ack(tcp_conn_t *conn, uint32_t seq, uint32_t ack, uint32_t wnd, tcp_opts_t *opts, uint32_t len)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    if (seq_lt(conn->snd_max, ack))
+    {
+        conn->ack_now = 1; //确认了还没发送的数据
+        tcp_dirty(conn);
+        return;
+    }
+    int new_sack = conn->sack_ok && opts->sack_count > 0 && tcp_sack_update(conn, opts);
+    uint32_t old_wnd = conn->snd_wnd;
+    if (seq_lt(conn->snd_wl1, seq) || (conn->snd_wl1 == seq && seq_leq(conn->snd_wl2, ack)))
+    {
+        if (wnd > conn->snd_wnd)
+            tcp_dirty(conn);
+        conn->snd_wnd = wnd;
+        conn->snd_wl1 = seq;
+        conn->snd_wl2 = ack;
+    }
+
+    if (seq_lt(conn->snd_una, ack))
+        tcp_acked(conn, ack);
+    else if (ack == conn->snd_una && len == 0 && conn->snd_max != conn->snd_una && (new_sack || wnd == old_wnd))
+    {
+        //重复确认
+        conn->dupacks++;
+        if (conn->in_recovery && !conn->sack_ok)
+            conn->cwnd += conn->mss;
+        tcp_dirty(conn);
+    }
+
+    //丢包判定：三个重复确认，或snd_una之后被SACK的数据达到三个报文段（RFC 6675），
+    //后者覆盖了上一次恢复结束时之后的数据已全部被SACK、不会再有重复确认的情况
+    if (!conn->in_recovery && conn->state >= TCP_ESTABLISHED && conn->snd_max != conn->snd_una &&
+        seq_leq(conn->recover, conn->snd_una) &&
+        (conn->dupacks >= TCP_DUPACK_THRESH ||
+         (conn->sack_ok && tcp_sacked_in(conn, conn->snd_una, conn->snd_max) >= TCP_DUPACK_THRESH * conn->mss)))
+    {
+        uint32_t flight = conn->snd_max - conn->snd_una;
+        conn->ssthresh = flight / 2 > 2u * conn->mss ? flight / 2 : 2u * conn->mss;
+        conn->cwnd = conn->ssthresh + (conn->sack_ok ? 0 : TCP_DUPACK_THRESH * conn->mss);
+        conn->in_recovery = 1;
+        conn->recover = conn->snd_max;
+        conn->rtx_next = conn->snd_una;
+        conn->rtt_start = 0;
+        ctx->stats.fast_retrans++;
+        tcp_dirty(conn);
+    }
+    if (conn->state == TCP_CLOSED)
+        return;
+
+    if (tcp_fin_state(conn) && conn->snd_una == tcp_data_end(conn) + 1)
+    {
+        if (conn->state == TCP_FIN_WAIT_1)
+            conn->state = TCP_FIN_WAIT_2;
+        else if (conn->state == TCP_CLOSING)
+            tcp_enter_time_wait(conn);
+        else
+            tcp_destroy(conn, 1);
+    }
+}
+
+/**
+ * @brief 按序的FIN：推进关闭状态并通知应用
+ *
+ */
+static void tcp_fin(tcp_conn_t *conn)
+{
+    conn->fin_received = 1;
+    conn->fin_pending = 0;
+    conn->rcv_nxt++;
+    conn->ack_now = 1;
+    if (conn->state == TCP_ESTABLISHED)
+        conn->state = TCP_CLOSE_WAIT;
+    else if (conn->state == TCP_FIN_WAIT_1)
+        conn->state = TCP_CLOSING;
+    else if (conn->state == TCP_FIN_WAIT_2)
+        tcp_enter_time_wait(conn);
+    tcp_event(conn, TCP_EVENT_FIN);
+}
+
+/**
+ * @brief 处理报文段中的数据与FIN：截去窗口外的部分后写入接收缓冲区，
+ *        按序的数据推进rcv_nxt并合并已到的乱序块，乱序的数据记为块并立即回送带SACK的确认
+ *
+ */
+static void tcp_data(tcp_conn_t *conn, uint32_t seq, uint8_t *data, uint32_t len, int fin)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    uint32_t tail = conn->rcv.tail;
+    uint32_t right = conn->irs + 1 + conn->rcv.head + conn->rcv.size;
+    if (seq_lt(seq, conn->rcv_nxt))
+    {
+        uint32_t skip = conn->rcv_nxt - seq;
+        if (skip > len)
+            skip = len;
+        data += skip;
+        len -= skip;
+        seq += skip;
+    }
+    if (seq_lt(right, seq + len))
+    {
+        len = seq_lt(seq, right) ? right - seq : 0;
+        fin = 0;
+    }
+    if (fin && !conn->fin_received)
+    {
+        conn->fin_pending = 1;
+        conn->fin_seq = seq + len;
+    }
+
+    if (len > 0)
+    {
+        tcp_ring_write(&conn->rcv, seq - (conn->irs + 1), data, len);
+        if (seq == conn->rcv_nxt)
+        {
+            uint32_t end = seq + len;
+            while (conn->ooo_count > 0 && seq_leq(conn->ooo[0].start, end))
+            {
+                end = seq_max(end, conn->ooo[0].end);
+                memmove(&conn->ooo[0], &conn->ooo[1], (conn->ooo_count - 1) * sizeof(tcp_block_t));
+                conn->ooo_count--;
+                conn->ack_now = 1; //填补了空洞
+            }
+            conn->ooo_last = 0;
+            conn->rcv.tail += end - conn->rcv_nxt;
+            conn->rcv_nxt = end;
+            conn->unacked_segs++;
+        }
+        else
+        {
+            int i = tcp_block_add(conn->ooo, &conn->ooo_count, seq, seq + len);
+            if (i >= 0)
+                conn->ooo_last = i;
+            conn->ack_now++; //每个乱序报文段一个重复确认，供对端快速重传
+            ctx->stats.ooo_segs++;
+        }
+    }
+    else if (!fin)
+        conn->ack_now = 1; //完全重复的数据
+    tcp_dirty(conn);
+    if (conn->rcv.tail != tail)
+        tcp_event(conn, TCP_EVENT_RECV);
+    if (conn->state != TCP_CLOSED && conn->fin_pending && conn->fin_seq == conn->rcv_nxt)
+        tcp_fin(conn);
+}
+
+/**
+ * @brief 连接建立：初始化拥塞窗口并通知应用
+ *
+ */
+static void tcp_established(tcp_conn_t *conn)
+{
+    conn->state = conn->fin_queued ? TCP_FIN_WAIT_1 : TCP_ESTABLISHED;
+    conn->cwnd = TCP_INIT_CWND * conn->mss;
+    conn->retries = 0;
+    conn->rcv_adv = conn->rcv_nxt;
+    if (conn->snd_una == conn->snd_max)
+        timer_del(&conn->rtx_timer);
+    tcp_dirty(conn);
+    tcp_event(conn, TCP_EVENT_CONNECTED);
+}
+
+/**
+ * @brief 从SYN中取得对端的初始序号与选项
+ *
+ */
+static void tcp_syn_options(tcp_conn_t *conn, uint32_t seq, tcp_opts_t *opts)
+{
+    conn->irs = seq;
+    conn->rcv_nxt = seq + 1;
+    uint16_t peer_mss = opts->mss ? opts->mss : 536;
+    if (peer_mss < conn->mss)
+        conn->mss = peer_mss;
+    conn->wscale_ok = opts->wscale >= 0;
+    conn->snd_wscale = conn->wscale_ok ? opts->wscale : 0;
+    if (!conn->wscale_ok)
+        conn->rcv_wscale = 0;
+    conn->sack_ok = opts->sack_ok;
+}
+
+/**
+ * @brief SYN_SENT状态收到报文段
+ *
+ */
+static void tcp_syn_sent(tcp_conn_t *conn, tcp_hdr_t *hdr, uint32_t seq, uint32_t ack, uint8_t flags)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    int ack_ok = seq_lt(conn->iss, ack) && seq_leq(ack, conn->snd_max);
+    if ((flags & TCP_ACK) && !ack_ok)
+    {
+        if (!(flags & TCP_RST))
+            tcp_send_rst(conn->local_ip, conn->remote_ip, conn->local_port, conn->remote_port, ack, 0, TCP_RST);
+        return;
+    }
+    if (flags & TCP_RST)
+    {
+        if (flags & TCP_ACK)
+        {
+            ctx->stats.resets_in++;
+            tcp_destroy(conn, 1); //连接被拒绝
+        }
+        return;
+    }
+    if (!(flags & TCP_SYN))
+        return;
+    tcp_opts_t opts;
+    tcp_parse_options(hdr, &opts);
+    tcp_syn_options(conn, seq, &opts);
+    conn->snd_wnd = swap16(hdr->window);
+    conn->snd_wl1 = seq;
+    conn->snd_wl2 = ack;
+    conn->ack_now = 1;
+    if (flags & TCP_ACK)
+    {
+        conn->snd_una = ack;
+        tcp_established(conn);
+    }
+    else
+    {
+        //同时打开：重发SYN并带上确认
+        conn->state = TCP_SYN_RCVD;
+        conn->snd_nxt = conn->iss;
+        tcp_dirty(conn);
+    }
+}
+
+/**
+ * @brief 没有对应连接的报文段：监听端口上的SYN建立新连接，其余的回送复位
+ *
+ */
+static void tcp_no_conn(tcp_hdr_t *hdr, uint8_t *src_ip, uint8_t *dest_ip, uint32_t seq, uint32_t ack, uint32_t len)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    uint8_t flags = hdr->flags;
+    uint16_t src_port = swap16(hdr->src_port), dest_port = swap16(hdr->dest_port);
+    if ((flags & TCP_RST) || netif_lookup(dest_ip) == -1)
+        return;
+    tcp_listener_t *listener = tcp_listener_find(dest_port);
+    if ((flags & (TCP_SYN | TCP_ACK | TCP_FIN)) == TCP_SYN && listener != NULL)
+    {
+        tcp_conn_t *conn = tcp_conn_new(dest_ip, dest_port, src_ip, src_port, listener->handler, listener->arg);
+        if (conn == NULL)
+            return;
+        tcp_opts_t opts;
+        tcp_parse_options(hdr, &opts);
+        tcp_syn_options(conn, seq, &opts);
+        conn->state = TCP_SYN_RCVD;
+        conn->snd_wnd = swap16(hdr->window);
+        conn->snd_wl1 = seq;
+        ctx->stats.passive_opens++;
+        tcp_dirty(conn);
+        return;
+    }
+    if (flags & TCP_ACK)
+        tcp_send_rst(dest_ip, src_ip, dest_port, src_port, ack, 0, TCP_RST);
+    else
+        tcp_send_rst(dest_ip, src_ip, dest_port, src_port, 0, seq + len + !!(flags & TCP_SYN) + !!(flags & TCP_FIN), TCP_RST | TCP_ACK);
+}
+
+/**
+ * @brief 处理一个收到的tcp报文段
+ *        已建立连接上的首部预测：没有选项、只有ACK标志（可带PSH）、序号正是rcv_nxt、
+ *        窗口没有变化且不在重传或快速恢复中时，纯确认只需释放发送缓冲区、增大拥塞窗口，
+ *        纯数据只需拷入接收缓冲区；其余的报文段走完整的处理。
+ *
+ * @param buf 要处理的包，data指向tcp头部
+ * @param src_ip 源ip地址
+ * @param dest_ip 目的ip地址
+ */
+void tcp_in(buf_t *buf, uint8_t *src_ip, uint8_t *dest_ip)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    tcp_hdr_t *hdr = tcp_hdr_of(buf);
+    if (hdr == NULL || tcp_checksum(buf->data, buf->len, src_ip, dest_ip) != 0)
+    {
+        ctx->stats.bad_segs++;
+        return;
+    }
+    ctx->stats.segs_in++;
+    uint32_t seq = swap32(hdr->seq), ack = swap32(hdr->ack);
+    uint8_t flags = hdr->flags;
+    int hdr_len = hdr->hdr_len * 4;
+    uint8_t *data = buf->data + hdr_len;
+    uint32_t len = buf->len - hdr_len;
+    tcp_conn_t *conn = tcp_lookup(dest_ip, swap16(hdr->dest_port), src_ip, swap16(hdr->src_port));
+    if (conn == NULL)
+    {
+        tcp_no_conn(hdr, src_ip, dest_ip, seq, ack, len);
+        return;
+    }
+
+    //首部预测
+    uint32_t wnd = (uint32_t)swap16(hdr->window) << conn->snd_wscale;
+    if (conn->state == TCP_ESTABLISHED && hdr_len == sizeof(tcp_hdr_t) &&
+        (flags & (TCP_SYN | TCP_FIN | TCP_RST | TCP_URG | TCP_ACK)) == TCP_ACK && seq == conn->rcv_nxt &&
+        wnd == conn->snd_wnd && conn->snd_nxt == conn->snd_max && !conn->in_recovery)
+    {
+        if (len == 0 && seq_lt(conn->snd_una, ack) && seq_leq(ack, conn->snd_max))
+        {
+            ctx->stats.predicted_acks++;
+            conn->snd_wl1 = seq;
+            conn->snd_wl2 = ack;
+            tcp_acked(conn, ack);
+            return;
+        }
+        if (len > 0 && ack == conn->snd_una && conn->ooo_count == 0 && !conn->fin_pending &&
+            len <= conn->rcv.size - (conn->rcv.tail - conn->rcv.head))
+        {
+            ctx->stats.predicted_data++;
+            conn->snd_wl1 = seq;
+            conn->snd_wl2 = ack;
+            tcp_ring_write(&conn->rcv, conn->rcv.tail, data, len);
+            conn->rcv.tail += len;
+            conn->rcv_nxt += len;
+            conn->unacked_segs++;
+            tcp_dirty(conn);
+            tcp_event(conn, TCP_EVENT_RECV);
+            return;
+        }
+    }
+
+    if (conn->state == TCP_SYN_SENT)
+    {
+        tcp_syn_sent(conn, hdr, seq, ack, flags);
+        return;
+    }
+
+    //可接受性检查（RFC 793），SYN与FIN各占一个序号
+    uint32_t seg_len = len + !!(flags & TCP_SYN) + !!(flags & TCP_FIN);
+    uint32_t rwnd = conn->irs + 1 + conn->rcv.head + conn->rcv.size + conn->fin_received - conn->rcv_nxt;
+    int ok;
+    if (seg_len == 0)
+        ok = rwnd == 0 ? seq == conn->rcv_nxt : seq_leq(conn->rcv_nxt, seq) && seq_lt(seq, conn->rcv_nxt + rwnd);
+    else
+        ok = rwnd > 0 && ((seq_leq(conn->rcv_nxt, seq) && seq_lt(seq, conn->rcv_nxt + rwnd)) ||
+                          (seq_lt(conn->rcv_nxt, seq + seg_len) && seq_leq(seq + seg_len, conn->rcv_nxt + rwnd)));
+    if (!ok && seg_len > 0 && seq_lt(seq, conn->rcv_nxt) && seq_leq(conn->rcv_nxt, seq + seg_len))
+        ok = 1; //与已收到的数据重叠，其中可能有新的部分
+    if (!ok)
+    {
+        if (!(flags & TCP_RST))
+        {
+            conn->ack_now = 1;
+            tcp_dirty(conn);
+        }
+        return;
+    }
+    if (flags & TCP_RST)
+    {
+        ctx->stats.resets_in++;
+        tcp_destroy(conn, 1);
+        return;
+    }
+    if (flags & TCP_SYN)
+    {
+        //SYN_RCVD中对端重传的SYN：重发SYN-ACK；其余回送确认（RFC 5961）
+        if (conn->state == TCP_SYN_RCVD && seq == conn->irs)
+            conn->snd_nxt = conn->iss;
+        else
+            conn->ack_now = 1;
+        tcp_dirty(conn);
+        return;
+    }
+    if (!(flags & TCP_ACK))
+        return;
+
+    tcp_opts_t opts;
+    tcp_parse_options(hdr, &opts);
+    if (conn->state == TCP_SYN_RCVD)
+    {
+        if (!(seq_lt(conn->snd_una, ack) && seq_leq(ack, conn->snd_max)))
+        {
+            tcp_send_rst(conn->local_ip, conn->remote_ip, conn->local_port, conn->remote_port, ack, 0, TCP_RST);
+            return;
+        }
+        conn->snd_una = ack;
+        conn->snd_wnd = wnd;
+        conn->snd_wl1 = seq;
+        conn->snd_wl2 = ack;
+        tcp_established(conn);
+        if (conn->state == TCP_CLOSED)
+            return;
+    }
+    tcp_ack(conn, seq, ack, wnd, &opts, len);
+    if (conn->state == TCP_CLOSED)
+        return;
+
+    if (conn->state == TCP_ESTABLISHED || conn->state == TCP_FIN_WAIT_1 || conn->state == TCP_FIN_WAIT_2)
+    {
+        if (len > 0 || (flags & TCP_FIN))
+            tcp_data(conn, seq, data, len, flags & TCP_FIN);
+    }
+    else if ((flags & TCP_FIN) || len > 0)
+    {
+        //对端重传的FIN或关闭后的数据：回送确认，TIME_WAIT重新计时
+        conn->ack_now = 1;
+        if (conn->state == TCP_TIME_WAIT)
+            tcp_enter_time_wait(conn);
+        tcp_dirty(conn);
+    }
+}
+
+/**
+ * @brief 输出指定协议栈实例所有有待发送数据或确认的连接，并释放已结束的连接
+ *        由net_stack_poll()在每次轮询末尾调用，之后发送批量发送队列；期间实例绑定到本线程
+ *
+ * @param stack 实例
+ */
+void tcp_flush_stack(net_stack_t *stack)
+{
+    tcp_ctx_t *ctx = &stack->tcp;
+    if (ctx->dirty_head == NULL)
+        return;
+    net_stack_t *prev = net_stack_bind(stack);
+    while (ctx->dirty_head != NULL)
+    {
+        tcp_conn_t *conn = ctx->dirty_head;
+        ctx->dirty_head = conn->dirty_next;
+        if (ctx->dirty_head == NULL)
+            ctx->dirty_tail = NULL;
+        conn->dirty = 0;
+        if (conn->state == TCP_CLOSED)
+            tcp_conn_free(conn);
+        else
+            tcp_output(conn);
+    }
+    ethernet_flush_stack(stack);
+    net_stack_bind(prev);
+}
+
+/**
+ * @brief 输出当前协议栈实例所有有待发送数据或确认的连接
+ *
+ */
+void tcp_flush()
+{
+    tcp_flush_stack(net_stack_current());
+}
+
+/**
+ * @brief 初始化当前协议栈实例的tcp协议，释放它的所有连接，并向ip层注册
+ *        定时器已由timer_init()重置，这里不再逐个停止
+ *
+ */
+void tcp_init()
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    for (tcp_conn_t *conn = ctx->dirty_head, *next; conn != NULL; conn = next)
+    {
+        next = conn->dirty_next;
+        if (conn->state == TCP_CLOSED)
+            tcp_conn_free(conn);
+    }
+    for (int i = 0; i < TCP_CONN_HASH_SIZE; i++)
+    {
+        for (tcp_conn_t *conn = ctx->conn_hash[i], *next; conn != NULL; conn = next)
+        {
+            next = conn->hash_next;
+            tcp_conn_free(conn);
+        }
+        ctx->conn_hash[i] = NULL;
+    }
+    ctx->dirty_head = ctx->dirty_tail = NULL;
+    ctx->conns = 0;
+    memset(ctx->listeners, 0, sizeof(ctx->listeners));
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    ctx->iss_seed = ((uint32_t)timer_now_ms() ^ (uint32_t)(uintptr_t)ctx) * 2654435761u; //同时初始化的实例也选择不同的序号与端口
+    ctx->next_port = ctx->iss_seed >> 16;
+    ip_register(NET_PROTOCOL_TCP, tcp_in);
+}
+
+/**
+ * @brief 监听一个端口，新连接的事件交给handler
+ *
+ * @param port 端口号
+ * @param handler 处理程序
+ * @param arg 处理程序参数
+ * @return int 成功为0，已监听或监听数已达TCP_MAX_LISTEN为-1
+ */
+int tcp_listen(uint16_t port, tcp_handler_t handler, void *arg)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    if (tcp_listener_find(port) != NULL)
+        return -1;
+    for (int i = 0; i < TCP_MAX_LISTEN; i++)
+    {
+        tcp_listener_t *l = &ctx->listeners[i];
+        if (l->valid)
+            continue;
+        l->port = port;
+        l->handler = handler;
+        l->arg = arg;
+        l->valid = 1;
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * @brief 停止监听一个端口，已建立的连接不受影响
+ *
+ * @param port 端口号
+ */
+void tcp_unlisten(uint16_t port)
+{
+    tcp_listener_t *l = tcp_listener_find(port);
+    if (l != NULL)
+        l->valid = 0;
+}
+
+/**
+ * @brief 主动打开一个连接，SYN在下一次tcp_flush()时发出
+ *
+ * @param dest_ip 目的ip地址
+ * @param dest_port 目的端口号
+ * @param src_port 源端口号，0表示自动选择
+ * @param handler 处理程序
+ * @param arg 处理程序参数
+ * @return tcp_conn_t* 连接，没有可用的源地址、端口或连接数已达TCP_MAX_CONN时为NULL
+ */
+tcp_conn_t *tcp_connect(uint8_t *dest_ip, uint16_t dest_port, uint16_t src_port, tcp_handler_t handler, void *arg)
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    uint8_t *src_ip = ip_select_src(dest_ip);
+    if (src_ip == NULL)
+        return NULL;
+    const uint32_t range = 65536 - TCP_EPHEMERAL_MIN;
+    for (uint32_t i = 0; src_port == 0 && i < range; i++)
+    {
+        uint16_t port = TCP_EPHEMERAL_MIN + ctx->next_port++ % range;
+        if (tcp_listener_find(port) == NULL && tcp_lookup(src_ip, port, dest_ip, dest_port) == NULL)
+            src_port = port;
+    }
+    if (src_port == 0 || tcp_lookup(src_ip, src_port, dest_ip, dest_port) != NULL)
+        return NULL;
+    tcp_conn_t *conn = tcp_conn_new(src_ip, src_port, dest_ip, dest_port, handler, arg);
+    if (conn == NULL)
+        return NULL;
+    conn->state = TCP_SYN_SENT;
+    ctx->stats.active_opens++;
+    tcp_dirty(conn);
+    return conn;
+}
+
+static int tcp_can_send(tcp_conn_t *conn)
+{
+    return !conn->fin_queued && (conn->state == TCP_SYN_SENT || conn->state == TCP_SYN_RCVD ||
+                                 conn->state == TCP_ESTABLISHED || conn->state == TCP_CLOSE_WAIT);
+}
+
+/**
+ * @brief 获取发送缓冲区中可直接写入的连续空间，写入后调用tcp_send_commit()
+ *
+ * @param conn 连接
+ * @param len 可写入的字节数
+ * @return uint8_t* 可写入的位置
+ */
+uint8_t *tcp_send_buf(tcp_conn_t *conn, int *len)
+{
+    uint32_t idx = conn->snd.tail & (conn->snd.size - 1);
+    uint32_t room = conn->snd.size - (conn->snd.tail - conn->snd.head);
+    *len = tcp_can_send(conn) ? min_u32(room, conn->snd.size - idx) : 0;
+    return conn->snd.data + idx;
+}
+
+/**
+ * @brief 提交tcp_send_buf()中写入的数据，在下一次tcp_flush()时发送
+ *
+ * @param conn 连接
+ * @param len 写入的字节数
+ */
+void tcp_send_commit(tcp_conn_t *conn, int len)
+{
+    if (len <= 0 || !tcp_can_send(conn))
+        return;
+    conn->snd.tail += min_u32(len, conn->snd.size - (conn->snd.tail - conn->snd.head));
+    tcp_dirty(conn);
+}
+
+/**
+ * @brief 把数据拷贝进发送缓冲区
+ *
+ * @param conn 连接
+ * @param data 数据
+ * @param len 数据长度
+ * @return int 放入的字节数，缓冲区满时可能少于len；连接不能再发送时为-1
+ */
+int tcp_send(tcp_conn_t *conn, const void *data, int len)
+{
+    if (!tcp_can_send(conn))
+        return -1;
+    int n = min_u32(len, conn->snd.size - (conn->snd.tail - conn->snd.head));
+    tcp_ring_write(&conn->snd, conn->snd.tail, data, n);
+    tcp_send_commit(conn, n);
+    return n;
+}
+
+/**
+ * @brief 获取接收缓冲区中可直接读取的连续数据，读完后调用tcp_recv_consume()
+ *
+ * @param conn 连接
+ * @param len 可读取的字节数
+ * @return uint8_t* 数据
+ */
+uint8_t *tcp_recv_buf(tcp_conn_t *conn, int *len)
+{
+    uint32_t idx = conn->rcv.head & (conn->rcv.size - 1);
+    *len = min_u32(conn->rcv.tail - conn->rcv.head, conn->rcv.size - idx);
+    return conn->rcv.data + idx;
+}
+
+/**
+ * @brief 释放接收缓冲区中已读取的数据，窗口增大到两个报文段或缓冲区的一半以上时通告对端
+ *
+ * @param conn 连接
+ * @param len 读取的字节数
+ */
+void tcp_recv_consume(tcp_conn_t *conn, int len)
+{
+    if (len <= 0)
+        return;
+    conn->rcv.head += min_u32(len, conn->rcv.tail - conn->rcv.head);
+    if (conn->state == TCP_CLOSED || conn->fin_received)
+        return;
+    uint32_t right = conn->irs + 1 + conn->rcv.head + conn->rcv.size;
+    if (seq_leq(conn->rcv_adv + min_u32(2u * conn->mss, conn->rcv.size / 2), right))
+    {
+        conn->ack_now = 1;
+        tcp_dirty(conn);
+    }
+}
+
+/**
+ * @brief 从接收缓冲区拷贝出数据
+ *
+ * @param conn 连接
+ * @param data 存放数据的位置
+ * @param len 最多读取的字节数
+ * @return int 读取的字节数
+ */
+int tcp_recv(tcp_conn_t *conn, void *data, int len)
+{
+    int n = min_u32(len, conn->rcv.tail - conn->rcv.head);
+    tcp_ring_read(&conn->rcv, conn->rcv.head, data, n);
+    tcp_recv_consume(conn, n);
+    return n;
+}
+
+/**
+ * @brief 关闭发送方向，已放入发送缓冲区的数据发完后发送FIN
+ *        连接在四次挥手完成后以TCP_EVENT_CLOSED结束；还在SYN_SENT时立即结束
+ *
+ * @param conn 连接
+ */
+void tcp_close(tcp_conn_t *conn)
+{
+    if (conn->fin_queued)
+        return;
+    switch (conn->state)
+    {
+    case TCP_SYN_SENT:
+        tcp_destroy(conn, 1);
+        return;
+    case TCP_SYN_RCVD:
+        break;
+    case TCP_ESTABLISHED:
+        conn->state = TCP_FIN_WAIT_1;
+        break;
+    case TCP_CLOSE_WAIT:
+        conn->state = TCP_LAST_ACK;
+        break;
+    default:
+        return;
+    }
+    conn->fin_queued = 1;
+    tcp_dirty(conn);
+}
+
+/**
+ * @brief 发送复位并立即结束连接，不再产生事件，返回后不能再使用连接
+ *
+ * @param conn 连接
+ */
+void tcp_abort(tcp_conn_t *conn)
+{
+    if (conn->state == TCP_CLOSED)
+        return;
+    if (conn->state != TCP_SYN_SENT)
+        tcp_send_rst(conn->local_ip, conn->remote_ip, conn->local_port, conn->remote_port, conn->snd_nxt, 0, TCP_RST);
+    tcp_destroy(conn, 0);
+}
+
+/**
+ * @brief 开启或关闭Nagle算法，关闭后不足一个报文段的数据也立即发送
+ *
+ * @param conn 连接
+ * @param nodelay 非0为关闭
+ */
+void tcp_set_nodelay(tcp_conn_t *conn, int nodelay)
+{
+    conn->nodelay = nodelay;
+}
+
+/**
+ * @brief 获取当前协议栈实例的连接数
+ *
+ * @return int 连接数
+ */
+int tcp_conn_count()
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    return ctx->conns;
+}
+
+/**
+ * @brief 获取当前协议栈实例的tcp计数
+ *
+ * @return const tcp_stats_t* 计数
+ */
+const tcp_stats_t *tcp_get_stats()
+{
+    tcp_ctx_t *ctx = &net_stack_current()->tcp;
+    return &ctx->stats;
+}
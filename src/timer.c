@@ -0,0 +1,126 @@
+#include "timer.h"
+#include "utils.h"
+#include "stack.h"
+#include <time.h>
+
+uint64_t timer_now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void timer_unlink(net_timer_t *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->pending = 0;
+}
+
+/**
+ * @brief 初始化当前协议栈实例的定时器模块，已挂在时间轮上的定时器会被丢弃
+ *
+ */
+void timer_init()
+{
+    timer_ctx_t *ctx = &net_stack_current()->timer;
+    for (int i = 0; i < TIMER_WHEEL_SIZE; i++)
+        ctx->wheel[i].prev = ctx->wheel[i].next = &ctx->wheel[i];
+    ctx->tick = timer_now_ms() / TIMER_TICK_MS;
+    ctx->ready = 1;
+}
+
+/**
+ * @brief 启动一个定时器，已启动的定时器会被重新设置到期时间
+ *        到期时间向上取整到tick，保证不会提前到期
+ *
+ * @param timer 定时器
+ * @param ms 多少毫秒后到期
+ * @param handler 到期处理程序
+ * @param arg 处理程序参数
+ */
+void timer_add(net_timer_t *timer, uint32_t ms, timer_handler_t handler, void *arg)
+{
+    timer_ctx_t *ctx = &net_stack_current()->timer;
+    if (!ctx->ready)
+        timer_init();
+    if (timer->pending)
+        timer_unlink(timer);
+    timer->expire = (timer_now_ms() + ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    if (timer->expire <= ctx->tick)
+        timer->expire = ctx->tick + 1;
+    timer->handler = handler;
+    timer->arg = arg;
+
+    net_timer_t *head = &ctx->wheel[timer->expire % TIMER_WHEEL_SIZE];
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+    timer->pending = 1;
+}
+
+/**
+ * @brief 停止一个定时器，未启动的定时器不做处理
+ *
+ * @param timer 定时器
+ */
+void timer_del(net_timer_t *timer)
+{
+    if (timer->pending)
+        timer_unlink(timer);
+}
+
+/**
+ * @brief 推进指定协议栈实例的时间轮，调用所有已到期定时器的处理程序，期间实例绑定到本线程
+ *        距上次推进超过一圈时只需把每个槽检查一遍。
+ *        先把到期的定时器摘到临时链表上再逐个调用，
+ *        处理程序中重新启动定时器不会打乱正在遍历的槽。
+ *
+ * @param stack 实例
+ */
+void timer_poll_stack(net_stack_t *stack)
+{
+    net_stack_t *prev = net_stack_bind(stack);
+    timer_ctx_t *ctx = &stack->timer;
+    if (!ctx->ready)
+        timer_init();
+    uint64_t now = timer_now_ms() / TIMER_TICK_MS;
+    if (now - ctx->tick > TIMER_WHEEL_SIZE)
+        ctx->tick = now - TIMER_WHEEL_SIZE;
+
+    while (ctx->tick < now)
+    {
+        ctx->tick++;
+        net_timer_t *head = &ctx->wheel[ctx->tick % TIMER_WHEEL_SIZE];
+        net_timer_t expired = {.prev = &expired, .next = &expired};
+        for (net_timer_t *t = head->next, *next; t != head; t = next)
+        {
+            next = t->next;
+            if (t->expire > ctx->tick)
+                continue;
+            timer_unlink(t);
+            t->prev = expired.prev;
+            t->next = &expired;
+            expired.prev->next = t;
+            expired.prev = t;
+            t->pending = 1;
+        }
+        while (expired.next != &expired)
+        {
+            net_timer_t *t = expired.next;
+            timer_unlink(t);
+            t->handler(t, t->arg);
+        }
+    }
+    net_stack_bind(prev);
+}
+
+/**
+ * @brief 推进当前协议栈实例的时间轮
+ *
+ */
+void timer_poll()
+{
+    timer_poll_stack(net_stack_current());
+}
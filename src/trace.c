@@ -0,0 +1,114 @@
+#define _GNU_SOURCE
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#if NET_TRACE
+NET_LOCAL net_trace_ring_t net_trace_ring;
+#endif
+
+static const char *net_trace_names[NET_TRACE_EVENT_COUNT] = {
+    [NET_TRACE_DRIVER_RECV] = "driver_recv",
+    [NET_TRACE_ETHERNET_IN] = "ethernet_in",
+    [NET_TRACE_IP_IN] = "ip_in",
+    [NET_TRACE_UDP_IN] = "udp_in",
+    [NET_TRACE_HANDLER_ENTER] = "handler",
+    [NET_TRACE_HANDLER_EXIT] = "handler",
+    [NET_TRACE_IP_OUT] = "ip_out",
+    [NET_TRACE_ARP_OUT] = "arp_out",
+    [NET_TRACE_DRIVER_SEND] = "driver_send",
+};
+
+/**
+ * @brief 获取跟踪点的名称
+ *
+ * @param event 跟踪点
+ * @return const char* 名称，未知的跟踪点为"unknown"
+ */
+const char *net_trace_name(uint16_t event)
+{
+    return event < NET_TRACE_EVENT_COUNT ? net_trace_names[event] : "unknown";
+}
+
+static uint64_t net_trace_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief 以单调时钟测量时间戳计数器的频率，耗时约10毫秒
+ *
+ */
+static double net_trace_tsc_hz()
+{
+    uint64_t ns0 = net_trace_now_ns(), tsc0 = net_trace_tsc(), ns1;
+    while ((ns1 = net_trace_now_ns()) - ns0 < 10000000)
+        ;
+    return (net_trace_tsc() - tsc0) * 1e9 / (ns1 - ns0);
+}
+
+/**
+ * @brief 把本线程跟踪环中的记录按时间先后写入快照文件，可用tools/tracedump转换为Chrome trace格式
+ *        只能在写跟踪环的线程中调用；NET_TRACE为0时写入没有记录的快照
+ *
+ * @param path 文件路径
+ * @return int 成功为0，失败为-1
+ */
+int net_trace_snapshot(const char *path)
+{
+    net_trace_file_t file = {
+        .magic = NET_TRACE_MAGIC,
+        .version = NET_TRACE_VERSION,
+        .rec_size = sizeof(net_trace_rec_t),
+        .tsc_hz = net_trace_tsc_hz(),
+        .pid = getpid(),
+        .tid = syscall(SYS_gettid),
+    };
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+        return -1;
+#if NET_TRACE
+    net_trace_ring_t *ring = &net_trace_ring;
+    uint64_t first = ring->head > NET_TRACE_RING_SIZE ? ring->head - NET_TRACE_RING_SIZE : 0;
+    file.count = ring->head - first;
+    file.lost = first;
+#endif
+    int ok = fwrite(&file, sizeof(file), 1, fp) == 1;
+#if NET_TRACE
+    for (uint64_t i = first; ok && i < ring->head; i++)
+        ok = fwrite(&ring->recs[i & (NET_TRACE_RING_SIZE - 1)], sizeof(net_trace_rec_t), 1, fp) == 1;
+#endif
+    return fclose(fp) == 0 && ok ? 0 : -1;
+}
+
+/**
+ * @brief 读取快照文件
+ *
+ * @param path 文件路径
+ * @param file 保存头部
+ * @return net_trace_rec_t* 记录，由调用者free()；文件不存在或格式不一致时为NULL
+ */
+net_trace_rec_t *net_trace_load(const char *path, net_trace_file_t *file)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return NULL;
+    net_trace_rec_t *recs = NULL;
+    if (fread(file, sizeof(*file), 1, fp) == 1 && file->magic == NET_TRACE_MAGIC && file->version == NET_TRACE_VERSION &&
+        file->rec_size == sizeof(net_trace_rec_t))
+    {
+        recs = malloc((file->count ? file->count : 1) * sizeof(net_trace_rec_t));
+        if (recs != NULL && fread(recs, sizeof(net_trace_rec_t), file->count, fp) != file->count)
+        {
+            free(recs);
+            recs = NULL;
+        }
+    }
+    fclose(fp);
+    return recs;
+}
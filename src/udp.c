@@ -1,146 +1,336 @@
 #include "udp.h"
 #include "ip.h"
 #include "icmp.h"
+#include "ethernet.h"
+#include "netif.h"
+#include "stack.h"
+#include "trace.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
-#define UDP_PESO_LEN 12
-udp_hdr_t udp_hdr;
+#define UDP_GSO_HDR_LEN (sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + sizeof(udp_hdr_t)) //分段发送时模板的长度
 
 /**
- * @brief udp处理程序表
+ * @brief 从udp表中查找dest_port
  * 
+ * @param dest_port 欲查找的dest_port
+ * @return udp_entry_t* 找到时为对应表项，未找到时为NULL
  */
-static udp_entry_t udp_table[UDP_MAX_HANDLER];
+static inline udp_entry_t *udp_lookup(uint16_t dest_port)
+{
+    udp_ctx_t *ctx = &net_stack_current()->udp;
+    udp_entry_t *entry = &ctx->table[dest_port];
+    return entry->valid ? entry : NULL;
+}
 
 /**
- * @brief 从udp表中查找dest_port
+ * @brief 记录从一个端口发出的数据报，只为已打开的端口计数
  * 
- * @param dest_port 欲查找的dest_port
- * @return int 找到时为对应索引i,未找到时为-1
+ * @param src_port 源端口
+ * @param len 数据报长度，含udp头部
+ */
+static inline void udp_count_out(uint16_t src_port, uint16_t len)
+{
+    udp_entry_t *entry = udp_lookup(src_port);
+    if (entry != NULL)
+    {
+        entry->stats.out_packets++;
+        entry->stats.out_bytes += len;
+    }
+}
+
+/**
+ * @brief 在暂存的流中查找一个流
+ * 
+ * @return int 流的下标，未找到时为-1
  */
-static int udp_lookup(int dest_port)
+static int udp_gro_find(udp_ctx_t *ctx, udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, uint8_t *dest_ip)
 {
-    for (int i = 0; i < UDP_MAX_HANDLER; i++)
-        if (udp_table[i].valid == 1 && udp_table[i].port == dest_port)
+    for (int i = 0; i < ctx->gro_flow_count; i++)
+    {
+        udp_gro_flow_t *flow = &ctx->gro_flows[i];
+        if (flow->entry == entry && flow->src_port == src_port &&
+            memcmp(flow->src_ip, src_ip, NET_IP_LEN) == 0 && memcmp(flow->dest_ip, dest_ip, NET_IP_LEN) == 0)
             return i;
+    }
     return -1;
 }
 
 /**
- * @brief udp伪校验和计算
- *        1. 你首先调用buf_add_header()添加UDP伪头部
- *        2. 将IP头部拷贝出来，暂存被UDP伪头部覆盖的IP头部
- *        3. 填写UDP伪头部的12字节字段
- *        4. 计算UDP校验和，注意：UDP校验和覆盖了UDP头部、UDP数据和UDP伪头部
- *        5. 再将暂存的IP头部拷贝回来
- *        6. 调用buf_remove_header()函数去掉UDP伪头部
- *        7. 返回计算后的校验和。  
- * 
- * @param buf 要计算的包
+ * @brief 把一个流暂存的数据报交付给批量处理程序，交付后流中不再有数据报
+ * 
+ */
+static void udp_gro_deliver(udp_gro_flow_t *flow)
+{
+    udp_entry_t *entry = flow->entry;
+    if (flow->count > 0 && entry->valid && entry->port == flow->port && entry->batch_handler != NULL)
+    {
+        NET_TRACEPOINT(NET_TRACE_HANDLER_ENTER, flow->count, flow->port);
+        entry->batch_handler(entry, flow->src_ip, flow->src_port, flow->data, flow->lens, flow->count);
+        NET_TRACEPOINT(NET_TRACE_HANDLER_EXIT, flow->count, flow->port);
+    }
+    flow->count = 0;
+}
+
+/**
+ * @brief 暂存一个发往批量处理程序的数据报，暂存区或流表已满时先交付已暂存的数据报
+ *        超过一个暂存槽的数据报直接交付，同一流已暂存的数据报先交付，保持流内的顺序
+ * 
+ * @param entry 目的端口的表项
  * @param src_ip 源ip地址
+ * @param src_port 源端口
  * @param dest_ip 目的ip地址
- * @return uint16_t 伪校验和
+ * @param buf 数据报的数据
  */
-static uint16_t udp_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dest_ip)
-{   
-    //添加UDP伪头部
-    buf_add_header(buf,UDP_PESO_LEN);
-
-    //IP头部拷贝
-    uint8_t ip_header_temp[UDP_PESO_LEN];
-    memcpy(ip_header_temp,buf->data,UDP_PESO_LEN);
-
-    //填写UDP伪头部的12字节字段
-    udp_peso_hdr_t peso_hdr;
-    memcpy(peso_hdr.src_ip,src_ip,NET_IP_LEN);
-    memcpy(peso_hdr.dest_ip,dest_ip,NET_IP_LEN);
-    peso_hdr.placeholder = 0;
-    peso_hdr.protocol = NET_PROTOCOL_UDP;
-    peso_hdr.total_len = udp_hdr.total_len;
-    memcpy(buf->data,&peso_hdr,sizeof(udp_peso_hdr_t));
-    buf->data[10] = peso_hdr.total_len >> 8;
-    buf->data[11] = peso_hdr.total_len & 0xff;
-    
-    //计算UDP校验和
-    int peso_len = peso_hdr.total_len + UDP_PESO_LEN;
-    uint16_t cksum;
-    //在奇数长度的数据报尾部追加一个值为0的填充（虚）字节
-    if(peso_len % 2 == 1){
-        uint8_t temp = buf->data[peso_len];
-        buf->data[peso_len] = 0;
-        peso_len++;
-        cksum = checksum16((uint16_t*) buf->data, peso_len/2);
-        buf->data[peso_len-1] = temp;
+static void udp_gro_add(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, uint8_t *dest_ip, buf_t *buf)
+{
+    udp_ctx_t *ctx = &net_stack_current()->udp;
+    if (buf->len > ETHERNET_MTU)
+    {
+        int i = udp_gro_find(ctx, entry, src_ip, src_port, dest_ip);
+        if (i != -1)
+            udp_gro_deliver(&ctx->gro_flows[i]);
+        uint8_t *data = buf->data;
+        uint16_t len = buf->len;
+        NET_TRACEPOINT(NET_TRACE_HANDLER_ENTER, len, entry->port);
+        entry->batch_handler(entry, src_ip, src_port, &data, &len, 1);
+        NET_TRACEPOINT(NET_TRACE_HANDLER_EXIT, len, entry->port);
+        return;
     }
-    else{
-        cksum = checksum16((uint16_t*) buf->data, peso_len/2);
+    if (ctx->gro_seg_count == UDP_GRO_MAX_SEGS)
+        udp_flush();
+
+    udp_gro_flow_t *flow = &ctx->gro_flows[ctx->gro_last];
+    if (ctx->gro_last >= ctx->gro_flow_count || flow->entry != entry || flow->src_port != src_port ||
+        memcmp(flow->src_ip, src_ip, NET_IP_LEN) != 0 || memcmp(flow->dest_ip, dest_ip, NET_IP_LEN) != 0)
+    {
+        int i = udp_gro_find(ctx, entry, src_ip, src_port, dest_ip);
+        if (i == -1)
+        {
+            if (ctx->gro_flow_count == UDP_GRO_MAX_FLOWS)
+                udp_flush();
+            i = ctx->gro_flow_count++;
+            flow = &ctx->gro_flows[i];
+            flow->entry = entry;
+            flow->port = entry->port;
+            memcpy(flow->src_ip, src_ip, NET_IP_LEN);
+            flow->src_port = src_port;
+            memcpy(flow->dest_ip, dest_ip, NET_IP_LEN);
+            flow->count = 0;
+        }
+        else
+            flow = &ctx->gro_flows[i];
+        ctx->gro_last = i;
     }
-    
-    //暂存的IP头部拷贝回来
-    memcpy(buf->data,ip_header_temp,12);
-    buf_remove_header(buf,UDP_PESO_LEN);
-    return cksum;
+
+    uint8_t *data = ctx->gro_payload[ctx->gro_seg_count++];
+    memcpy(data, buf->data, buf->len);
+    flow->data[flow->count] = data;
+    flow->lens[flow->count] = buf->len;
+    flow->count++;
+}
+
+/**
+ * @brief 把一个数据报扇出给端口的所有订阅者
+ *        数据从rxbuf拷贝一次到引用计数的缓冲区，各订阅者得到同一缓冲区的引用；
+ *        扇出期间协议栈持有一个引用，结束时没有订阅者保留则留作下一次扇出使用
+ * 
+ * @param entry 目的端口的表项
+ * @param src_ip 源ip地址
+ * @param src_port 源端口
+ * @param dest_ip 目的ip地址
+ * @param buf 数据报的数据
+ */
+static void udp_fanout(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, uint8_t *dest_ip, buf_t *buf)
+{
+    udp_ctx_t *ctx = &net_stack_current()->udp;
+    udp_dgram_t *dgram = ctx->dgram_spare;
+    if (dgram == NULL || ctx->dgram_spare_len < buf->len)
+    {
+        free(dgram);
+        ctx->dgram_spare = NULL;
+        dgram = malloc(sizeof(udp_dgram_t) + buf->len);
+        if (dgram == NULL)
+            return;
+        ctx->dgram_spare_len = buf->len;
+    }
+    ctx->dgram_spare = NULL;
+    atomic_init(&dgram->refs, 1);
+    memcpy(dgram->src_ip, src_ip, NET_IP_LEN);
+    memcpy(dgram->dest_ip, dest_ip, NET_IP_LEN);
+    dgram->src_port = src_port;
+    dgram->dest_port = entry->port;
+    dgram->len = buf->len;
+    memcpy(dgram->data, buf->data, buf->len);
+
+    //回调中可以订阅或取消订阅，扇出给数据报到达时的订阅者
+    udp_sub_t subs[UDP_MAX_SUBSCRIBERS];
+    int count = entry->sub_count;
+    memcpy(subs, ctx->subs[entry->port], count * sizeof(udp_sub_t));
+    for (int i = 0; i < count; i++)
+        subs[i].fn(dgram, subs[i].arg);
+
+    if (atomic_load(&dgram->refs) == 1)
+        ctx->dgram_spare = dgram;
+    else
+        udp_dgram_release(dgram);
+}
+
+/**
+ * @brief 释放数据报的一个引用，最后一个引用释放时回收缓冲区
+ * 
+ * @param dgram 数据报
+ */
+void udp_dgram_release(udp_dgram_t *dgram)
+{
+    if (atomic_fetch_sub_explicit(&dgram->refs, 1, memory_order_acq_rel) == 1)
+        free(dgram);
+}
+
+/**
+ * @brief 把指定协议栈实例暂存的数据报按流交付给批量处理程序，在一个接收批次结束时调用
+ *        交付期间实例绑定到本线程，处理程序中可以发送数据或关闭端口
+ * 
+ * @param stack 实例
+ */
+void udp_flush_stack(net_stack_t *stack)
+{
+    net_stack_t *prev = net_stack_bind(stack);
+    udp_ctx_t *ctx = &stack->udp;
+    for (int i = 0; i < ctx->gro_flow_count; i++)
+        udp_gro_deliver(&ctx->gro_flows[i]);
+    ctx->gro_flow_count = 0;
+    ctx->gro_seg_count = 0;
+    ctx->gro_last = 0;
+    net_stack_bind(prev);
+}
+
+/**
+ * @brief 把当前协议栈实例暂存的数据报按流交付给批量处理程序
+ * 
+ */
+void udp_flush()
+{
+    udp_flush_stack(net_stack_current());
+}
+
+/**
+ * @brief 获取（源ip、目的ip）地址对的伪头部累加和：两个地址与协议号，不含长度
+ *        同一地址对的这部分在每个数据报中都相同，按地址对缓存在直接映射表中，
+ *        收发时只需再累加udp长度、udp头部与数据。
+ * 
+ * @param src_ip 源ip地址
+ * @param dest_ip 目的ip地址
+ * @return uint32_t 未折叠的累加和
+ */
+static uint32_t udp_peso_sum(uint8_t *src_ip, uint8_t *dest_ip)
+{
+    udp_ctx_t *ctx = &net_stack_current()->udp;
+    uint32_t src, dest;
+    memcpy(&src, src_ip, NET_IP_LEN);
+    memcpy(&dest, dest_ip, NET_IP_LEN);
+    udp_peso_sum_t *slot = &ctx->peso_cache[((src ^ dest) * 0x9e3779b1u >> 16) & (UDP_PESO_CACHE_SIZE - 1)];
+    if (slot->sum != 0 && slot->src == src && slot->dest == dest)
+        return slot->sum;
+    slot->src = src;
+    slot->dest = dest;
+    slot->sum = checksum_add(checksum_add(0, src_ip, NET_IP_LEN), dest_ip, NET_IP_LEN) + swap16(NET_PROTOCOL_UDP);
+    return slot->sum;
+}
+
+/**
+ * @brief udp伪校验和计算
+ *        伪头部只参与计算，不写入数据包：地址对的累加和取自缓存，
+ *        加上udp长度后再累加udp头部与数据，数据包本身与其前面的空间都不会被修改。
+ *        奇数长度的数据报由checksum_add()在末尾补一个值为0的字节。
+ * 
+ * @param buf 要计算的包，长度为udp数据报的总长度
+ * @param src_ip 源ip地址
+ * @param dest_ip 目的ip地址
+ * @return uint16_t 网络字节序的校验和，校验收到的数据报时为0表示正确
+ */
+static uint16_t udp_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dest_ip)
+{
+    uint32_t sum = udp_peso_sum(src_ip, dest_ip) + swap16(buf->len);
+    return checksum_fold(checksum_add(sum, buf->data, buf->len));
 }
 
 /**
  * @brief 处理一个收到的udp数据包
  *        你首先需要检查UDP报头长度
- *        接着计算checksum，步骤如下：
- *          （1）先将UDP首部的checksum缓存起来
- *          （2）再将UDP首都的checksum字段清零
- *          （3）调用udp_checksum()计算UDP校验和
- *          （4）比较计算后的校验和与之前缓存的checksum进行比较，如不相等，则不处理该数据报。
+ *        接着检查checksum：连同首部的checksum字段一起调用udp_checksum()计算，
+ *          结果不为0说明数据报有误，不处理该数据报。
+ *          checksum为0表示发送方没有计算校验和，不做检查。
  *       然后，根据该数据报目的端口号查找udp_table，查看是否有对应的处理函数（回调函数）
  *       
  *       如果没有找到，则调用buf_add_header()函数增加IP数据报头部(想一想，此处为什么要增加IP头部？？)
  *       然后调用icmp_unreachable()函数发送一个端口不可达的ICMP差错报文。
+ *       icmp差错报文被限速时直接丢弃，不重建ip头部。
  * 
  *       如果能找到，则去掉UDP报头，调用处理函数（回调函数）来做相应处理。
+ *       端口有订阅者时，先把数据报扇出给所有订阅者，再交给处理函数。
+ *       发往广播或组播地址的数据报找不到端口时直接丢弃，不回送差错报文。
  * 
  * @param buf 要处理的包
  * @param src_ip 源ip地址
+ * @param dest_ip 目的ip地址
  */
-void udp_in(buf_t *buf, uint8_t *src_ip)
+void udp_in(buf_t *buf, uint8_t *src_ip, uint8_t *dest_ip)
 {
-    udp_hdr.src_port = (buf->data[0]<<8) + buf->data[1];  // 源端口
-    udp_hdr.dest_port = (buf->data[2]<<8) + buf->data[3]; // 目标端口
-    udp_hdr.total_len = (buf->data[4]<<8) + buf->data[5]; // 整个数据包的长度
-    udp_hdr.checksum = (buf->data[6]<<8) + buf->data[7];  // 校验和
-
-    buf->len = udp_hdr.total_len;
     //检查UDP报头长度
-    if(udp_hdr.total_len < 8) return;
+    udp_hdr_t *hdr = udp_hdr_of(buf);
+    if(hdr == NULL){
+        int bad_len = buf->len >= sizeof(udp_hdr_t) && swap16(((udp_hdr_t *)buf->data)->total_len) < sizeof(udp_hdr_t);
+        net_drop(bad_len ? NET_DROP_UDP_BAD_LEN : NET_DROP_UDP_TRUNCATED, buf);
+        return;
+    }
+    NET_TRACEPOINT(NET_TRACE_UDP_IN, buf->len, swap16(hdr->dest_port));
+    buf->len = swap16(hdr->total_len);
     //计算checksum
-    uint8_t if_ip[] = DRIVER_IF_IP;
-    if(udp_checksum(buf,src_ip,if_ip)!=0) return;
+    if(hdr->checksum != 0 && udp_checksum(buf,src_ip,dest_ip)!=0){
+        net_drop(NET_DROP_UDP_CHECKSUM, buf);
+        return;
+    }
     //根据该数据报目的端口号查找udp_table
-    int index = udp_lookup(udp_hdr.dest_port);
-    if(index != -1){
-        buf_remove_header(buf,8);
-        //回调函数
-        udp_table[index].handler(&udp_table[index], src_ip, udp_hdr.src_port, buf);
+    udp_entry_t *entry = udp_lookup(swap16(hdr->dest_port));
+    if(entry != NULL){
+        entry->stats.packets++;
+        entry->stats.bytes += buf->len;
+        uint16_t src_port = swap16(hdr->src_port);
+        buf_remove_header(buf,sizeof(udp_hdr_t));
+        if(entry->sub_count > 0)
+            udp_fanout(entry, src_ip, src_port, dest_ip, buf);
+        //批量处理程序在批次结束时合并交付，否则直接调用回调函数
+        if(entry->batch_handler != NULL)
+            udp_gro_add(entry, src_ip, src_port, dest_ip, buf);
+        else if(entry->handler != NULL){
+            NET_TRACEPOINT(NET_TRACE_HANDLER_ENTER, buf->len, entry->port);
+            entry->handler(entry, src_ip, src_port, buf);
+            NET_TRACEPOINT(NET_TRACE_HANDLER_EXIT, buf->len, entry->port);
+        }
     }
-    else
-    {
-        buf_add_header(buf,20);
-        buf->data[0] = IP_VERSION_4*16 + 5;
-        buf->data[1] = 0;
-        buf->data[2] = (buf->len & 0xff00)>>8; 
-        buf->data[3] = buf->len & 0x00ff;
-        buf->data[4] = 0;   buf->data[5] = 0;
-        buf->data[6] = 0;   buf->data[7] = 0;
-        buf->data[8] = 64;  buf->data[9] = NET_PROTOCOL_UDP;
-        buf->data[10] = 0;  buf->data[11] = 0;
-        uint8_t if_ip[] = DRIVER_IF_IP;
-        memcpy(&buf->data[12] ,if_ip,NET_IP_LEN);
-        memcpy(&buf->data[16] ,src_ip,NET_IP_LEN);
-        uint16_t cksum = checksum16((uint16_t*)buf->data,buf->len/2);
-        buf->data[10] = (cksum & 0xff00)>>8;
-        buf->data[11] = cksum & 0x00ff;
+    else{
+        net_drop(NET_DROP_UDP_NO_PORT, buf);
+        if(netif_lookup(dest_ip) != -1 && icmp_error_allowed(src_ip)) //被限速时不必重建ip头部
+        {
+            buf_add_header(buf,20);
+            buf->data[0] = IP_VERSION_4*16 + 5;
+            buf->data[1] = 0;
+            buf->data[2] = (buf->len & 0xff00)>>8; 
+            buf->data[3] = buf->len & 0x00ff;
+            buf->data[4] = 0;   buf->data[5] = 0;
+            buf->data[6] = 0;   buf->data[7] = 0;
+            buf->data[8] = 64;  buf->data[9] = NET_PROTOCOL_UDP;
+            buf->data[10] = 0;  buf->data[11] = 0;
+            memmove(&buf->data[12] ,src_ip,NET_IP_LEN); //src_ip、dest_ip可能就指向这里
+            memmove(&buf->data[16] ,dest_ip,NET_IP_LEN);
+            uint16_t cksum = checksum16((uint16_t*)buf->data,buf->len/2);
+            buf->data[10] = (cksum & 0xff00)>>8;
+            buf->data[11] = cksum & 0x00ff;
 
-        icmp_unreachable(buf,if_ip,ICMP_CODE_PORT_UNREACH);
+            icmp_unreachable(buf,src_ip,ICMP_CODE_PORT_UNREACH);
+        }
     }
 
 }
@@ -149,8 +339,9 @@ void udp_in(buf_t *buf, uint8_t *src_ip)
  * @brief 处理一个要发送的数据包
  *        你首先需要调用buf_add_header()函数增加UDP头部长度空间
  *        填充UDP首部字段
- *        调用udp_checksum()函数计算UDP校验和
- *        将封装的UDP数据报发送到IP层。    
+ *        按路由选出源地址，调用udp_checksum()函数计算UDP校验和，
+ *        计算结果为0时填0xffff（0表示没有校验和）
+ *        以该源地址将封装的UDP数据报发送到IP层。    
  * 
  * @param buf 要处理的包
  * @param src_port 源端口号
@@ -159,40 +350,92 @@ void udp_in(buf_t *buf, uint8_t *src_ip)
  */
 void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
 {   
+    uint8_t *src_ip = ip_select_src(dest_ip);
+    if (src_ip == NULL)
+        return;
     // 增加UDP报头
     buf_add_header(buf,8);
+    udp_hdr_t *hdr = (udp_hdr_t *)buf->data;
+    hdr->src_port = swap16(src_port);
+    hdr->dest_port = swap16(dest_port);
+    hdr->total_len = swap16(buf->len);
+    hdr->checksum = 0;
+    uint16_t cksum = udp_checksum(buf, src_ip, dest_ip);
+    hdr->checksum = cksum ? cksum : 0xffff;
+    udp_count_out(src_port, buf->len);
 
-    //源端口号
-    buf->data[0] = src_port >> 8;
-    buf->data[1] = src_port & 0xff;
-    //目的端口号
-    buf->data[2] = dest_port >> 8;
-    buf->data[3] = dest_port & 0xff;
-    //长度
-    buf->data[4] = buf->len >> 8;
-    buf->data[5] = buf->len & 0xff;
-    //校验和
-    buf->data[6] = 0;buf->data[7] = 0;
+    //调用 ip_out_from 函数发送 UDP 数据报。
+    ip_out_from(buf,src_ip,dest_ip,NET_PROTOCOL_UDP);
 
-    // //调用 udp_checksum 函数计算校验和。
-    // uint8_t if_ip[] = DRIVER_IF_IP;
-    // uint16_t cksum = udp_checksum(buf,if_ip,dest_ip);
-    // buf->data[6] = cksum >> 8;
-    // buf->data[7] = cksum & 0xff;
-
-    //调用 ip_out 函数发送 UDP 数据报。
-    ip_out(buf,dest_ip,NET_PROTOCOL_UDP);
+}
 
+/**
+ * @brief 获取发往目的地址时不会被分片的最大数据长度
+ *        应用据此决定每个报文的大小，发送更长的数据时由ip层在本机分片
+ * 
+ * @param dest_ip 目的ip地址
+ * @return int 最大数据长度
+ */
+int udp_get_mtu(uint8_t *dest_ip)
+{
+    return ip_get_pmtu(dest_ip) - IP_HDR_LEN_PER_BYTE * 5 - 8;
 }
 
 /**
- * @brief 初始化udp协议
+ * @brief 初始化当前协议栈实例的udp协议，关闭所有端口并释放订阅者与备用的数据报
  * 
  */
 void udp_init()
 {
-    for (int i = 0; i < UDP_MAX_HANDLER; i++)
-        udp_table[i].valid = 0;
+    udp_ctx_t *ctx = &net_stack_current()->udp;
+    for (int i = 0; i < UDP_PORT_COUNT; i++)
+    {
+        ctx->table[i].valid = 0;
+        if (ctx->subs[i] != NULL)
+        {
+            free(ctx->subs[i]);
+            ctx->subs[i] = NULL;
+            ctx->table[i].sub_count = 0;
+        }
+    }
+    ctx->gro_flow_count = 0;
+    ctx->gro_seg_count = 0;
+    ctx->gro_last = 0;
+    ctx->open_count = 0;
+    free(ctx->dgram_spare);
+    ctx->dgram_spare = NULL;
+}
+
+/**
+ * @brief 判断端口是否在已打开的端口列表中
+ *        open_index只在端口加入列表时设置，列表中对应位置是该端口时才有效，表项无需初始化
+ * 
+ */
+static int udp_listed(uint16_t port)
+{
+    udp_ctx_t *ctx = &net_stack_current()->udp;
+    int i = ctx->table[port].open_index;
+    return i < ctx->open_count && ctx->open_ports[i] == port;
+}
+
+/**
+ * @brief 获取端口的表项，已打开的端口会被更新，新打开的端口加入已打开的端口列表并清零计数
+ * 
+ * @param port 端口号
+ * @return udp_entry_t* 表项
+ */
+static udp_entry_t *udp_open_entry(uint16_t port)
+{
+    udp_ctx_t *ctx = &net_stack_current()->udp;
+    udp_entry_t *entry = &ctx->table[port];
+    entry->port = port;
+    if (!udp_listed(port))
+    {
+        entry->open_index = ctx->open_count;
+        ctx->open_ports[ctx->open_count++] = port;
+        memset(&entry->stats, 0, sizeof(entry->stats));
+    }
+    return entry;
 }
 
 /**
@@ -204,23 +447,44 @@ void udp_init()
  */
 int udp_open(uint16_t port, udp_handler_t handler)
 {
-    for (int i = 0; i < UDP_MAX_HANDLER; i++) //试图更新
-        if (udp_table[i].port == port)
-        {
-            udp_table[i].handler = handler;
-            udp_table[i].valid = 1;
-            return 0;
-        }
+    return udp_open_arg(port, handler, NULL);
+}
 
-    for (int i = 0; i < UDP_MAX_HANDLER; i++) //试图插入
-        if (udp_table[i].valid == 0)
-        {
-            udp_table[i].handler = handler;
-            udp_table[i].port = port;
-            udp_table[i].valid = 1;
-            return 0;
-        }
-    return -1;
+/**
+ * @brief 打开一个udp端口并注册带参数的处理程序，处理程序从entry->arg取得参数
+ * 
+ * @param port 端口号
+ * @param handler 处理程序
+ * @param arg 处理程序参数
+ * @return int 成功为0，失败为-1
+ */
+int udp_open_arg(uint16_t port, udp_handler_t handler, void *arg)
+{
+    udp_entry_t *entry = udp_open_entry(port);
+    entry->handler = handler;
+    entry->batch_handler = NULL;
+    entry->arg = arg;
+    entry->valid = 1;
+    return 0;
+}
+
+/**
+ * @brief 打开一个udp端口并注册批量处理程序
+ *        一个接收批次内发往该端口的数据报按（源ip、源端口、目的ip）分组，
+ *        在udp_flush()时每组调用一次处理程序，组内保持到达顺序
+ * 
+ * @param port 端口号
+ * @param handler 批量处理程序
+ * @return int 成功为0，失败为-1
+ */
+int udp_open_batch(uint16_t port, udp_batch_handler_t handler)
+{
+    udp_entry_t *entry = udp_open_entry(port);
+    entry->handler = NULL;
+    entry->batch_handler = handler;
+    entry->arg = NULL;
+    entry->valid = 1;
+    return 0;
 }
 
 /**
@@ -230,9 +494,92 @@ int udp_open(uint16_t port, udp_handler_t handler)
  */
 void udp_close(uint16_t port)
 {
-    for (int i = 0; i < UDP_MAX_HANDLER; i++)
-        if (udp_table[i].port == port)
-            udp_table[i].valid = 0;
+    udp_ctx_t *ctx = &net_stack_current()->udp;
+    udp_entry_t *entry = &ctx->table[port];
+    entry->valid = 0;
+    entry->sub_count = 0;
+    free(ctx->subs[port]);
+    ctx->subs[port] = NULL;
+    if (udp_listed(port))
+    {
+        uint16_t last = ctx->open_ports[--ctx->open_count];
+        ctx->open_ports[entry->open_index] = last;
+        ctx->table[last].open_index = entry->open_index;
+    }
+}
+
+/**
+ * @brief 获取一个已打开端口的收发计数，从端口打开时开始计
+ * 
+ * @param port 端口号
+ * @return const net_proto_stats_t* 收发计数，端口未打开时为NULL
+ */
+const net_proto_stats_t *udp_get_stats(uint16_t port)
+{
+    udp_entry_t *entry = udp_lookup(port);
+    return entry != NULL ? &entry->stats : NULL;
+}
+
+/**
+ * @brief 订阅一个udp端口，可以与处理程序共存；同一端口的每个数据报按订阅顺序交给所有订阅者
+ *        端口未打开时打开它，不设处理程序
+ * 
+ * @param port 端口号
+ * @param fn 回调
+ * @param arg 回调参数
+ * @return int 成功为0，已订阅或订阅者已达UDP_MAX_SUBSCRIBERS为-1
+ */
+int udp_subscribe(uint16_t port, udp_subscriber_t fn, void *arg)
+{
+    udp_ctx_t *ctx = &net_stack_current()->udp;
+    udp_entry_t *entry = &ctx->table[port];
+    if (!entry->valid)
+    {
+        udp_open_entry(port);
+        entry->handler = NULL;
+        entry->batch_handler = NULL;
+        entry->arg = NULL;
+        entry->sub_count = 0;
+    }
+    for (int i = 0; i < entry->sub_count; i++)
+        if (ctx->subs[port][i].fn == fn && ctx->subs[port][i].arg == arg)
+            return -1;
+    if (entry->sub_count == UDP_MAX_SUBSCRIBERS)
+        return -1;
+    udp_sub_t *subs = realloc(ctx->subs[port], (entry->sub_count + 1) * sizeof(udp_sub_t));
+    if (subs == NULL)
+        return -1;
+    ctx->subs[port] = subs;
+    subs[entry->sub_count].fn = fn;
+    subs[entry->sub_count].arg = arg;
+    entry->sub_count++;
+    entry->valid = 1;
+    return 0;
+}
+
+/**
+ * @brief 取消订阅，端口没有订阅者与处理程序时被关闭；可以在回调中调用
+ * 
+ * @param port 端口号
+ * @param fn 回调
+ * @param arg 回调参数
+ * @return int 成功为0，未订阅为-1
+ */
+int udp_unsubscribe(uint16_t port, udp_subscriber_t fn, void *arg)
+{
+    udp_ctx_t *ctx = &net_stack_current()->udp;
+    udp_entry_t *entry = &ctx->table[port];
+    udp_sub_t *subs = ctx->subs[port];
+    int i = 0;
+    while (i < entry->sub_count && (subs[i].fn != fn || subs[i].arg != arg))
+        i++;
+    if (!entry->valid || i == entry->sub_count)
+        return -1;
+    entry->sub_count--;
+    memmove(&subs[i], &subs[i + 1], (entry->sub_count - i) * sizeof(udp_sub_t));
+    if (entry->sub_count == 0 && entry->handler == NULL && entry->batch_handler == NULL)
+        udp_close(port);
+    return 0;
 }
 
 /**
@@ -246,7 +593,80 @@ void udp_close(uint16_t port)
  */
 void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
 {
-    buf_init(&txbuf, len);
-    memcpy(txbuf.data, data, len);
-    udp_out(&txbuf, src_port, dest_ip, dest_port);
-}
\ No newline at end of file
+    udp_ctx_t *ctx = &net_stack_current()->udp;
+    buf_init(&ctx->txbuf, len);
+    memcpy(ctx->txbuf.data, data, len);
+    udp_out(&ctx->txbuf, src_port, dest_ip, dest_port);
+}
+
+/**
+ * @brief 分段发送一大块数据，每seg_size字节构成一个udp数据报
+ *        以太网、ip、udp头部只构造一次作为模板，各数据报直接在批量发送队列中构造：
+ *        拷贝模板与数据，最后一个较短的数据报增量修正ip总长度与头部校验和；
+ *        udp校验和由模板中不变部分（缓存的伪头部地址与协议号累加和、端口）的累加和，
+ *        加上长度与数据的累加和得到。全部数据报构造完后一次交给驱动。
+ *        下一跳的mac地址未知时只用udp_send()发出第一个数据报，它在arp层等待应答，其余数据报不发送。
+ * 
+ * @param data 要发送的数据
+ * @param len 数据长度
+ * @param seg_size 每个数据报的数据长度，超过路径MTU时按路径MTU
+ * @param src_port 源端口号
+ * @param dest_ip 目的ip地址
+ * @param dest_port 目的端口号
+ * @return int 发送的数据报数，下一跳mac未知时为1，其余数据报未发送；参数错误时为-1
+ */
+int udp_send_gso(uint8_t *data, int len, uint16_t seg_size, uint16_t src_port, uint8_t *dest_ip, uint16_t dest_port)
+{
+    udp_ctx_t *ctx = &net_stack_current()->udp;
+    int max_seg = udp_get_mtu(dest_ip);
+    if (len < 0 || seg_size == 0 || max_seg <= 0)
+        return -1;
+    if (seg_size > max_seg)
+        seg_size = max_seg;
+    int count = (len + seg_size - 1) / seg_size;
+
+    //按完整数据报的长度构造模板
+    buf_init(&ctx->txbuf, sizeof(udp_hdr_t) + seg_size);
+    udp_hdr_t *udp = (udp_hdr_t *)ctx->txbuf.data;
+    udp->src_port = swap16(src_port);
+    udp->dest_port = swap16(dest_port);
+    udp->total_len = swap16(sizeof(udp_hdr_t) + seg_size);
+    udp->checksum = 0;
+    if (ip_build_template(&ctx->txbuf, dest_ip, NET_PROTOCOL_UDP) != 0)
+    {
+        //arp层只能暂存一个数据包，逐个发送会互相覆盖，只发出第一个数据报触发arp解析
+        if (count == 0)
+            return 0;
+        udp_send(data, len < seg_size ? len : seg_size, src_port, dest_ip, dest_port);
+        return 1;
+    }
+    uint8_t tmpl[UDP_GSO_HDR_LEN];
+    memcpy(tmpl, ctx->txbuf.data, UDP_GSO_HDR_LEN);
+    int ifindex = ctx->txbuf.ifindex;
+    ip_hdr_t *ip = (ip_hdr_t *)(tmpl + sizeof(ether_hdr_t));
+    udp = (udp_hdr_t *)(ip + 1);
+    uint32_t base = checksum_add(udp_peso_sum(ip->src_ip, ip->dest_ip), udp, 2 * sizeof(uint16_t));
+
+    for (int off = 0; off < len; off += seg_size)
+    {
+        int n = len - off < seg_size ? len - off : seg_size;
+        if (n != seg_size)
+        {
+            //RFC 1624：HC' = ~(~HC + ~m + m')
+            uint16_t old_len = ip->total_len;
+            ip->total_len = swap16(sizeof(ip_hdr_t) + sizeof(udp_hdr_t) + n);
+            ip->hdr_checksum = checksum_fold((uint16_t)~ip->hdr_checksum + (uint16_t)~old_len + ip->total_len);
+            udp->total_len = swap16(sizeof(udp_hdr_t) + n);
+        }
+        uint8_t *frame = ethernet_burst_reserve(ifindex);
+        memcpy(frame, tmpl, UDP_GSO_HDR_LEN);
+        memcpy(frame + UDP_GSO_HDR_LEN, data + off, n);
+        uint16_t cksum = checksum_fold(checksum_add(base + 2 * udp->total_len, frame + UDP_GSO_HDR_LEN, n));
+        ((udp_hdr_t *)(frame + UDP_GSO_HDR_LEN - sizeof(udp_hdr_t)))->checksum = cksum ? cksum : 0xffff;
+        udp_count_out(src_port, sizeof(udp_hdr_t) + n);
+        ip_count_out(NET_PROTOCOL_UDP, sizeof(ip_hdr_t) + sizeof(udp_hdr_t) + n);
+        ethernet_burst_commit(ifindex, UDP_GSO_HDR_LEN + n);
+    }
+    ethernet_flush();
+    return count;
+}
@@ -0,0 +1,174 @@
+#include "udp_socket.h"
+#include "udp.h"
+#include "ring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @brief 接收队列中的一个数据报，由协议栈线程分配，接收线程拷贝出数据后释放
+ *
+ */
+typedef struct udp_socket_dgram
+{
+    uint8_t src_ip[NET_IP_LEN]; //源ip地址
+    uint16_t src_port;          //源端口
+    uint16_t len;               //数据长度
+    uint64_t timestamp_ns;      //收到的时间
+    uint8_t data[];             //数据
+} udp_socket_dgram_t;
+
+/**
+ * @brief udp套接字
+ *        rmem由协议栈线程增加、接收线程减少，是原子变量；
+ *        各丢弃计数只由协议栈线程修改，其他线程读取时可能稍有滞后
+ *
+ */
+struct udp_socket
+{
+    ring_t ring;             //接收队列
+    uint16_t port;           //绑定的端口
+    uint32_t rcvbuf;         //接收内存上限
+    _Atomic uint64_t rmem;   //当前占用的接收内存，每个数据报按数据长度加记录头计算
+    _Atomic uint64_t received;
+    _Atomic uint64_t dropped_ring;
+    _Atomic uint64_t dropped_mem;
+};
+
+static uint64_t udp_socket_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief 套接字端口的处理程序，运行在协议栈线程中：
+ *        检查内存上限后拷贝数据报放入接收队列，队列满或超过上限时只增加丢弃计数
+ *
+ */
+static void udp_socket_handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+    udp_socket_t *sock = entry->arg;
+    uint32_t size = sizeof(udp_socket_dgram_t) + buf->len;
+    if (atomic_load_explicit(&sock->rmem, memory_order_relaxed) + size > sock->rcvbuf)
+    {
+        atomic_fetch_add_explicit(&sock->dropped_mem, 1, memory_order_relaxed);
+        return;
+    }
+    if (ring_count(&sock->ring) == sock->ring.mask + 1)
+    {
+        atomic_fetch_add_explicit(&sock->dropped_ring, 1, memory_order_relaxed);
+        return;
+    }
+    udp_socket_dgram_t *dgram = malloc(size);
+    if (dgram == NULL)
+    {
+        atomic_fetch_add_explicit(&sock->dropped_mem, 1, memory_order_relaxed);
+        return;
+    }
+    memcpy(dgram->src_ip, src_ip, NET_IP_LEN);
+    dgram->src_port = src_port;
+    dgram->len = buf->len;
+    dgram->timestamp_ns = udp_socket_now_ns();
+    memcpy(dgram->data, buf->data, buf->len);
+    atomic_fetch_add_explicit(&sock->rmem, size, memory_order_relaxed);
+    ring_enqueue(&sock->ring, dgram); //只有本线程入队，上面检查过有空位
+    atomic_fetch_add_explicit(&sock->received, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief 打开一个udp套接字，绑定到端口，端口上原有的处理程序被替换
+ *
+ * @param port 端口号
+ * @param ring_size 接收队列长度，须为2的幂，0表示UDP_SOCKET_RING_SIZE
+ * @param rcvbuf 最多占用的接收内存（字节），0表示UDP_SOCKET_RCVBUF
+ * @return udp_socket_t* 套接字，参数错误或内存不足时为NULL
+ */
+udp_socket_t *udp_socket_open(uint16_t port, uint32_t ring_size, uint32_t rcvbuf)
+{
+    udp_socket_t *sock = calloc(1, sizeof(udp_socket_t));
+    if (sock == NULL)
+        return NULL;
+    if (ring_init(&sock->ring, ring_size ? ring_size : UDP_SOCKET_RING_SIZE) != 0)
+    {
+        free(sock);
+        return NULL;
+    }
+    sock->port = port;
+    sock->rcvbuf = rcvbuf ? rcvbuf : UDP_SOCKET_RCVBUF;
+    if (udp_open_arg(port, udp_socket_handler, sock) != 0)
+    {
+        ring_free(&sock->ring);
+        free(sock);
+        return NULL;
+    }
+    return sock;
+}
+
+/**
+ * @brief 批量接收数据报，不阻塞
+ *        一次从接收队列取出最多n个数据报，拷贝到调用者的缓冲区后释放并归还接收内存
+ *
+ * @param sock 套接字
+ * @param msgs 接收的数据报
+ * @param n 最多接收的个数
+ * @return int 实际接收的个数，没有数据报时为0
+ */
+int udp_socket_recv_batch(udp_socket_t *sock, udp_msg_t *msgs, int n)
+{
+    udp_socket_dgram_t *dgrams[64];
+    int total = 0;
+    while (total < n)
+    {
+        int want = n - total < 64 ? n - total : 64;
+        int got = ring_dequeue_burst(&sock->ring, (void **)dgrams, want);
+        uint64_t freed = 0;
+        for (int i = 0; i < got; i++)
+        {
+            udp_msg_t *msg = &msgs[total + i];
+            udp_socket_dgram_t *dgram = dgrams[i];
+            memcpy(msg->buf, dgram->data, dgram->len < msg->buf_len ? dgram->len : msg->buf_len);
+            msg->len = dgram->len;
+            memcpy(msg->src_ip, dgram->src_ip, NET_IP_LEN);
+            msg->src_port = dgram->src_port;
+            msg->timestamp_ns = dgram->timestamp_ns;
+            freed += sizeof(udp_socket_dgram_t) + dgram->len;
+            free(dgram);
+        }
+        atomic_fetch_sub_explicit(&sock->rmem, freed, memory_order_relaxed);
+        total += got;
+        if (got < want)
+            break;
+    }
+    return total;
+}
+
+/**
+ * @brief 获取套接字的计数，可以在任何线程中调用
+ *
+ * @param sock 套接字
+ * @param stats 保存计数
+ */
+void udp_socket_get_stats(udp_socket_t *sock, udp_socket_stats_t *stats)
+{
+    stats->received = atomic_load_explicit(&sock->received, memory_order_relaxed);
+    stats->dropped_ring = atomic_load_explicit(&sock->dropped_ring, memory_order_relaxed);
+    stats->dropped_mem = atomic_load_explicit(&sock->dropped_mem, memory_order_relaxed);
+    stats->rmem = atomic_load_explicit(&sock->rmem, memory_order_relaxed);
+}
+
+/**
+ * @brief 关闭套接字，释放队列中剩余的数据报，须在协议栈线程中调用，且没有线程正在接收
+ *
+ * @param sock 套接字
+ */
+void udp_socket_close(udp_socket_t *sock)
+{
+    udp_close(sock->port);
+    void *dgram;
+    while ((dgram = ring_dequeue(&sock->ring)) != NULL)
+        free(dgram);
+    ring_free(&sock->ring);
+    free(sock);
+}
@@ -29,6 +29,7 @@ void buf_init(buf_t *buf, int len)
 {
     buf->len = len;
     buf->data = buf->payload + BUF_MAX_LEN - len;
+    buf->ifindex = 0;
 }
 
 /**
@@ -65,6 +66,7 @@ void buf_copy(buf_t *dst, buf_t *src)
 {
     buf_init(dst, src->len);
     memcpy(dst->payload, src->payload, BUF_MAX_LEN);
+    dst->ifindex = src->ifindex;
 }
 
 #define swap16(x) ((((x) & 0xFF) << 8) | (((x) >> 8) & 0xFF))
@@ -96,4 +98,46 @@ uint16_t checksum16(uint16_t *buf, int len)
     cksum = ~cksum;
     return (cksum & 0xffff);
 
-}
\ No newline at end of file
+}
+
+/**
+ * @brief 累加16位反码和，不折叠也不取反，用于分段计算校验和
+ *        反码和与字节序无关：按内存中的字节序累加网络字节序的数据，
+ *        折叠取反后的结果同样是网络字节序，不需要逐字交换大小端。
+ *        不超过64KB的数据不会使32位累加和溢出。
+ * 
+ * @param sum 已有的累加和
+ * @param data 要累加的数据
+ * @param len 字节数，奇数长度时末尾补0
+ * @return uint32_t 累加和
+ */
+uint32_t checksum_add(uint32_t sum, const void *data, int len)
+{
+    const uint8_t *p = data;
+    uint16_t word;
+    for (; len > 1; len -= 2, p += 2)
+    {
+        memcpy(&word, p, sizeof(word));
+        sum += word;
+    }
+    if (len)
+    {
+        uint8_t last[2] = {*p, 0};
+        memcpy(&word, last, sizeof(word));
+        sum += word;
+    }
+    return sum;
+}
+
+/**
+ * @brief 折叠累加和并取反，得到可直接写入报头的校验和
+ * 
+ * @param sum checksum_add()得到的累加和
+ * @return uint16_t 网络字节序的校验和
+ */
+uint16_t checksum_fold(uint32_t sum)
+{
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum += sum >> 16;
+    return ~sum;
+}
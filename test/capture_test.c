@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "net.h"
+#include "stack.h"
+#include "capture.h"
+#include "driver.h"
+#include "netif.h"
+#include "faker/fake_driver.h"
+
+/**
+ * 抓包测试：驱动替身把发出的数据帧放回接收队列，按端口过滤抓包，
+ * 读出pcapng文件检查头部、每个网卡一个接口描述、纳秒时间戳精度，以及每个数据帧的内容、长度与收发方向；
+ * 再按方向过滤并每4个采样1个，检查写入的数据帧数与抓包计数。
+ */
+
+#define TEST_PORT_A 7000
+#define TEST_PORT_B 7001
+#define TEST_PORT_C 7002
+#define PAYLOAD_LEN 100
+#define FRAME_LEN (sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + sizeof(udp_hdr_t) + PAYLOAD_LEN)
+
+static int received;
+
+static void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        received++;
+}
+
+/**
+ * @brief pcapng文件中读出的内容
+ *
+ */
+typedef struct capture_file
+{
+        int blocks;          //块数
+        int interfaces;      //接口描述块数
+        int tsresol;         //每个接口描述块都带有纳秒精度时为1
+        int packets;         //数据帧数
+        int rx, tx;          //收发方向的数据帧数
+        int wrong;           //长度、接口或内容不对的数据帧数
+        uint64_t first_ts;   //第一个数据帧的时间戳（纳秒）
+} capture_file_t;
+
+static uint32_t get32(const uint8_t *p)
+{
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+        uint16_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+}
+
+/**
+ * @brief 在块的选项中查找一个选项
+ *
+ * @return const uint8_t* 选项的值，没有时为NULL
+ */
+static const uint8_t *find_opt(const uint8_t *opt, const uint8_t *end, uint16_t code)
+{
+        while (opt + 4 <= end && get16(opt) != 0)
+        {
+                if (get16(opt) == code)
+                        return opt + 4;
+                opt += 4 + (get16(opt + 2) + 3) / 4 * 4;
+        }
+        return NULL;
+}
+
+/**
+ * @brief 读出pcapng文件，检查每个数据帧是端口A收发的数据报
+ *
+ * @return int 成功为0，文件格式错误为-1
+ */
+static int read_capture(const char *path, capture_file_t *file)
+{
+        static uint8_t data[1 << 20];
+        memset(file, 0, sizeof(*file));
+        FILE *fp = fopen(path, "rb");
+        if (fp == NULL)
+                return -1;
+        size_t size = fread(data, 1, sizeof(data), fp);
+        fclose(fp);
+        file->tsresol = 1;
+        for (size_t off = 0; off < size; file->blocks++)
+        {
+                if (off + 12 > size)
+                        return -1;
+                const uint8_t *block = data + off;
+                uint32_t type = get32(block), len = get32(block + 4);
+                if (len < 12 || len % 4 != 0 || off + len > size || get32(block + len - 4) != len)
+                        return -1;
+                if (file->blocks == 0 && (type != 0x0a0d0d0a || get32(block + 8) != 0x1a2b3c4d || get16(block + 12) != 1))
+                        return -1;
+                if (type == 1)
+                {
+                        const uint8_t *resol = find_opt(block + 16, block + len - 4, 9);
+                        if (get16(block + 8) != 1 || get32(block + 12) != NET_CAPTURE_SNAPLEN || resol == NULL || *resol != 9 ||
+                            find_opt(block + 16, block + len - 4, 2) == NULL)
+                                file->tsresol = 0;
+                        file->interfaces++;
+                }
+                else if (type == 6)
+                {
+                        uint32_t cap_len = get32(block + 20), orig_len = get32(block + 24);
+                        const uint8_t *frame = block + 28;
+                        const uint8_t *flags = find_opt(frame + (cap_len + 3) / 4 * 4, block + len - 4, 2);
+                        uint64_t ts = (uint64_t)get32(block + 12) << 32 | get32(block + 16);
+                        if (file->packets++ == 0)
+                                file->first_ts = ts;
+                        if (flags != NULL && get32(flags) == 1)
+                                file->rx++;
+                        else if (flags != NULL && get32(flags) == 2)
+                                file->tx++;
+                        uint16_t dest_port = frame[sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + 2] << 8 |
+                                             frame[sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + 3];
+                        if (get32(block + 8) != 0 || cap_len != FRAME_LEN || orig_len != FRAME_LEN || dest_port != TEST_PORT_A)
+                                file->wrong++;
+                }
+                off += len;
+        }
+        return 0;
+}
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        fake_driver_set(NULL, fake_driver_loopback);
+        uint8_t my_ip[] = DRIVER_IF_IP, my_mac[] = DRIVER_IF_MAC, peer_ip[] = {192, 168, 231, 101};
+        uint8_t payload[PAYLOAD_LEN] = {0};
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/net_capture_test_%d.pcapng", (int)getpid());
+        net_init();
+        netif_add_addr(0, peer_ip, 24);
+        arp_update(my_ip, my_mac, ARP_VALID);
+        arp_update(peer_ip, my_mac, ARP_VALID);
+        udp_open(TEST_PORT_A, handler);
+        udp_open(TEST_PORT_B, handler);
+        udp_open(TEST_PORT_C, handler);
+        net_poll(); //处理初始化时宣告本机地址的arp请求
+
+        // 按端口A过滤：3个发往A的数据报各被抓取一次发送、一次接收，B与C之间的数据报不抓取
+        net_capture_filter_t filter = {.port = TEST_PORT_A};
+        net_capture_stats_t before, after;
+        net_capture_get_stats(&before);
+        struct timespec start;
+        clock_gettime(CLOCK_REALTIME, &start);
+        if (net_capture_start(path, &filter) != 0 || net_capture_start(path, &filter) == 0)
+        {
+                printf("\e[0;31mcapture start wrong\n");
+                result = 1;
+        }
+        for (int i = 0; i < 3; i++)
+        {
+                udp_send(payload, sizeof(payload), TEST_PORT_B, peer_ip, TEST_PORT_A);
+                udp_send(payload, sizeof(payload), TEST_PORT_B, peer_ip, TEST_PORT_C);
+                net_poll();
+        }
+        net_capture_stop();
+        net_capture_get_stats(&after);
+
+        capture_file_t file;
+        uint64_t start_ns = (uint64_t)start.tv_sec * 1000000000 + start.tv_nsec;
+        if (read_capture(path, &file) != 0)
+        {
+                printf("\e[0;31mmalformed pcapng file\n");
+                result = 1;
+        }
+        else if (file.interfaces != NETIF_MAX_IF || !file.tsresol)
+        {
+                printf("\e[0;31mwrong interfaces: %d, nanosecond resolution %d\n", file.interfaces, file.tsresol);
+                result = 1;
+        }
+        else if (file.packets != 6 || file.rx != 3 || file.tx != 3 || file.wrong != 0 || file.first_ts < start_ns)
+        {
+                printf("\e[0;31mwrong packets: %d (rx %d tx %d wrong %d)\n", file.packets, file.rx, file.tx, file.wrong);
+                result = 1;
+        }
+        if (received != 6 || after.matched - before.matched != 6 || after.written - before.written != 6 || after.dropped != before.dropped)
+        {
+                printf("\e[0;31mwrong counters: matched %lu written %lu\n", (unsigned long)(after.matched - before.matched),
+                       (unsigned long)(after.written - before.written));
+                result = 1;
+        }
+
+        // 只抓接收方向，每4个采样1个：8个数据报抓取2个
+        filter.dir = NET_CAPTURE_RX;
+        filter.sample_every = 4;
+        before = after;
+        net_capture_start(path, &filter);
+        for (int i = 0; i < 8; i++)
+        {
+                udp_send(payload, sizeof(payload), TEST_PORT_B, peer_ip, TEST_PORT_A);
+                net_poll();
+        }
+        net_capture_stop();
+        net_capture_get_stats(&after);
+        if (read_capture(path, &file) != 0 || file.packets != 2 || file.rx != 2 || file.wrong != 0 ||
+            after.matched - before.matched != 8 || after.queued - before.queued != 2)
+        {
+                printf("\e[0;31msampling wrong: %d packets written, %lu matched\n", file.packets,
+                       (unsigned long)(after.matched - before.matched));
+                result = 1;
+        }
+
+        // 停止后不再抓包
+        before = after;
+        udp_send(payload, sizeof(payload), TEST_PORT_B, peer_ip, TEST_PORT_A);
+        net_poll();
+        net_capture_get_stats(&after);
+        if (after.matched != before.matched)
+        {
+                printf("\e[0;31mframes captured after stop\n");
+                result = 1;
+        }
+        unlink(path);
+
+        if (result)
+        {
+                printf("\e[1;31m====> Some captures were wrong.\n");
+        }
+        else
+        {
+                printf("\e[1;32m====> All captures were right.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
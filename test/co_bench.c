@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "net.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "udp.h"
+#include "co.h"
+#include "faker/fake_driver.h"
+
+/**
+ * 协程与回调的请求/应答基准测试：驱动替身轮流提供BENCH_PEERS个对端发来的请求（带ip与udp校验和），
+ * 先由udp处理程序直接用udp_send()应答，再由N个协程用CO_RECV()接收、co_send()应答，
+ * 统计每秒应答的请求数。驱动替身只在已提供的请求都得到应答后才提供下一批，测量的是处理能力。
+ *   co_bench [N...]    N默认为1、16与CO_POOL_SIZE
+ */
+
+#define BENCH_REQUESTS (1 << 20)
+#define BENCH_PEERS 64
+#define BENCH_PAYLOAD 64
+#define BENCH_PORT 9000
+#define BENCH_REPLY_PORT 9001
+
+static uint8_t frames[BENCH_PEERS][sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + 8 + BENCH_PAYLOAD];
+static int frame_len = sizeof(frames[0]);
+static uint64_t frame_next, replied;
+
+static int count_replies(driver_t *driver, uint8_t *burst[], uint16_t lens[], int n, int is_burst)
+{
+        replied += n;
+        return n;
+}
+
+static int next_request(driver_t *driver, buf_t *buf)
+{
+        if (frame_next == BENCH_REQUESTS || frame_next - replied >= ETHERNET_RX_BURST)
+                return 0;
+        buf_init(buf, frame_len);
+        memcpy(buf->data, frames[frame_next++ % BENCH_PEERS], frame_len);
+        return frame_len;
+}
+
+static void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        udp_send(buf->data, buf->len, BENCH_PORT, src_ip, BENCH_REPLY_PORT);
+}
+
+static void server(co_t *co)
+{
+        CO_BEGIN(co);
+        while (1)
+        {
+                CO_RECV(co, BENCH_PORT, 0);
+                if (co->result != 0)
+                        break;
+                co_send(co->msg.data, co->msg.len, BENCH_PORT, co->msg.src_ip, BENCH_REPLY_PORT);
+        }
+        CO_END(co);
+}
+
+static double now_s()
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void build_frames()
+{
+        uint8_t my_ip[] = DRIVER_IF_IP, my_mac[] = DRIVER_IF_MAC;
+        for (int i = 0; i < BENCH_PEERS; i++)
+        {
+                ether_hdr_t *eth = (ether_hdr_t *)frames[i];
+                ip_hdr_t *ip = (ip_hdr_t *)(eth + 1);
+                uint8_t *udp = (uint8_t *)(ip + 1);
+                memset(frames[i], 0, frame_len); //每次初始化协议栈后重新构造，校验和须从0算起
+                uint8_t peer_ip[] = {192, 168, 231, 10 + i}, peer_mac[] = {0x02, 0, 0, 0, 0, 10 + i};
+                arp_update(peer_ip, peer_mac, ARP_VALID);
+                memcpy(eth->dest, my_mac, NET_MAC_LEN);
+                memcpy(eth->src, peer_mac, NET_MAC_LEN);
+                eth->protocol = swap16(NET_PROTOCOL_IP);
+                ip->version = IP_VERSION_4;
+                ip->hdr_len = 5;
+                ip->ttl = 64;
+                ip->protocol = NET_PROTOCOL_UDP;
+                ip->total_len = swap16(sizeof(ip_hdr_t) + 8 + BENCH_PAYLOAD);
+                memcpy(ip->src_ip, peer_ip, NET_IP_LEN);
+                memcpy(ip->dest_ip, my_ip, NET_IP_LEN);
+                ip->hdr_checksum = swap16(checksum16((uint16_t *)ip, 10));
+                uint16_t src_port = 5000 + i;
+                udp[0] = src_port >> 8; udp[1] = src_port; udp[2] = BENCH_PORT >> 8; udp[3] = BENCH_PORT & 0xff;
+                udp[4] = (8 + BENCH_PAYLOAD) >> 8; udp[5] = (8 + BENCH_PAYLOAD) & 0xff;
+                for (int j = 0; j < BENCH_PAYLOAD; j++)
+                        udp[8 + j] = i + j;
+                uint32_t sum = checksum_add(checksum_add(0, ip->src_ip, 2 * NET_IP_LEN), udp, 8 + BENCH_PAYLOAD);
+                uint16_t cksum = checksum_fold(sum + swap16(NET_PROTOCOL_UDP) + swap16(8 + BENCH_PAYLOAD));
+                memcpy(udp + 6, &cksum, 2);
+        }
+}
+
+static void report(const char *label, double t)
+{
+        printf("%-16s %8.3f M requests/s (%lu of %d replied)\n", label, BENCH_REQUESTS / t / 1e6,
+               (unsigned long)replied, BENCH_REQUESTS);
+}
+
+int main(int argc, char *argv[])
+{
+        int counts[16] = {1, 16, CO_POOL_SIZE}, runs = 3;
+        if (argc > 1)
+        {
+                runs = argc - 1 < 16 ? argc - 1 : 16;
+                for (int i = 0; i < runs; i++)
+                        counts[i] = atoi(argv[i + 1]);
+        }
+        fake_driver_set(next_request, count_replies);
+        net_init();
+        build_frames();
+
+        // 回调基准
+        udp_open(BENCH_PORT, handler);
+        frame_next = replied = 0; //不计初始化时发送的arp报文
+        double t0 = now_s();
+        while (replied < BENCH_REQUESTS)
+                net_poll();
+        report("callback", now_s() - t0);
+        udp_close(BENCH_PORT);
+
+        for (int r = 0; r < runs; r++)
+        {
+                int n = counts[r] < 1 ? 1 : counts[r] > CO_POOL_SIZE ? CO_POOL_SIZE : counts[r];
+                net_init();
+                build_frames();
+                co_init();
+                co_open(BENCH_PORT);
+                for (int i = 0; i < n; i++)
+                        co_spawn(server, NULL, 0);
+                frame_next = replied = 0;
+                t0 = now_s();
+                while (replied < BENCH_REQUESTS)
+                        co_poll();
+                double t = now_s() - t0;
+                char label[32];
+                snprintf(label, sizeof(label), "%d coroutines", n);
+                report(label, t);
+                co_close(BENCH_PORT);
+                co_run();
+        }
+        return 0;
+}
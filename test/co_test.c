@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <string.h>
+#include "net.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "udp.h"
+#include "co.h"
+#include "faker/fake_driver.h"
+
+/**
+ * 协程测试：等待的协程按开始等待的顺序收到数据报，没有协程等待时数据报暂存、暂存满后丢弃；
+ * 接收超时与睡眠由时间轮唤醒；跨等待点的变量保存在协程帧中；关闭端口时等待的协程以-1恢复；
+ * 协程帧池用完后co_spawn()失败，协程结束后帧被复用；让出的协程在下一次co_run()中运行；协程发送的应答到达驱动。
+ */
+
+#define CO_TEST_PORT 40000
+#define CO_TEST_REPLY_PORT 40001
+
+static uint8_t peer_ip[] = {192, 168, 231, 1}, peer_mac[] = {0x02, 0, 0, 0, 0, 1};
+static int sent;
+static uint32_t sent_seq;
+
+static int capture(driver_t *driver, uint8_t *frames[], uint16_t lens[], int n, int burst)
+{
+        for (int i = 0; i < n; i++)
+        {
+                uint8_t *l4 = frames[i] + sizeof(ether_hdr_t) + sizeof(ip_hdr_t);
+                if (((l4[2] << 8) | l4[3]) == CO_TEST_REPLY_PORT)
+                        memcpy(&sent_seq, l4 + 8, sizeof(sent_seq));
+                sent++;
+        }
+        return n;
+}
+
+/**
+ * @brief 构造并交付一个发往本机的udp数据帧，数据为seq
+ *
+ */
+static void deliver(uint16_t port, uint32_t seq)
+{
+        static buf_t buf;
+        uint8_t my_ip[] = DRIVER_IF_IP, my_mac[] = DRIVER_IF_MAC;
+        int len = sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + 8 + sizeof(seq);
+        buf_init(&buf, len);
+        ether_hdr_t *eth = (ether_hdr_t *)buf.data;
+        ip_hdr_t *ip = (ip_hdr_t *)(eth + 1);
+        uint8_t *l4 = (uint8_t *)(ip + 1);
+        memcpy(eth->dest, my_mac, NET_MAC_LEN);
+        memcpy(eth->src, peer_mac, NET_MAC_LEN);
+        eth->protocol = swap16(NET_PROTOCOL_IP);
+        memset(ip, 0, sizeof(*ip));
+        ip->version = IP_VERSION_4;
+        ip->hdr_len = 5;
+        ip->ttl = 64;
+        ip->protocol = NET_PROTOCOL_UDP;
+        ip->total_len = swap16(sizeof(ip_hdr_t) + 8 + sizeof(seq));
+        memcpy(ip->src_ip, peer_ip, NET_IP_LEN);
+        memcpy(ip->dest_ip, my_ip, NET_IP_LEN);
+        ip->hdr_checksum = swap16(checksum16((uint16_t *)ip, 10));
+        memset(l4, 0, 8);
+        l4[0] = 5000 >> 8; l4[1] = 5000 & 0xff; l4[2] = port >> 8; l4[3] = port & 0xff;
+        l4[5] = 8 + sizeof(seq);
+        memcpy(l4 + 8, &seq, sizeof(seq));
+        buf.ifindex = 0;
+        ethernet_in(&buf);
+}
+
+/**
+ * @brief 接收协程：收到的数据与结果依次记在locals中，收到数据报后以seq + 1应答，超时或端口关闭后结束
+ *
+ */
+typedef struct receiver
+{
+        uint32_t timeout_ms;
+        int count;
+        uint32_t got[8];
+        int results[8];
+        int *done; //结束时置1
+} receiver_t;
+
+static receiver_t *receivers[4];
+
+static void receiver(co_t *co)
+{
+        receiver_t *r = CO_LOCALS(co, receiver_t);
+        CO_BEGIN(co);
+        receivers[r->count] = r; //创建时count为编号
+        r->count = 0;
+        while (r->count < 8)
+        {
+                CO_RECV(co, CO_TEST_PORT, r->timeout_ms);
+                r->results[r->count] = co->result;
+                if (co->result != 0)
+                        break;
+                memcpy(&r->got[r->count], co->msg.data, sizeof(uint32_t));
+                uint32_t reply = r->got[r->count] + 1;
+                co_send((uint8_t *)&reply, sizeof(reply), CO_TEST_PORT, co->msg.src_ip, CO_TEST_REPLY_PORT);
+                r->count++;
+        }
+        *r->done = 1;
+        CO_END(co);
+}
+
+static int sleeper_woke;
+
+static void sleeper(co_t *co)
+{
+        CO_BEGIN(co);
+        CO_SLEEP(co, 30);
+        sleeper_woke = 1;
+        CO_END(co);
+}
+
+static int yields;
+
+static void yielder(co_t *co)
+{
+        CO_BEGIN(co);
+        while (1)
+        {
+                yields++;
+                CO_YIELD(co);
+        }
+        CO_END(co);
+}
+
+static void nothing(co_t *co)
+{
+        CO_BEGIN(co);
+        CO_END(co);
+}
+
+static int spawn_receiver(int id, uint32_t timeout_ms, int *done)
+{
+        receiver_t r = {.timeout_ms = timeout_ms, .count = id, .done = done};
+        return co_spawn(receiver, &r, sizeof(r)) != NULL ? 0 : -1;
+}
+
+/**
+ * @brief 轮询直到cond成立或超过ms毫秒
+ *
+ */
+#define POLL_UNTIL(cond, ms)                                              \
+        do                                                                \
+        {                                                                 \
+                uint64_t deadline = timer_now_ms() + (ms);                \
+                while (!(cond) && timer_now_ms() < deadline)              \
+                        co_poll();                                        \
+        } while (0)
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        fake_driver_set(NULL, capture);
+        net_init();
+        co_init();
+        arp_update(peer_ip, peer_mac, ARP_VALID);
+
+        if (co_open(CO_TEST_PORT) != 0 || co_open(CO_TEST_PORT) != -1)
+        {
+                printf("\e[0;31mco_open accepted a duplicate port\n");
+                result = 1;
+        }
+
+        // 两个协程轮流收到数据报并应答
+        int done[2] = {0};
+        spawn_receiver(0, 0, &done[0]);
+        spawn_receiver(1, 0, &done[1]);
+        co_run();
+        sent = 0;
+        for (uint32_t seq = 0; seq < 6; seq++)
+        {
+                deliver(CO_TEST_PORT, seq);
+                co_run();
+                if (sent_seq != seq + 1)
+                {
+                        printf("\e[0;31mreply to %u carries %u\n", seq, sent_seq);
+                        result = 1;
+                }
+        }
+        if (sent != 6 || receivers[0]->count != 3 || receivers[1]->count != 3 ||
+            receivers[0]->got[1] != 2 || receivers[1]->got[2] != 5)
+        {
+                printf("\e[0;31m%d replies, receivers got %d and %d datagrams out of order\n", sent,
+                       receivers[0]->count, receivers[1]->count);
+                result = 1;
+        }
+
+        // 关闭端口时等待的协程以-1恢复并结束，帧回到池中
+        int active = co_count();
+        co_close(CO_TEST_PORT);
+        co_run();
+        if (!done[0] || !done[1] || co_count() != active - 2 || receivers[0]->results[3] != -1)
+        {
+                printf("\e[0;31mwaiters not woken when the port was closed\n");
+                result = 1;
+        }
+
+        // 没有协程等待时数据报暂存，暂存满后丢弃；之后开始接收的协程不挂起，按到达顺序取出
+        co_open(CO_TEST_PORT);
+        for (uint32_t seq = 100; seq < 100 + CO_BACKLOG + 3; seq++)
+                deliver(CO_TEST_PORT, seq);
+        if (co_dropped(CO_TEST_PORT) != 3)
+        {
+                printf("\e[0;31m%lu datagrams dropped, expect 3\n", (unsigned long)co_dropped(CO_TEST_PORT));
+                result = 1;
+        }
+        done[0] = 0;
+        sent = 0;
+        spawn_receiver(0, 0, &done[0]);
+        co_run();
+        if (!done[0] || receivers[0]->count != 8 || receivers[0]->got[0] != 100 || receivers[0]->got[7] != 107 || sent != 8)
+        {
+                printf("\e[0;31mbacklog not handed out in order\n");
+                result = 1;
+        }
+        co_close(CO_TEST_PORT);
+
+        // 接收超时
+        co_open(CO_TEST_PORT);
+        int timed_out = 0;
+        uint64_t start = timer_now_ms();
+        spawn_receiver(2, 30, &timed_out);
+        POLL_UNTIL(timed_out, 1000);
+        if (!timed_out || timer_now_ms() - start < 30 || receivers[2]->results[0] != -1)
+        {
+                printf("\e[0;31mreceive did not time out after 30ms\n");
+                result = 1;
+        }
+
+        // 数据报先于超时到达时取消定时器
+        int answered = 0;
+        spawn_receiver(3, 20, &answered);
+        co_run();
+        deliver(CO_TEST_PORT, 7);
+        co_run();
+        POLL_UNTIL(0, 60);
+        if (receivers[3]->results[0] != 0 || receivers[3]->got[0] != 7 || receivers[3]->count != 1 || receivers[3]->results[1] != -1)
+        {
+                printf("\e[0;31mdatagram before the timeout not received\n");
+                result = 1;
+        }
+        co_close(CO_TEST_PORT);
+        co_run();
+
+        // 睡眠
+        start = timer_now_ms();
+        co_spawn(sleeper, NULL, 0);
+        co_run();
+        if (sleeper_woke)
+        {
+                printf("\e[0;31msleeper woke immediately\n");
+                result = 1;
+        }
+        POLL_UNTIL(sleeper_woke, 1000);
+        if (!sleeper_woke || timer_now_ms() - start < 30)
+        {
+                printf("\e[0;31msleeper did not wake after 30ms\n");
+                result = 1;
+        }
+
+        // 让出的协程每次co_run()运行一次
+        co_t *y = co_spawn(yielder, NULL, 0);
+        for (int i = 0; i < 5; i++)
+                co_run();
+        if (yields != 5)
+        {
+                printf("\e[0;31myielder ran %d times in 5 rounds\n", yields);
+                result = 1;
+        }
+
+        // 池用完后co_spawn()失败，结束的协程帧被复用
+        int spawned = 0;
+        while (co_spawn(nothing, NULL, 0) != NULL)
+                spawned++;
+        if (co_count() != CO_POOL_SIZE || spawned != CO_POOL_SIZE - 1 || co_spawn(nothing, NULL, CO_LOCAL_SIZE + 1) != NULL)
+        {
+                printf("\e[0;31mpool of %d frames: %d spawned, %d active\n", CO_POOL_SIZE, spawned, co_count());
+                result = 1;
+        }
+        co_run();
+        if (co_count() != 1 || co_spawn(nothing, NULL, 0) == NULL || co_spawn(nothing, NULL, 0) == y)
+        {
+                printf("\e[0;31mfinished frames not returned to the pool\n");
+                result = 1;
+        }
+
+        if (result)
+        {
+                printf("\e[1;31m====> Some coroutines did not run as expected.\n");
+        }
+        else
+        {
+                printf("\e[1;32m====> All coroutines ran as expected.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "net.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "udp.h"
+#include "route.h"
+#include "netif.h"
+#include "drop.h"
+
+/**
+ * 驱动过滤测试：把构造的数据帧写入pcap文件，用driver_open_file()代替网卡打开，
+ * 数据帧经过与真实网卡相同的过滤条件、driver_recv_if()与ethernet_poll()进入协议栈；
+ * 发往本网卡、广播与已加入组播组的数据帧被交付，发往其他主机与本网卡自己发出的数据帧被驱动过滤掉，
+ * 未加入的组播组的数据帧通过驱动后由ip层丢弃。
+ */
+
+#define FILTER_TEST_PORT 30002
+#define FILTER_TEST_FRAMES 6
+
+static uint8_t my_ip[] = DRIVER_IF_IP, my_mac[] = DRIVER_IF_MAC;
+static uint8_t peer_ip[] = {192, 168, 231, 1}, peer_mac[] = {0x02, 0, 0, 0, 0, 1};
+static uint8_t group_ip[] = {239, 1, 1, 1}, other_group_ip[] = {239, 1, 1, 2}, bcast_ip[] = {255, 255, 255, 255};
+static uint8_t group_mac[] = {0x01, 0x00, 0x5e, 0x01, 0x01, 0x01}, other_group_mac[] = {0x01, 0x00, 0x5e, 0x01, 0x01, 0x02};
+static uint8_t bcast_mac[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff}, other_mac[] = {0x02, 0, 0, 0, 0, 0x99};
+static int received[FILTER_TEST_FRAMES + 1];
+
+static void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        if (buf->len == 1 && buf->data[0] <= FILTER_TEST_FRAMES)
+                received[buf->data[0]]++;
+}
+
+/**
+ * @brief 向pcap文件写入一个携带一字节数据seq的udp数据帧
+ *
+ */
+static void write_frame(FILE *fp, const uint8_t *dest_mac, const uint8_t *src_mac, uint8_t *dest_ip, uint8_t seq)
+{
+        uint8_t frame[sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + 8 + 1] = {0};
+        ether_hdr_t *eth = (ether_hdr_t *)frame;
+        ip_hdr_t *ip = (ip_hdr_t *)(eth + 1);
+        uint8_t *udp = (uint8_t *)(ip + 1);
+        memcpy(eth->dest, dest_mac, NET_MAC_LEN);
+        memcpy(eth->src, src_mac, NET_MAC_LEN);
+        eth->protocol = swap16(NET_PROTOCOL_IP);
+        ip->version = IP_VERSION_4;
+        ip->hdr_len = 5;
+        ip->ttl = 64;
+        ip->protocol = NET_PROTOCOL_UDP;
+        ip->total_len = swap16(sizeof(ip_hdr_t) + 8 + 1);
+        memcpy(ip->src_ip, peer_ip, NET_IP_LEN);
+        memcpy(ip->dest_ip, dest_ip, NET_IP_LEN);
+        ip->hdr_checksum = swap16(checksum16((uint16_t *)ip, 10));
+        udp[0] = 5000 >> 8; udp[1] = 5000 & 0xff; udp[2] = FILTER_TEST_PORT >> 8; udp[3] = FILTER_TEST_PORT & 0xff;
+        udp[5] = 8 + 1;
+        udp[8] = seq;
+        uint32_t rec[4] = {0, 0, sizeof(frame), sizeof(frame)}; //时间戳、保存的长度、原长度
+        fwrite(rec, sizeof(rec), 1, fp);
+        fwrite(frame, sizeof(frame), 1, fp);
+}
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/net_driver_filter_test_%d.pcap", (int)getpid());
+        FILE *fp = fopen(path, "wb");
+        uint32_t file_hdr[6] = {0xa1b2c3d4, 2 | 4 << 16, 0, 0, 65535, 1}; //版本2.4，链路类型为以太网
+        fwrite(file_hdr, sizeof(file_hdr), 1, fp);
+        write_frame(fp, group_mac, peer_mac, group_ip, 1);             //已加入的组播组：交付
+        write_frame(fp, my_mac, peer_mac, my_ip, 2);                   //本网卡：交付
+        write_frame(fp, other_mac, peer_mac, my_ip, 3);                //其他主机：驱动过滤
+        write_frame(fp, group_mac, my_mac, group_ip, 4);               //本网卡发出的：驱动过滤
+        write_frame(fp, bcast_mac, peer_mac, bcast_ip, 5);             //广播：交付
+        write_frame(fp, other_group_mac, peer_mac, other_group_ip, 6); //未加入的组播组：ip层丢弃
+        fclose(fp);
+
+        route_init();
+        netif_init();
+        net_if_t *netif = netif_get(0);
+        netif->driver = driver_open_file(path, my_mac); //ethernet_init()不再为该网卡打开驱动
+        if (netif->driver == NULL)
+        {
+                printf("\e[0;31mcannot open %s\n", path);
+                result = 1;
+        }
+        ethernet_init();
+        arp_init();
+        udp_init();
+        netif_join_group(0, group_ip);
+        udp_open(FILTER_TEST_PORT, handler);
+        uint64_t not_for_us = net_drop_get_stats()->counts[NET_DROP_IP_NOT_FOR_US];
+        for (int i = 0; netif->driver != NULL && i < FILTER_TEST_FRAMES; i++)
+                ethernet_poll();
+
+        static const int expect[FILTER_TEST_FRAMES + 1] = {0, 1, 1, 0, 0, 1, 0};
+        for (int i = 1; i <= FILTER_TEST_FRAMES; i++)
+                if (received[i] != expect[i])
+                {
+                        printf("\e[0;31mframe %d delivered %d times, expect %d\n", i, received[i], expect[i]);
+                        result = 1;
+                }
+        if (net_drop_get_stats()->counts[NET_DROP_IP_NOT_FOR_US] - not_for_us != 1)
+        {
+                printf("\e[0;31mframe for a group not joined did not reach ip\n");
+                result = 1;
+        }
+        if (netif->driver != NULL)
+                driver_close_if(netif->driver);
+        unlink(path);
+
+        if (result)
+        {
+                printf("\e[1;31m====> Some frames were not filtered as expected.\n");
+        }
+        else
+        {
+                printf("\e[1;32m====> All frames were filtered as expected.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <string.h>
+#include "net.h"
+#include "stack.h"
+#include "drop.h"
+#include "driver.h"
+#include "netif.h"
+#include "route.h"
+#include "faker/fake_driver.h"
+
+/**
+ * 丢弃计数测试：驱动替身依次交出构造的异常数据帧，每种帧应在对应的层被丢弃并按原因计数一次，
+ * 正常的数据报不计丢弃；转发或发送时出口网卡不存在、转发时TTL耗尽、加入批量发送队列的数据帧过长也按原因计数，批量发送队列中的每个数据帧各计一次；每种原因第一次丢弃时写入丢弃日志，之后每NET_DROP_SAMPLE_EVERY次写一次，
+ * 样本保存丢弃它的那一层的头部；最后检查计数被导出到计数槽。
+ */
+
+#define TEST_PORT 7000
+#define MAX_FRAMES 256
+#define MAX_FRAME_LEN 256
+
+static uint8_t frames[MAX_FRAMES][MAX_FRAME_LEN];
+static uint16_t frame_lens[MAX_FRAMES];
+static int frame_head, frame_tail;
+static int received;
+static uint8_t my_ip[] = DRIVER_IF_IP, my_mac[] = DRIVER_IF_MAC;
+static uint8_t peer_ip[] = {192, 168, 231, 7}, peer_mac[] = {0x02, 0, 0, 0, 0, 7};
+
+//应答与差错报文不送回接收队列，数据帧就地构造在frames中
+static int next_frame(driver_t *driver, buf_t *buf)
+{
+        if (frame_head == frame_tail)
+                return 0;
+        int len = frame_lens[frame_head % MAX_FRAMES];
+        buf_init(buf, len);
+        memcpy(buf->data, frames[frame_head % MAX_FRAMES], len);
+        frame_head++;
+        return len;
+}
+
+static void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        received++;
+}
+
+/**
+ * @brief 在接收队列尾部构造一个以太网帧
+ *
+ * @return uint8_t* 以太网头部之后的位置
+ */
+static uint8_t *eth_frame(uint16_t protocol, int len)
+{
+        uint8_t *f = frames[frame_tail % MAX_FRAMES];
+        memcpy(f, my_mac, NET_MAC_LEN);
+        memcpy(f + 6, peer_mac, NET_MAC_LEN);
+        f[12] = protocol >> 8;
+        f[13] = protocol & 0xff;
+        frame_lens[frame_tail++ % MAX_FRAMES] = sizeof(ether_hdr_t) + len;
+        return f + sizeof(ether_hdr_t);
+}
+
+static void ip_checksum(uint8_t *ip)
+{
+        ip[10] = ip[11] = 0;
+        uint16_t sum = checksum16((uint16_t *)ip, (ip[0] & 0xf) * 2);
+        ip[10] = sum >> 8;
+        ip[11] = sum & 0xff;
+}
+
+/**
+ * @brief 构造一个从对端发来的ip数据报，头部校验和正确
+ *
+ * @return uint8_t* ip头部
+ */
+static uint8_t *ip_frame(uint8_t protocol, const uint8_t *dest_ip, int payload_len)
+{
+        uint8_t *ip = eth_frame(NET_PROTOCOL_IP, 20 + payload_len);
+        memset(ip, 0, 20 + payload_len);
+        ip[0] = 0x45;
+        ip[2] = (20 + payload_len) >> 8;
+        ip[3] = (20 + payload_len) & 0xff;
+        ip[8] = 64;
+        ip[9] = protocol;
+        memcpy(ip + 12, peer_ip, NET_IP_LEN);
+        memcpy(ip + 16, dest_ip, NET_IP_LEN);
+        ip_checksum(ip);
+        return ip;
+}
+
+/**
+ * @brief 构造一个不带校验和的udp数据报
+ *
+ * @return uint8_t* udp头部
+ */
+static uint8_t *udp_frame(uint16_t dest_port, int data_len)
+{
+        uint8_t *udp = ip_frame(NET_PROTOCOL_UDP, my_ip, 8 + data_len) + 20;
+        udp[0] = 0x1f;
+        udp[1] = 0x40;
+        udp[2] = dest_port >> 8;
+        udp[3] = dest_port & 0xff;
+        udp[4] = (8 + data_len) >> 8;
+        udp[5] = (8 + data_len) & 0xff;
+        return udp;
+}
+
+static uint8_t *icmp_frame(uint8_t type, const uint8_t *dest_ip, int len)
+{
+        uint8_t *icmp = ip_frame(NET_PROTOCOL_ICMP, dest_ip, len) + 20;
+        icmp[0] = type;
+        uint16_t sum = checksum16((uint16_t *)icmp, len / 2);
+        icmp[2] = sum >> 8;
+        icmp[3] = sum & 0xff;
+        return icmp;
+}
+
+static void poll_all()
+{
+        while (frame_head != frame_tail)
+                net_poll();
+}
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        fake_driver_set(next_frame, NULL);
+        uint8_t broadcast[] = {255, 255, 255, 255}, elsewhere[] = {10, 9, 9, 9};
+        net_init();
+        arp_update(peer_ip, peer_mac, ARP_VALID);
+        udp_open(TEST_PORT, handler);
+        net_poll();
+        net_drop_ctx_t before = *net_drop_get_stats();
+        uint64_t tx_errors = ethernet_get_driver_stats()->tx_errors;
+
+        // 路由的出口网卡不存在：转发与发送各丢弃一次
+        uint8_t no_if_net[] = {10, 7, 0, 0}, no_if_host[] = {10, 7, 0, 1}, direct[NET_IP_LEN] = {0};
+        route_add(no_if_net, 16, direct, NETIF_MAX_IF - 1);
+        ip_set_forward(1);
+        ip_frame(NET_PROTOCOL_UDP, no_if_host, 8);                   //ip_fwd_no_if
+        uint8_t *ttl_ip = ip_frame(NET_PROTOCOL_UDP, no_if_host, 8); //ip_ttl_exceeded
+        ttl_ip[8] = 1;
+        ip_checksum(ttl_ip);
+        poll_all();
+        ip_set_forward(0);
+        static buf_t out;
+        buf_init(&out, 28);
+        out.ifindex = NETIF_MAX_IF - 1;
+        ethernet_out(&out, peer_mac, NET_PROTOCOL_IP);               //eth_tx_no_if
+        buf_init(&out, ETHERNET_MTU + sizeof(ether_hdr_t) + 1);
+        out.ifindex = 0;
+        ethernet_out_burst(&out);                                    //eth_tx_oversize
+
+        // 每种原因各一个数据帧
+        uint8_t *p;
+        eth_frame(NET_PROTOCOL_IP, 0);
+        frame_lens[(frame_tail - 1) % MAX_FRAMES] = 10;              //eth_truncated
+        eth_frame(0x88b5, 46);                                       //eth_unknown_type
+        eth_frame(NET_PROTOCOL_ARP, 10);                             //arp_truncated
+        p = eth_frame(NET_PROTOCOL_ARP, 28);                         //arp_unsupported：硬件类型为0
+        memset(p, 0, 28);
+        p = ip_frame(NET_PROTOCOL_UDP, my_ip, 8);                    //ip_truncated：总长度超过收到的数据
+        p[3] += 40;
+        ip_checksum(p);
+        p = ip_frame(NET_PROTOCOL_UDP, my_ip, 8);                    //ip_bad_version
+        p[0] = 0x65;
+        p = ip_frame(NET_PROTOCOL_UDP, my_ip, 8);                    //ip_bad_hdr_len
+        p[0] = 0x44;
+        p = ip_frame(NET_PROTOCOL_UDP, my_ip, 8);                    //ip_checksum
+        p[10] ^= 0xff;
+        ip_frame(NET_PROTOCOL_UDP, elsewhere, 8);                    //ip_not_for_us
+        ip_frame(99, my_ip, 8);                                      //ip_unknown_proto
+        ip_frame(NET_PROTOCOL_ICMP, my_ip, 4);                       //icmp_truncated
+        p = icmp_frame(ICMP_TYPE_ECHO_REQUEST, my_ip, 16);           //icmp_checksum
+        p[8] ^= 0xff;
+        icmp_frame(ICMP_TYPE_ECHO_REQUEST, broadcast, 16);           //icmp_not_for_us
+        icmp_frame(13, my_ip, 20);                                   //icmp_unhandled：时间戳请求
+        ip_frame(NET_PROTOCOL_UDP, my_ip, 4);                        //udp_truncated
+        p = udp_frame(TEST_PORT, 8);                                 //udp_bad_len
+        p[5] = 4;
+        p = udp_frame(TEST_PORT, 8);                                 //udp_checksum
+        p[6] = 0x12;
+        udp_frame(TEST_PORT + 1, 8);                                 //udp_no_port
+        udp_frame(TEST_PORT, 8);                                     //正常的数据报
+        poll_all();
+
+        const net_drop_ctx_t *drop = net_drop_get_stats();
+        if (received != 1)
+        {
+                printf("\e[0;31mvalid datagram not delivered\n");
+                result = 1;
+        }
+        for (int i = 0; i < NET_DROP_REASON_COUNT; i++)
+                if (drop->counts[i] - before.counts[i] != 1)
+                {
+                        printf("\e[0;31m%s counted %lu times\n", net_drop_name(i), (unsigned long)(drop->counts[i] - before.counts[i]));
+                        result = 1;
+                }
+
+        // 第一次丢弃都写入了日志，日志中保存丢弃它的那一层的头部
+        if (drop->logged - before.logged != NET_DROP_REASON_COUNT)
+        {
+                printf("\e[0;31m%lu samples logged\n", (unsigned long)(drop->logged - before.logged));
+                result = 1;
+        }
+        const net_drop_sample_t *last = &drop->log[(drop->logged - 1) % NET_DROP_LOG_SIZE];
+        if (last->reason != NET_DROP_UDP_NO_PORT || last->len != 16 || last->cap_len != 16 || last->data[3] != (TEST_PORT + 1) % 256 ||
+            last->ifindex != 0)
+        {
+                printf("\e[0;31mlast sample wrong: %s len %u\n", net_drop_name(last->reason), last->len);
+                result = 1;
+        }
+
+        // 之后每NET_DROP_SAMPLE_EVERY次丢弃采样一次
+        uint64_t logged = drop->logged;
+        for (int i = 0; i < NET_DROP_SAMPLE_EVERY; i++)
+        {
+                udp_frame(TEST_PORT + 1, 8);
+                if (frame_tail - frame_head == MAX_FRAMES)
+                        poll_all();
+        }
+        poll_all();
+        if (drop->logged - logged != 1 || drop->counts[NET_DROP_UDP_NO_PORT] - before.counts[NET_DROP_UDP_NO_PORT] != NET_DROP_SAMPLE_EVERY + 1)
+        {
+                printf("\e[0;31msampling wrong: %lu samples for %d drops\n", (unsigned long)(drop->logged - logged), NET_DROP_SAMPLE_EVERY);
+                result = 1;
+        }
+
+        // 批量发送队列中的数据帧在发送前网卡不存在，每个数据帧计一次
+        uint64_t no_if = drop->counts[NET_DROP_ETH_TX_NO_IF];
+        for (int i = 0; i < 3; i++)
+                ethernet_burst_commit(NETIF_MAX_IF - 1, 60);
+        ethernet_flush();
+        if (drop->counts[NET_DROP_ETH_TX_NO_IF] - no_if != 3 || ethernet_get_driver_stats()->tx_errors - tx_errors != 4 ||
+            ip_get_forward_stats()->no_if != 1)
+        {
+                printf("\e[0;31mdrops without an interface miscounted: burst %lu, tx errors %lu\n",
+                       (unsigned long)(drop->counts[NET_DROP_ETH_TX_NO_IF] - no_if),
+                       (unsigned long)(ethernet_get_driver_stats()->tx_errors - tx_errors));
+                result = 1;
+        }
+
+        // 导出到计数槽
+        static net_stats_slot_t slot;
+        net_stats_collect(&slot);
+        if (slot.drops[NET_DROP_IP_CHECKSUM] != drop->counts[NET_DROP_IP_CHECKSUM] || slot.drop_logged != drop->logged ||
+            memcmp(slot.drop_log, drop->log, sizeof(slot.drop_log)) != 0)
+        {
+                printf("\e[0;31mdrops not exported\n");
+                result = 1;
+        }
+
+        if (result)
+        {
+                printf("\e[1;31m====> Some drops were miscounted.\n");
+        }
+        else
+        {
+                printf("\e[1;32m====> All drops were counted.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
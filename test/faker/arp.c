@@ -14,9 +14,6 @@ char* print_ip(uint8_t *ip);
 char* print_mac(uint8_t *mac);
 void fprint_buf(FILE* f, buf_t* buf);
 
-arp_entry_t arp_table[ARP_MAX_ENTRY];
-arp_buf_t arp_buf;
-
 void arp_update(uint8_t *ip, uint8_t *mac, arp_state_t state)
 {
         fprintf(arp_fout,"arp update:\t");
@@ -25,6 +22,11 @@ void arp_update(uint8_t *ip, uint8_t *mac, arp_state_t state)
         fprintf(arp_fout,"state:%d\n",state);
 }
 
+uint8_t *arp_lookup(uint8_t *ip)
+{
+        return NULL;
+}
+
 void arp_in(buf_t *buf)
 {
         fprintf(arp_fout,"arp_in:");
@@ -1,7 +1,11 @@
 #include <pcap.h>
 #include <string.h>
 #include <utils.h>
+#include "driver.h"
 #include "config.h"
+#include "ethernet.h"
+#include "netif.h"
+#include "fake_driver.h"
 static pcap_t *pcap;
 static pcap_dumper_t *pdump;
 static char pcap_errbuf[PCAP_ERRBUF_SIZE];
@@ -55,6 +59,110 @@ int driver_send(buf_t *buf)
         return 0;
 }
 
+int driver_send_burst(uint8_t *frames[], uint16_t lens[], int n)
+{
+        struct pcap_pkthdr header;
+        memset(&header.ts,0,sizeof(header.ts));
+        for(int i = 0; i < n; i++){
+                header.caplen = lens[i];
+                header.len = lens[i];
+                pcap_dump((u_char *)pdump,&header,frames[i]);
+        }
+        return n;
+}
+
+typedef struct fake_queue
+{
+        uint8_t frames[FAKE_DRIVER_FRAMES][ETHERNET_MTU + sizeof(ether_hdr_t)];
+        uint16_t lens[FAKE_DRIVER_FRAMES];
+        int head, tail;
+} fake_queue_t;
+
+static fake_queue_t fake_queues[FAKE_DRIVER_MAX];
+static char fake_names[FAKE_DRIVER_MAX][NETIF_NAME_LEN];
+static int fake_opened;
+static fake_driver_rx_t fake_rx;
+static fake_driver_tx_t fake_tx;
+
+void fake_driver_set(fake_driver_rx_t rx, fake_driver_tx_t tx)
+{
+        fake_rx = rx;
+        fake_tx = tx;
+}
+
+int fake_driver_push(driver_t *driver, const uint8_t *frame, int len)
+{
+        fake_queue_t *q = &fake_queues[(intptr_t)driver - 1];
+        if (q->tail - q->head == FAKE_DRIVER_FRAMES)
+                return -1;
+        memcpy(q->frames[q->tail % FAKE_DRIVER_FRAMES], frame, len);
+        q->lens[q->tail % FAKE_DRIVER_FRAMES] = len;
+        q->tail++;
+        return 0;
+}
+
+int fake_driver_pop(driver_t *driver, buf_t *buf)
+{
+        fake_queue_t *q = &fake_queues[(intptr_t)driver - 1];
+        if (q->head == q->tail)
+                return 0;
+        int len = q->lens[q->head % FAKE_DRIVER_FRAMES];
+        buf_init(buf, len);
+        memcpy(buf->data, q->frames[q->head % FAKE_DRIVER_FRAMES], len);
+        q->head++;
+        return len;
+}
+
+int fake_driver_loopback(driver_t *driver, uint8_t *frames[], uint16_t lens[], int n, int burst)
+{
+        for (int i = 0; i < n; i++)
+                if (fake_driver_push(driver, frames[i], lens[i]) != 0)
+                        return i;
+        return n;
+}
+
+driver_t *driver_open_if(const char *name, const uint8_t *mac)
+{
+        if (pcap_in == NULL) //没有打开pcap文件时使用内存模式，同名网卡再次打开得到同一个句柄
+        {
+                for (int i = 0; i < fake_opened; i++)
+                        if (strncmp(fake_names[i], name, NETIF_NAME_LEN) == 0)
+                                return (driver_t *)(intptr_t)(i + 1);
+                if (fake_opened == FAKE_DRIVER_MAX)
+                        return NULL;
+                strncpy(fake_names[fake_opened], name, NETIF_NAME_LEN - 1);
+                return (driver_t *)(intptr_t)++fake_opened;
+        }
+        return driver_open() ? NULL : (driver_t *)pcap;
+}
+
+int driver_recv_if(driver_t *driver, buf_t *buf)
+{
+        if (pcap_in == NULL)
+                return fake_rx ? fake_rx(driver, buf) : fake_driver_pop(driver, buf);
+        return driver_recv(buf);
+}
+
+int driver_send_if(driver_t *driver, buf_t *buf)
+{
+        if (pcap_in == NULL)
+                return fake_tx == NULL || fake_tx(driver, &buf->data, &buf->len, 1, 0) == 1 ? 0 : -1;
+        return driver_send(buf);
+}
+
+int driver_send_burst_if(driver_t *driver, uint8_t *frames[], uint16_t lens[], int n)
+{
+        if (pcap_in == NULL)
+                return fake_tx ? fake_tx(driver, frames, lens, n, 1) : n;
+        return driver_send_burst(frames, lens, n);
+}
+
+void driver_close_if(driver_t *driver)
+{
+        if (pcap_in != NULL)
+                driver_close();
+}
+
 void driver_close()
 {
         fprintf(control_flow,"\ndriver closed\n");
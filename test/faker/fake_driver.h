@@ -0,0 +1,57 @@
+#ifndef FAKE_DRIVER_H
+#define FAKE_DRIVER_H
+#include <stdint.h>
+#include "driver.h"
+#include "utils.h"
+
+/**
+ * 驱动替身（faker/driver.c）的内存模式：没有打开pcap文件（pcap_in为NULL）时，
+ * driver_open_if()按网卡第一次打开的顺序返回句柄(driver_t *)1、(driver_t *)2……，同名网卡再次打开得到同一个句柄，
+ * 每个句柄有一个接收队列；
+ * 接收与发送交给fake_driver_set()设置的处理程序，不设置时从接收队列取数据帧，发出的数据帧被丢弃。
+ */
+
+#define FAKE_DRIVER_MAX 2       //内存模式下可打开的网卡数
+#define FAKE_DRIVER_FRAMES 4096 //每个接收队列的数据帧数
+
+/**
+ * @brief 接收处理程序，返回值同driver_recv_if()
+ *
+ */
+typedef int (*fake_driver_rx_t)(driver_t *driver, buf_t *buf);
+
+/**
+ * @brief 发送处理程序，driver_send_if()以n为1、burst为0调用，driver_send_burst_if()以整批数据帧、burst为1调用
+ *
+ * @return int 发送成功的数据帧数
+ */
+typedef int (*fake_driver_tx_t)(driver_t *driver, uint8_t *frames[], uint16_t lens[], int n, int burst);
+
+/**
+ * @brief 设置内存模式的接收与发送处理程序
+ *
+ * @param rx 接收处理程序，为NULL时从接收队列取数据帧
+ * @param tx 发送处理程序，为NULL时丢弃发出的数据帧
+ */
+void fake_driver_set(fake_driver_rx_t rx, fake_driver_tx_t tx);
+
+/**
+ * @brief 把一个数据帧放入网卡的接收队列
+ *
+ * @return int 成功为0，队列已满为-1
+ */
+int fake_driver_push(driver_t *driver, const uint8_t *frame, int len);
+
+/**
+ * @brief 从网卡的接收队列取一个数据帧
+ *
+ * @return int 数据帧长度，队列为空时为0
+ */
+int fake_driver_pop(driver_t *driver, buf_t *buf);
+
+/**
+ * @brief 回环的发送处理程序：发出的数据帧放回同一网卡的接收队列，队列满时停止
+ *
+ */
+int fake_driver_loopback(driver_t *driver, uint8_t *frames[], uint16_t lens[], int n, int burst);
+#endif
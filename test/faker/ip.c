@@ -19,7 +19,7 @@ void ip_in(buf_t *buf)
         fprint_buf(ip_fout, buf);
 }
 
-void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf)
+void ip_fragment_out(buf_t *buf, uint8_t *src_ip, uint8_t *ip, uint8_t *next_hop, net_protocol_t protocol, int id, uint16_t offset, int mf)
 {
         fprintf(ip_fout,"ip_fragment_out:\t");        
         fprintf(ip_fout,"ip: %s\t", print_ip(ip));
@@ -10,7 +10,7 @@ extern FILE *udp_fout;
 char* print_ip(uint8_t *ip);
 void fprint_buf(FILE* f, buf_t* buf);
 
-void udp_in(buf_t *buf, uint8_t *src_ip)
+void udp_in(buf_t *buf, uint8_t *src_ip, uint8_t *dest_ip)
 {
         fprintf(udp_fout,"udp_in:\tsrc_ip:%s\n",print_ip(src_ip));
         fprint_buf(udp_fout, buf);
@@ -5,6 +5,7 @@
 #include <pcap.h>
 #include "arp.h"
 #include "utils.h"
+#include "stack.h"
 
 FILE *control_flow;
 
@@ -28,8 +29,6 @@ FILE *udp_fout;
 FILE *out_log;
 FILE *demo_log;
 
-extern arp_entry_t arp_table[ARP_MAX_ENTRY];
-extern arp_buf_t arp_buf;
 
 char* state[16] = {
         [ARP_PENDING] "pending",
@@ -87,6 +86,8 @@ void fprint_buf(FILE* f, buf_t* buf)
 }
 
 void log_tab_buf(){
+        arp_entry_t *arp_table = net_stack_current()->arp.table;
+        arp_buf_t *arp_buf = &net_stack_current()->arp.buf;
         fprintf(arp_log_f, "<====== arp table =======>\n");
         fprintf(arp_log_f, "state  \ttimeout/10^7\tip\t\t\tmac\n");
         for(int i = 0; i < ARP_MAX_ENTRY; i++){
@@ -99,14 +100,14 @@ void log_tab_buf(){
                 }
         }
         fprintf(arp_log_f, "arp buf: \n");
-        fprintf(arp_log_f, "\tvalid: %d\n",arp_buf.valid);
-        if(arp_buf.valid){
+        fprintf(arp_log_f, "\tvalid: %d\n",arp_buf->valid);
+        if(arp_buf->valid){
                 fprintf(arp_log_f, "\tbuf:");
-                for(int i = 0; i < arp_buf.buf.len; i++){
-                        fprintf(arp_log_f, "%02x ",arp_buf.buf.data[i]);
+                for(int i = 0; i < arp_buf->buf.len; i++){
+                        fprintf(arp_log_f, "%02x ",arp_buf->buf.data[i]);
                 }
-                fprintf(arp_log_f, "\n\tip: %s\n", print_ip(arp_buf.ip));
-                fprintf(arp_log_f, "\tprotocol: %04x\n",arp_buf.protocol);
+                fprintf(arp_log_f, "\n\tip: %s\n", print_ip(arp_buf->ip));
+                fprintf(arp_log_f, "\tprotocol: %04x\n",arp_buf->protocol);
         }
 }
 
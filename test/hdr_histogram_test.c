@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "hdr_histogram.h"
+
+/**
+ * 高动态范围直方图测试：记录跨越多个数量级的值，
+ * 检查百分位数的相对误差不超过有效数字位数决定的精度，最大值精确，清空与累加正确。
+ */
+
+#define HDR_TEST_VALUES 100000
+
+static int64_t values[HDR_TEST_VALUES];
+
+static int cmp(const void *a, const void *b)
+{
+        int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+        return x < y ? -1 : x > y;
+}
+
+static int check_percentile(hdr_histogram_t *h, double p)
+{
+        int64_t rank = (int64_t)(p / 100 * HDR_TEST_VALUES + 0.999999);
+        if (rank < 1)
+                rank = 1;
+        int64_t expect = values[rank - 1], got = hdr_value_at_percentile(h, p);
+        if (got < expect || got > expect + expect / 1000 + 1)
+        {
+                printf("\e[0;31mp%g: got %ld, expect %ld within 0.1%%\n", p, (long)got, (long)expect);
+                return 1;
+        }
+        return 0;
+}
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        hdr_histogram_t h, sum;
+        if (hdr_init(&h, 1, 10000000000, 3) || hdr_init(&sum, 1, 10000000000, 3))
+        {
+                printf("\e[0;31mhdr_init failed\n");
+                return 1;
+        }
+
+        // 1纳秒到10秒之间按对数均匀分布的值
+        srand(1);
+        for (int i = 0; i < HDR_TEST_VALUES; i++)
+        {
+                int magnitude = rand() % 33;
+                values[i] = ((int64_t)1 << magnitude) + rand() % ((int64_t)1 << magnitude);
+                if (values[i] > 10000000000)
+                        values[i] = 10000000000;
+                hdr_record(&h, values[i]);
+        }
+        qsort(values, HDR_TEST_VALUES, sizeof(values[0]), cmp);
+
+        double percentiles[] = {0, 1, 25, 50, 90, 99, 99.9, 99.99, 100};
+        for (int i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++)
+                result |= check_percentile(&h, percentiles[i]);
+        if (h.total != HDR_TEST_VALUES || h.max != values[HDR_TEST_VALUES - 1] || h.min != values[0])
+        {
+                printf("\e[0;31mtotal %ld min %ld max %ld\n", (long)h.total, (long)h.min, (long)h.max);
+                result = 1;
+        }
+
+        // 累加两次后百分位数不变，计数加倍
+        hdr_add(&sum, &h);
+        hdr_add(&sum, &h);
+        if (sum.total != 2 * HDR_TEST_VALUES || hdr_value_at_percentile(&sum, 99) != hdr_value_at_percentile(&h, 99))
+        {
+                printf("\e[0;31mhdr_add: total %ld\n", (long)sum.total);
+                result = 1;
+        }
+
+        // 清空后没有记录，超出范围的值按最大值记录
+        hdr_reset(&h);
+        if (h.total != 0 || hdr_value_at_percentile(&h, 50) != 0)
+        {
+                printf("\e[0;31mhdr_reset left %ld values\n", (long)h.total);
+                result = 1;
+        }
+        hdr_record(&h, 20000000000);
+        hdr_record(&h, -5);
+        if (h.max != 10000000000 || h.min != 0)
+        {
+                printf("\e[0;31mout of range values: min %ld max %ld\n", (long)h.min, (long)h.max);
+                result = 1;
+        }
+        hdr_free(&h);
+        hdr_free(&sum);
+
+        if (result)
+        {
+                printf("\e[1;31m====> Some percentiles were not accurate.\n");
+        }
+        else
+        {
+                printf("\e[1;32m====> All percentiles were accurate.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
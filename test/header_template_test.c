@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <string.h>
+#include "net.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "icmp.h"
+#include "udp.h"
+#include "route.h"
+#include "netif.h"
+#include "faker/fake_driver.h"
+
+/**
+ * 头部模板测试：用驱动替身截获发出的数据帧，
+ * 检查按模板构造的arp请求、ip分片（同一数据报的分片共用标识，不同数据报标识不同）、icmp回显应答与差错报文的字段正确，
+ * 增量或分段计算的校验和与对整个头部（报文）重新计算的结果一致；
+ * 差错报文带回的原数据报不超过原数据报本身，关于icmp差错、非第一个分片与广播、组播或0.0.0.0源地址的数据报不发送差错报文。
+ */
+
+#define TEMPLATE_TEST_FRAMES 16
+
+static uint8_t frames[TEMPLATE_TEST_FRAMES][ETHERNET_MTU + sizeof(ether_hdr_t)];
+static int lens[TEMPLATE_TEST_FRAMES];
+static int frame_count;
+
+static int capture(driver_t *driver, uint8_t *burst[], uint16_t burst_lens[], int n, int is_burst)
+{
+        for (int i = 0; i < n && frame_count < TEMPLATE_TEST_FRAMES; i++, frame_count++)
+        {
+                memcpy(frames[frame_count], burst[i], burst_lens[i]);
+                lens[frame_count] = burst_lens[i];
+        }
+        return n;
+}
+
+static uint8_t my_ip[] = DRIVER_IF_IP, my_mac[] = DRIVER_IF_MAC;
+static uint8_t peer_ip[] = {192, 168, 231, 1}, peer_mac[] = {0x02, 0, 0, 0, 0, 1};
+
+/**
+ * @brief 交付一个从src_ip发往dest_ip的ip数据报，数据部分为payload的前len字节，返回发出的数据帧数
+ *
+ */
+static int deliver_ip(uint8_t *src_ip, uint8_t *dest_ip, uint8_t protocol, uint8_t ttl, uint16_t frag, const uint8_t *payload, int len)
+{
+        static buf_t buf;
+        buf_init(&buf, sizeof(ip_hdr_t) + len);
+        ip_hdr_t *ip = (ip_hdr_t *)buf.data;
+        memset(ip, 0, sizeof(ip_hdr_t));
+        ip->version = IP_VERSION_4;
+        ip->hdr_len = 5;
+        ip->total_len = swap16(sizeof(ip_hdr_t) + len);
+        ip->flags_fragment = swap16(frag);
+        ip->ttl = ttl;
+        ip->protocol = protocol;
+        memcpy(ip->src_ip, src_ip, NET_IP_LEN);
+        memcpy(ip->dest_ip, dest_ip, NET_IP_LEN);
+        ip->hdr_checksum = swap16(checksum16((uint16_t *)ip, 10));
+        memcpy(ip + 1, payload, len);
+        buf.ifindex = 0;
+        frame_count = 0;
+        ip_in(&buf);
+        return frame_count;
+}
+
+/**
+ * @brief 检查数据帧的ip头部，返回ip头部，出错时为NULL
+ *
+ */
+static ip_hdr_t *check_ip(int i, int protocol, const char *what)
+{
+        ip_hdr_t *ip = (ip_hdr_t *)(frames[i] + sizeof(ether_hdr_t));
+        if (lens[i] < sizeof(ether_hdr_t) + sizeof(ip_hdr_t) || memcmp(frames[i], peer_mac, NET_MAC_LEN) ||
+            ip->version != IP_VERSION_4 || ip->hdr_len != 5 || ip->ttl != 64 || ip->protocol != protocol ||
+            swap16(ip->total_len) != lens[i] - sizeof(ether_hdr_t) || checksum16((uint16_t *)ip, 10) != 0 ||
+            memcmp(ip->src_ip, my_ip, NET_IP_LEN) || memcmp(ip->dest_ip, peer_ip, NET_IP_LEN))
+        {
+                printf("\e[0;31m%s: frame %d has a malformed ip header\n", what, i);
+                return NULL;
+        }
+        return ip;
+}
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        fake_driver_set(NULL, capture);
+        route_init();
+        netif_init();
+        ethernet_init();
+        arp_init();
+        icmp_init();
+        udp_init();
+
+        // arp请求
+        static uint8_t data[4000];
+        for (int i = 0; i < sizeof(data); i++)
+                data[i] = i * 7 + 3;
+        frame_count = 0;
+        udp_send(data, 8, 60000, peer_ip, 60001);
+        arp_pkt_t *req = (arp_pkt_t *)(frames[0] + sizeof(ether_hdr_t));
+        buf_t arp_buf_view = {.len = lens[0] - sizeof(ether_hdr_t), .data = (uint8_t *)req};
+        uint8_t zero_mac[NET_MAC_LEN] = {0};
+        if (frame_count != 1 || memcmp(frames[0], "\xff\xff\xff\xff\xff\xff", NET_MAC_LEN) || arp_pkt_of(&arp_buf_view) == NULL ||
+            req->opcode != swap16(ARP_REQUEST) || memcmp(req->sender_mac, my_mac, NET_MAC_LEN) ||
+            memcmp(req->sender_ip, my_ip, NET_IP_LEN) || memcmp(req->target_mac, zero_mac, NET_MAC_LEN) ||
+            memcmp(req->target_ip, peer_ip, NET_IP_LEN))
+        {
+                printf("\e[0;31marp request is malformed\n");
+                result = 1;
+        }
+        arp_update(peer_ip, peer_mac, ARP_VALID);
+
+        // ip分片共用一个模板
+        frame_count = 0;
+        udp_send(data, sizeof(data), 60000, peer_ip, 60001);
+        int offset = 0;
+        for (int i = 0; i < frame_count; i++)
+        {
+                ip_hdr_t *ip = check_ip(i, NET_PROTOCOL_UDP, "fragment");
+                if (ip == NULL)
+                {
+                        result = 1;
+                        continue;
+                }
+                uint16_t flags = swap16(ip->flags_fragment);
+                int mf = i + 1 < frame_count;
+                if ((flags & 0x1fff) * IP_HDR_OFFSET_PER_BYTE != offset || !!(flags & (IP_MORE_FRAGMENT << 8)) != mf)
+                {
+                        printf("\e[0;31mfragment %d: flags %04x, expect offset %d\n", i, flags, offset);
+                        result = 1;
+                }
+                offset += swap16(ip->total_len) - sizeof(ip_hdr_t);
+        }
+        if (frame_count < 3 || offset != 8 + sizeof(data))
+        {
+                printf("\e[0;31m%d fragments carry %d bytes\n", frame_count, offset);
+                result = 1;
+        }
+
+        // 同一数据报的分片共用一个标识，下一个数据报换一个标识
+        uint16_t first_id = ((ip_hdr_t *)(frames[0] + sizeof(ether_hdr_t)))->id;
+        for (int i = 1; i < frame_count; i++)
+                if (((ip_hdr_t *)(frames[i] + sizeof(ether_hdr_t)))->id != first_id)
+                {
+                        printf("\e[0;31mfragment %d has a different id\n", i);
+                        result = 1;
+                }
+        frame_count = 0;
+        udp_send(data, sizeof(data), 60000, peer_ip, 60001);
+        if (frame_count == 0 || ((ip_hdr_t *)(frames[0] + sizeof(ether_hdr_t)))->id == first_id)
+        {
+                printf("\e[0;31mtwo datagrams share id %u\n", swap16(first_id));
+                result = 1;
+        }
+
+        // 回显应答增量修正的校验和
+        for (int len = 0; len <= 1000; len += 50)
+        {
+                static buf_t buf;
+                buf_init(&buf, sizeof(icmp_hdr_t) + len);
+                icmp_hdr_t *echo = (icmp_hdr_t *)buf.data;
+                echo->type = ICMP_TYPE_ECHO_REQUEST;
+                echo->code = 0;
+                echo->checksum = 0;
+                echo->id = swap16(0x1234);
+                echo->seq = swap16(len);
+                memcpy(echo + 1, data + len, len);
+                echo->checksum = checksum_fold(checksum_add(0, buf.data, buf.len));
+                frame_count = 0;
+                icmp_in(&buf, peer_ip, my_ip);
+                ip_hdr_t *ip = frame_count == 1 ? check_ip(0, NET_PROTOCOL_ICMP, "echo reply") : NULL;
+                icmp_hdr_t *reply = (icmp_hdr_t *)(ip + 1);
+                if (ip == NULL || swap16(ip->total_len) != sizeof(ip_hdr_t) + sizeof(icmp_hdr_t) + len ||
+                    reply->type != ICMP_TYPE_ECHO_REPLY || reply->code != 0 || reply->seq != swap16(len) ||
+                    checksum_fold(checksum_add(0, reply, sizeof(icmp_hdr_t) + len)) != 0 || memcmp(reply + 1, data + len, len))
+                {
+                        printf("\e[0;31mecho reply of %d bytes is malformed\n", len);
+                        result = 1;
+                }
+        }
+
+        // 差错报文
+        {
+                static buf_t buf;
+                buf_init(&buf, 8 + 4);
+                uint8_t *p = buf.data;
+                memset(p, 0, 12);
+                p[0] = 5000 >> 8; p[1] = 5000 & 0xff; p[2] = 60099 >> 8; p[3] = 60099 & 0xff;
+                p[5] = 12;
+                memcpy(p + 8, "ping", 4);
+                frame_count = 0;
+                udp_in(&buf, peer_ip, my_ip);
+                ip_hdr_t *ip = frame_count == 1 ? check_ip(0, NET_PROTOCOL_ICMP, "port unreachable") : NULL;
+                icmp_hdr_t *err = (icmp_hdr_t *)(ip + 1);
+                ip_hdr_t *orig = (ip_hdr_t *)(err + 1);
+                if (ip == NULL || swap16(ip->total_len) != sizeof(ip_hdr_t) + sizeof(icmp_hdr_t) + 28 ||
+                    err->type != ICMP_TYPE_UNREACH || err->code != ICMP_CODE_PORT_UNREACH || err->id != 0 || err->seq != 0 ||
+                    checksum_fold(checksum_add(0, err, sizeof(icmp_hdr_t) + 28)) != 0 ||
+                    memcmp(orig->src_ip, peer_ip, NET_IP_LEN) || memcmp(orig + 1, p, 8))
+                {
+                        printf("\e[0;31mport unreachable is malformed\n");
+                        result = 1;
+                }
+        }
+
+        // 短于ip头部加8字节的数据报只带回数据报本身
+        {
+                ip_hdr_t *ip = deliver_ip(peer_ip, my_ip, 99, 64, 0, data, 2) == 1 ? check_ip(0, NET_PROTOCOL_ICMP, "protocol unreachable") : NULL;
+                icmp_hdr_t *err = (icmp_hdr_t *)(ip + 1);
+                if (ip == NULL || swap16(ip->total_len) != sizeof(ip_hdr_t) + sizeof(icmp_hdr_t) + 22 ||
+                    err->type != ICMP_TYPE_UNREACH || err->code != ICMP_CODE_PROTOCOL_UNREACH ||
+                    checksum_fold(checksum_add(0, err, sizeof(icmp_hdr_t) + 22)) != 0 || memcmp((uint8_t *)(err + 1) + 20, data, 2))
+                {
+                        printf("\e[0;31mprotocol unreachable for a short datagram is malformed\n");
+                        result = 1;
+                }
+        }
+
+        // 不发送差错报文的数据报，TTL耗尽的回显请求作为对照
+        {
+                uint8_t elsewhere[] = {10, 9, 9, 9}, any[] = {0, 0, 0, 0}, group[] = {224, 0, 0, 5};
+                uint8_t bcast[] = {255, 255, 255, 255}, subnet_bcast[] = {192, 168, 231, 255};
+                uint8_t echo[8] = {ICMP_TYPE_ECHO_REQUEST}, unreach[8] = {ICMP_TYPE_UNREACH, ICMP_CODE_PORT_UNREACH};
+                ip_set_forward(1);
+                int echo_errors = deliver_ip(peer_ip, elsewhere, NET_PROTOCOL_ICMP, 1, 0, echo, 8);
+                int sent = deliver_ip(peer_ip, elsewhere, NET_PROTOCOL_ICMP, 1, 0, unreach, 8);
+                ip_set_forward(0);
+                sent += deliver_ip(peer_ip, my_ip, 99, 64, 185, data, 8);
+                sent += deliver_ip(any, my_ip, 99, 64, 0, data, 8);
+                sent += deliver_ip(group, my_ip, 99, 64, 0, data, 8);
+                sent += deliver_ip(bcast, my_ip, 99, 64, 0, data, 8);
+                sent += deliver_ip(subnet_bcast, my_ip, 99, 64, 0, data, 8);
+                if (echo_errors != 1 || sent != 0)
+                {
+                        printf("\e[0;31m%d errors for an expired echo request, %d errors where none are allowed\n", echo_errors, sent);
+                        result = 1;
+                }
+        }
+
+        if (result)
+        {
+                printf("\e[1;31m====> Some packets were not built as expected.\n");
+        }
+        else
+        {
+                printf("\e[1;32m====> All packets were built as expected.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "net.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "icmp.h"
+#include "udp.h"
+#include "route.h"
+#include "netif.h"
+
+/**
+ * icmp差错限速测试：向未打开的端口交付udp数据报，
+ * 检查按地址与全局的令牌桶分别限制端口不可达报文的数量，
+ * 被抑制的报文计入抑制计数，令牌随时间补充，速率为0时不限制。
+ */
+
+static uint8_t my_ip[] = DRIVER_IF_IP;
+
+/**
+ * @brief 从src_ip向未打开的60099端口交付一个udp数据报
+ *
+ */
+static void deliver(uint8_t *src_ip)
+{
+        static buf_t buf;
+        buf_init(&buf, 8 + 4);
+        uint8_t *p = buf.data;
+        memset(p, 0, 12);
+        p[0] = 5000 >> 8; p[1] = 5000 & 0xff; p[2] = 60099 >> 8; p[3] = 60099 & 0xff;
+        p[5] = 12;
+        udp_in(&buf, src_ip, my_ip);
+}
+
+/**
+ * @brief 检查上次检查以来的计数，令牌在测试过程中仍会补充，发送数允许多出slack个
+ *
+ */
+static int expect(const char *what, int total, uint64_t sent, int slack, int by_src)
+{
+        static icmp_error_stats_t last;
+        const icmp_error_stats_t *now = icmp_get_error_stats();
+        icmp_error_stats_t delta = {now->sent - last.sent, now->suppressed_global - last.suppressed_global,
+                                    now->suppressed_src - last.suppressed_src};
+        last = *now;
+        uint64_t suppressed = by_src ? delta.suppressed_src : delta.suppressed_global;
+        uint64_t other = by_src ? delta.suppressed_global : delta.suppressed_src;
+        if (delta.sent < sent || delta.sent > sent + slack || delta.sent + suppressed != total || other != 0)
+        {
+                printf("\e[0;31m%s: sent %lu, suppressed %lu by source and %lu globally, expect %lu sent\n", what,
+                       (unsigned long)delta.sent, (unsigned long)delta.suppressed_src, (unsigned long)delta.suppressed_global,
+                       (unsigned long)sent);
+                return 1;
+        }
+        return 0;
+}
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        route_init();
+        netif_init();
+        ethernet_init();
+        arp_init();
+        icmp_init();
+        udp_init();
+
+        // 同一地址的扫描只得到按地址令牌桶容量个应答
+        uint8_t scanner[] = {192, 168, 231, 1};
+        for (int i = 0; i < 100; i++)
+                deliver(scanner);
+        result |= expect("single source", 100, ICMP_BURST_PER_SRC, 1, 1);
+
+        // 令牌随时间补充
+        struct timespec ts = {0, 1000000000 / ICMP_RATE_PER_SRC * 2 + 50000000};
+        nanosleep(&ts, NULL);
+        for (int i = 0; i < 10; i++)
+                deliver(scanner);
+        result |= expect("refill", 10, 2, 1, 1);
+
+        // 大量地址时由全局令牌桶限制，等待期间全局令牌桶已补满，上一步用掉了2个
+        for (int i = 0; i < 200; i++)
+        {
+                uint8_t src[] = {10, 0, i >> 8, i};
+                deliver(src);
+        }
+        result |= expect("many sources", 200, ICMP_BURST_GLOBAL - 2, 5, 0);
+
+        // 速率为0时不限制
+        icmp_rate_limit_t unlimited = {0, 0, 0, 0};
+        icmp_set_rate_limit(&unlimited);
+        for (int i = 0; i < 100; i++)
+                deliver(scanner);
+        result |= expect("unlimited", 100, 100, 0, 1);
+
+        if (result)
+        {
+                printf("\e[1;31m====> Some icmp errors were not limited as expected.\n");
+        }
+        else
+        {
+                printf("\e[1;32m====> All icmp errors were limited as expected.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
@@ -3,6 +3,7 @@
 #include "driver.h"
 #include "ethernet.h"
 #include "arp.h"
+#include "icmp.h"
 #include "ip.h"
 
 extern FILE *pcap_in;
@@ -51,6 +52,7 @@ int main(){
                 return 0;
         }
         arp_init();
+        icmp_init();
         log_tab_buf();
         int i = 1;
         printf("\e[0;34mFeeding input %02d",i);
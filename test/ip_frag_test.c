@@ -29,7 +29,8 @@ int main()
                 buf.len++;
         }
         printf("\e[0;34mFeeding input.\n");
-        ip_out(&buf,net_if_ip,NET_PROTOCOL_TCP);
+        uint8_t if_ip[] = DRIVER_IF_IP;
+        ip_out(&buf,if_ip,NET_PROTOCOL_TCP);
 
         fclose(in);
         fclose(control_flow);
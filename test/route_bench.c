@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "route.h"
+
+#define BENCH_PREFIXES 4000
+#define BENCH_LOOKUPS (1 << 22)
+
+static uint32_t mask(int len)
+{
+        return len == 0 ? 0 : 0xffffffffu << (32 - len);
+}
+
+static double now_ns()
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * 前缀长度分布参考公网BGP表：过半为/24，其余集中在/16~/23，
+ * 少量/8~/15与长于/24的主机路由，另有一条默认路由。
+ */
+static int pick_len()
+{
+        int r = rand() % 100;
+        if(r < 55) return 24;
+        if(r < 85) return 16 + rand() % 8;
+        if(r < 92) return 8 + rand() % 8;
+        return 25 + rand() % 8;
+}
+
+int main()
+{
+        static uint32_t nets[BENCH_PREFIXES];
+        static int lens[BENCH_PREFIXES];
+        uint8_t (*addrs)[4] = malloc(BENCH_LOOKUPS * 4);
+        srand(2020);
+
+        double t0 = now_ns();
+        for(int i = 0; i < BENCH_PREFIXES; i++){
+                lens[i] = pick_len();
+                nets[i] = (((uint32_t)rand() << 16) ^ rand()) & mask(lens[i]);
+                uint8_t net[4] = {nets[i] >> 24, nets[i] >> 16, nets[i] >> 8, nets[i]};
+                uint8_t gw[4] = {10, i >> 16, i >> 8, i};
+                route_add(net, lens[i], gw, 0);
+        }
+        uint8_t any[4] = {0}, def_gw[4] = {10, 255, 255, 254};
+        route_add(any, 0, def_gw, 0);
+        double t1 = now_ns();
+        printf("add %d prefixes: %.1f us/prefix\n", BENCH_PREFIXES, (t1 - t0) / 1e3 / BENCH_PREFIXES);
+
+        // 一半目的地址命中随机前缀，一半为随机地址（多数走默认路由）
+        for(int i = 0; i < BENCH_LOOKUPS; i++){
+                uint32_t v;
+                if(i & 1){
+                        int p = rand() % BENCH_PREFIXES;
+                        v = nets[p] | (((uint32_t)rand() << 16 ^ rand()) & ~mask(lens[p]));
+                }else{
+                        v = ((uint32_t)rand() << 16) ^ rand();
+                }
+                addrs[i][0] = v >> 24; addrs[i][1] = v >> 16; addrs[i][2] = v >> 8; addrs[i][3] = v;
+        }
+
+        uintptr_t sink = 0;
+        for(int round = 0; round < 3; round++){
+                t0 = now_ns();
+                for(int i = 0; i < BENCH_LOOKUPS; i++)
+                        sink += (uintptr_t)route_lookup(addrs[i], NULL);
+                t1 = now_ns();
+                printf("lookup round %d: %.2f ns/lookup\n", round, (t1 - t0) / BENCH_LOOKUPS);
+        }
+        free(addrs);
+        return sink == 0;
+}
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "route.h"
+
+#define ROUTE_TEST_PREFIXES 2000
+#define ROUTE_TEST_LOOKUPS 200000
+
+typedef struct ref_route
+{
+        int valid;
+        uint32_t net;
+        int len;
+        uint8_t gw[4];
+} ref_route_t;
+
+ref_route_t ref[ROUTE_TEST_PREFIXES];
+
+static char* print_ip(uint8_t *ip)
+{
+        static char result[4][32];
+        static int which;
+        which = (which + 1) % 4;
+        sprintf(result[which],"%d.%d.%d.%d",ip[0],ip[1],ip[2],ip[3]);
+        return result[which];
+}
+
+static uint32_t mask(int len)
+{
+        return len == 0 ? 0 : 0xffffffffu << (32 - len);
+}
+
+static void u32_to_ip(uint32_t v, uint8_t *ip)
+{
+        ip[0] = v >> 24; ip[1] = v >> 16; ip[2] = v >> 8; ip[3] = v;
+}
+
+// 线性扫描的参考实现
+static uint8_t *ref_lookup(uint8_t *ip, uint8_t *def_gw)
+{
+        uint32_t v = ((uint32_t)ip[0] << 24) | (ip[1] << 16) | (ip[2] << 8) | ip[3];
+        int best = -1;
+        for(int i = 0; i < ROUTE_TEST_PREFIXES; i++){
+                if(ref[i].valid && (v & mask(ref[i].len)) == ref[i].net &&
+                   (best == -1 || ref[i].len > ref[best].len))
+                        best = i;
+        }
+        if(best == -1)
+                return def_gw ? def_gw : ip;
+        static const uint8_t zero[4] = {0};
+        return memcmp(ref[best].gw,zero,4) ? ref[best].gw : ip;
+}
+
+static int check(const char *name, uint8_t *def_gw)
+{
+        int diff = 0;
+        for(int i = 0; i < ROUTE_TEST_LOOKUPS && diff < 5; i++){
+                uint8_t ip[4];
+                if(i & 1){
+                        ref_route_t *r = &ref[rand() % ROUTE_TEST_PREFIXES];
+                        u32_to_ip(r->net | (rand() & ~mask(r->len)),ip);
+                }else{
+                        u32_to_ip(((uint32_t)rand() << 16) ^ rand(),ip);
+                }
+                uint8_t *expect = ref_lookup(ip,def_gw);
+                uint8_t *got = route_lookup(ip,NULL);
+                if(memcmp(expect,got,4)){
+                        printf("\e[0;31m%s: lookup %s expect %s got %s\n",
+                               name,print_ip(ip),print_ip(expect),print_ip(got));
+                        diff++;
+                }
+        }
+        if(diff == 0)
+                printf("\e[0;32m%s: no differences\n",name);
+        return diff;
+}
+
+int main()
+{
+        int result = 0;
+        srand(2020);
+        printf("\e[0;34mTest begin.\n");
+        for(int i = 0; i < ROUTE_TEST_PREFIXES; i++){
+                int r = rand() % 100;
+                ref[i].len = r < 50 ? 24 : r < 70 ? 16 + rand() % 8 : r < 85 ? 25 + rand() % 8 : 8 + rand() % 8;
+                ref[i].net = (((uint32_t)rand() << 16) ^ rand()) & mask(ref[i].len);
+                if(i % 10 == 0) // 一部分前缀落在已有前缀之内，检查嵌套的情况
+                        ref[i].net = (ref[i / 2].net | (rand() & ~mask(ref[i / 2].len))) & mask(ref[i].len);
+                u32_to_ip(0x0a000001 + i,ref[i].gw);
+                if(i % 7 == 0)
+                        memset(ref[i].gw,0,4);
+                for(int j = 0; j < i; j++) // 去除重复前缀
+                        if(ref[j].valid && ref[j].len == ref[i].len && ref[j].net == ref[i].net)
+                                ref[j].valid = 0;
+                ref[i].valid = 1;
+                uint8_t net[4];
+                u32_to_ip(ref[i].net,net);
+                if(route_add(net,ref[i].len,ref[i].gw,0)){
+                        printf("\e[0;31mroute_add failed\n");
+                        return 1;
+                }
+        }
+        result |= check("Add",NULL);
+
+        uint8_t def_gw[4] = {10,255,255,254}, any[4] = {0};
+        route_add(any,0,def_gw,0);
+        result |= check("Default",def_gw);
+
+        for(int i = 0; i < ROUTE_TEST_PREFIXES; i += 3){
+                if(!ref[i].valid)
+                        continue;
+                uint8_t net[4];
+                u32_to_ip(ref[i].net,net);
+                if(route_del(net,ref[i].len)){
+                        printf("\e[0;31mroute_del failed\n");
+                        result = 1;
+                }
+                ref[i].valid = 0;
+        }
+        result |= check("Delete",def_gw);
+
+        route_del(any,0);
+        result |= check("Delete default",NULL);
+
+        if(result){
+                printf("\e[1;31m====> Some lookups are different to the reference.\n");
+        }else{
+                printf("\e[1;32m====> All lookups are the same to the reference.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "net.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "ip.h"
+#include "udp.h"
+#include "shard.h"
+#include "faker/fake_driver.h"
+
+/**
+ * 分片模式扩展性基准测试：驱动替身轮流提供BENCH_FLOWS条流的udp数据帧（带ip与udp校验和），
+ * 先在调用线程中用net_poll()处理作为单线程基准，再分别用1到N个工作线程处理，
+ * 统计每秒处理的数据帧数。驱动替身只在未处理的数据帧少于接收队列容量时提供数据帧，测量的是处理能力而不是丢包率。
+ *   shard_bench [N]    N默认为在线的cpu数
+ */
+
+#define BENCH_FRAMES (1 << 20)
+#define BENCH_FLOWS 1024
+#define BENCH_PAYLOAD 1000
+#define BENCH_PORT 9000
+
+static uint8_t frames[BENCH_FLOWS][sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + 8 + BENCH_PAYLOAD];
+static int frame_len = sizeof(frames[0]);
+static uint64_t frame_next, frame_limit;
+static int workers;
+static _Atomic uint64_t received;
+
+static uint64_t in_flight()
+{
+        uint64_t n = 0;
+        for (int i = 0; i < workers; i++)
+        {
+                net_shard_stats_t s;
+                net_shard_get_stats(i, &s);
+                n += s.dispatched - s.processed;
+        }
+        return n;
+}
+
+static int next_frame(driver_t *driver, buf_t *buf)
+{
+        if (frame_next == frame_limit || (workers && in_flight() >= (uint64_t)workers * NET_SHARD_RING_SIZE / 2))
+                return 0;
+        buf_init(buf, frame_len);
+        memcpy(buf->data, frames[frame_next++ % BENCH_FLOWS], frame_len);
+        return frame_len;
+}
+
+static void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        atomic_fetch_add_explicit(&received, 1, memory_order_relaxed);
+}
+
+static void open_ports(int shard, void *arg)
+{
+        udp_open(BENCH_PORT, handler);
+}
+
+static double now_s()
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void build_frames()
+{
+        uint8_t my_ip[] = DRIVER_IF_IP, my_mac[] = DRIVER_IF_MAC;
+        for (int i = 0; i < BENCH_FLOWS; i++)
+        {
+                ether_hdr_t *eth = (ether_hdr_t *)frames[i];
+                ip_hdr_t *ip = (ip_hdr_t *)(eth + 1);
+                uint8_t *udp = (uint8_t *)(ip + 1);
+                memcpy(eth->dest, my_mac, NET_MAC_LEN);
+                memset(eth->src, 0x02, NET_MAC_LEN);
+                eth->protocol = swap16(NET_PROTOCOL_IP);
+                ip->version = IP_VERSION_4;
+                ip->hdr_len = 5;
+                ip->ttl = 64;
+                ip->protocol = NET_PROTOCOL_UDP;
+                ip->total_len = swap16(sizeof(ip_hdr_t) + 8 + BENCH_PAYLOAD);
+                uint8_t src_ip[] = {10, 0, i >> 8, i};
+                memcpy(ip->src_ip, src_ip, NET_IP_LEN);
+                memcpy(ip->dest_ip, my_ip, NET_IP_LEN);
+                ip->hdr_checksum = swap16(checksum16((uint16_t *)ip, 10));
+                uint16_t src_port = 5000 + i;
+                udp[0] = src_port >> 8; udp[1] = src_port; udp[2] = BENCH_PORT >> 8; udp[3] = BENCH_PORT & 0xff;
+                udp[4] = (8 + BENCH_PAYLOAD) >> 8; udp[5] = (8 + BENCH_PAYLOAD) & 0xff;
+                for (int j = 0; j < BENCH_PAYLOAD; j++)
+                        udp[8 + j] = i + j;
+                uint32_t sum = checksum_add(checksum_add(0, ip->src_ip, 2 * NET_IP_LEN), udp, 8 + BENCH_PAYLOAD);
+                uint16_t cksum = checksum_fold(sum + swap16(NET_PROTOCOL_UDP) + swap16(8 + BENCH_PAYLOAD));
+                memcpy(udp + 6, &cksum, 2);
+        }
+}
+
+static void report(const char *label, double t)
+{
+        printf("%-12s %8.3f Mpps (%lu of %d frames received)\n", label, BENCH_FRAMES / t / 1e6,
+               (unsigned long)received, BENCH_FRAMES);
+}
+
+int main(int argc, char *argv[])
+{
+        int max_workers = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+        if (max_workers < 1)
+                max_workers = 1;
+        if (max_workers > NET_SHARD_MAX)
+                max_workers = NET_SHARD_MAX;
+        build_frames();
+        fake_driver_set(next_frame, NULL);
+        net_init();
+
+        // 单线程基准
+        udp_open(BENCH_PORT, handler);
+        frame_limit = BENCH_FRAMES;
+        double t0 = now_s();
+        while (received < BENCH_FRAMES)
+                net_poll();
+        report("net_poll", now_s() - t0);
+
+        for (int n = 1; n <= max_workers; n++)
+        {
+                received = 0;
+                frame_next = 0;
+                workers = n;
+                if (net_shard_start(n, open_ports, NULL) != 0)
+                {
+                        printf("net_shard_start(%d) failed\n", n);
+                        return 1;
+                }
+                t0 = now_s();
+                while (received < BENCH_FRAMES)
+                        if (net_shard_poll() == 0) //接收队列已满，让出cpu给工作线程
+                                sched_yield();
+                double t = now_s() - t0;
+                net_shard_stop();
+                char label[32];
+                snprintf(label, sizeof(label), "%d workers", n);
+                report(label, t);
+        }
+        return 0;
+}
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "net.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "udp.h"
+#include "shard.h"
+#include "faker/fake_driver.h"
+
+/**
+ * 分片模式测试：用驱动替身提供数据帧，由4个工作线程处理，检查
+ * 同一条流只在一个工作线程中处理且顺序不变，数据帧被分到多个工作线程，
+ * arp应答复制给每个工作线程（工作线程回复时不再发送arp请求），arp请求只被应答一次，
+ * 同一数据报的各分片哈希值相同，一条流两个方向的数据帧哈希值相同。
+ */
+
+#define SHARD_TEST_WORKERS 4
+#define SHARD_TEST_PEERS 8
+#define SHARD_TEST_FLOWS (SHARD_TEST_PEERS * 8)
+#define SHARD_TEST_DATAGRAMS 20000
+#define SHARD_TEST_PORT 9000
+#define SHARD_TEST_IN_FLIGHT 256 //驱动替身最多提供的未处理数据帧数，使接收队列不会满
+
+static uint8_t my_ip[] = DRIVER_IF_IP, my_mac[] = DRIVER_IF_MAC;
+
+static uint8_t (*frames)[128];
+static int frame_lens[SHARD_TEST_DATAGRAMS + 64];
+static int frame_total, frame_next;
+
+static _Atomic int flow_owner[SHARD_TEST_FLOWS];
+static uint32_t flow_next_seq[SHARD_TEST_FLOWS]; //只由该流所在的工作线程修改
+static _Atomic int errors, received, worker_frames[SHARD_TEST_WORKERS];
+
+static pthread_mutex_t sent_lock = PTHREAD_MUTEX_INITIALIZER;
+static int sent_udp, sent_arp_requests, sent_arp_replies;
+
+static uint64_t in_flight()
+{
+        uint64_t n = 0;
+        for (int i = 0; i < SHARD_TEST_WORKERS; i++)
+        {
+                net_shard_stats_t s;
+                net_shard_get_stats(i, &s);
+                n += s.dispatched - s.processed;
+        }
+        return n;
+}
+
+static int next_frame(driver_t *driver, buf_t *buf)
+{
+        if (frame_next == frame_total || in_flight() >= SHARD_TEST_IN_FLIGHT)
+                return 0;
+        buf_init(buf, frame_lens[frame_next]);
+        memcpy(buf->data, frames[frame_next], frame_lens[frame_next]);
+        return frame_lens[frame_next++];
+}
+
+/**
+ * @brief 统计工作线程发出的数据帧，启动时的arp宣告（目标为本机地址）不计入
+ *
+ */
+static int count_sent(driver_t *driver, uint8_t *burst[], uint16_t lens[], int n, int is_burst)
+{
+        pthread_mutex_lock(&sent_lock);
+        for (int i = 0; i < n; i++)
+        {
+                ether_hdr_t *eth = (ether_hdr_t *)burst[i];
+                arp_pkt_t *arp = (arp_pkt_t *)(eth + 1);
+                if (eth->protocol == swap16(NET_PROTOCOL_IP))
+                        sent_udp++;
+                else if (arp->opcode == swap16(ARP_REPLY))
+                        sent_arp_replies++;
+                else if (memcmp(arp->target_ip, my_ip, NET_IP_LEN) != 0)
+                        sent_arp_requests++;
+        }
+        pthread_mutex_unlock(&sent_lock);
+        return n;
+}
+
+static void peer_ip(int peer, uint8_t *ip)
+{
+        ip[0] = 192; ip[1] = 168; ip[2] = 231; ip[3] = 1 + peer;
+}
+
+static void peer_mac(int peer, uint8_t *mac)
+{
+        uint8_t m[] = {0x02, 0, 0, 0, 0, 1 + peer};
+        memcpy(mac, m, NET_MAC_LEN);
+}
+
+static void add_arp(int peer, int opcode, const uint8_t *target_ip)
+{
+        uint8_t *f = frames[frame_total];
+        ether_hdr_t *eth = (ether_hdr_t *)f;
+        arp_pkt_t *arp = (arp_pkt_t *)(eth + 1);
+        memset(f, 0xff, NET_MAC_LEN);
+        peer_mac(peer, eth->src);
+        eth->protocol = swap16(NET_PROTOCOL_ARP);
+        arp->hw_type = swap16(ARP_HW_ETHER);
+        arp->pro_type = swap16(NET_PROTOCOL_IP);
+        arp->hw_len = NET_MAC_LEN;
+        arp->pro_len = NET_IP_LEN;
+        arp->opcode = swap16(opcode);
+        peer_mac(peer, arp->sender_mac);
+        peer_ip(peer, arp->sender_ip);
+        memcpy(arp->target_mac, my_mac, NET_MAC_LEN);
+        memcpy(arp->target_ip, target_ip, NET_IP_LEN);
+        frame_lens[frame_total++] = sizeof(ether_hdr_t) + sizeof(arp_pkt_t);
+}
+
+/**
+ * @brief 构造一个udp数据帧，数据为流号与序号
+ *
+ */
+static int build_udp(uint8_t *f, int flow, uint32_t seq, uint16_t frag)
+{
+        ether_hdr_t *eth = (ether_hdr_t *)f;
+        ip_hdr_t *ip = (ip_hdr_t *)(eth + 1);
+        uint8_t *udp = (uint8_t *)(ip + 1);
+        memcpy(eth->dest, my_mac, NET_MAC_LEN);
+        peer_mac(flow % SHARD_TEST_PEERS, eth->src);
+        eth->protocol = swap16(NET_PROTOCOL_IP);
+        memset(ip, 0, sizeof(*ip));
+        ip->version = IP_VERSION_4;
+        ip->hdr_len = 5;
+        ip->ttl = 64;
+        ip->protocol = NET_PROTOCOL_UDP;
+        ip->total_len = swap16(sizeof(ip_hdr_t) + 16);
+        ip->flags_fragment = swap16(frag);
+        peer_ip(flow % SHARD_TEST_PEERS, ip->src_ip);
+        memcpy(ip->dest_ip, my_ip, NET_IP_LEN);
+        ip->hdr_checksum = swap16(checksum16((uint16_t *)ip, 10));
+        uint16_t src_port = 5000 + flow / SHARD_TEST_PEERS;
+        udp[0] = src_port >> 8; udp[1] = src_port; udp[2] = SHARD_TEST_PORT >> 8; udp[3] = SHARD_TEST_PORT & 0xff;
+        udp[4] = 0; udp[5] = 16; udp[6] = 0; udp[7] = 0;
+        uint32_t payload[2] = {flow, seq};
+        memcpy(udp + 8, payload, sizeof(payload));
+        return sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + 16;
+}
+
+/**
+ * @brief 工作线程中的处理程序：检查流只在一个线程中出现且序号连续，每个流的第一个数据报回复一次
+ *
+ */
+static void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        uint32_t payload[2];
+        memcpy(payload, buf->data, sizeof(payload));
+        int flow = payload[0], self = net_shard_self(), expected = -1;
+        if (flow >= SHARD_TEST_FLOWS || self < 0)
+        {
+                atomic_fetch_add(&errors, 1);
+                return;
+        }
+        if (!atomic_compare_exchange_strong(&flow_owner[flow], &expected, self) && expected != self)
+        {
+                printf("\e[0;31mflow %d seen on workers %d and %d\n", flow, expected, self);
+                atomic_fetch_add(&errors, 1);
+        }
+        if (payload[1] != flow_next_seq[flow])
+        {
+                printf("\e[0;31mflow %d: seq %u, expect %u\n", flow, payload[1], flow_next_seq[flow]);
+                atomic_fetch_add(&errors, 1);
+        }
+        if (payload[1] == 0)
+                udp_send((uint8_t *)"hi", 2, SHARD_TEST_PORT, src_ip, src_port);
+        flow_next_seq[flow] = payload[1] + 1;
+        atomic_fetch_add(&received, 1);
+        atomic_fetch_add(&worker_frames[self], 1);
+}
+
+static void open_ports(int shard, void *arg)
+{
+        udp_open(SHARD_TEST_PORT, handler);
+}
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        fake_driver_set(next_frame, count_sent);
+        frames = calloc(SHARD_TEST_DATAGRAMS + 64, sizeof(frames[0]));
+        for (int i = 0; i < SHARD_TEST_FLOWS; i++)
+                flow_owner[i] = -1;
+
+        // 同一数据报的各分片哈希值相同
+        uint8_t a[128], b[128];
+        int len = build_udp(a, 3, 1, IP_MORE_FRAGMENT << 8);
+        build_udp(b, 3, 2, 185);
+        memset(b + sizeof(ether_hdr_t) + sizeof(ip_hdr_t), 0x77, 8); //后续分片的该位置是数据而不是端口
+        if (net_shard_hash(a, len) != net_shard_hash(b, len))
+        {
+                printf("\e[0;31mfragments of one datagram hash differently\n");
+                result = 1;
+        }
+
+        // 交换两端的地址与端口（应答方向）后哈希值不变
+        for (int flow = 0; flow < SHARD_TEST_FLOWS; flow++)
+        {
+                len = build_udp(a, flow, 0, 0);
+                memcpy(b, a, len);
+                ip_hdr_t *orig_ip = (ip_hdr_t *)(a + sizeof(ether_hdr_t)), *ip = (ip_hdr_t *)(b + sizeof(ether_hdr_t));
+                memcpy(ip->src_ip, orig_ip->dest_ip, NET_IP_LEN);
+                memcpy(ip->dest_ip, orig_ip->src_ip, NET_IP_LEN);
+                uint8_t *l4 = (uint8_t *)(ip + 1), *orig = (uint8_t *)(orig_ip + 1);
+                memcpy(l4, orig + 2, 2);
+                memcpy(l4 + 2, orig, 2);
+                if (net_shard_hash(a, len) != net_shard_hash(b, len))
+                {
+                        printf("\e[0;31mflow %d hashes differently in the reply direction\n", flow);
+                        result = 1;
+                        break;
+                }
+        }
+
+        // 先学习每个对端的mac地址，再按随机顺序交错发送各流的数据报，最后请求本机mac地址
+        for (int p = 0; p < SHARD_TEST_PEERS; p++)
+                add_arp(p, ARP_REPLY, my_ip);
+        uint32_t seq[SHARD_TEST_FLOWS] = {0};
+        srand(1);
+        for (int i = 0; i < SHARD_TEST_DATAGRAMS; i++)
+        {
+                int flow = rand() % SHARD_TEST_FLOWS;
+                frame_lens[frame_total] = build_udp(frames[frame_total], flow, seq[flow]++, 0);
+                frame_total++;
+        }
+        add_arp(0, ARP_REQUEST, my_ip);
+
+        net_init();
+        if (net_shard_start(SHARD_TEST_WORKERS, open_ports, NULL) != 0)
+        {
+                printf("\e[0;31mnet_shard_start failed\n");
+                return 1;
+        }
+        while (frame_next < frame_total || in_flight() > 0)
+                net_shard_poll();
+        net_shard_stop();
+
+        int used = 0;
+        uint64_t dropped = 0;
+        for (int i = 0; i < SHARD_TEST_WORKERS; i++)
+        {
+                net_shard_stats_t s;
+                net_shard_get_stats(i, &s);
+                dropped += s.dropped;
+                used += worker_frames[i] > 0;
+                printf("worker %d: %lu frames, %d datagrams\n", i, (unsigned long)s.processed, worker_frames[i]);
+        }
+        if (errors || received != SHARD_TEST_DATAGRAMS || dropped || used < 2)
+        {
+                printf("\e[0;31m%d errors, %d of %d datagrams received, %lu dropped, %d workers used\n",
+                       errors, received, SHARD_TEST_DATAGRAMS, (unsigned long)dropped, used);
+                result = 1;
+        }
+        if (sent_udp != SHARD_TEST_FLOWS || sent_arp_requests != 0 || sent_arp_replies != 1)
+        {
+                printf("\e[0;31msent %d udp replies, %d arp requests and %d arp replies\n",
+                       sent_udp, sent_arp_requests, sent_arp_replies);
+                result = 1;
+        }
+
+        if (result)
+        {
+                printf("\e[1;31m====> Some frames were not sharded as expected.\n");
+        }
+        else
+        {
+                printf("\e[1;32m====> All frames were sharded as expected.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "net.h"
+#include "stack.h"
+#include "driver.h"
+#include "route.h"
+#include "netif.h"
+#include "faker/fake_driver.h"
+
+/**
+ * 协议栈实例测试：两块网卡由驱动替身背靠背连接，一块发出的数据帧从另一块收到，
+ * 实例a只负责0号网卡，实例b只负责1号网卡，两者在同一个线程中交替轮询。
+ * 检查两个实例各自解析arp、建立tcp连接并完整传输数据；udp端口、arp表、tcp连接、icmp计数与设置、定时器互不可见；
+ * 默认实例不受影响；释放实例后恢复绑定。
+ * 默认实例在第一次使用时才在堆上分配：栈只有256KB的线程也能创建，线程在使用协议栈之前不分配实例。
+ */
+
+#define STACK_TEST_PORT 7000
+
+static uint8_t ip_a[] = DRIVER_IF_IP;
+static uint8_t ip_b[] = {192, 168, 200, 2};
+static uint8_t mac_b[] = {0x02, 0, 0, 0, 0, 0xb};
+
+/**
+ * @brief 两块网卡背靠背连接：一块发出的数据帧放入另一块的接收队列
+ *
+ */
+static int back_to_back(driver_t *driver, uint8_t *frames[], uint16_t lens[], int n, int burst)
+{
+        driver_t *peer = (driver_t *)(intptr_t)(3 - (intptr_t)driver);
+        for (int i = 0; i < n; i++)
+                fake_driver_push(peer, frames[i], lens[i]);
+        return n;
+}
+
+typedef struct app
+{
+        tcp_conn_t *conn;
+        uint64_t total, sent, received;
+        int errors, connected;
+} app_t;
+
+static app_t client, server;
+static int udp_received;
+static uint8_t udp_src[NET_IP_LEN];
+static int timer_fired;
+static int echo_received;
+
+static uint8_t pattern(uint64_t off)
+{
+        return (uint8_t)(off * 13 + (off >> 9));
+}
+
+static void handler(tcp_conn_t *conn, tcp_event_t event, void *arg)
+{
+        app_t *app = arg;
+        app->conn = conn;
+        int len;
+        uint8_t *p;
+        switch (event)
+        {
+        case TCP_EVENT_CONNECTED:
+        case TCP_EVENT_SENT:
+                app->connected = 1;
+                while (app->sent < app->total && (p = tcp_send_buf(conn, &len), len > 0))
+                {
+                        if (len > app->total - app->sent)
+                                len = app->total - app->sent;
+                        for (int i = 0; i < len; i++)
+                                p[i] = pattern(app->sent + i);
+                        tcp_send_commit(conn, len);
+                        app->sent += len;
+                }
+                break;
+        case TCP_EVENT_RECV:
+                while ((p = tcp_recv_buf(conn, &len)), len > 0)
+                {
+                        for (int i = 0; i < len; i++)
+                                app->errors += p[i] != pattern(app->received + i);
+                        app->received += len;
+                        tcp_recv_consume(conn, len);
+                }
+                break;
+        default:
+                break;
+        }
+}
+
+static void udp_handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        udp_received++;
+        memcpy(udp_src, src_ip, NET_IP_LEN);
+}
+
+static void echo_handler(uint8_t *src_ip, uint16_t id, uint16_t seq, uint8_t *data, uint16_t len)
+{
+        echo_received++;
+}
+
+static void timer_handler(net_timer_t *timer, void *arg)
+{
+        timer_fired++;
+}
+
+/**
+ * @brief 小栈线程：检查本线程的默认实例在第一次使用时分配、退出前释放，且不同于其他线程的默认实例
+ *
+ */
+static void *small_thread(void *arg)
+{
+        net_stack_t *main_default = arg;
+        intptr_t wrong = net_stack_local != NULL;
+        net_init_thread();
+        wrong |= net_stack_local == NULL || net_stack_current() != net_stack_local || net_stack_local == main_default;
+        wrong |= udp_open(STACK_TEST_PORT, udp_handler) != 0;
+        net_poll();
+        net_exit_thread();
+        wrong |= net_stack_local != NULL;
+        return (void *)wrong;
+}
+
+/**
+ * @brief 交替轮询两个实例直到cond成立或超过ms毫秒
+ *
+ */
+#define POLL_UNTIL(a, b, cond, ms)                                        \
+        do                                                                \
+        {                                                                 \
+                uint64_t deadline = timer_now_ms() + (ms);                \
+                while (!(cond) && timer_now_ms() < deadline)              \
+                {                                                         \
+                        net_stack_poll(a);                                \
+                        net_stack_poll(b);                                \
+                }                                                         \
+        } while (0)
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        fake_driver_set(NULL, back_to_back);
+        if (net_stack_local != NULL)
+        {
+                printf("\e[0;31mdefault instance allocated before first use\n");
+                result = 1;
+        }
+        route_init();
+        netif_init();
+        uint8_t direct[NET_IP_LEN] = {0};
+        int if_b = netif_add("peer", mac_b);
+        netif_add_addr(if_b, ip_b, 24);
+        route_add(ip_b, 32, direct, 0); //a经0号网卡到达b
+        route_add(ip_a, 32, direct, if_b); //b经1号网卡到达a
+
+        net_stack_t *a = net_stack_new(1u << 0), *b = net_stack_new(1u << if_b);
+        net_stack_init(a);
+        net_stack_init(b);
+
+        // tcp：a主动打开，b监听，两个实例各自解析对方的mac
+        const uint64_t bulk = 4u << 20;
+        client.total = bulk;
+        net_stack_bind(b);
+        tcp_listen(STACK_TEST_PORT, handler, &server);
+        net_stack_bind(a);
+        tcp_connect(ip_b, STACK_TEST_PORT, 0, handler, &client);
+        net_stack_bind(NULL);
+        POLL_UNTIL(a, b, server.received == bulk, 5000);
+        if (!client.connected || !server.connected || server.received != bulk || server.errors)
+        {
+                printf("\e[0;31mtcp between instances failed: received %lu of %lu, %d errors\n",
+                       (unsigned long)server.received, (unsigned long)bulk, server.errors);
+                result = 1;
+        }
+        net_stack_bind(a);
+        int a_conns = tcp_conn_count(), a_knows_b = arp_lookup(ip_b) != NULL, a_knows_a = arp_lookup(ip_a) != NULL;
+        net_stack_bind(b);
+        int b_conns = tcp_conn_count(), b_knows_a = arp_lookup(ip_a) != NULL, b_knows_b = arp_lookup(ip_b) != NULL;
+        net_stack_bind(NULL);
+        if (a_conns != 1 || b_conns != 1 || tcp_conn_count() != 0)
+        {
+                printf("\e[0;31mconnections not isolated: a %d b %d default %d\n", a_conns, b_conns, tcp_conn_count());
+                result = 1;
+        }
+        if (!a_knows_b || !b_knows_a || a_knows_a || b_knows_b || arp_lookup(ip_a) || arp_lookup(ip_b))
+        {
+                printf("\e[0;31marp tables not isolated\n");
+                result = 1;
+        }
+
+        // udp：只有a打开端口，b发来的数据报交给a；a发往b的同一端口得到端口不可达
+        net_stack_bind(a);
+        udp_open(STACK_TEST_PORT, udp_handler);
+        net_stack_bind(b);
+        uint8_t payload[] = "hello";
+        udp_send(payload, sizeof(payload), STACK_TEST_PORT, ip_a, STACK_TEST_PORT);
+        net_stack_bind(a);
+        udp_send(payload, sizeof(payload), STACK_TEST_PORT, ip_b, STACK_TEST_PORT);
+        net_stack_bind(NULL);
+        POLL_UNTIL(a, b, udp_received == 1 && b->icmp.error_stats.sent == 1, 1000);
+        if (udp_received != 1 || memcmp(udp_src, ip_b, NET_IP_LEN) || b->icmp.error_stats.sent != 1 || a->icmp.error_stats.sent != 0)
+        {
+                printf("\e[0;31mudp ports not isolated: received %d, unreachable sent a %lu b %lu\n", udp_received,
+                       (unsigned long)a->icmp.error_stats.sent, (unsigned long)b->icmp.error_stats.sent);
+                result = 1;
+        }
+
+        // icmp限速参数与回显应答的处理程序只作用于设置时绑定的实例：两个实例互相发送回显请求，只有a收到应答
+        icmp_rate_limit_t unlimited = {0, 0, 0, 0};
+        net_stack_bind(a);
+        icmp_set_rate_limit(&unlimited);
+        icmp_set_echo_handler(echo_handler);
+        icmp_send_echo(ip_b, 1, 1, payload, sizeof(payload));
+        net_stack_bind(b);
+        icmp_send_echo(ip_a, 1, 1, payload, sizeof(payload));
+        net_stack_bind(NULL);
+        POLL_UNTIL(a, b, 0, 100);
+        if (echo_received != 1 || a->icmp.limit.src_rate != 0 || b->icmp.limit.src_rate != ICMP_RATE_PER_SRC)
+        {
+                printf("\e[0;31micmp settings not isolated: %d echo replies handled\n", echo_received);
+                result = 1;
+        }
+
+        // 定时器挂在添加时绑定的实例上，只在该实例轮询时到期
+        net_timer_t timer = {0};
+        net_stack_bind(b);
+        timer_add(&timer, 0, timer_handler, NULL);
+        net_stack_bind(NULL);
+        uint64_t deadline = timer_now_ms() + 3 * TIMER_TICK_MS;
+        while (timer_now_ms() < deadline)
+                net_stack_poll(a);
+        int fired_early = timer_fired;
+        net_stack_poll(b);
+        if (fired_early || timer_fired != 1)
+        {
+                printf("\e[0;31mtimer not isolated: fired %d before and %d after its instance polled\n", fired_early, timer_fired);
+                result = 1;
+        }
+
+        if (net_stack_current() != net_stack_local)
+        {
+                printf("\e[0;31mbinding not restored\n");
+                result = 1;
+        }
+
+        // 实例不在线程局部存储中，栈远小于实例的线程也能创建，并有自己的默认实例
+        pthread_t thread;
+        pthread_attr_t attr;
+        void *wrong = (void *)1;
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, 256 * 1024);
+        if (pthread_create(&thread, &attr, small_thread, net_stack_local) == 0)
+                pthread_join(thread, &wrong);
+        pthread_attr_destroy(&attr);
+        if (wrong != NULL)
+        {
+                printf("\e[0;31mthread with a small stack failed or shared the default instance\n");
+                result = 1;
+        }
+        net_stack_free(a);
+        net_stack_free(b);
+
+        if (result)
+        {
+                printf("\e[1;31m====> Some instances shared state.\n");
+        }
+        else
+        {
+                printf("\e[1;32m====> All instances were independent.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "net.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "udp.h"
+#include "stage.h"
+#include "faker/fake_driver.h"
+
+/**
+ * 流水线模式测试：用驱动替身提供数据帧，由接收线程、2个协议线程与发送线程处理，检查
+ * 同一条流只在一个协议线程中处理且顺序不变，协议线程不直接调用驱动，应答都由发送线程批量发出，
+ * arp请求只被应答一次；处理程序阻塞时接收线程因没有空闲缓冲区而受阻、不丢弃数据帧，
+ * 阻塞的协议线程的平均占用不为0，各阶段的数据帧计数一致。
+ */
+
+#define STAGE_TEST_WORKERS 2
+#define STAGE_TEST_PEERS 8
+#define STAGE_TEST_FLOWS (STAGE_TEST_PEERS * 8)
+#define STAGE_TEST_DATAGRAMS 20000
+#define STAGE_TEST_PORT 9000
+
+static uint8_t my_ip[] = DRIVER_IF_IP, my_mac[] = DRIVER_IF_MAC;
+
+static uint8_t (*frames)[128];
+static int frame_lens[STAGE_TEST_DATAGRAMS + 64];
+static int frame_total, frame_next, arp_frames;
+
+static _Atomic int flow_owner[STAGE_TEST_FLOWS];
+static uint32_t flow_next_seq[STAGE_TEST_FLOWS]; //只由该流所在的协议线程修改
+static _Atomic int errors, received, hold;
+
+static pthread_mutex_t sent_lock = PTHREAD_MUTEX_INITIALIZER;
+static int sent_udp, sent_arp_replies, sent_arp_requests, direct_sends;
+
+static int next_frame(driver_t *driver, buf_t *buf)
+{
+        if (frame_next == frame_total)
+                return 0;
+        buf_init(buf, frame_lens[frame_next]);
+        memcpy(buf->data, frames[frame_next], frame_lens[frame_next]);
+        return frame_lens[frame_next++];
+}
+
+/**
+ * @brief 统计发送线程批量发出的数据帧，协议线程启动时的arp宣告（目标为本机地址）不计入；
+ *        只有主线程初始化协议栈时的arp宣告可以直接发送
+ *
+ */
+static int count_sent(driver_t *driver, uint8_t *burst[], uint16_t lens[], int n, int is_burst)
+{
+        if (net_stage_self() >= 0)
+                atomic_fetch_add(&errors, 1);
+        pthread_mutex_lock(&sent_lock);
+        if (!is_burst)
+                direct_sends++;
+        for (int i = 0; is_burst && i < n; i++)
+        {
+                ether_hdr_t *eth = (ether_hdr_t *)burst[i];
+                arp_pkt_t *arp = (arp_pkt_t *)(eth + 1);
+                if (eth->protocol == swap16(NET_PROTOCOL_IP))
+                        sent_udp++;
+                else if (arp->opcode == swap16(ARP_REPLY))
+                        sent_arp_replies++;
+                else if (memcmp(arp->target_ip, my_ip, NET_IP_LEN) != 0)
+                        sent_arp_requests++;
+        }
+        pthread_mutex_unlock(&sent_lock);
+        return n;
+}
+
+static void peer_ip(int peer, uint8_t *ip)
+{
+        ip[0] = 192; ip[1] = 168; ip[2] = 231; ip[3] = 1 + peer;
+}
+
+static void peer_mac(int peer, uint8_t *mac)
+{
+        uint8_t m[] = {0x02, 0, 0, 0, 0, 1 + peer};
+        memcpy(mac, m, NET_MAC_LEN);
+}
+
+static void add_arp(int peer, int opcode, const uint8_t *target_ip)
+{
+        uint8_t *f = frames[frame_total];
+        ether_hdr_t *eth = (ether_hdr_t *)f;
+        arp_pkt_t *arp = (arp_pkt_t *)(eth + 1);
+        memset(f, 0xff, NET_MAC_LEN);
+        peer_mac(peer, eth->src);
+        eth->protocol = swap16(NET_PROTOCOL_ARP);
+        arp->hw_type = swap16(ARP_HW_ETHER);
+        arp->pro_type = swap16(NET_PROTOCOL_IP);
+        arp->hw_len = NET_MAC_LEN;
+        arp->pro_len = NET_IP_LEN;
+        arp->opcode = swap16(opcode);
+        peer_mac(peer, arp->sender_mac);
+        peer_ip(peer, arp->sender_ip);
+        memcpy(arp->target_mac, my_mac, NET_MAC_LEN);
+        memcpy(arp->target_ip, target_ip, NET_IP_LEN);
+        frame_lens[frame_total++] = sizeof(ether_hdr_t) + sizeof(arp_pkt_t);
+        arp_frames++;
+}
+
+/**
+ * @brief 构造一个udp数据帧，数据为流号与序号
+ *
+ */
+static int build_udp(uint8_t *f, int flow, uint32_t seq)
+{
+        ether_hdr_t *eth = (ether_hdr_t *)f;
+        ip_hdr_t *ip = (ip_hdr_t *)(eth + 1);
+        uint8_t *udp = (uint8_t *)(ip + 1);
+        memcpy(eth->dest, my_mac, NET_MAC_LEN);
+        peer_mac(flow % STAGE_TEST_PEERS, eth->src);
+        eth->protocol = swap16(NET_PROTOCOL_IP);
+        memset(ip, 0, sizeof(*ip));
+        ip->version = IP_VERSION_4;
+        ip->hdr_len = 5;
+        ip->ttl = 64;
+        ip->protocol = NET_PROTOCOL_UDP;
+        ip->total_len = swap16(sizeof(ip_hdr_t) + 16);
+        peer_ip(flow % STAGE_TEST_PEERS, ip->src_ip);
+        memcpy(ip->dest_ip, my_ip, NET_IP_LEN);
+        ip->hdr_checksum = swap16(checksum16((uint16_t *)ip, 10));
+        uint16_t src_port = 5000 + flow / STAGE_TEST_PEERS;
+        udp[0] = src_port >> 8; udp[1] = src_port; udp[2] = STAGE_TEST_PORT >> 8; udp[3] = STAGE_TEST_PORT & 0xff;
+        udp[4] = 0; udp[5] = 16; udp[6] = 0; udp[7] = 0;
+        uint32_t payload[2] = {flow, seq};
+        memcpy(udp + 8, payload, sizeof(payload));
+        return sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + 16;
+}
+
+/**
+ * @brief 协议线程中的处理程序：检查流只在一个线程中出现且序号连续，每个流的第一个数据报回复一次
+ *        第一个数据报在hold清零前阻塞，使接收缓冲区耗尽
+ *
+ */
+static void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        uint32_t payload[2];
+        memcpy(payload, buf->data, sizeof(payload));
+        int flow = payload[0], self = net_stage_self(), expected = -1;
+        if (flow >= STAGE_TEST_FLOWS || self < 0)
+        {
+                atomic_fetch_add(&errors, 1);
+                return;
+        }
+        while (atomic_load(&received) == 0 && atomic_load(&hold))
+                sched_yield();
+        if (!atomic_compare_exchange_strong(&flow_owner[flow], &expected, self) && expected != self)
+        {
+                printf("\e[0;31mflow %d seen on workers %d and %d\n", flow, expected, self);
+                atomic_fetch_add(&errors, 1);
+        }
+        if (payload[1] != flow_next_seq[flow])
+        {
+                printf("\e[0;31mflow %d: seq %u, expect %u\n", flow, payload[1], flow_next_seq[flow]);
+                atomic_fetch_add(&errors, 1);
+        }
+        if (payload[1] == 0)
+                udp_send((uint8_t *)"hi", 2, STAGE_TEST_PORT, src_ip, src_port);
+        flow_next_seq[flow] = payload[1] + 1;
+        atomic_fetch_add(&received, 1);
+}
+
+static void open_ports(int index, void *arg)
+{
+        udp_open(STAGE_TEST_PORT, handler);
+}
+
+static int sent_all()
+{
+        pthread_mutex_lock(&sent_lock);
+        int done = sent_udp == STAGE_TEST_FLOWS && sent_arp_replies == 1;
+        pthread_mutex_unlock(&sent_lock);
+        return done;
+}
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        fake_driver_set(next_frame, count_sent);
+        frames = calloc(STAGE_TEST_DATAGRAMS + 64, sizeof(frames[0]));
+        for (int i = 0; i < STAGE_TEST_FLOWS; i++)
+                flow_owner[i] = -1;
+
+        // 先学习每个对端的mac地址，再按随机顺序交错发送各流的数据报，最后请求本机mac地址
+        for (int p = 0; p < STAGE_TEST_PEERS; p++)
+                add_arp(p, ARP_REPLY, my_ip);
+        uint32_t seq[STAGE_TEST_FLOWS] = {0};
+        srand(1);
+        for (int i = 0; i < STAGE_TEST_DATAGRAMS; i++)
+        {
+                int flow = rand() % STAGE_TEST_FLOWS;
+                frame_lens[frame_total] = build_udp(frames[frame_total], flow, seq[flow]++);
+                frame_total++;
+        }
+        add_arp(0, ARP_REQUEST, my_ip);
+
+        net_init();
+        int main_sends = direct_sends;
+        atomic_store(&hold, 1);
+        if (net_stage_start(STAGE_TEST_WORKERS, open_ports, NULL) != 0)
+        {
+                printf("\e[0;31mnet_stage_start failed\n");
+                return 1;
+        }
+
+        // 第一个数据报阻塞期间，接收线程应当用尽接收缓冲区而受阻
+        net_stage_stats_t rx, tx, proto[STAGE_TEST_WORKERS];
+        for (int i = 0; i < 2000000; i++)
+        {
+                net_stage_get_stats(NET_STAGE_RX, 0, &rx);
+                if (rx.stalls > 0)
+                        break;
+                sched_yield();
+        }
+        atomic_store(&hold, 0);
+        for (int i = 0; i < 2000000 && !(atomic_load(&received) == STAGE_TEST_DATAGRAMS && sent_all()); i++)
+                sched_yield();
+        net_stage_stop();
+
+        net_stage_get_stats(NET_STAGE_RX, 0, &rx);
+        net_stage_get_stats(NET_STAGE_TX, 0, &tx);
+        uint64_t processed = 0, occupied = 0;
+        for (int i = 0; i < STAGE_TEST_WORKERS; i++)
+        {
+                net_stage_get_stats(NET_STAGE_PROTO, i, &proto[i]);
+                processed += proto[i].packets;
+                occupied += proto[i].occupancy;
+                printf("proto %d: %lu frames, %lu polls, avg queue %.1f\n", i, (unsigned long)proto[i].packets,
+                       (unsigned long)proto[i].polls, proto[i].polls ? (double)proto[i].occupancy / proto[i].polls : 0);
+        }
+        printf("rx: %lu frames, %lu stalls; tx: %lu frames\n", (unsigned long)rx.packets, (unsigned long)rx.stalls,
+               (unsigned long)tx.packets);
+        if (errors || received != STAGE_TEST_DATAGRAMS || direct_sends != main_sends)
+        {
+                printf("\e[0;31m%d errors, %d of %d datagrams received, %d direct sends\n",
+                       errors, received, STAGE_TEST_DATAGRAMS, direct_sends - main_sends);
+                result = 1;
+        }
+        if (sent_udp != STAGE_TEST_FLOWS || sent_arp_requests != 0 || sent_arp_replies != 1)
+        {
+                printf("\e[0;31msent %d udp replies, %d arp requests and %d arp replies\n",
+                       sent_udp, sent_arp_requests, sent_arp_replies);
+                result = 1;
+        }
+        // 接收线程受阻时不丢弃，每个arp数据帧复制给每个协议线程，发送线程发出的还包括0号协议线程的arp宣告
+        if (rx.stalls == 0 || rx.dropped || occupied == 0 || rx.packets != frame_total ||
+            processed != frame_total + (uint64_t)arp_frames * (STAGE_TEST_WORKERS - 1) ||
+            tx.packets != sent_udp + sent_arp_replies + 1 || tx.dropped)
+        {
+                printf("\e[0;31mstage counters: rx %lu stalls %lu dropped %lu, processed %lu, tx %lu dropped %lu\n",
+                       (unsigned long)rx.packets, (unsigned long)rx.stalls, (unsigned long)rx.dropped,
+                       (unsigned long)processed, (unsigned long)tx.packets, (unsigned long)tx.dropped);
+                result = 1;
+        }
+
+        if (result)
+        {
+                printf("\e[1;31m====> Some frames did not pass through the pipeline as expected.\n");
+        }
+        else
+        {
+                printf("\e[1;32m====> All frames passed through the pipeline as expected.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "net.h"
+#include "stack.h"
+#include "stats.h"
+#include "driver.h"
+#include "netif.h"
+#include "faker/fake_driver.h"
+
+/**
+ * 计数测试：驱动替身把发出的数据帧放回接收队列，检查以太网协议、ip协议、udp端口的收发计数，
+ * arp表的命中、未命中与替换计数，驱动收发出错计数；
+ * 再导出到共享内存，检查按布局读出的快照、定时发布、实例释放后槽变为空闲。
+ */
+
+#define TEST_PORT_A 7000
+#define TEST_PORT_B 7001
+
+static int fail_send, fail_recv;
+static int received;
+
+static int loop_send(driver_t *driver, uint8_t *frames[], uint16_t lens[], int n, int burst)
+{
+        return fail_send ? 0 : fake_driver_loopback(driver, frames, lens, n, burst);
+}
+
+static int loop_recv(driver_t *driver, buf_t *buf)
+{
+        return fail_recv ? -1 : fake_driver_pop(driver, buf);
+}
+
+static void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        received++;
+}
+
+static const net_stats_port_t *find_port(const net_stats_slot_t *slot, uint16_t port)
+{
+        for (uint32_t i = 0; i < slot->udp_port_count; i++)
+                if (slot->udp_ports[i].port == port)
+                        return &slot->udp_ports[i];
+        return NULL;
+}
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        fake_driver_set(loop_recv, loop_send);
+        uint8_t my_ip[] = DRIVER_IF_IP, my_mac[] = DRIVER_IF_MAC, peer_ip[] = {192, 168, 231, 101};
+        uint8_t payload[100] = {0};
+        net_init();
+        netif_add_addr(0, peer_ip, 24);
+        arp_update(my_ip, my_mac, ARP_VALID);
+        arp_update(peer_ip, my_mac, ARP_VALID);
+        udp_open(TEST_PORT_A, handler);
+        udp_open(TEST_PORT_B, handler);
+        net_poll(); //处理初始化时宣告本机地址的arp请求
+        const arp_stats_t *arp = arp_get_stats();
+        uint64_t ip_out = ethernet_get_stats(NET_PROTOCOL_IP)->out_packets, hits = arp->hits;
+
+        // 一个数据报从B端口发往A端口：发送与接收各经过udp、ip、以太网一次
+        udp_send(payload, sizeof(payload), TEST_PORT_B, peer_ip, TEST_PORT_A);
+        net_poll();
+        const net_proto_stats_t *a = udp_get_stats(TEST_PORT_A), *b = udp_get_stats(TEST_PORT_B);
+        const net_proto_stats_t *udp = ip_get_stats(NET_PROTOCOL_UDP), *eth = ethernet_get_stats(NET_PROTOCOL_IP);
+        uint16_t udp_len = sizeof(udp_hdr_t) + sizeof(payload), ip_len = sizeof(ip_hdr_t) + udp_len;
+        if (received != 1 || a->packets != 1 || a->bytes != udp_len || a->out_packets != 0 || b->out_packets != 1 ||
+            b->out_bytes != udp_len || b->packets != 0)
+        {
+                printf("\e[0;31mudp port counters wrong: port a in %lu/%lu out %lu, port b in %lu out %lu/%lu\n",
+                       (unsigned long)a->packets, (unsigned long)a->bytes, (unsigned long)a->out_packets,
+                       (unsigned long)b->packets, (unsigned long)b->out_packets, (unsigned long)b->out_bytes);
+                result = 1;
+        }
+        if (udp->packets != 1 || udp->bytes != ip_len || udp->out_packets != 1 || udp->out_bytes != ip_len)
+        {
+                printf("\e[0;31mip counters wrong: in %lu/%lu out %lu/%lu\n", (unsigned long)udp->packets,
+                       (unsigned long)udp->bytes, (unsigned long)udp->out_packets, (unsigned long)udp->out_bytes);
+                result = 1;
+        }
+        if (eth->out_packets != ip_out + 1 || eth->out_bytes < sizeof(ether_hdr_t) + ip_len)
+        {
+                printf("\e[0;31methernet counters wrong: out %lu\n", (unsigned long)(eth->out_packets - ip_out));
+                result = 1;
+        }
+
+        // 查找已知地址命中，未知地址未命中，表满后继续加入替换有效表项
+        uint8_t unknown[] = {192, 168, 231, 200};
+        if (arp_lookup(unknown) != NULL || arp->hits <= hits || arp->misses == 0)
+        {
+                printf("\e[0;31marp lookups not counted: hits %lu misses %lu\n", (unsigned long)arp->hits, (unsigned long)arp->misses);
+                result = 1;
+        }
+        for (int i = 0; i < ARP_MAX_ENTRY; i++)
+        {
+                uint8_t ip[] = {10, 0, 0, i};
+                arp_update(ip, my_mac, ARP_VALID);
+        }
+        if (arp->evictions == 0)
+        {
+                printf("\e[0;31marp evictions not counted\n");
+                result = 1;
+        }
+        arp_update(my_ip, my_mac, ARP_VALID);
+        arp_update(peer_ip, my_mac, ARP_VALID);
+
+        // 驱动出错
+        fail_send = 1;
+        udp_send(payload, sizeof(payload), TEST_PORT_B, peer_ip, TEST_PORT_A);
+        fail_send = 0;
+        fail_recv = 1;
+        net_poll();
+        fail_recv = 0;
+        const ethernet_driver_stats_t *driver = ethernet_get_driver_stats();
+        if (driver->tx_errors != 1 || driver->rx_errors != 1)
+        {
+                printf("\e[0;31mdriver errors wrong: rx %lu tx %lu\n", (unsigned long)driver->rx_errors, (unsigned long)driver->tx_errors);
+                result = 1;
+        }
+
+        // 导出到共享内存，按布局读出
+        char name[64];
+        snprintf(name, sizeof(name), "/net_stats_test_%d", getpid());
+        if (net_stats_export(name) != 0 || net_stats_export(name) != -1)
+        {
+                printf("\e[0;31mexport failed\n");
+                printf("\e[1;31m====> Some counters were wrong.\n\e[0m");
+                return 1;
+        }
+        net_stats_publish();
+        const net_stats_shm_t *shm = net_stats_attach(name);
+        net_stats_slot_t slot;
+        if (shm == NULL || atomic_load(&shm->slots_used) != 1 || net_stats_read(shm, 0, &slot) != 0)
+        {
+                printf("\e[0;31mattach or read failed\n");
+                printf("\e[1;31m====> Some counters were wrong.\n\e[0m");
+                shm_unlink(name);
+                return 1;
+        }
+        const net_stats_port_t *port = find_port(&slot, TEST_PORT_A);
+        if (slot.ip[NET_PROTOCOL_UDP].packets != udp->packets || slot.ip[NET_PROTOCOL_UDP].out_bytes != udp->out_bytes ||
+            port == NULL || port->stats.packets != 1 || find_port(&slot, TEST_PORT_B) == NULL || slot.udp_port_count != 2 ||
+            slot.arp.evictions != arp->evictions || slot.driver.tx_errors != 1 || slot.tid <= 0 || slot.ifmask != 0)
+        {
+                printf("\e[0;31mexported snapshot differs from the counters\n");
+                result = 1;
+        }
+
+        // 定时发布：再收一个数据报，轮询超过一个发布周期后快照随之更新
+        udp_send(payload, sizeof(payload), TEST_PORT_B, peer_ip, TEST_PORT_A);
+        uint64_t deadline = timer_now_ms() + 2 * NET_STATS_PUBLISH_MS + TIMER_TICK_MS;
+        while (timer_now_ms() < deadline)
+                net_poll();
+        if (net_stats_read(shm, 0, &slot) != 0 || find_port(&slot, TEST_PORT_A) == NULL ||
+            find_port(&slot, TEST_PORT_A)->stats.packets != 2)
+        {
+                printf("\e[0;31msnapshot not republished by the timer\n");
+                result = 1;
+        }
+
+        // 另一个实例占用下一个槽，释放后槽变为空闲
+        net_stack_t *other = net_stack_new(1);
+        net_stack_init(other);
+        net_stack_bind(other);
+        net_stats_publish();
+        net_stack_bind(NULL);
+        int used = atomic_load(&shm->slots_used), busy = net_stats_read(shm, 1, &slot) == 0 && slot.ifmask == 1;
+        net_stack_free(other);
+        if (used != 2 || !busy || net_stats_read(shm, 1, &slot) != -1 || net_stats_read(shm, 0, &slot) != 0)
+        {
+                printf("\e[0;31mslots not claimed or released: used %d, busy %d\n", used, busy);
+                result = 1;
+        }
+        net_stats_detach(shm);
+        shm_unlink(name);
+
+        if (result)
+        {
+                printf("\e[1;31m====> Some counters were wrong.\n");
+        }
+        else
+        {
+                printf("\e[1;32m====> All counters were right.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
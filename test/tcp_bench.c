@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "net.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "netif.h"
+#include "tcp.h"
+#include "faker/fake_driver.h"
+
+/**
+ * tcp大块传输基准测试：驱动替身把发出的数据帧放回接收队列，发送端与接收端在同一个协议栈中，
+ * 测得的是一个线程同时承担两端时协议栈的处理能力，包括驱动替身每帧两次拷贝的开销。
+ * 发送端直接写发送缓冲区，接收端直接读接收缓冲区后释放，另打印首部预测的命中率与每个数据报文段的确认数。
+ *   tcp_bench [MB]    MB默认为1024
+ */
+
+#define BENCH_PORT 5001
+
+static uint64_t total, sent, received;
+static int done;
+
+static void sender(tcp_conn_t *conn, tcp_event_t event, void *arg)
+{
+        if (event != TCP_EVENT_CONNECTED && event != TCP_EVENT_SENT)
+                return;
+        int len;
+        while (sent < total && (tcp_send_buf(conn, &len), len > 0))
+        {
+                if (len > total - sent)
+                        len = total - sent;
+                tcp_send_commit(conn, len); //数据内容不影响处理开销，不写入
+                sent += len;
+        }
+}
+
+static void receiver(tcp_conn_t *conn, tcp_event_t event, void *arg)
+{
+        int len;
+        if (event == TCP_EVENT_RECV)
+        {
+                while (tcp_recv_buf(conn, &len), len > 0)
+                {
+                        received += len;
+                        tcp_recv_consume(conn, len);
+                }
+                done = received == total;
+        }
+}
+
+static double now_s()
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+        total = (uint64_t)(argc > 1 ? atoi(argv[1]) : 1024) << 20;
+        fake_driver_set(NULL, fake_driver_loopback);
+        uint8_t my_ip[] = DRIVER_IF_IP, my_mac[] = DRIVER_IF_MAC, peer_ip[] = {192, 168, 231, 101};
+        net_init();
+        netif_add_addr(0, peer_ip, 24);
+        arp_update(my_ip, my_mac, ARP_VALID);
+        arp_update(peer_ip, my_mac, ARP_VALID);
+        tcp_listen(BENCH_PORT, receiver, NULL);
+        tcp_connect(peer_ip, BENCH_PORT, 0, sender, NULL);
+
+        double t0 = now_s();
+        while (!done)
+                net_poll();
+        double t = now_s() - t0;
+
+        const tcp_stats_t *stats = tcp_get_stats();
+        uint64_t data = stats->predicted_data + stats->ooo_segs;
+        printf("%lu MB in %.3f s: %.3f Gbit/s\n", (unsigned long)(total >> 20), t, total * 8 / t / 1e9);
+        printf("segments out %lu, retransmitted %lu, predicted data %lu, predicted acks %lu, acks %lu (%.2f per data segment)\n",
+               (unsigned long)stats->segs_out, (unsigned long)stats->retrans_segs, (unsigned long)stats->predicted_data,
+               (unsigned long)stats->predicted_acks, (unsigned long)stats->acks_out, data ? (double)stats->acks_out / data : 0);
+        return 0;
+}
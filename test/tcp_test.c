@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <string.h>
+#include "net.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "netif.h"
+#include "tcp.h"
+#include "faker/fake_driver.h"
+
+/**
+ * tcp测试：驱动替身把发出的数据帧放回接收队列，客户端（本机地址）与服务端（第二个本机地址）在同一个协议栈中。
+ * 检查三次握手与窗口扩大、SACK的协商；大块传输的数据完整，且首部预测命中、确认被合并；
+ * 丢包时由SACK快速重传恢复，尾部丢包由重传超时恢复；单个小报文段的确认被延迟；
+ * 连接未监听的端口收到复位；四次挥手后主动关闭方进入TIME_WAIT，被动关闭方结束；
+ * 传输中路径MTU减小后报文段随之缩小，传输仍能完成。
+ */
+
+#define TCP_TEST_PORT 8080
+#define TCP_TEST_CLOSED_PORT 8081
+
+static uint8_t server_ip[] = {192, 168, 231, 101};
+
+static int drop_every;    //每drop_every个发往服务端的新数据报文段丢弃一个，0为不丢弃
+static int drop_next;     //丢弃接下来的drop_next个发往服务端的新数据报文段
+static int data_segs;     //发往服务端的新数据报文段数，重传的不计
+static int dropped;
+static uint32_t data_high; //发往服务端的数据的最大序号
+static int path_mtu;       //大于它且置DF位的ip数据报被丢弃，模拟路径上MTU更小的路由器，0为不限制
+static int too_big;        //因超过path_mtu而丢弃的数据报数
+
+/**
+ * @brief 发往服务端端口、带新数据的报文段，丢包只针对首次发送的数据，重传总能到达
+ *
+ */
+static int is_client_data(const uint8_t *frame, int len)
+{
+        const ip_hdr_t *ip = (const ip_hdr_t *)(frame + sizeof(ether_hdr_t));
+        if (len < sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + sizeof(tcp_hdr_t) || ip->protocol != NET_PROTOCOL_TCP)
+                return 0;
+        const tcp_hdr_t *tcp = (const tcp_hdr_t *)(ip + 1);
+        int data_len = swap16(ip->total_len) - sizeof(ip_hdr_t) - tcp->hdr_len * 4;
+        if (swap16(tcp->dest_port) != TCP_TEST_PORT || data_len <= 0)
+                return 0;
+        uint32_t end = swap32(tcp->seq) + data_len;
+        if (data_segs > 0 && (int32_t)(end - data_high) <= 0)
+                return 0;
+        data_high = end;
+        return 1;
+}
+
+static void loop_push(driver_t *driver, const uint8_t *frame, int len)
+{
+        const ip_hdr_t *ip = (const ip_hdr_t *)(frame + sizeof(ether_hdr_t));
+        if (path_mtu && len > sizeof(ether_hdr_t) + path_mtu && (ip->flags_fragment & swap16(IP_DONT_FRAGMENT << 8)))
+        {
+                too_big++;
+                return;
+        }
+        if (is_client_data(frame, len))
+        {
+                data_segs++;
+                if (drop_next > 0 || (drop_every && data_segs % drop_every == 0))
+                {
+                        if (drop_next > 0)
+                                drop_next--;
+                        dropped++;
+                        return;
+                }
+        }
+        fake_driver_push(driver, frame, len);
+}
+
+static int lossy_loopback(driver_t *driver, uint8_t *frames[], uint16_t lens[], int n, int burst)
+{
+        for (int i = 0; i < n; i++)
+                loop_push(driver, frames[i], lens[i]);
+        return n;
+}
+
+/**
+ * @brief 一端的应用：客户端发送total字节的序列数据，服务端校验收到的数据
+ *
+ */
+typedef struct app
+{
+        tcp_conn_t *conn;
+        uint64_t total;    //要发送的字节数
+        uint64_t sent;     //已放入发送缓冲区的字节数
+        uint64_t received; //已读取的字节数
+        int errors;        //数据不符的字节数
+        int connected, fin, closed;
+        int close_when_done; //发送完后关闭
+        int close_on_fin;    //收到FIN后关闭
+} app_t;
+
+static app_t client, server;
+
+static uint8_t pattern(uint64_t off)
+{
+        return (uint8_t)(off * 7 + (off >> 11));
+}
+
+/**
+ * @brief 直接写入发送缓冲区，直到发完或缓冲区满
+ *
+ */
+static void app_fill(app_t *app)
+{
+        while (app->sent < app->total)
+        {
+                int len;
+                uint8_t *p = tcp_send_buf(app->conn, &len);
+                if (len <= 0)
+                        break;
+                if (len > app->total - app->sent)
+                        len = app->total - app->sent;
+                for (int i = 0; i < len; i++)
+                        p[i] = pattern(app->sent + i);
+                tcp_send_commit(app->conn, len);
+                app->sent += len;
+        }
+        if (app->sent == app->total && app->close_when_done)
+        {
+                app->close_when_done = 0;
+                tcp_close(app->conn);
+        }
+}
+
+/**
+ * @brief 直接从接收缓冲区读取并校验
+ *
+ */
+static void app_drain(app_t *app)
+{
+        int len;
+        uint8_t *p;
+        while ((p = tcp_recv_buf(app->conn, &len)), len > 0)
+        {
+                for (int i = 0; i < len; i++)
+                        if (p[i] != pattern(app->received + i))
+                                app->errors++;
+                app->received += len;
+                tcp_recv_consume(app->conn, len);
+        }
+}
+
+static void handler(tcp_conn_t *conn, tcp_event_t event, void *arg)
+{
+        app_t *app = arg;
+        app->conn = conn;
+        switch (event)
+        {
+        case TCP_EVENT_CONNECTED:
+                app->connected = 1;
+                app_fill(app);
+                break;
+        case TCP_EVENT_SENT:
+                app_fill(app);
+                break;
+        case TCP_EVENT_RECV:
+                app_drain(app);
+                break;
+        case TCP_EVENT_FIN:
+                app->fin = 1;
+                if (app->close_on_fin)
+                        tcp_close(conn);
+                break;
+        case TCP_EVENT_CLOSED:
+                app->closed = 1;
+                app->conn = NULL;
+                break;
+        }
+}
+
+/**
+ * @brief 轮询直到cond成立或超过ms毫秒
+ *
+ */
+#define POLL_UNTIL(cond, ms)                                              \
+        do                                                                \
+        {                                                                 \
+                uint64_t deadline = timer_now_ms() + (ms);                \
+                while (!(cond) && timer_now_ms() < deadline)              \
+                        net_poll();                                       \
+        } while (0)
+
+/**
+ * @brief 新建一对连接，客户端发送total字节
+ *
+ */
+static int open_pair(uint64_t total)
+{
+        memset(&client, 0, sizeof(client));
+        memset(&server, 0, sizeof(server));
+        client.total = total;
+        data_segs = dropped = 0;
+        if (tcp_connect(server_ip, TCP_TEST_PORT, 0, handler, &client) == NULL)
+                return -1;
+        POLL_UNTIL(client.connected && server.connected, 1000);
+        return client.connected && server.connected ? 0 : -1;
+}
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        fake_driver_set(NULL, lossy_loopback);
+        net_init();
+        uint8_t my_ip[] = DRIVER_IF_IP, my_mac[] = DRIVER_IF_MAC;
+        netif_add_addr(0, server_ip, 24);
+        arp_update(my_ip, my_mac, ARP_VALID);
+        arp_update(server_ip, my_mac, ARP_VALID);
+        net_poll();
+        tcp_listen(TCP_TEST_PORT, handler, &server);
+        if (tcp_listen(TCP_TEST_PORT, handler, &server) != -1)
+        {
+                printf("\e[0;31mtcp_listen accepted a duplicate port\n");
+                result = 1;
+        }
+
+        // 连接未监听的端口收到复位
+        app_t refused = {0};
+        tcp_connect(server_ip, TCP_TEST_CLOSED_PORT, 0, handler, &refused);
+        POLL_UNTIL(refused.closed, 1000);
+        if (!refused.closed || refused.connected || tcp_get_stats()->resets_in != 1 || tcp_conn_count() != 0)
+        {
+                printf("\e[0;31mconnection to a closed port not reset\n");
+                result = 1;
+        }
+
+        // 大块传输：数据完整，首部预测命中，确认被合并，窗口扩大与SACK协商成功
+        const uint64_t bulk = 16u << 20;
+        tcp_stats_t before = *tcp_get_stats();
+        if (open_pair(bulk) != 0)
+        {
+                printf("\e[0;31mhandshake did not complete\n");
+                return 1;
+        }
+        if (!client.conn->wscale_ok || !client.conn->sack_ok || client.conn->snd_wscale != server.conn->rcv_wscale ||
+            server.conn->rcv_wscale == 0 || client.conn->mss != ETHERNET_MTU - 40)
+        {
+                printf("\e[0;31moptions not negotiated: wscale %d/%d sack %d mss %d\n", client.conn->wscale_ok,
+                       client.conn->snd_wscale, client.conn->sack_ok, client.conn->mss);
+                result = 1;
+        }
+        uint32_t max_wnd = 0;
+        uint64_t deadline = timer_now_ms() + 10000;
+        while (server.received < bulk && timer_now_ms() < deadline)
+        {
+                net_poll();
+                if (client.conn->snd_wnd > max_wnd)
+                        max_wnd = client.conn->snd_wnd;
+        }
+        POLL_UNTIL(client.conn->snd_una == client.conn->snd_max, 1000);
+        const tcp_stats_t *st = tcp_get_stats();
+        uint64_t data_in = st->predicted_data - before.predicted_data, acks = st->acks_out - before.acks_out;
+        if (server.received != bulk || server.errors || st->retrans_segs != before.retrans_segs)
+        {
+                printf("\e[0;31mbulk: %lu of %lu bytes, %d corrupt, %lu retransmitted\n", (unsigned long)server.received,
+                       (unsigned long)bulk, server.errors, (unsigned long)(st->retrans_segs - before.retrans_segs));
+                result = 1;
+        }
+        if (data_in < bulk / ETHERNET_MTU / 2 || st->predicted_acks == before.predicted_acks || acks * 3 > data_in * 2)
+        {
+                printf("\e[0;31mbulk: %lu predicted data segments, %lu predicted acks, %lu acks sent\n", (unsigned long)data_in,
+                       (unsigned long)(st->predicted_acks - before.predicted_acks), (unsigned long)acks);
+                result = 1;
+        }
+        if (max_wnd <= 0xffff)
+        {
+                printf("\e[0;31mpeer window never exceeded 64KB: %u\n", max_wnd);
+                result = 1;
+        }
+
+        // 单个小报文段的确认被延迟
+        tcp_set_nodelay(client.conn, 1);
+        before = *tcp_get_stats();
+        uint8_t small = pattern(server.received);
+        tcp_send(client.conn, &small, 1);
+        POLL_UNTIL(client.conn->snd_una == client.conn->snd_max && server.received == bulk + 1, 1000);
+        st = tcp_get_stats();
+        if (server.received != bulk + 1 || st->delayed_acks != before.delayed_acks + 1)
+        {
+                printf("\e[0;31msmall segment: received %lu, %lu delayed acks\n", (unsigned long)(server.received - bulk),
+                       (unsigned long)(st->delayed_acks - before.delayed_acks));
+                result = 1;
+        }
+
+        // 四次挥手：主动关闭方进入TIME_WAIT，被动关闭方结束
+        tcp_conn_t *client_conn = client.conn;
+        server.close_on_fin = 1;
+        tcp_close(client.conn);
+        POLL_UNTIL(server.closed && client.fin, 1000);
+        if (!server.closed || !client.fin || client.closed || client_conn->state != TCP_TIME_WAIT || tcp_conn_count() != 1)
+        {
+                printf("\e[0;31mclose: server closed %d, client state %d, %d connections\n", server.closed,
+                       client.closed ? TCP_CLOSED : client_conn->state, tcp_conn_count());
+                result = 1;
+        }
+        tcp_abort(client_conn);
+        net_poll();
+
+        // 每50个数据报文段丢弃一个：SACK快速重传恢复，不超时
+        before = *tcp_get_stats();
+        drop_every = 50;
+        if (open_pair(4u << 20) != 0)
+        {
+                printf("\e[0;31mhandshake did not complete\n");
+                return 1;
+        }
+        client.close_when_done = 1;
+        server.close_on_fin = 1;
+        POLL_UNTIL(client.fin && server.closed, 10000);
+        drop_every = 0;
+        st = tcp_get_stats();
+        if (server.received != client.total || server.errors || !server.closed || st->fast_retrans == before.fast_retrans ||
+            st->ooo_segs == before.ooo_segs || st->timeouts != before.timeouts || dropped == 0)
+        {
+                printf("\e[0;31mloss: %lu of %lu bytes, %d corrupt, %d dropped, %lu fast retransmits, %lu timeouts\n",
+                       (unsigned long)server.received, (unsigned long)client.total, server.errors, dropped,
+                       (unsigned long)(st->fast_retrans - before.fast_retrans), (unsigned long)(st->timeouts - before.timeouts));
+                result = 1;
+        }
+        if (client.conn != NULL)
+                tcp_abort(client.conn);
+        net_poll();
+
+        // 尾部丢包没有重复确认，由重传超时恢复
+        before = *tcp_get_stats();
+        if (open_pair(0) != 0)
+        {
+                printf("\e[0;31mhandshake did not complete\n");
+                return 1;
+        }
+        client.total = 1000;
+        drop_next = 1;
+        uint64_t start = timer_now_ms();
+        app_fill(&client);
+        POLL_UNTIL(server.received == 1000, 3000);
+        st = tcp_get_stats();
+        if (server.received != 1000 || server.errors || st->timeouts != before.timeouts + 1 || timer_now_ms() - start < TCP_RTO_MIN_MS)
+        {
+                printf("\e[0;31mtail loss: %lu bytes after %lu ms, %lu timeouts\n", (unsigned long)server.received,
+                       (unsigned long)(timer_now_ms() - start), (unsigned long)(st->timeouts - before.timeouts));
+                result = 1;
+        }
+        tcp_abort(client.conn);
+        POLL_UNTIL(server.closed, 1000);
+        if (!server.closed || tcp_conn_count() != 0 || tcp_get_stats()->resets_in == before.resets_in)
+        {
+                printf("\e[0;31mabort did not reset the peer\n");
+                result = 1;
+        }
+
+        // 传输中路径MTU减小：路由器丢弃过大的报文段并回送“需要分片”差错，之后的报文段按新的路径MTU缩小
+        if (open_pair(1u << 20) != 0)
+        {
+                printf("\e[0;31mhandshake did not complete\n");
+                return 1;
+        }
+        POLL_UNTIL(server.received > 0, 1000);
+        path_mtu = 1200;
+        ip_pmtu_update(server_ip, path_mtu, ETHERNET_MTU);
+        client.close_when_done = 1;
+        server.close_on_fin = 1;
+        POLL_UNTIL(client.fin && server.closed, 10000);
+        int shrunk_mss = client.conn != NULL ? client.conn->mss : 0;
+        path_mtu = 0;
+        if (server.received != client.total || server.errors || !server.closed || shrunk_mss != 1200 - 40)
+        {
+                printf("\e[0;31mpmtu drop: %lu of %lu bytes, %d corrupt, %d too big, mss %d\n", (unsigned long)server.received,
+                       (unsigned long)client.total, server.errors, too_big, shrunk_mss);
+                result = 1;
+        }
+        if (client.conn != NULL)
+                tcp_abort(client.conn);
+        net_poll();
+
+        if (result)
+        {
+                printf("\e[1;31m====> Some connections did not behave as expected.\n");
+        }
+        else
+        {
+                printf("\e[1;32m====> All connections behaved as expected.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <time.h>
+#include "timer.h"
+
+#define TIMER_TEST_COUNT 64
+
+net_timer_t timers[TIMER_TEST_COUNT];
+uint64_t fired_at[TIMER_TEST_COUNT];
+int fired[TIMER_TEST_COUNT];
+uint64_t start;
+
+static void on_expire(net_timer_t *timer, void *arg)
+{
+        int i = timer - timers;
+        fired[i]++;
+        fired_at[i] = timer_now_ms() - start;
+        if(arg) // 周期定时器，在处理程序中重新启动
+                timer_add(timer, (uintptr_t)arg, on_expire, arg);
+}
+
+static void run_until(uint64_t ms)
+{
+        struct timespec ts = {0, 1000000};
+        while(timer_now_ms() - start < ms){
+                timer_poll();
+                nanosleep(&ts, NULL);
+        }
+}
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        timer_init();
+        start = timer_now_ms();
+
+        // 单次定时器，到期时间跨越时间轮的一圈
+        for(int i = 0; i < TIMER_TEST_COUNT - 2; i++)
+                timer_add(&timers[i], 5 + i * 97 % (TIMER_TICK_MS * TIMER_WHEEL_SIZE + 400), on_expire, NULL);
+        // 一半在到期前停止
+        for(int i = 0; i < TIMER_TEST_COUNT - 2; i += 2)
+                timer_del(&timers[i]);
+        // 重新设置到期时间
+        timer_add(&timers[1], 30, on_expire, NULL);
+        // 周期定时器
+        timer_add(&timers[TIMER_TEST_COUNT - 1], 100, on_expire, (void *)100);
+        // 未启动的定时器可以安全地停止
+        timer_del(&timers[TIMER_TEST_COUNT - 2]);
+
+        run_until(TIMER_TICK_MS * TIMER_WHEEL_SIZE + 600);
+
+        for(int i = 0; i < TIMER_TEST_COUNT - 1; i++){
+                int expect = i % 2 == 1;
+                uint64_t due = i == 1 ? 30 : 5 + i * 97 % (TIMER_TICK_MS * TIMER_WHEEL_SIZE + 400);
+                if(fired[i] != expect){
+                        printf("\e[0;31mtimer %d fired %d times, expect %d\n", i, fired[i], expect);
+                        result = 1;
+                }else if(expect && (fired_at[i] < due || fired_at[i] > due + 2 * TIMER_TICK_MS + 20)){
+                        printf("\e[0;31mtimer %d fired at %lu ms, due %lu ms\n", i,
+                               (unsigned long)fired_at[i], (unsigned long)due);
+                        result = 1;
+                }
+        }
+        int periodic = fired[TIMER_TEST_COUNT - 1];
+        int periodic_expect = (TIMER_TICK_MS * TIMER_WHEEL_SIZE + 600) / 100;
+        if(periodic < periodic_expect - 1 || periodic > periodic_expect){
+                printf("\e[0;31mperiodic timer fired %d times, expect about %d\n", periodic, periodic_expect);
+                result = 1;
+        }
+        timer_del(&timers[TIMER_TEST_COUNT - 1]);
+
+        if(result){
+                printf("\e[1;31m====> Some timers did not fire as expected.\n");
+        }else{
+                printf("\e[1;32m====> All timers fired as expected.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
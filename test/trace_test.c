@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "net.h"
+#include "stack.h"
+#include "trace.h"
+#include "driver.h"
+#include "netif.h"
+#include "faker/fake_driver.h"
+
+/**
+ * 跟踪测试（以-DNET_TRACE=1编译）：驱动替身把发出的数据帧放回接收队列，
+ * 发送一个数据报并轮询，写入快照后读回，检查发送路径经过ip_out、arp_out、driver_send，
+ * 同一个数据包的接收路径依次经过driver_recv、ethernet_in、ip_in、udp_in、handler调用与返回，
+ * 以及时间戳不减；再写满跟踪环，检查快照只保留最新的记录并报告被覆盖的记录数。
+ */
+
+#define TEST_PORT 7000
+
+static void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+}
+
+/**
+ * @brief 在记录中从start开始查找一个跟踪点
+ *
+ * @return int 下标，找不到为-1
+ */
+static int find(const net_trace_rec_t *recs, uint32_t count, uint32_t start, uint16_t event)
+{
+        for (uint32_t i = start; i < count; i++)
+                if (recs[i].event == event)
+                        return i;
+        return -1;
+}
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        fake_driver_set(NULL, fake_driver_loopback);
+        uint8_t my_ip[] = DRIVER_IF_IP, my_mac[] = DRIVER_IF_MAC, peer_ip[] = {192, 168, 231, 101};
+        uint8_t payload[100] = {0};
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/net_trace_test_%d", getpid());
+        net_init();
+        netif_add_addr(0, peer_ip, 24);
+        arp_update(my_ip, my_mac, ARP_VALID);
+        arp_update(peer_ip, my_mac, ARP_VALID);
+        udp_open(TEST_PORT, handler);
+        net_poll();
+
+        udp_send(payload, sizeof(payload), TEST_PORT + 1, peer_ip, TEST_PORT);
+        net_poll();
+        net_trace_file_t file;
+        net_trace_rec_t *recs = NULL;
+        if (net_trace_snapshot(path) != 0 || (recs = net_trace_load(path, &file)) == NULL)
+        {
+                printf("\e[0;31msnapshot not written or not readable\n");
+                printf("\e[1;31m====> Some traces were wrong.\n\e[0m");
+                unlink(path);
+                return 1;
+        }
+        if (file.lost != 0 || file.count == 0 || file.tsc_hz <= 0 || file.pid != getpid())
+        {
+                printf("\e[0;31mbad snapshot header: count %u lost %lu\n", file.count, (unsigned long)file.lost);
+                result = 1;
+        }
+        for (uint32_t i = 1; i < file.count; i++)
+                if (recs[i].tsc < recs[i - 1].tsc)
+                {
+                        printf("\e[0;31mtimestamps go backwards at record %u\n", i);
+                        result = 1;
+                        break;
+                }
+
+        // 发送：ip_out之后是命中arp表的arp_out，再交给驱动
+        int ip_out = find(recs, file.count, 0, NET_TRACE_IP_OUT);
+        int arp_out = ip_out < 0 ? -1 : find(recs, file.count, ip_out, NET_TRACE_ARP_OUT);
+        int send = arp_out < 0 ? -1 : find(recs, file.count, arp_out, NET_TRACE_DRIVER_SEND);
+        if (send < 0 || recs[ip_out].arg != NET_PROTOCOL_UDP || recs[arp_out].arg != 1)
+        {
+                printf("\e[0;31msend path not traced\n");
+                result = 1;
+        }
+
+        // 接收：最后一个数据包的记录按层次依次出现，且序号相同
+        static const uint16_t path_in[] = {NET_TRACE_DRIVER_RECV, NET_TRACE_ETHERNET_IN, NET_TRACE_IP_IN,
+                                           NET_TRACE_UDP_IN, NET_TRACE_HANDLER_ENTER, NET_TRACE_HANDLER_EXIT};
+        int at = -1;
+        for (int i = (int)file.count - 1; i >= 0 && at < 0; i--)
+                if (recs[i].event == NET_TRACE_DRIVER_RECV)
+                        at = i;
+        for (size_t k = 0; at >= 0 && k < sizeof(path_in) / sizeof(path_in[0]); k++, at++)
+        {
+                if (at >= (int)file.count || recs[at].event != path_in[k] || recs[at].pkt != recs[at - k].pkt)
+                {
+                        printf("\e[0;31mexpected %s, got %s\n", net_trace_name(path_in[k]),
+                               at < (int)file.count ? net_trace_name(recs[at].event) : "end");
+                        result = 1;
+                        break;
+                }
+                if (path_in[k] == NET_TRACE_UDP_IN && recs[at].arg != TEST_PORT)
+                {
+                        printf("\e[0;31mudp_in traced port %lu\n", (unsigned long)recs[at].arg);
+                        result = 1;
+                }
+        }
+        if (at < 0)
+        {
+                printf("\e[0;31mno frame received\n");
+                result = 1;
+        }
+        free(recs);
+
+        // 写满跟踪环：快照只含最新的NET_TRACE_RING_SIZE条记录
+        for (int i = 0; i < NET_TRACE_RING_SIZE / 4; i++)
+        {
+                udp_send(payload, sizeof(payload), TEST_PORT + 1, peer_ip, TEST_PORT);
+                net_poll();
+        }
+        recs = NULL;
+        if (net_trace_snapshot(path) != 0 || (recs = net_trace_load(path, &file)) == NULL ||
+            file.count != NET_TRACE_RING_SIZE || file.lost == 0 || recs[file.count - 1].event != NET_TRACE_HANDLER_EXIT)
+        {
+                printf("\e[0;31mwrapped ring not snapshotted correctly\n");
+                result = 1;
+        }
+        free(recs);
+        unlink(path);
+
+        if (result)
+        {
+                printf("\e[1;31m====> Some traces were wrong.\n");
+        }
+        else
+        {
+                printf("\e[1;32m====> All traces were right.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <string.h>
+#include "net.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "udp.h"
+#include "route.h"
+#include "netif.h"
+#include "stack.h"
+#include "faker/fake_driver.h"
+
+/**
+ * udp校验和测试：与逐字节按定义计算的校验和对照，
+ * 检查udp_in()接受正确与未计算校验和的数据报、丢弃校验和错误的数据报，且不修改udp头部之前的空间；
+ * 大量地址对挤占伪头部累加和缓存时结果仍然正确，缓存的累加和在udp_flush()之后仍被保留；
+ * udp_send()发出的数据报带有正确的校验和，计算结果为0时填0xffff。
+ */
+
+static uint8_t frame[ETHERNET_MTU + sizeof(ether_hdr_t)];
+static int frame_len;
+
+static int capture(driver_t *driver, uint8_t *frames[], uint16_t lens[], int n, int burst)
+{
+        //只保留最后发出的数据帧
+        memcpy(frame, frames[n - 1], lens[n - 1]);
+        frame_len = lens[n - 1];
+        return n;
+}
+
+#define CHECKSUM_TEST_PORT 60020
+
+static uint8_t my_ip[] = DRIVER_IF_IP, peer_ip[] = {192, 168, 231, 1}, peer_mac[] = {0x02, 0, 0, 0, 0, 1};
+static int received;
+
+static void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        received++;
+}
+
+/**
+ * @brief 按定义计算udp校验和：伪头部、udp头部与数据按大端16位字累加，奇数长度末尾补0
+ *
+ */
+static uint16_t reference_checksum(const uint8_t *src_ip, const uint8_t *dest_ip, const uint8_t *udp, int len)
+{
+        uint8_t peso[12] = {src_ip[0], src_ip[1], src_ip[2], src_ip[3], dest_ip[0], dest_ip[1], dest_ip[2], dest_ip[3],
+                            0, NET_PROTOCOL_UDP, len >> 8, len & 0xff};
+        uint32_t sum = 0;
+        for (int i = 0; i < 12; i += 2)
+                sum += peso[i] << 8 | peso[i + 1];
+        for (int i = 0; i < len; i += 2)
+                sum += udp[i] << 8 | (i + 1 < len ? udp[i + 1] : 0);
+        while (sum >> 16)
+                sum = (sum & 0xffff) + (sum >> 16);
+        return ~sum & 0xffff;
+}
+
+/**
+ * @brief 从src_ip交付一个数据长度为len的数据报
+ *
+ * @param mode 0为正确的校验和，1为不计算校验和，2为错误的校验和
+ * @return int 数据报被交付给处理程序为1，udp头部之前的空间被修改为-1，否则为0
+ */
+static int deliver(uint8_t *src_ip, int len, int mode)
+{
+        static buf_t buf;
+        buf_init(&buf, 8 + len);
+        uint8_t *p = buf.data;
+        memset(buf.payload, 0xa5, p - buf.payload);
+        p[0] = 5000 >> 8; p[1] = 5000 & 0xff; p[2] = CHECKSUM_TEST_PORT >> 8; p[3] = CHECKSUM_TEST_PORT & 0xff;
+        p[4] = (8 + len) >> 8; p[5] = 8 + len; p[6] = 0; p[7] = 0;
+        for (int i = 0; i < len; i++)
+                p[8 + i] = i * 13 + len;
+        uint16_t cksum = mode == 1 ? 0 : reference_checksum(src_ip, my_ip, p, 8 + len) ^ (mode == 2 ? 0x0100 : 0);
+        p[6] = cksum >> 8;
+        p[7] = cksum & 0xff;
+        int before = received;
+        udp_in(&buf, src_ip, my_ip);
+        for (uint8_t *q = buf.payload; q < p; q++)
+                if (*q != 0xa5)
+                        return -1;
+        return received - before;
+}
+
+/**
+ * @brief 发送一个数据报并检查截获的数据帧中的校验和
+ *
+ */
+static int send_and_check(uint8_t *data, int len, uint16_t expect)
+{
+        frame_len = 0;
+        udp_send(data, len, 60000, peer_ip, CHECKSUM_TEST_PORT);
+        uint8_t *udp = frame + sizeof(ether_hdr_t) + sizeof(ip_hdr_t);
+        uint16_t cksum = udp[6] << 8 | udp[7];
+        if (frame_len != sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + 8 + len ||
+            (expect ? cksum != expect : reference_checksum(my_ip, peer_ip, udp, 8 + len) != 0))
+        {
+                printf("\e[0;31mtx len %d: frame %d bytes, checksum %04x\n", len, frame_len, cksum);
+                return 1;
+        }
+        return 0;
+}
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        fake_driver_set(NULL, capture);
+        route_init();
+        netif_init();
+        ethernet_init();
+        arp_init();
+        udp_init();
+        arp_update(peer_ip, peer_mac, ARP_VALID);
+        udp_open(CHECKSUM_TEST_PORT, handler);
+
+        // 各种长度的正确、未计算与错误的校验和
+        for (int len = 0; len <= 1472; len += len < 64 ? 1 : 101)
+        {
+                int ok = deliver(peer_ip, len, 0), none = deliver(peer_ip, len, 1), bad = deliver(peer_ip, len, 2);
+                if (ok != 1 || none != 1 || bad != 0)
+                {
+                        printf("\e[0;31mrx len %d: valid %d, none %d, corrupted %d\n", len, ok, none, bad);
+                        result = 1;
+                }
+        }
+
+        // 大量地址对挤占缓存
+        for (int round = 0; round < 2; round++)
+                for (int i = 0; i < 4 * UDP_PESO_CACHE_SIZE; i++)
+                {
+                        uint8_t src[] = {10, i >> 8, i & 0xff, 1};
+                        if (deliver(src, 33, 0) != 1 || deliver(src, 33, 2) != 0)
+                        {
+                                printf("\e[0;31mrx from %s: wrong result\n", iptos(src));
+                                result = 1;
+                                break;
+                        }
+                }
+
+        // 每次轮询结束时的udp_flush()不清空缓存
+        deliver(peer_ip, 33, 0);
+        udp_flush();
+        const udp_ctx_t *udp_ctx = &net_stack_current()->udp;
+        uint32_t peer;
+        memcpy(&peer, peer_ip, NET_IP_LEN);
+        int cached = 0;
+        for (int i = 0; i < UDP_PESO_CACHE_SIZE; i++)
+                cached |= udp_ctx->peso_cache[i].sum != 0 && udp_ctx->peso_cache[i].src == peer;
+        if (!cached)
+        {
+                printf("\e[0;31mpseudo header sum dropped by udp_flush\n");
+                result = 1;
+        }
+
+        // 发送的校验和
+        static uint8_t data[1472];
+        for (int i = 0; i < sizeof(data); i++)
+                data[i] = i * 7 + 3;
+        result |= send_and_check(data, 0, 0);
+        result |= send_and_check(data, 1, 0);
+        result |= send_and_check(data, 1001, 0);
+        result |= send_and_check(data, sizeof(data), 0);
+        // 末尾两字节取为数据为0时的校验和，使校验和的计算结果为0
+        uint8_t udp[8 + 10] = {60000 >> 8, 60000 & 0xff, CHECKSUM_TEST_PORT >> 8, CHECKSUM_TEST_PORT & 0xff, 0, 18};
+        memcpy(udp + 8, data, 8);
+        uint16_t fill = reference_checksum(my_ip, peer_ip, udp, sizeof(udp));
+        data[8] = fill >> 8;
+        data[9] = fill & 0xff;
+        result |= send_and_check(data, 10, 0xffff);
+
+        if (result)
+        {
+                printf("\e[1;31m====> Some checksums were not handled as expected.\n");
+        }
+        else
+        {
+                printf("\e[1;32m====> All checksums were handled as expected.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
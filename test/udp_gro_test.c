@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <string.h>
+#include "udp.h"
+
+/**
+ * 接收合并测试：直接向udp_in()交付交错到达的几条流，
+ * 检查批量处理程序每条流只被调用一次、数据报保持到达顺序，
+ * 普通处理程序仍逐个立即调用，暂存区满时提前交付，端口关闭后不再交付，
+ * 超过暂存槽的数据报直接交付前先交付同一流已暂存的数据报。
+ */
+
+#define GRO_TEST_CALLS 64
+
+typedef struct call
+{
+        uint16_t port;
+        uint8_t src_ip[NET_IP_LEN];
+        uint16_t src_port;
+        int count;
+        uint8_t first, last; //第一个与最后一个数据报的序号
+} call_t;
+
+call_t calls[GRO_TEST_CALLS];
+int call_count;
+int plain_count;
+
+static uint8_t my_ip[] = DRIVER_IF_IP;
+static uint8_t peer_a[] = {192, 168, 231, 1}, peer_b[] = {192, 168, 231, 2};
+
+static void batch_handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port,
+                          uint8_t **data, uint16_t *lens, int count)
+{
+        call_t *c = &calls[call_count++ % GRO_TEST_CALLS];
+        c->port = entry->port;
+        memcpy(c->src_ip, src_ip, NET_IP_LEN);
+        c->src_port = src_port;
+        c->count = count;
+        c->first = data[0][0];
+        c->last = data[count - 1][0];
+        for (int i = 1; i < count; i++)
+                if (data[i][0] != (uint8_t)(data[i - 1][0] + 1) || lens[i] != 4)
+                        c->count = -1; //顺序或长度错误
+}
+
+static void plain_handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        plain_count++;
+}
+
+/**
+ * @brief 交付一个len字节数据的udp数据报，数据第一个字节为序号，不带校验和
+ *
+ */
+static void deliver_len(uint8_t *src_ip, uint16_t src_port, uint16_t dest_port, uint8_t seq, uint16_t len)
+{
+        static buf_t buf;
+        buf_init(&buf, 8 + len);
+        uint8_t *p = buf.data;
+        memset(p, 0, 8 + len);
+        p[0] = src_port >> 8; p[1] = src_port; p[2] = dest_port >> 8; p[3] = dest_port;
+        p[4] = (8 + len) >> 8; p[5] = 8 + len;
+        p[8] = seq;
+        udp_in(&buf, src_ip, my_ip);
+}
+
+/**
+ * @brief 交付一个4字节数据的udp数据报
+ *
+ */
+static void deliver(uint8_t *src_ip, uint16_t src_port, uint16_t dest_port, uint8_t seq)
+{
+        deliver_len(src_ip, src_port, dest_port, seq, 4);
+}
+
+static int expect(int i, uint16_t port, uint8_t *src_ip, uint16_t src_port, int count, uint8_t first)
+{
+        call_t *c = &calls[i];
+        if (i >= call_count || c->port != port || memcmp(c->src_ip, src_ip, NET_IP_LEN) ||
+            c->src_port != src_port || c->count != count || c->first != first)
+        {
+                printf("\e[0;31mcall %d: port %d from %d.%d.%d.%d:%d, %d datagrams starting at %d\n", i,
+                       c->port, c->src_ip[0], c->src_ip[1], c->src_ip[2], c->src_ip[3], c->src_port, c->count, c->first);
+                return 1;
+        }
+        return 0;
+}
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        udp_init();
+        udp_open_batch(60000, batch_handler);
+        udp_open_batch(60002, batch_handler);
+        udp_open(60001, plain_handler);
+
+        // 交错到达的三条流与一个普通端口
+        uint8_t seq_a = 0, seq_b = 100, seq_c = 200;
+        for (int i = 0; i < 10; i++)
+        {
+                deliver(peer_a, 5000, 60000, seq_a++);
+                if (i % 2)
+                        deliver(peer_b, 5000, 60000, seq_b++);
+                if (i % 3 == 0)
+                        deliver(peer_a, 5000, 60002, seq_c++);
+                deliver(peer_a, 5001, 60001, 0);
+        }
+        if (call_count != 0 || plain_count != 10)
+        {
+                printf("\e[0;31mdelivered before flush: %d batch calls, %d plain calls\n", call_count, plain_count);
+                result = 1;
+        }
+        udp_flush();
+        if (call_count != 3)
+        {
+                printf("\e[0;31m%d batch calls after flush, expect 3\n", call_count);
+                result = 1;
+        }
+        result |= expect(0, 60000, peer_a, 5000, 10, 0);
+        result |= expect(1, 60002, peer_a, 5000, 4, 200); //按每条流第一个数据报的到达顺序交付
+        result |= expect(2, 60000, peer_b, 5000, 5, 100);
+        udp_flush();
+        if (call_count != 3)
+        {
+                printf("\e[0;31man empty flush delivered again\n");
+                result = 1;
+        }
+
+        // 超过暂存区容量时提前交付，顺序不变
+        call_count = 0;
+        seq_a = 0;
+        for (int i = 0; i < UDP_GRO_MAX_SEGS + 5; i++)
+                deliver(peer_a, 5000, 60000, seq_a++);
+        udp_flush();
+        result |= expect(0, 60000, peer_a, 5000, UDP_GRO_MAX_SEGS, 0);
+        result |= expect(1, 60000, peer_a, 5000, 5, UDP_GRO_MAX_SEGS);
+
+        // 超过暂存槽的数据报直接交付，同一流已暂存的数据报先交付，其他流仍暂存到批次结束
+        call_count = 0;
+        for (uint8_t seq = 0; seq < 3; seq++)
+                deliver(peer_a, 5000, 60000, seq);
+        deliver(peer_b, 5000, 60000, 100);
+        deliver_len(peer_a, 5000, 60000, 3, ETHERNET_MTU + 1);
+        deliver(peer_a, 5000, 60000, 4);
+        if (call_count != 2)
+        {
+                printf("\e[0;31m%d batch calls for a large datagram, expect 2\n", call_count);
+                result = 1;
+        }
+        udp_flush();
+        result |= expect(0, 60000, peer_a, 5000, 3, 0);
+        result |= expect(1, 60000, peer_a, 5000, 1, 3);
+        result |= expect(2, 60000, peer_a, 5000, 1, 4);
+        result |= expect(3, 60000, peer_b, 5000, 1, 100);
+
+        // 交付前关闭端口，暂存的数据报被丢弃
+        call_count = 0;
+        deliver(peer_a, 5000, 60002, 0);
+        udp_close(60002);
+        udp_flush();
+        if (call_count != 0)
+        {
+                printf("\e[0;31mdatagrams delivered to a closed port\n");
+                result = 1;
+        }
+
+        if (result)
+        {
+                printf("\e[1;31m====> Some datagrams were not coalesced as expected.\n");
+        }
+        else
+        {
+                printf("\e[1;32m====> All datagrams were coalesced as expected.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
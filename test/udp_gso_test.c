@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <string.h>
+#include "net.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "udp.h"
+#include "route.h"
+#include "netif.h"
+#include "stack.h"
+#include "faker/fake_driver.h"
+
+/**
+ * 分段发送测试：用驱动替身截获发出的数据帧，
+ * 检查udp_send_gso()构造的每个数据报的长度、DF位、ip与udp校验和，
+ * 拼接后的数据与原数据一致，并且全部经批量发送接口发出；
+ * 下一跳未知时数据报在arp层等待，只有等待的地址的应答才把它发出，等待期间仍应答其他主机的arp请求。
+ */
+
+#define GSO_TEST_FRAMES 256
+#define GSO_TEST_HDR_LEN (sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + sizeof(udp_hdr_t))
+
+static uint8_t frames[GSO_TEST_FRAMES][ETHERNET_MTU + sizeof(ether_hdr_t)];
+static uint16_t lens[GSO_TEST_FRAMES];
+static int frame_count, burst_calls, single_sends;
+static uint8_t last_single[ETHERNET_MTU + sizeof(ether_hdr_t)];
+
+static int capture(driver_t *driver, uint8_t *burst[], uint16_t burst_lens[], int n, int is_burst)
+{
+        if (!is_burst)
+        {
+                single_sends++;
+                memcpy(last_single, burst[0], burst_lens[0]);
+                return n;
+        }
+        burst_calls++;
+        for (int i = 0; i < n && frame_count < GSO_TEST_FRAMES; i++, frame_count++)
+        {
+                memcpy(frames[frame_count], burst[i], burst_lens[i]);
+                lens[frame_count] = burst_lens[i];
+        }
+        return n;
+}
+
+static uint8_t data[100 * 1472];
+static uint8_t peer_ip[] = {192, 168, 231, 1}, peer_mac[] = {0x02, 0, 0, 0, 0, 1};
+static uint8_t my_ip[] = DRIVER_IF_IP;
+
+/**
+ * @brief 向arp层交付一个来自sender的arp报文
+ *
+ */
+static void deliver_arp(uint16_t opcode, uint8_t *sender_ip, uint8_t *sender_mac)
+{
+        buf_t buf;
+        buf_init(&buf, sizeof(arp_pkt_t));
+        arp_pkt_t *pkt = (arp_pkt_t *)buf.data;
+        memset(pkt, 0, sizeof(arp_pkt_t));
+        pkt->hw_type = swap16(ARP_HW_ETHER);
+        pkt->pro_type = swap16(NET_PROTOCOL_IP);
+        pkt->hw_len = NET_MAC_LEN;
+        pkt->pro_len = NET_IP_LEN;
+        pkt->opcode = swap16(opcode);
+        memcpy(pkt->sender_ip, sender_ip, NET_IP_LEN);
+        memcpy(pkt->sender_mac, sender_mac, NET_MAC_LEN);
+        memcpy(pkt->target_ip, my_ip, NET_IP_LEN);
+        arp_in(&buf);
+}
+
+/**
+ * @brief 检查截获的数据帧，返回出错的数据帧数
+ *
+ */
+static int check(int len, int seg_size, int expect_bursts)
+{
+        int errors = 0, off = 0;
+        int expect_frames = (len + seg_size - 1) / seg_size;
+        if (frame_count != expect_frames || burst_calls != expect_bursts || single_sends != 0)
+        {
+                printf("\e[0;31mlen %d seg %d: %d frames in %d bursts and %d single sends, expect %d frames in %d bursts\n",
+                       len, seg_size, frame_count, burst_calls, single_sends, expect_frames, expect_bursts);
+                return 1;
+        }
+        for (int i = 0; i < frame_count; i++)
+        {
+                uint8_t *f = frames[i];
+                ip_hdr_t *ip = (ip_hdr_t *)(f + sizeof(ether_hdr_t));
+                udp_hdr_t *udp = (udp_hdr_t *)(ip + 1);
+                int n = len - off < seg_size ? len - off : seg_size;
+                uint32_t sum = checksum_add(0, ip->src_ip, 2 * NET_IP_LEN) + swap16(NET_PROTOCOL_UDP) + udp->total_len;
+                if (lens[i] != GSO_TEST_HDR_LEN + n || swap16(ip->total_len) != sizeof(ip_hdr_t) + sizeof(udp_hdr_t) + n ||
+                    swap16(udp->total_len) != sizeof(udp_hdr_t) + n || !(ip->flags_fragment & swap16(IP_DONT_FRAGMENT << 8)) ||
+                    memcmp(ip->dest_ip, peer_ip, NET_IP_LEN) || memcmp(f, peer_mac, NET_MAC_LEN) ||
+                    swap16(udp->src_port) != 60000 || swap16(udp->dest_port) != 60001 ||
+                    checksum16((uint16_t *)ip, 10) != 0 || checksum_fold(checksum_add(sum, udp, sizeof(udp_hdr_t) + n)) != 0 ||
+                    memcmp(udp + 1, data + off, n))
+                {
+                        printf("\e[0;31mlen %d seg %d: datagram %d is malformed\n", len, seg_size, i);
+                        errors++;
+                }
+                off += n;
+        }
+        return errors;
+}
+
+static int run(int len, int seg_size, int expect_seg, int expect_bursts)
+{
+        frame_count = burst_calls = single_sends = 0;
+        int count = udp_send_gso(data, len, seg_size, 60000, peer_ip, 60001);
+        if (count != (len + expect_seg - 1) / expect_seg)
+        {
+                printf("\e[0;31mlen %d seg %d: udp_send_gso() returned %d\n", len, seg_size, count);
+                return 1;
+        }
+        return check(len, expect_seg, expect_bursts);
+}
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        fake_driver_set(NULL, capture);
+        route_init();
+        netif_init();
+        ethernet_init();
+        arp_init();
+        arp_update(peer_ip, peer_mac, ARP_VALID);
+        for (int i = 0; i < sizeof(data); i++)
+                data[i] = i * 7 + (i >> 8);
+
+        int mss = udp_get_mtu(peer_ip);
+        result |= run(10000, 1000, 1000, 1);                   // 等长分段
+        result |= run(10500, 1000, 1000, 1);                   // 最后一个分段较短
+        result |= run(10001, 1000, 1000, 1);                   // 奇数长度的最后一个分段
+        result |= run(3 * mss + 1, 60000, mss, 1);             // 分段长度超过路径MTU
+        result |= run(100 * 1000, 1000, 1000, (100 + ETHERNET_TX_BURST - 1) / ETHERNET_TX_BURST); // 超过一个批次
+
+        // 下一跳mac未知时只发出第一个数据报，它在arp层等待应答，只发送一次arp请求
+        uint8_t unknown_ip[] = {192, 168, 231, 77};
+        frame_count = burst_calls = single_sends = 0;
+        int count = udp_send_gso(data, 3000, 1000, 60000, unknown_ip, 60001);
+        arp_buf_t *pending = &net_stack_current()->arp.buf;
+        if (count != 1 || burst_calls != 0 || single_sends != 1 || !pending->valid || memcmp(pending->ip, unknown_ip, NET_IP_LEN) ||
+            pending->buf.len != sizeof(ip_hdr_t) + sizeof(udp_hdr_t) + 1000)
+        {
+                printf("\e[0;31mfallback returned %d, sent %d bursts and %d frames\n", count, burst_calls, single_sends);
+                result = 1;
+        }
+
+        // 其他主机的arp请求得到应答，等待的数据报不会发给它
+        single_sends = 0;
+        deliver_arp(ARP_REQUEST, peer_ip, peer_mac);
+        ether_hdr_t *eth = (ether_hdr_t *)last_single;
+        if (single_sends != 1 || eth->protocol != swap16(NET_PROTOCOL_ARP) || memcmp(eth->dest, peer_mac, NET_MAC_LEN) || !pending->valid)
+        {
+                printf("\e[0;31mrequest while waiting sent %d frames, pending %d\n", single_sends, pending->valid);
+                result = 1;
+        }
+
+        // 等待的地址的应答把数据报发出
+        uint8_t unknown_mac[] = {0x02, 0, 0, 0, 0, 77};
+        single_sends = 0;
+        deliver_arp(ARP_REPLY, unknown_ip, unknown_mac);
+        if (single_sends != 1 || eth->protocol != swap16(NET_PROTOCOL_IP) || memcmp(eth->dest, unknown_mac, NET_MAC_LEN) || pending->valid)
+        {
+                printf("\e[0;31mreply sent %d frames, pending %d\n", single_sends, pending->valid);
+                result = 1;
+        }
+
+        if (result)
+        {
+                printf("\e[1;31m====> Some datagrams were not segmented as expected.\n");
+        }
+        else
+        {
+                printf("\e[1;32m====> All datagrams were segmented as expected.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
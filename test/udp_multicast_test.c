@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <string.h>
+#include "net.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "ip.h"
+#include "icmp.h"
+#include "udp.h"
+#include "route.h"
+#include "netif.h"
+#include "faker/fake_driver.h"
+
+/**
+ * 广播与组播扇出测试：发往本机、受限广播、子网广播与已加入组播组的数据报交给端口的所有订阅者，
+ * 各订阅者收到同一个缓冲区，订阅者保留的缓冲区在释放前不被复用，没有保留时下一个数据报复用同一缓冲区；
+ * 未加入或已退出的组播组的数据报被丢弃；发往广播地址的数据报找不到端口、回显请求都不回送应答；
+ * 处理程序与订阅者共存，回调中可以取消订阅。
+ */
+
+#define MULTICAST_TEST_PORT 30001
+#define MULTICAST_TEST_SUBS 3
+
+static uint8_t my_ip[] = DRIVER_IF_IP, peer_ip[] = {192, 168, 231, 1}, peer_mac[] = {0x02, 0, 0, 0, 0, 1};
+static uint8_t bcast_ip[] = {255, 255, 255, 255}, subnet_bcast_ip[] = {192, 168, 231, 255};
+static uint8_t group_ip[] = {239, 1, 1, 1}, other_group_ip[] = {239, 1, 1, 2};
+static int sent;
+
+static int count_sent(driver_t *driver, uint8_t *frames[], uint16_t lens[], int n, int burst)
+{
+        sent += n;
+        return n;
+}
+
+typedef struct subscriber
+{
+        int received;          //收到的数据报数
+        udp_dgram_t *last;     //上一个数据报
+        int hold;              //是否保留收到的数据报
+        udp_dgram_t *held[16]; //保留的数据报
+        int held_count;
+        int unsubscribe;       //收到后是否取消订阅
+} subscriber_t;
+
+static subscriber_t subs[MULTICAST_TEST_SUBS];
+static int handled;
+
+static void on_dgram(udp_dgram_t *dgram, void *arg)
+{
+        subscriber_t *s = arg;
+        s->received++;
+        s->last = dgram;
+        if (s->hold && s->held_count < 16)
+        {
+                udp_dgram_hold(dgram);
+                s->held[s->held_count++] = dgram;
+        }
+        if (s->unsubscribe)
+                udp_unsubscribe(MULTICAST_TEST_PORT, on_dgram, arg);
+}
+
+static void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        handled++;
+}
+
+/**
+ * @brief 构造并交付一个以太网数据帧
+ *
+ * @param dest_ip 目的ip地址
+ * @param protocol ip上层协议，udp时数据为seq，icmp时为回显请求
+ * @param seq 数据
+ */
+static void deliver(uint8_t *dest_ip, uint16_t port, uint8_t protocol, uint32_t seq)
+{
+        static buf_t buf;
+        int len = sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + 8 + sizeof(seq);
+        buf_init(&buf, len);
+        ether_hdr_t *eth = (ether_hdr_t *)buf.data;
+        ip_hdr_t *ip = (ip_hdr_t *)(eth + 1);
+        uint8_t *l4 = (uint8_t *)(ip + 1);
+        memset(eth->dest, 0xff, NET_MAC_LEN);
+        memcpy(eth->src, peer_mac, NET_MAC_LEN);
+        eth->protocol = swap16(NET_PROTOCOL_IP);
+        memset(ip, 0, sizeof(*ip));
+        ip->version = IP_VERSION_4;
+        ip->hdr_len = 5;
+        ip->ttl = 64;
+        ip->protocol = protocol;
+        ip->total_len = swap16(sizeof(ip_hdr_t) + 8 + sizeof(seq));
+        memcpy(ip->src_ip, peer_ip, NET_IP_LEN);
+        memcpy(ip->dest_ip, dest_ip, NET_IP_LEN);
+        ip->hdr_checksum = swap16(checksum16((uint16_t *)ip, 10));
+        memset(l4, 0, 8);
+        memcpy(l4 + 8, &seq, sizeof(seq));
+        if (protocol == NET_PROTOCOL_UDP)
+        {
+                l4[0] = 5000 >> 8; l4[1] = 5000 & 0xff; l4[2] = port >> 8; l4[3] = port & 0xff;
+                l4[5] = 8 + sizeof(seq);
+        }
+        else
+        {
+                l4[0] = ICMP_TYPE_ECHO_REQUEST;
+                uint16_t cksum = checksum16((uint16_t *)l4, (8 + sizeof(seq)) / 2);
+                l4[2] = cksum >> 8;
+                l4[3] = cksum & 0xff;
+        }
+        buf.ifindex = 0;
+        ethernet_in(&buf);
+}
+
+/**
+ * @brief 交付一个udp数据报，返回收到它的订阅者数，并检查它们收到的是同一个缓冲区且数据正确
+ *
+ */
+static int fanout(uint8_t *dest_ip, uint32_t seq)
+{
+        int before[MULTICAST_TEST_SUBS], count = 0;
+        for (int i = 0; i < MULTICAST_TEST_SUBS; i++)
+                before[i] = subs[i].received;
+        deliver(dest_ip, MULTICAST_TEST_PORT, NET_PROTOCOL_UDP, seq);
+        udp_dgram_t *dgram = NULL;
+        for (int i = 0; i < MULTICAST_TEST_SUBS; i++)
+        {
+                if (subs[i].received == before[i])
+                        continue;
+                count++;
+                if (dgram != NULL && subs[i].last != dgram)
+                        return -1;
+                dgram = subs[i].last;
+                uint32_t got;
+                memcpy(&got, dgram->data, sizeof(got));
+                if (got != seq || dgram->len != sizeof(seq) || dgram->src_port != 5000 ||
+                    dgram->dest_port != MULTICAST_TEST_PORT || memcmp(dgram->dest_ip, dest_ip, NET_IP_LEN) != 0)
+                        return -1;
+        }
+        return count;
+}
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        fake_driver_set(NULL, count_sent);
+        route_init();
+        netif_init();
+        ethernet_init();
+        arp_init();
+        icmp_init();
+        udp_init();
+        arp_update(peer_ip, peer_mac, ARP_VALID);
+
+        if (netif_join_group(0, group_ip) != 0 || netif_join_group(0, group_ip) != -1 ||
+            netif_join_group(0, peer_ip) != -1 || netif_join_group(1, group_ip) != -1)
+        {
+                printf("\e[0;31mnetif_join_group accepted a duplicate, unicast or missing interface\n");
+                result = 1;
+        }
+        for (int i = 0; i < MULTICAST_TEST_SUBS; i++)
+                udp_subscribe(MULTICAST_TEST_PORT, on_dgram, &subs[i]);
+        if (udp_subscribe(MULTICAST_TEST_PORT, on_dgram, &subs[0]) != -1)
+        {
+                printf("\e[0;31mudp_subscribe accepted a duplicate subscriber\n");
+                result = 1;
+        }
+
+        // 各种目的地址：每个订阅者都收到同一个缓冲区，未加入的组被丢弃
+        struct
+        {
+                uint8_t *ip;
+                int expect;
+        } cases[] = {{my_ip, MULTICAST_TEST_SUBS}, {bcast_ip, MULTICAST_TEST_SUBS}, {subnet_bcast_ip, MULTICAST_TEST_SUBS},
+                     {group_ip, MULTICAST_TEST_SUBS}, {other_group_ip, 0}};
+        for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        {
+                int got = fanout(cases[i].ip, 100 + i);
+                if (got != cases[i].expect)
+                {
+                        printf("\e[0;31mto %s: %d subscribers, expect %d\n", iptos(cases[i].ip), got, cases[i].expect);
+                        result = 1;
+                }
+        }
+
+        // 没有订阅者保留时复用缓冲区；保留的缓冲区在释放前内容不变
+        fanout(group_ip, 1);
+        udp_dgram_t *spare = subs[0].last;
+        fanout(group_ip, 2);
+        if (subs[0].last != spare)
+        {
+                printf("\e[0;31mbuffer not reused when no subscriber held it\n");
+                result = 1;
+        }
+        subs[1].hold = 1;
+        for (uint32_t seq = 10; seq < 14; seq++)
+                fanout(group_ip, seq);
+        subs[1].hold = 0;
+        fanout(group_ip, 99);
+        for (int i = 0; i < subs[1].held_count; i++)
+        {
+                uint32_t got;
+                udp_dgram_t *dgram = subs[1].held[i];
+                memcpy(&got, dgram->data, sizeof(got));
+                if (got != 10 + i || atomic_load(&dgram->refs) != 1 || (i > 0 && dgram == subs[1].held[i - 1]))
+                {
+                        printf("\e[0;31mheld datagram %d: seq %u, %d refs\n", i, got, atomic_load(&dgram->refs));
+                        result = 1;
+                }
+                udp_dgram_release(dgram);
+        }
+
+        // 发往广播地址时端口不可达、回显请求都不应答；发往本机时照常应答
+        sent = 0;
+        deliver(bcast_ip, MULTICAST_TEST_PORT + 1, NET_PROTOCOL_UDP, 0);
+        deliver(subnet_bcast_ip, MULTICAST_TEST_PORT + 1, NET_PROTOCOL_UDP, 0);
+        deliver(group_ip, MULTICAST_TEST_PORT + 1, NET_PROTOCOL_UDP, 0);
+        deliver(bcast_ip, 0, NET_PROTOCOL_ICMP, 0);
+        if (sent != 0)
+        {
+                printf("\e[0;31m%d replies to broadcast or multicast datagrams\n", sent);
+                result = 1;
+        }
+        deliver(my_ip, MULTICAST_TEST_PORT + 1, NET_PROTOCOL_UDP, 0);
+        deliver(my_ip, 0, NET_PROTOCOL_ICMP, 0);
+        if (sent != 2)
+        {
+                printf("\e[0;31m%d replies to unicast datagrams, expect 2\n", sent);
+                result = 1;
+        }
+
+        // 处理程序与订阅者共存；回调中取消订阅
+        udp_open(MULTICAST_TEST_PORT, handler);
+        subs[0].unsubscribe = 1;
+        int first = fanout(bcast_ip, 200), second = fanout(bcast_ip, 201);
+        if (handled != 2 || first != MULTICAST_TEST_SUBS || second != MULTICAST_TEST_SUBS - 1)
+        {
+                printf("\e[0;31mhandler called %d times, %d then %d subscribers\n", handled, first, second);
+                result = 1;
+        }
+
+        // 退出组播组后不再接收；端口没有订阅者与处理程序时关闭
+        netif_leave_group(0, group_ip);
+        if (fanout(group_ip, 300) != 0 || netif_leave_group(0, group_ip) != -1)
+        {
+                printf("\e[0;31mdatagram delivered after leaving the group\n");
+                result = 1;
+        }
+        udp_close(MULTICAST_TEST_PORT);
+        udp_subscribe(MULTICAST_TEST_PORT, on_dgram, &subs[1]);
+        udp_unsubscribe(MULTICAST_TEST_PORT, on_dgram, &subs[1]);
+        sent = 0;
+        deliver(my_ip, MULTICAST_TEST_PORT, NET_PROTOCOL_UDP, 0);
+        if (sent != 1)
+        {
+                printf("\e[0;31mport still open after the last subscriber left\n");
+                result = 1;
+        }
+
+        if (result)
+        {
+                printf("\e[1;31m====> Some datagrams were not fanned out as expected.\n");
+        }
+        else
+        {
+                printf("\e[1;32m====> All datagrams were fanned out as expected.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
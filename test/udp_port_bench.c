@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "net.h"
+#include "udp.h"
+
+#define BENCH_DATAGRAMS (1 << 22)
+#define BENCH_DEST_PORTS 4096 //每轮轮流发往的不同端口数
+
+/**
+ * udp端口分发基准测试：打开不同数量的端口后，把发往随机已打开端口的数据报交给udp_in()，
+ * 统计每个数据报的耗时，检查耗时不随已打开端口数增长。
+ * 数据报不带校验和，测量的是头部检查、端口查找与回调的开销。
+ */
+
+static uint64_t received;
+static uint16_t dest_ports[BENCH_DEST_PORTS];
+static uint8_t peer_ip[] = {192, 168, 231, 1}, my_ip[] = DRIVER_IF_IP;
+
+static void handler(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+        received++;
+}
+
+static double now_ns()
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main()
+{
+        static buf_t buf;
+        int bound_counts[] = {1, 16, 256, 4096, 16384, 65535};
+        srand(1);
+        for (int round = 0; round < sizeof(bound_counts) / sizeof(bound_counts[0]); round++)
+        {
+                int bound = bound_counts[round];
+                udp_init();
+                for (int i = 0; i < bound; i++)
+                        if (udp_open(i + 1, handler) != 0)
+                        {
+                                printf("udp_open failed after %d ports\n", i);
+                                return 1;
+                        }
+                for (int i = 0; i < BENCH_DEST_PORTS; i++)
+                        dest_ports[i] = 1 + rand() % bound;
+
+                received = 0;
+                double t0 = now_ns();
+                for (int i = 0; i < BENCH_DATAGRAMS; i++)
+                {
+                        uint16_t port = dest_ports[i & (BENCH_DEST_PORTS - 1)];
+                        buf.len = 8 + 4;
+                        buf.data = buf.payload + 64;
+                        uint8_t *p = buf.data;
+                        p[0] = 5000 >> 8; p[1] = 5000 & 0xff; p[2] = port >> 8; p[3] = port;
+                        p[4] = 0; p[5] = 12; p[6] = 0; p[7] = 0;
+                        udp_in(&buf, peer_ip, my_ip);
+                }
+                double t1 = now_ns();
+                if (received != BENCH_DATAGRAMS)
+                {
+                        printf("only %lu of %d datagrams reached the handler\n", (unsigned long)received, BENCH_DATAGRAMS);
+                        return 1;
+                }
+                printf("%6d bound ports: %.1f ns/datagram\n", bound, (t1 - t0) / BENCH_DATAGRAMS);
+        }
+        return 0;
+}
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "net.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "arp.h"
+#include "udp.h"
+#include "udp_socket.h"
+#include "route.h"
+#include "netif.h"
+
+/**
+ * udp套接字测试：协议栈线程向套接字端口交付数据报，接收线程用udp_socket_recv_batch()批量取出，
+ * 检查顺序、内容、源地址与时间戳正确，接收队列满与超过接收内存上限时分别计入丢弃计数，
+ * 取出后接收内存归还。
+ */
+
+#define SOCKET_TEST_PORT 60010
+#define SOCKET_TEST_COUNT 100000
+#define SOCKET_TEST_BATCH 32
+
+static uint8_t peer_ip[] = {192, 168, 231, 1}, my_ip[] = DRIVER_IF_IP;
+
+/**
+ * @brief 从peer_ip的src_port交付一个数据报，数据为4字节的序号后跟len - 4个序号的低字节
+ *
+ */
+static void deliver(uint16_t src_port, uint32_t seq, uint16_t len)
+{
+        static buf_t buf;
+        buf_init(&buf, 8 + len);
+        uint8_t *p = buf.data;
+        p[0] = src_port >> 8; p[1] = src_port; p[2] = SOCKET_TEST_PORT >> 8; p[3] = SOCKET_TEST_PORT & 0xff;
+        p[4] = (8 + len) >> 8; p[5] = 8 + len; p[6] = 0; p[7] = 0;
+        memcpy(p + 8, &seq, 4);
+        memset(p + 12, seq & 0xff, len - 4);
+        udp_in(&buf, peer_ip, my_ip);
+}
+
+typedef struct consumer
+{
+        udp_socket_t *sock;
+        int expect;   //要接收的数据报数
+        int errors;   //内容错误数
+        int batches;  //接收到数据的批次数
+} consumer_t;
+
+/**
+ * @brief 接收线程：批量接收并检查序号连续、内容与源地址正确
+ *
+ */
+static void *consume(void *arg)
+{
+        consumer_t *c = arg;
+        static uint8_t bufs[SOCKET_TEST_BATCH][64];
+        udp_msg_t msgs[SOCKET_TEST_BATCH];
+        uint64_t last_ts = 0;
+        uint32_t next = 0;
+        while (next < c->expect)
+        {
+                for (int i = 0; i < SOCKET_TEST_BATCH; i++)
+                {
+                        msgs[i].buf = bufs[i];
+                        msgs[i].buf_len = sizeof(bufs[i]);
+                }
+                int n = udp_socket_recv_batch(c->sock, msgs, SOCKET_TEST_BATCH);
+                if (n == 0)
+                {
+                        sched_yield();
+                        continue;
+                }
+                c->batches++;
+                for (int i = 0; i < n; i++, next++)
+                {
+                        uint32_t seq;
+                        memcpy(&seq, msgs[i].buf, 4);
+                        if (seq != next || msgs[i].len != 16 || msgs[i].buf[15] != (seq & 0xff) ||
+                            memcmp(msgs[i].src_ip, peer_ip, NET_IP_LEN) || msgs[i].src_port != 5000 ||
+                            msgs[i].timestamp_ns < last_ts)
+                        {
+                                if (c->errors++ < 5)
+                                        printf("\e[0;31mdatagram %u: seq %u len %u port %u\n", next, seq, msgs[i].len, msgs[i].src_port);
+                        }
+                        last_ts = msgs[i].timestamp_ns;
+                }
+        }
+        return NULL;
+}
+
+static int check_stats(const char *what, udp_socket_t *sock, uint64_t received, uint64_t dropped_ring, uint64_t dropped_mem, uint64_t rmem)
+{
+        udp_socket_stats_t s;
+        udp_socket_get_stats(sock, &s);
+        if (s.received != received || s.dropped_ring != dropped_ring || s.dropped_mem != dropped_mem || s.rmem != rmem)
+        {
+                printf("\e[0;31m%s: received %lu, dropped %lu by ring and %lu by memory, rmem %lu\n", what, (unsigned long)s.received,
+                       (unsigned long)s.dropped_ring, (unsigned long)s.dropped_mem, (unsigned long)s.rmem);
+                return 1;
+        }
+        return 0;
+}
+
+int main()
+{
+        int result = 0;
+        printf("\e[0;34mTest begin.\n");
+        route_init();
+        netif_init();
+        ethernet_init();
+        arp_init();
+        udp_init();
+
+        // 接收线程并发取出，队列足够长时不丢包，顺序与内容不变
+        udp_socket_t *sock = udp_socket_open(SOCKET_TEST_PORT, 1 << 17, 1 << 30);
+        consumer_t c = {sock, SOCKET_TEST_COUNT, 0, 0};
+        pthread_t tid;
+        pthread_create(&tid, NULL, consume, &c);
+        for (uint32_t i = 0; i < SOCKET_TEST_COUNT; i++)
+                deliver(5000, i, 16);
+        pthread_join(tid, NULL);
+        result |= c.errors != 0;
+        result |= check_stats("concurrent", sock, SOCKET_TEST_COUNT, 0, 0, 0);
+        printf("%d datagrams received in %d batches\n", SOCKET_TEST_COUNT, c.batches);
+        udp_socket_close(sock);
+
+        // 队列满后丢弃并计数
+        sock = udp_socket_open(SOCKET_TEST_PORT, 8, 1 << 30);
+        for (uint32_t i = 0; i < 20; i++)
+                deliver(5000, i, 16);
+        udp_msg_t msgs[SOCKET_TEST_BATCH];
+        uint8_t bufs[SOCKET_TEST_BATCH][8];
+        for (int i = 0; i < SOCKET_TEST_BATCH; i++)
+        {
+                msgs[i].buf = bufs[i];
+                msgs[i].buf_len = sizeof(bufs[i]);
+        }
+        int n = udp_socket_recv_batch(sock, msgs, SOCKET_TEST_BATCH);
+        uint32_t seq;
+        memcpy(&seq, msgs[7].buf, 4);
+        if (n != 8 || seq != 7 || msgs[7].len != 16) //缓冲区短于数据报时截断，len仍为原长度
+        {
+                printf("\e[0;31mring full: received %d, last seq %u len %u\n", n, seq, msgs[7].len);
+                result = 1;
+        }
+        result |= check_stats("ring full", sock, 8, 12, 0, 0);
+        udp_socket_close(sock);
+
+        // 超过接收内存上限后丢弃并计数，取出后可以继续接收
+        sock = udp_socket_open(SOCKET_TEST_PORT, 1024, 4096);
+        for (uint32_t i = 0; i < 100; i++)
+                deliver(5000, i, 1000);
+        udp_socket_stats_t s;
+        udp_socket_get_stats(sock, &s);
+        if (s.received == 0 || s.received >= 5 || s.dropped_mem != 100 - s.received || s.rmem > 4096)
+        {
+                printf("\e[0;31mrcvbuf: received %lu, dropped %lu, rmem %lu\n", (unsigned long)s.received,
+                       (unsigned long)s.dropped_mem, (unsigned long)s.rmem);
+                result = 1;
+        }
+        uint64_t accepted = s.received, dropped = s.dropped_mem;
+        n = udp_socket_recv_batch(sock, msgs, SOCKET_TEST_BATCH);
+        deliver(5000, 100, 1000);
+        result |= check_stats("rcvbuf drained", sock, accepted + 1, 0, dropped, s.rmem / accepted);
+        if (n != accepted)
+        {
+                printf("\e[0;31mrcvbuf drained: received %d of %lu\n", n, (unsigned long)accepted);
+                result = 1;
+        }
+
+        udp_socket_close(sock); //队列中剩余的1个数据报随套接字释放
+
+        if (result)
+        {
+                printf("\e[1;31m====> Some datagrams were not received as expected.\n");
+        }
+        else
+        {
+                printf("\e[1;32m====> All datagrams were received as expected.\n");
+        }
+        printf("\e[0m");
+        return result;
+}
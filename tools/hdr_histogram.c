@@ -0,0 +1,167 @@
+#include "hdr_histogram.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static int hdr_log2(int64_t v)
+{
+    return 63 - __builtin_clzll(v);
+}
+
+/**
+ * @brief 初始化直方图
+ *        精度为significant_figures位有效数字时，每段需要不少于2 * 10^significant_figures个子桶，
+ *        取2的幂；段数为覆盖到highest所需的倍增次数。
+ *
+ * @param h 直方图
+ * @param lowest 可区分的最小值，不小于1
+ * @param highest 可记录的最大值，不小于2 * lowest
+ * @param significant_figures 有效数字位数，1到5
+ * @return int 成功为0，参数错误或内存不足为-1
+ */
+int hdr_init(hdr_histogram_t *h, int64_t lowest, int64_t highest, int significant_figures)
+{
+    if (lowest < 1 || highest < 2 * lowest || significant_figures < 1 || significant_figures > 5)
+        return -1;
+    memset(h, 0, sizeof(*h));
+    int64_t single_unit = 2 * (int64_t)pow(10, significant_figures);
+    int sub_bucket_count_magnitude = hdr_log2(single_unit - 1) + 1;
+    h->lowest = lowest;
+    h->highest = highest;
+    h->unit_magnitude = hdr_log2(lowest);
+    h->sub_bucket_half_count_magnitude = sub_bucket_count_magnitude - 1;
+    h->sub_bucket_half_count = 1 << h->sub_bucket_half_count_magnitude;
+    h->sub_bucket_mask = ((int64_t)(1 << sub_bucket_count_magnitude) - 1) << h->unit_magnitude;
+
+    int64_t smallest_untrackable = (int64_t)1 << (sub_bucket_count_magnitude + h->unit_magnitude);
+    h->bucket_count = 1;
+    while (smallest_untrackable <= highest)
+    {
+        smallest_untrackable <<= 1;
+        h->bucket_count++;
+    }
+    h->counts_len = (h->bucket_count + 1) * h->sub_bucket_half_count;
+    h->counts = calloc(h->counts_len, sizeof(int64_t));
+    if (h->counts == NULL)
+        return -1;
+    h->min = INT64_MAX;
+    return 0;
+}
+
+/**
+ * @brief 释放直方图的计数数组
+ *
+ * @param h 直方图
+ */
+void hdr_free(hdr_histogram_t *h)
+{
+    free(h->counts);
+    h->counts = NULL;
+}
+
+/**
+ * @brief 清空直方图
+ *
+ * @param h 直方图
+ */
+void hdr_reset(hdr_histogram_t *h)
+{
+    memset(h->counts, 0, h->counts_len * sizeof(int64_t));
+    h->total = 0;
+    h->min = INT64_MAX;
+    h->max = 0;
+}
+
+/**
+ * @brief 计算值所在子桶的下标
+ *        段号由最高位的位置决定，段内下标为值右移段号位后的结果，
+ *        第0段使用全部子桶，其余各段只使用后一半（前一半与上一段重合）
+ *
+ */
+static int hdr_index(const hdr_histogram_t *h, int64_t value)
+{
+    int bucket = hdr_log2(value | h->sub_bucket_mask) - h->unit_magnitude - h->sub_bucket_half_count_magnitude;
+    int sub_bucket = value >> (bucket + h->unit_magnitude);
+    return ((bucket + 1) << h->sub_bucket_half_count_magnitude) + sub_bucket - h->sub_bucket_half_count;
+}
+
+/**
+ * @brief 子桶所代表的最大值
+ *
+ */
+static int64_t hdr_highest_equivalent(const hdr_histogram_t *h, int index)
+{
+    int bucket = (index >> h->sub_bucket_half_count_magnitude) - 1;
+    int sub_bucket = (index & (h->sub_bucket_half_count - 1)) + h->sub_bucket_half_count;
+    if (bucket < 0)
+    {
+        sub_bucket -= h->sub_bucket_half_count;
+        bucket = 0;
+    }
+    int shift = bucket + h->unit_magnitude;
+    return ((int64_t)sub_bucket << shift) + ((int64_t)1 << shift) - 1;
+}
+
+/**
+ * @brief 记录一个值，负数按0记录，超过highest的值按highest记录
+ *
+ * @param h 直方图
+ * @param value 值
+ */
+void hdr_record(hdr_histogram_t *h, int64_t value)
+{
+    if (value < 0)
+        value = 0;
+    if (value > h->highest)
+        value = h->highest;
+    h->counts[hdr_index(h, value)]++;
+    h->total++;
+    if (value < h->min)
+        h->min = value;
+    if (value > h->max)
+        h->max = value;
+}
+
+/**
+ * @brief 把一个直方图的计数累加到另一个参数相同的直方图
+ *
+ * @param dst 目的直方图
+ * @param src 源直方图
+ */
+void hdr_add(hdr_histogram_t *dst, const hdr_histogram_t *src)
+{
+    for (int i = 0; i < dst->counts_len && i < src->counts_len; i++)
+        dst->counts[i] += src->counts[i];
+    dst->total += src->total;
+    if (src->min < dst->min)
+        dst->min = src->min;
+    if (src->max > dst->max)
+        dst->max = src->max;
+}
+
+/**
+ * @brief 获取百分位数
+ *
+ * @param h 直方图
+ * @param percentile 百分位，如99.9
+ * @return int64_t 不小于该比例的记录值的最小子桶上界，不超过记录的最大值，没有记录时为0
+ */
+int64_t hdr_value_at_percentile(const hdr_histogram_t *h, double percentile)
+{
+    if (h->total == 0)
+        return 0;
+    int64_t target = (int64_t)ceil(percentile / 100 * h->total);
+    if (target < 1)
+        target = 1;
+    int64_t seen = 0;
+    for (int i = 0; i < h->counts_len; i++)
+    {
+        seen += h->counts[i];
+        if (seen >= target)
+        {
+            int64_t value = hdr_highest_equivalent(h, i);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
@@ -0,0 +1,75 @@
+#ifndef HDR_HISTOGRAM_H
+#define HDR_HISTOGRAM_H
+#include <stdint.h>
+
+/**
+ * @brief 高动态范围直方图
+ *        值域按2的幂分成若干段，每段再等分为sub_bucket_count个子桶，
+ *        任何值的相对误差都不超过有效数字位数决定的精度，记录一个值只需几次位运算。
+ *
+ */
+typedef struct hdr_histogram
+{
+    int64_t lowest;              //可区分的最小值
+    int64_t highest;             //可记录的最大值，更大的值按最大值记录
+    int unit_magnitude;          //log2(lowest)
+    int sub_bucket_half_count_magnitude;
+    int32_t sub_bucket_half_count;
+    int64_t sub_bucket_mask;
+    int bucket_count;            //段数
+    int counts_len;              //计数数组长度
+    int64_t *counts;             //各子桶的计数
+    int64_t total;               //记录的值的个数
+    int64_t min, max;            //记录的最小值与最大值（精确值）
+} hdr_histogram_t;
+
+/**
+ * @brief 初始化直方图
+ *
+ * @param h 直方图
+ * @param lowest 可区分的最小值，不小于1
+ * @param highest 可记录的最大值，不小于2 * lowest
+ * @param significant_figures 有效数字位数，1到5
+ * @return int 成功为0，参数错误或内存不足为-1
+ */
+int hdr_init(hdr_histogram_t *h, int64_t lowest, int64_t highest, int significant_figures);
+
+/**
+ * @brief 释放直方图的计数数组
+ *
+ * @param h 直方图
+ */
+void hdr_free(hdr_histogram_t *h);
+
+/**
+ * @brief 清空直方图
+ *
+ * @param h 直方图
+ */
+void hdr_reset(hdr_histogram_t *h);
+
+/**
+ * @brief 记录一个值，负数按0记录
+ *
+ * @param h 直方图
+ * @param value 值
+ */
+void hdr_record(hdr_histogram_t *h, int64_t value);
+
+/**
+ * @brief 把一个直方图的计数累加到另一个参数相同的直方图
+ *
+ * @param dst 目的直方图
+ * @param src 源直方图
+ */
+void hdr_add(hdr_histogram_t *dst, const hdr_histogram_t *src);
+
+/**
+ * @brief 获取百分位数
+ *
+ * @param h 直方图
+ * @param percentile 百分位，如99.9
+ * @return int64_t 不小于该比例的记录值的最小子桶上界，没有记录时为0
+ */
+int64_t hdr_value_at_percentile(const hdr_histogram_t *h, double percentile);
+#endif
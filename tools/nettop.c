@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include "net.h"
+#include "stats.h"
+
+/**
+ * 协议栈计数查看工具，读取另一个进程用net_stats_export()导出的共享内存，不影响被观察的进程：
+ *   nettop [-i 间隔毫秒] [-n 次数] [-t] [-p 端口数] [-d] [名称]
+ *       每个间隔输出各以太网协议、ip协议、udp端口的收发速率（包/秒与Mbit/s），
+ *       arp查找命中、未命中、替换与驱动收发出错的速率，以及各丢弃原因的丢弃速率；
+ *       默认把所有实例（线程）的速率相加，-t时先逐个实例输出一行；
+ *       -d时再输出这个间隔中新写入丢弃日志的样本（原因、网卡、长度与开头的字节）。
+ *       名称默认为NET_STATS_SHM_NAME，间隔默认1000毫秒，实例每NET_STATS_PUBLISH_MS毫秒发布一次，
+ *       因此间隔不宜短于两个发布周期（100毫秒）。
+ */
+
+#define NETTOP_TOP_PORTS 20 //默认输出的udp端口数，按收包速率排序
+
+/**
+ * @brief 一个计数的收发速率
+ *
+ */
+typedef struct nettop_rate
+{
+    double pps, bps;         //接收的包/秒与比特/秒
+    double out_pps, out_bps; //发送的包/秒与比特/秒
+} nettop_rate_t;
+
+typedef struct nettop_port
+{
+    uint16_t port;      //端口号
+    nettop_rate_t rate; //所有实例的速率之和
+} nettop_port_t;
+
+static net_stats_slot_t last[NET_STATS_MAX_SLOTS], now[NET_STATS_MAX_SLOTS];
+static int last_valid[NET_STATS_MAX_SLOTS], now_valid[NET_STATS_MAX_SLOTS];
+static nettop_rate_t port_rates[65536]; //以端口号索引
+static int port_seen[65536];
+static nettop_port_t ports[65536];
+static volatile sig_atomic_t stopping;
+
+static void on_signal(int sig)
+{
+    stopping = 1;
+}
+
+/**
+ * @brief 把两次快照之间的差值换算为速率累加到sum上，计数变小（实例被替换、端口重新打开）时从0开始算
+ *
+ */
+static void add_rate(nettop_rate_t *sum, const net_proto_stats_t *cur, const net_proto_stats_t *prev, double dt)
+{
+    net_proto_stats_t zero = {0};
+    if (prev == NULL || cur->packets < prev->packets || cur->out_packets < prev->out_packets)
+        prev = &zero;
+    sum->pps += (cur->packets - prev->packets) / dt;
+    sum->bps += (cur->bytes - prev->bytes) * 8 / dt;
+    sum->out_pps += (cur->out_packets - prev->out_packets) / dt;
+    sum->out_bps += (cur->out_bytes - prev->out_bytes) * 8 / dt;
+}
+
+static double delta(uint64_t cur, uint64_t prev, double dt)
+{
+    return cur >= prev ? (cur - prev) / dt : cur / dt;
+}
+
+static void print_rate(const char *name, const nettop_rate_t *r)
+{
+    printf("  %-14s %12.0f %10.2f %12.0f %10.2f\n", name, r->pps, r->bps / 1e6, r->out_pps, r->out_bps / 1e6);
+}
+
+static int nonzero(const nettop_rate_t *r)
+{
+    return r->pps > 0 || r->out_pps > 0;
+}
+
+static int by_rx_pps(const void *a, const void *b)
+{
+    const nettop_port_t *x = a, *y = b;
+    return x->rate.pps < y->rate.pps ? 1 : x->rate.pps > y->rate.pps ? -1 : x->port - y->port;
+}
+
+static const net_stats_port_t *find_port(const net_stats_slot_t *slot, uint16_t port)
+{
+    for (uint32_t i = 0; i < slot->udp_port_count; i++)
+        if (slot->udp_ports[i].port == port)
+            return &slot->udp_ports[i];
+    return NULL;
+}
+
+static const net_stats_ethertype_t *find_ethertype(const net_stats_slot_t *slot, uint16_t protocol)
+{
+    for (uint32_t i = 0; i < slot->ethertype_count; i++)
+        if (slot->ethertypes[i].protocol == protocol)
+            return &slot->ethertypes[i];
+    return NULL;
+}
+
+/**
+ * @brief 输出一个实例在这个间隔中新写入丢弃日志的样本，间隔中写入的样本多于日志长度时只有最新的还在
+ *
+ */
+static void print_drop_log(int instance, const net_stats_slot_t *cur, const net_stats_slot_t *prev)
+{
+    uint64_t first = prev->drop_logged <= cur->drop_logged ? prev->drop_logged : 0;
+    if (cur->drop_logged - first > NET_DROP_LOG_SIZE)
+        first = cur->drop_logged - NET_DROP_LOG_SIZE;
+    for (uint64_t i = first; i < cur->drop_logged; i++)
+    {
+        const net_drop_sample_t *sample = &cur->drop_log[i % NET_DROP_LOG_SIZE];
+        printf("  drop instance %d if %d %-16s len %-5u %lums ago:", instance, sample->ifindex,
+               net_drop_name(sample->reason), sample->len, (unsigned long)(cur->publish_ms - sample->time_ms));
+        for (int j = 0; j < sample->cap_len && j < NET_DROP_SAMPLE_BYTES; j++)
+            printf("%s%02x", j % 16 ? " " : "\n    ", sample->data[j]);
+        printf("\n");
+    }
+}
+
+/**
+ * @brief 输出一个间隔的速率，只有前后两次都读到的实例参与计算
+ *
+ */
+static void report(int slots, int per_instance, int top, int drop_log)
+{
+    nettop_rate_t ether[ETHERNET_PROTO_TABLE_SIZE] = {0}, ip[256] = {0};
+    uint16_t ether_proto[ETHERNET_PROTO_TABLE_SIZE];
+    int ether_count = 0, instances = 0, port_count = 0;
+    double arp_hits = 0, arp_misses = 0, arp_evictions = 0, rx_errors = 0, tx_errors = 0;
+    double drops[NET_DROP_REASON_COUNT] = {0};
+    memset(port_seen, 0, sizeof(port_seen));
+
+    time_t t = time(NULL);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%H:%M:%S", localtime(&t));
+    if (per_instance)
+        printf("%s\n  %-8s %8s %4s %8s %12s %10s %12s %10s\n", stamp, "instance", "tid", "cpu", "ifmask",
+               "rx pps", "rx Mbit/s", "tx pps", "tx Mbit/s");
+    for (int i = 0; i < slots; i++)
+    {
+        if (!now_valid[i] || !last_valid[i] || now[i].publish_ms <= last[i].publish_ms)
+            continue;
+        const net_stats_slot_t *cur = &now[i], *prev = &last[i];
+        double dt = (cur->publish_ms - prev->publish_ms) / 1000.0;
+        nettop_rate_t total = {0};
+        instances++;
+        for (uint32_t j = 0; j < cur->ethertype_count; j++)
+        {
+            uint16_t protocol = cur->ethertypes[j].protocol;
+            int k = 0;
+            while (k < ether_count && ether_proto[k] != protocol)
+                k++;
+            if (k == ether_count && ether_count == ETHERNET_PROTO_TABLE_SIZE)
+                continue;
+            if (k == ether_count)
+                ether_proto[ether_count++] = protocol;
+            const net_stats_ethertype_t *p = find_ethertype(prev, protocol);
+            add_rate(&ether[k], &cur->ethertypes[j].stats, p ? &p->stats : NULL, dt);
+            add_rate(&total, &cur->ethertypes[j].stats, p ? &p->stats : NULL, dt);
+        }
+        for (int j = 0; j < 256; j++)
+            add_rate(&ip[j], &cur->ip[j], &prev->ip[j], dt);
+        for (uint32_t j = 0; j < cur->udp_port_count; j++)
+        {
+            uint16_t port = cur->udp_ports[j].port;
+            const net_stats_port_t *p = find_port(prev, port);
+            if (!port_seen[port])
+            {
+                port_seen[port] = 1;
+                memset(&port_rates[port], 0, sizeof(nettop_rate_t));
+                ports[port_count++].port = port;
+            }
+            add_rate(&port_rates[port], &cur->udp_ports[j].stats, p ? &p->stats : NULL, dt);
+        }
+        arp_hits += delta(cur->arp.hits, prev->arp.hits, dt);
+        arp_misses += delta(cur->arp.misses, prev->arp.misses, dt);
+        arp_evictions += delta(cur->arp.evictions, prev->arp.evictions, dt);
+        rx_errors += delta(cur->driver.rx_errors, prev->driver.rx_errors, dt);
+        tx_errors += delta(cur->driver.tx_errors, prev->driver.tx_errors, dt);
+        for (int j = 0; j < NET_DROP_REASON_COUNT; j++)
+            drops[j] += delta(cur->drops[j], prev->drops[j], dt);
+        if (per_instance)
+            printf("  %-8d %8d %4d %#8x %12.0f %10.2f %12.0f %10.2f\n", i, cur->tid, cur->cpu, cur->ifmask,
+                   total.pps, total.bps / 1e6, total.out_pps, total.out_bps / 1e6);
+    }
+
+    if (!per_instance)
+        printf("%s, %d instances\n", stamp, instances);
+    printf("  %-14s %12s %10s %12s %10s\n", "ethertype", "rx pps", "rx Mbit/s", "tx pps", "tx Mbit/s");
+    for (int k = 0; k < ether_count; k++)
+    {
+        char name[16];
+        if (ether_proto[k] == 0)
+            snprintf(name, sizeof(name), "other");
+        else
+            snprintf(name, sizeof(name), "%#06x", ether_proto[k]);
+        print_rate(name, &ether[k]);
+    }
+    printf("  %-14s\n", "ip protocol");
+    for (int j = 0; j < 256; j++)
+    {
+        char name[16];
+        if (j == NET_PROTOCOL_ICMP || j == NET_PROTOCOL_UDP || j == NET_PROTOCOL_TCP)
+            snprintf(name, sizeof(name), "%s", j == NET_PROTOCOL_ICMP ? "icmp" : j == NET_PROTOCOL_UDP ? "udp" : "tcp");
+        else
+            snprintf(name, sizeof(name), "%d", j);
+        if (nonzero(&ip[j]))
+            print_rate(name, &ip[j]);
+    }
+    for (int j = 0; j < port_count; j++)
+        ports[j].rate = port_rates[ports[j].port];
+    qsort(ports, port_count, sizeof(nettop_port_t), by_rx_pps);
+    printf("  %-14s\n", "udp port");
+    for (int j = 0; j < port_count && j < top; j++)
+    {
+        char name[16];
+        snprintf(name, sizeof(name), "%u", ports[j].port);
+        print_rate(name, &ports[j].rate);
+    }
+    printf("  arp hits %.0f/s, misses %.0f/s, evictions %.0f/s; driver rx errors %.0f/s, tx errors %.0f/s\n",
+           arp_hits, arp_misses, arp_evictions, rx_errors, tx_errors);
+    printf("  %-16s %12s\n", "drop reason", "drops/s");
+    for (int j = 0; j < NET_DROP_REASON_COUNT; j++)
+        if (drops[j] > 0)
+            printf("  %-16s %12.0f\n", net_drop_name(j), drops[j]);
+    for (int i = 0; drop_log && i < slots; i++)
+        if (now_valid[i] && last_valid[i] && now[i].publish_ms > last[i].publish_ms)
+            print_drop_log(i, &now[i], &last[i]);
+    printf("\n");
+    fflush(stdout);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-i interval_ms] [-n count] [-t] [-p ports] [-d] [name]\n", name);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int interval_ms = 1000, count = -1, per_instance = 0, top = NETTOP_TOP_PORTS, drop_log = 0, opt;
+    while ((opt = getopt(argc, argv, "i:n:tp:d")) != -1)
+    {
+        switch (opt)
+        {
+        case 'i': interval_ms = atoi(optarg); break;
+        case 'n': count = atoi(optarg); break;
+        case 't': per_instance = 1; break;
+        case 'p': top = atoi(optarg); break;
+        case 'd': drop_log = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (interval_ms <= 0 || optind < argc - 1)
+        usage(argv[0]);
+    const char *name = optind < argc ? argv[optind] : NET_STATS_SHM_NAME;
+    const net_stats_shm_t *shm = net_stats_attach(name);
+    if (shm == NULL)
+    {
+        fprintf(stderr, "%s: no stats exported as %s (or layout version mismatch)\n", argv[0], name);
+        return 1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    int first = 1;
+    while (!stopping && count != 0)
+    {
+        int slots = atomic_load(&shm->slots_used);
+        for (int i = 0; i < slots; i++)
+            now_valid[i] = net_stats_read(shm, i, &now[i]) == 0;
+        if (!first)
+        {
+            report(slots, per_instance, top, drop_log);
+            if (count > 0)
+                count--;
+        }
+        first = 0;
+        memcpy(last, now, sizeof(last));
+        memcpy(last_valid, now_valid, sizeof(last_valid));
+        if (count != 0)
+            usleep(interval_ms * 1000);
+    }
+    net_stats_detach(shm);
+    return 0;
+}
@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include "net.h"
+#include "icmp.h"
+#include "udp.h"
+#include "hdr_histogram.h"
+
+/**
+ * 时延探测工具，基于本协议栈收发：
+ *   probe [-u] [-p 端口] [-l 本地端口] [-i 间隔微秒] [-t 报告间隔秒] [-d 持续秒] [-w 超时毫秒] [-s 数据长度] 目标ip...
+ *       以固定速率向每个目标发送ICMP回显请求（-u时为udp乒乓消息），
+ *       每个报告间隔输出各目标的发送、接收、丢失、乱序数与往返时延的p50/p99/p99.9/max，结束时输出总计。
+ *   probe -r [-p 端口]
+ *       反射端，在端口上把收到的udp消息原样发回发送方的端口，与src/main.c的处理程序一样用udp_open()注册。
+ */
+
+#define PROBE_MAX_TARGETS 64
+#define PROBE_WINDOW 4096            //每个目标记录发送时间的探测数，超过后最早的探测按丢失计
+#define PROBE_MAGIC 0x50524245       //"PRBE"
+#define PROBE_HIGHEST_NS 10000000000 //直方图可记录的最大往返时延（10秒）
+
+/**
+ * @brief 探测消息，icmp回显请求与udp消息的数据部分，只由本工具读取，使用主机字节序
+ *
+ */
+#pragma pack(1)
+typedef struct probe_msg
+{
+    uint32_t magic;   //魔数
+    uint32_t seq;     //序号
+    uint64_t sent_ns; //发送时间
+} probe_msg_t;
+#pragma pack()
+
+typedef struct probe_slot
+{
+    uint32_t seq;     //序号
+    uint64_t sent_ns; //发送时间
+    int pending;      //是否在等待应答
+} probe_slot_t;
+
+/**
+ * @brief 每个报告间隔的计数，结束时累加到总计
+ *
+ */
+typedef struct probe_counts
+{
+    uint64_t sent;      //发送数
+    uint64_t received;  //收到应答数
+    uint64_t lost;      //超时或被挤出窗口的探测数
+    uint64_t reordered; //序号小于已收到的最大序号的应答数
+} probe_counts_t;
+
+typedef struct probe_target
+{
+    uint8_t ip[NET_IP_LEN];           //目标ip地址
+    uint32_t next_seq;                //下一个探测的序号
+    int64_t max_seq;                  //已收到应答的最大序号，-1表示还没有
+    probe_slot_t window[PROBE_WINDOW]; //以序号取模索引的发送记录
+    probe_counts_t interval, total;   //本间隔与总计的计数
+    hdr_histogram_t interval_hist, total_hist; //往返时延（纳秒）
+} probe_target_t;
+
+static probe_target_t targets[PROBE_MAX_TARGETS];
+static int target_count;
+static int use_udp, reflector;
+static uint16_t remote_port = 60000, local_port = 60001;
+static uint16_t echo_id;
+static int payload_len = sizeof(probe_msg_t);
+static volatile sig_atomic_t stopping;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static probe_target_t *find_target(uint8_t *ip)
+{
+    for (int i = 0; i < target_count; i++)
+        if (memcmp(targets[i].ip, ip, NET_IP_LEN) == 0)
+            return &targets[i];
+    return NULL;
+}
+
+/**
+ * @brief 处理一个应答：按序号找到发送记录，记录往返时延，统计乱序
+ *        超时后才到达的应答与重复的应答不计入
+ *
+ */
+static void on_reply(uint8_t *src_ip, uint8_t *data, int len)
+{
+    uint64_t now = now_ns();
+    probe_target_t *t = find_target(src_ip);
+    probe_msg_t msg;
+    if (t == NULL || len < sizeof(msg))
+        return;
+    memcpy(&msg, data, sizeof(msg));
+    probe_slot_t *slot = &t->window[msg.seq % PROBE_WINDOW];
+    if (msg.magic != PROBE_MAGIC || !slot->pending || slot->seq != msg.seq)
+        return;
+    slot->pending = 0;
+    t->interval.received++;
+    hdr_record(&t->interval_hist, now - slot->sent_ns);
+    if ((int64_t)msg.seq < t->max_seq)
+        t->interval.reordered++;
+    else
+        t->max_seq = msg.seq;
+}
+
+static void on_echo(uint8_t *src_ip, uint16_t id, uint16_t seq, uint8_t *data, uint16_t len)
+{
+    if (id == echo_id)
+        on_reply(src_ip, data, len);
+}
+
+static void on_udp(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+    if (src_port == remote_port)
+        on_reply(src_ip, buf->data, buf->len);
+}
+
+/**
+ * @brief 反射端：把收到的消息原样发回
+ *
+ */
+static void on_reflect(udp_entry_t *entry, uint8_t *src_ip, uint16_t src_port, buf_t *buf)
+{
+    static uint8_t data[ETHERNET_MTU];
+    uint16_t len = buf->len < sizeof(data) ? buf->len : sizeof(data);
+    memcpy(data, buf->data, len);
+    udp_send(data, len, entry->port, src_ip, src_port);
+}
+
+static void send_probe(probe_target_t *t)
+{
+    static uint8_t data[ETHERNET_MTU];
+    probe_slot_t *slot = &t->window[t->next_seq % PROBE_WINDOW];
+    if (slot->pending) //窗口已满，最早的探测仍未收到应答
+        t->interval.lost++;
+    probe_msg_t msg = {PROBE_MAGIC, t->next_seq++, now_ns()};
+    slot->seq = msg.seq;
+    slot->sent_ns = msg.sent_ns;
+    slot->pending = 1;
+    memcpy(data, &msg, sizeof(msg));
+    if (use_udp)
+        udp_send(data, payload_len, local_port, t->ip, remote_port);
+    else
+        icmp_send_echo(t->ip, echo_id, msg.seq, data, payload_len);
+    t->interval.sent++;
+}
+
+/**
+ * @brief 把超时仍未收到应答的探测计为丢失
+ *
+ */
+static void expire(probe_target_t *t, uint64_t now, uint64_t timeout_ns)
+{
+    for (int i = 0; i < PROBE_WINDOW; i++)
+    {
+        probe_slot_t *slot = &t->window[i];
+        if (slot->pending && now - slot->sent_ns > timeout_ns)
+        {
+            slot->pending = 0;
+            t->interval.lost++;
+        }
+    }
+}
+
+static void print_line(const char *label, probe_target_t *t, probe_counts_t *c, hdr_histogram_t *h)
+{
+    printf("%-16s %-15s sent %-7lu recv %-7lu loss %-5lu reorder %-5lu", label, iptos(t->ip),
+           (unsigned long)c->sent, (unsigned long)c->received, (unsigned long)c->lost, (unsigned long)c->reordered);
+    if (h->total)
+        printf(" p50 %9.1fus p99 %9.1fus p99.9 %9.1fus max %9.1fus",
+               hdr_value_at_percentile(h, 50) / 1e3, hdr_value_at_percentile(h, 99) / 1e3,
+               hdr_value_at_percentile(h, 99.9) / 1e3, h->max / 1e3);
+    printf("\n");
+}
+
+/**
+ * @brief 输出每个目标本间隔的结果，并累加到总计
+ *
+ */
+static void report(double elapsed)
+{
+    char label[32];
+    snprintf(label, sizeof(label), "[%8.1fs]", elapsed);
+    for (int i = 0; i < target_count; i++)
+    {
+        probe_target_t *t = &targets[i];
+        print_line(label, t, &t->interval, &t->interval_hist);
+        t->total.sent += t->interval.sent;
+        t->total.received += t->interval.received;
+        t->total.lost += t->interval.lost;
+        t->total.reordered += t->interval.reordered;
+        hdr_add(&t->total_hist, &t->interval_hist);
+        memset(&t->interval, 0, sizeof(t->interval));
+        hdr_reset(&t->interval_hist);
+    }
+    fflush(stdout);
+}
+
+static void on_signal(int sig)
+{
+    stopping = 1;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-u] [-p port] [-l local_port] [-i interval_us] [-t report_s] [-d duration_s] [-w timeout_ms] [-s size] target...\n"
+                    "       %s -r [-p port]\n", name, name);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t interval_us = 100000, timeout_ms = 1000;
+    double report_s = 1, duration_s = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "urp:l:i:t:d:w:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'u': use_udp = 1; break;
+        case 'r': reflector = 1; break;
+        case 'p': remote_port = atoi(optarg); break;
+        case 'l': local_port = atoi(optarg); break;
+        case 'i': interval_us = strtoull(optarg, NULL, 10); break;
+        case 't': report_s = atof(optarg); break;
+        case 'd': duration_s = atof(optarg); break;
+        case 'w': timeout_ms = strtoull(optarg, NULL, 10); break;
+        case 's': payload_len = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (payload_len < (int)sizeof(probe_msg_t))
+        payload_len = sizeof(probe_msg_t);
+    if (payload_len > ETHERNET_MTU - 28)
+        payload_len = ETHERNET_MTU - 28;
+    if (interval_us == 0 || report_s <= 0)
+        usage(argv[0]);
+
+    net_init();
+    if (reflector)
+    {
+        udp_open(remote_port, on_reflect);
+        printf("reflecting udp port %d\n", remote_port);
+        while (1)
+            net_poll();
+    }
+
+    for (int i = optind; i < argc && target_count < PROBE_MAX_TARGETS; i++)
+    {
+        probe_target_t *t = &targets[target_count];
+        unsigned a, b, c, d;
+        if (sscanf(argv[i], "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+            usage(argv[0]);
+        t->ip[0] = a; t->ip[1] = b; t->ip[2] = c; t->ip[3] = d;
+        t->max_seq = -1;
+        if (hdr_init(&t->interval_hist, 1, PROBE_HIGHEST_NS, 3) || hdr_init(&t->total_hist, 1, PROBE_HIGHEST_NS, 3))
+        {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        target_count++;
+    }
+    if (target_count == 0)
+        usage(argv[0]);
+
+    echo_id = getpid() & 0xffff;
+    if (use_udp)
+        udp_open(local_port, on_udp);
+    else
+        icmp_set_echo_handler(on_echo);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    uint64_t start = now_ns(), next_send = start, interval_ns = interval_us * 1000;
+    uint64_t report_ns = report_s * 1e9, next_report = start + report_ns;
+    uint64_t end = duration_s > 0 ? start + (uint64_t)(duration_s * 1e9) : 0;
+    while (!stopping)
+    {
+        net_poll();
+        uint64_t now = now_ns();
+        if (now > next_send + 1000000000) //落后超过1秒（如进程被挂起）时不再补发
+            next_send = now;
+        for (; next_send <= now; next_send += interval_ns)
+            for (int i = 0; i < target_count; i++)
+                send_probe(&targets[i]);
+        if (now >= next_report)
+        {
+            for (int i = 0; i < target_count; i++)
+                expire(&targets[i], now, timeout_ms * 1000000);
+            report((now - start) / 1e9);
+            next_report += report_ns;
+        }
+        if (end && now >= end)
+            break;
+    }
+
+    //等待最后一批应答后输出总计
+    uint64_t drain_end = now_ns() + timeout_ms * 1000000;
+    while (now_ns() < drain_end)
+        net_poll();
+    for (int i = 0; i < target_count; i++)
+        expire(&targets[i], now_ns(), 0);
+    report((now_ns() - start) / 1e9);
+    for (int i = 0; i < target_count; i++)
+        print_line("total", &targets[i], &targets[i].total, &targets[i].total_hist);
+    return 0;
+}
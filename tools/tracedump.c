@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "trace.h"
+
+/**
+ * 跟踪快照转换工具，把net_trace_snapshot()写入的快照转换为Chrome trace格式（JSON），
+ * 可在chrome://tracing或Perfetto中打开：
+ *   tracedump [-p] 快照文件 > trace.json
+ *       每条记录是一个持续到下一条记录的事件，即数据包在这一层停留的时间；
+ *       udp处理程序的调用与返回配对为一个"handler"事件，其中发生的发送嵌套在内。
+ *       默认所有记录在快照线程的一条轨道上，-p时按数据包序号分轨道，便于比较各个数据包的路径。
+ */
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-p] snapshot > trace.json\n", name);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int per_packet = 0, opt;
+    while ((opt = getopt(argc, argv, "p")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p': per_packet = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+    net_trace_file_t file;
+    net_trace_rec_t *recs = net_trace_load(argv[optind], &file);
+    if (recs == NULL)
+    {
+        fprintf(stderr, "%s: cannot read %s (or format version mismatch)\n", argv[0], argv[optind]);
+        return 1;
+    }
+    if (file.lost)
+        fprintf(stderr, "%s: %lu earlier records were overwritten\n", argv[0], (unsigned long)file.lost);
+
+    double us_per_tick = file.tsc_hz > 0 ? 1e6 / file.tsc_hz : 0;
+    uint64_t base = file.count ? recs[0].tsc : 0;
+    printf("{\"displayTimeUnit\":\"ns\",\"otherData\":{\"lost\":%lu},\"traceEvents\":[\n", (unsigned long)file.lost);
+    printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"net %d\"}}", file.pid, file.pid);
+    for (uint32_t i = 0; i < file.count; i++)
+    {
+        const net_trace_rec_t *rec = &recs[i];
+        int tid = per_packet ? (int)rec->pkt : file.tid;
+        double ts = (rec->tsc - base) * us_per_tick;
+        const char *ph = rec->event == NET_TRACE_HANDLER_ENTER ? "B" : rec->event == NET_TRACE_HANDLER_EXIT ? "E" : "X";
+        printf(",\n{\"name\":\"%s\",\"ph\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f", net_trace_name(rec->event), ph,
+               file.pid, tid, ts);
+        if (*ph == 'X')
+            printf(",\"dur\":%.3f", i + 1 < file.count ? (recs[i + 1].tsc - rec->tsc) * us_per_tick : 0);
+        printf(",\"args\":{\"pkt\":%u,\"len\":%u,\"arg\":%lu}}", rec->pkt, rec->len, (unsigned long)rec->arg);
+    }
+    printf("\n]}\n");
+    free(recs);
+    return 0;
+}